@@ -0,0 +1,176 @@
+#include "chunked_payload.h"
+#include "threading.h"
+#include "stb_image.h"
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+//! Checks that the given chunk table is sorted and that all chunks are small
+//! enough for the zlib decoder. Returns 0 if it is valid.
+int validate_chunk_table(const chunked_payload_t* payload) {
+	for (uint64_t i = 0; i != payload->chunk_count; ++i) {
+		const payload_chunk_t* chunk = &payload->chunks[i];
+		const payload_chunk_t* next = &payload->chunks[i + 1];
+		if (next->uncompressed_offset < chunk->uncompressed_offset || next->compressed_offset < chunk->compressed_offset
+			|| next->uncompressed_offset - chunk->uncompressed_offset > INT_MAX
+			|| next->compressed_offset - chunk->compressed_offset > INT_MAX)
+			return 1;
+	}
+	return 0;
+}
+
+
+int read_mapped_chunked_payload(chunked_payload_t* payload, const file_mapping_t* file, size_t* cursor) {
+	memset(payload, 0, sizeof(*payload));
+	if (read_mapped_file(&payload->chunk_count, sizeof(uint64_t), file, cursor)
+		|| payload->chunk_count >= file->size / sizeof(payload_chunk_t))
+	{
+		printf("Failed to read the number of chunks of a compressed payload.\n");
+		return 1;
+	}
+	payload->chunks = malloc((payload->chunk_count + 1) * sizeof(payload_chunk_t));
+	if (read_mapped_file(payload->chunks, (payload->chunk_count + 1) * sizeof(payload_chunk_t), file, cursor)
+		|| validate_chunk_table(payload))
+	{
+		printf("The chunk table of a compressed payload is truncated or invalid.\n");
+		free_chunked_payload(payload);
+		return 1;
+	}
+	payload->data_offset = *cursor;
+	payload->data = (const uint8_t*) skip_mapped_file(payload->chunks[payload->chunk_count].compressed_offset, file, cursor);
+	if (!payload->data) {
+		printf("The file ends prematurely within compressed data.\n");
+		free_chunked_payload(payload);
+		return 1;
+	}
+	return 0;
+}
+
+
+int read_chunked_payload(chunked_payload_t* payload, FILE* file) {
+	memset(payload, 0, sizeof(*payload));
+	if (fread(&payload->chunk_count, sizeof(uint64_t), 1, file) != 1 || payload->chunk_count > UINT_MAX) {
+		printf("Failed to read the number of chunks of a compressed payload.\n");
+		return 1;
+	}
+	payload->chunks = malloc((payload->chunk_count + 1) * sizeof(payload_chunk_t));
+	if (fread(payload->chunks, sizeof(payload_chunk_t), payload->chunk_count + 1, file) != payload->chunk_count + 1
+		|| validate_chunk_table(payload))
+	{
+		printf("The chunk table of a compressed payload is truncated or invalid.\n");
+		free_chunked_payload(payload);
+		return 1;
+	}
+	payload->data_offset = (uint64_t) ftell(file);
+	return 0;
+}
+
+
+void free_chunked_payload(chunked_payload_t* payload) {
+	free(payload->chunks);
+	memset(payload, 0, sizeof(*payload));
+}
+
+
+/*! Decompresses a single chunk.
+	\param destination Receives the uncompressed data of the chunk.
+	\param source The zlib stream of the chunk.
+	\param payload The payload to which the chunk belongs.
+	\param chunk_index The index of the chunk.
+	\return 0 upon success.*/
+int decompress_chunk(void* destination, const void* source, const chunked_payload_t* payload, uint64_t chunk_index) {
+	const payload_chunk_t* chunk = &payload->chunks[chunk_index];
+	int uncompressed_size = (int) (chunk[1].uncompressed_offset - chunk->uncompressed_offset);
+	int compressed_size = (int) (chunk[1].compressed_offset - chunk->compressed_offset);
+	if (stbi_zlib_decode_buffer((char*) destination, uncompressed_size, (const char*) source, compressed_size) != uncompressed_size) {
+		printf("Failed to decompress chunk %lu of a compressed payload.\n", chunk_index);
+		return 1;
+	}
+	return 0;
+}
+
+
+//! Shared state for decompress_mapped_chunk_task()
+typedef struct {
+	//! \see decompress_mapped_payload()
+	uint8_t* destination;
+	const chunked_payload_t* payload;
+} decompress_mapped_t;
+
+
+//! A task for run_parallel() that decompresses the chunk with the given index
+//! using a decompress_mapped_t as context
+int decompress_mapped_chunk_task(void* raw_decompress, uint32_t chunk_index) {
+	const decompress_mapped_t* decompress = (const decompress_mapped_t*) raw_decompress;
+	const payload_chunk_t* chunk = &decompress->payload->chunks[chunk_index];
+	return decompress_chunk(decompress->destination + chunk->uncompressed_offset, decompress->payload->data + chunk->compressed_offset, decompress->payload, chunk_index);
+}
+
+
+int decompress_mapped_payload(void* destination, const chunked_payload_t* payload, uint32_t thread_count) {
+	decompress_mapped_t decompress = {
+		.destination = (uint8_t*) destination,
+		.payload = payload,
+	};
+	return run_parallel(&decompress_mapped_chunk_task, &decompress, (uint32_t) payload->chunk_count, thread_count);
+}
+
+
+int read_chunked_payload_range(void* destination, uint64_t offset, uint64_t size, const chunked_payload_t* payload, FILE* file) {
+	if (offset + size > get_uncompressed_payload_size(payload)) {
+		printf("Attempted to read bytes %lu to %lu from a compressed payload with only %lu bytes.\n", offset, offset + size, get_uncompressed_payload_size(payload));
+		return 1;
+	}
+	uint8_t* compressed = NULL;
+	uint8_t* uncompressed = NULL;
+	int result = 0;
+	for (uint64_t i = 0; i != payload->chunk_count && !result; ++i) {
+		const payload_chunk_t* chunk = &payload->chunks[i];
+		uint64_t chunk_begin = chunk->uncompressed_offset;
+		uint64_t chunk_end = chunk[1].uncompressed_offset;
+		if (chunk_end <= offset || chunk_begin >= offset + size)
+			continue;
+		// Read the compressed chunk, unless it is mapped already
+		const uint8_t* source = payload->data ? (payload->data + chunk->compressed_offset) : NULL;
+		if (!source) {
+			size_t compressed_size = (size_t) (chunk[1].compressed_offset - chunk->compressed_offset);
+			uint8_t* new_compressed = realloc(compressed, compressed_size);
+			if (!new_compressed) {
+				printf("Failed to allocate %lu bytes for chunk %lu of a compressed payload.\n", (uint64_t) compressed_size, i);
+				result = 1;
+				break;
+			}
+			compressed = new_compressed;
+			if (fseek(file, (long) (payload->data_offset + chunk->compressed_offset), SEEK_SET)
+				|| fread(compressed, sizeof(uint8_t), compressed_size, file) != compressed_size)
+			{
+				printf("Failed to read chunk %lu of a compressed payload.\n", i);
+				result = 1;
+				break;
+			}
+			source = compressed;
+		}
+		// Decompress directly into the destination, if the chunk is covered
+		// completely, or take a detour through temporary memory
+		if (chunk_begin >= offset && chunk_end <= offset + size)
+			result = decompress_chunk((uint8_t*) destination + (chunk_begin - offset), source, payload, i);
+		else {
+			uint8_t* new_uncompressed = realloc(uncompressed, (size_t) (chunk_end - chunk_begin));
+			if (!new_uncompressed) {
+				printf("Failed to allocate %lu bytes for chunk %lu of a compressed payload.\n", chunk_end - chunk_begin, i);
+				result = 1;
+				break;
+			}
+			uncompressed = new_uncompressed;
+			result = decompress_chunk(uncompressed, source, payload, i);
+			uint64_t copy_begin = (chunk_begin > offset) ? chunk_begin : offset;
+			uint64_t copy_end = (chunk_end < offset + size) ? chunk_end : (offset + size);
+			if (!result)
+				memcpy((uint8_t*) destination + (copy_begin - offset), uncompressed + (copy_begin - chunk_begin), (size_t) (copy_end - copy_begin));
+		}
+	}
+	free(compressed);
+	free(uncompressed);
+	return result;
+}
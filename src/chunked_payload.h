@@ -0,0 +1,86 @@
+#pragma once
+#include "file_mapping.h"
+#include <stdio.h>
+
+
+//! An entry in the chunk table of a chunked payload
+typedef struct {
+	//! The offset in bytes from the beginning of the uncompressed payload to
+	//! the data of this chunk
+	uint64_t uncompressed_offset;
+	//! The offset in bytes from the beginning of the compressed data to the
+	//! zlib stream of this chunk
+	uint64_t compressed_offset;
+} payload_chunk_t;
+
+
+/*! Compressed *.vks and *.vkt files split their payload into chunks, which are
+	compressed independently using zlib. Thus, they can be decompressed
+	concurrently and ranges of the payload can be decompressed without
+	touching the rest. In the file, a chunk table (the chunk count as uint64_t
+	followed by chunk_count + 1 pairs of uint64_t offsets) is followed by the
+	compressed data of all chunks.*/
+typedef struct {
+	//! The number of chunks
+	uint64_t chunk_count;
+	//! chunk_count + 1 entries. The last one holds the total sizes of the
+	//! uncompressed payload and of the compressed data.
+	payload_chunk_t* chunks;
+	//! The offset in bytes from the beginning of the file to the compressed
+	//! data
+	uint64_t data_offset;
+	//! A pointer to the compressed data if the payload has been read from a
+	//! mapped file, NULL otherwise
+	const uint8_t* data;
+} chunked_payload_t;
+
+
+/*! Reads the chunk table of a chunked payload from a mapped file, validates
+	it and advances the cursor past the compressed data.
+	\param payload The output. Clean up with free_chunked_payload().
+	\param file The mapped file.
+	\param cursor The offset at which the chunk table begins.
+	\return 0 upon success.*/
+int read_mapped_chunked_payload(chunked_payload_t* payload, const file_mapping_t* file, size_t* cursor);
+
+
+/*! Like read_mapped_chunked_payload() but reads the chunk table from the
+	current position in the given file and leaves the file position at the
+	beginning of the compressed data.*/
+int read_chunked_payload(chunked_payload_t* payload, FILE* file);
+
+
+void free_chunked_payload(chunked_payload_t* payload);
+
+
+//! \return The size in bytes of the uncompressed payload
+static inline uint64_t get_uncompressed_payload_size(const chunked_payload_t* payload) {
+	return payload->chunks ? payload->chunks[payload->chunk_count].uncompressed_offset : 0;
+}
+
+
+/*! Decompresses the complete payload of a mapped file. Chunks are
+	decompressed concurrently.
+	\param destination Pointer to get_uncompressed_payload_size() bytes to
+		which the payload is written.
+	\param payload Output of read_mapped_chunked_payload().
+	\param thread_count The maximal number of threads to use or 0 to use all
+		logical processors.
+	\return 0 upon success.*/
+int decompress_mapped_payload(void* destination, const chunked_payload_t* payload, uint32_t thread_count);
+
+
+/*! Reads and decompresses a range of the uncompressed payload from a file or
+	a mapping. Chunks that are covered by the range completely get
+	decompressed directly into the destination. The file position is
+	undefined afterwards.
+	\param destination Pointer to size bytes to which the range is written.
+	\param offset The offset of the range in bytes within the uncompressed
+		payload.
+	\param size The size of the range in bytes.
+	\param payload Output of read_chunked_payload() for the given file or of
+		read_mapped_chunked_payload().
+	\param file The file from which the payload is to be read. Unused (and
+		possibly NULL) if the payload is mapped.
+	\return 0 upon success.*/
+int read_chunked_payload_range(void* destination, uint64_t offset, uint64_t size, const chunked_payload_t* payload, FILE* file);
@@ -0,0 +1,245 @@
+#ifdef __linux__
+// Needed for O_DIRECT
+#define _GNU_SOURCE
+#endif
+#include "direct_io.h"
+#include "threading.h"
+#include <stdlib.h>
+#include <string.h>
+#ifdef __linux__
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#ifdef HAVE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+#endif
+// The CMake script checks for the header. The system call numbers come from
+// the C library.
+#if defined(HAVE_IO_URING) && defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter)
+#define USE_IO_URING 1
+#else
+#define USE_IO_URING 0
+#endif
+
+
+//! The maximal number of entries in the submission queue of io_uring. More
+//! reads get submitted in several rounds.
+#define DIRECT_READ_QUEUE_SIZE 256
+
+
+int open_direct_file(direct_file_t* file, const char* file_path) {
+	memset(file, 0, sizeof(*file));
+#ifdef __linux__
+	file->descriptor = open(file_path, O_RDONLY | O_DIRECT);
+	file->open = (file->descriptor >= 0);
+#endif
+	return file->open ? 0 : 1;
+}
+
+
+void close_direct_file(direct_file_t* file) {
+#ifdef __linux__
+	if (file->open) close(file->descriptor);
+#endif
+	memset(file, 0, sizeof(*file));
+}
+
+
+#if USE_IO_URING
+//! An io_uring instance with its submission and completion rings mapped into
+//! memory. There is no dependency on liburing, only system calls are used.
+typedef struct {
+	//! The file descriptor of the io_uring or -1
+	int descriptor;
+	//! The parameters filled in by the kernel, including ring offsets
+	struct io_uring_params params;
+	//! The mapped rings and their sizes in bytes. Both rings may be the same
+	//! mapping.
+	uint8_t* submission_ring;
+	size_t submission_ring_size;
+	uint8_t* completion_ring;
+	size_t completion_ring_size;
+	//! The mapped array of submission queue entries
+	struct io_uring_sqe* entries;
+	size_t entries_size;
+} io_uring_t;
+
+
+//! Returns a pointer to a 32-bit member of a mapped ring at the given offset
+static inline uint32_t* get_ring_member(uint8_t* ring, uint32_t offset) {
+	return (uint32_t*) (ring + offset);
+}
+
+
+//! Unmaps and closes an io_uring created by create_io_uring()
+static void destroy_io_uring(io_uring_t* ring) {
+	if (ring->entries) munmap(ring->entries, ring->entries_size);
+	if (ring->completion_ring && ring->completion_ring != ring->submission_ring) munmap(ring->completion_ring, ring->completion_ring_size);
+	if (ring->submission_ring) munmap(ring->submission_ring, ring->submission_ring_size);
+	if (ring->descriptor >= 0) close(ring->descriptor);
+	memset(ring, 0, sizeof(*ring));
+	ring->descriptor = -1;
+}
+
+
+/*! Creates an io_uring with room for the given number of submissions and maps
+	its rings. It fails if the kernel lacks io_uring or forbids it.
+	\return 0 upon success.*/
+static int create_io_uring(io_uring_t* ring, uint32_t entry_count) {
+	memset(ring, 0, sizeof(*ring));
+	ring->descriptor = (int) syscall(__NR_io_uring_setup, entry_count, &ring->params);
+	if (ring->descriptor < 0) {
+		ring->descriptor = -1;
+		return 1;
+	}
+	const struct io_uring_params* params = &ring->params;
+	ring->submission_ring_size = params->sq_off.array + params->sq_entries * sizeof(uint32_t);
+	ring->completion_ring_size = params->cq_off.cqes + params->cq_entries * sizeof(struct io_uring_cqe);
+	bool single_mapping = (params->features & IORING_FEAT_SINGLE_MMAP) != 0;
+	if (single_mapping) {
+		if (ring->completion_ring_size > ring->submission_ring_size)
+			ring->submission_ring_size = ring->completion_ring_size;
+		ring->completion_ring_size = ring->submission_ring_size;
+	}
+	void* submission_ring = mmap(NULL, ring->submission_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->descriptor, IORING_OFF_SQ_RING);
+	if (submission_ring == MAP_FAILED) {
+		destroy_io_uring(ring);
+		return 1;
+	}
+	ring->submission_ring = (uint8_t*) submission_ring;
+	if (single_mapping)
+		ring->completion_ring = ring->submission_ring;
+	else {
+		void* completion_ring = mmap(NULL, ring->completion_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->descriptor, IORING_OFF_CQ_RING);
+		if (completion_ring == MAP_FAILED) {
+			destroy_io_uring(ring);
+			return 1;
+		}
+		ring->completion_ring = (uint8_t*) completion_ring;
+	}
+	ring->entries_size = params->sq_entries * sizeof(struct io_uring_sqe);
+	void* entries = mmap(NULL, ring->entries_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->descriptor, IORING_OFF_SQES);
+	if (entries == MAP_FAILED) {
+		destroy_io_uring(ring);
+		return 1;
+	}
+	ring->entries = (struct io_uring_sqe*) entries;
+	return 0;
+}
+
+
+//! Writes the results of all available completions to the corresponding reads
+//! and returns how many there were
+static uint32_t reap_io_uring_completions(io_uring_t* ring, direct_read_t* reads) {
+	const struct io_uring_params* params = &ring->params;
+	uint32_t* head_pointer = get_ring_member(ring->completion_ring, params->cq_off.head);
+	uint32_t mask = *get_ring_member(ring->completion_ring, params->cq_off.ring_mask);
+	const struct io_uring_cqe* completions = (const struct io_uring_cqe*) (ring->completion_ring + params->cq_off.cqes);
+	uint32_t head = *head_pointer;
+	uint32_t tail = __atomic_load_n(get_ring_member(ring->completion_ring, params->cq_off.tail), __ATOMIC_ACQUIRE);
+	uint32_t count = 0;
+	for (; head != tail; ++head, ++count) {
+		const struct io_uring_cqe* completion = &completions[head & mask];
+		reads[completion->user_data].result = (completion->res >= 0) ? (int64_t) completion->res : -1;
+	}
+	__atomic_store_n(head_pointer, head, __ATOMIC_RELEASE);
+	return count;
+}
+
+
+/*! Submits the reads from read_begin to read_end - 1 (at most as many as
+	there are submission queue entries) and waits for all of them.
+	\return 0 if the ring is still usable, 1 if submitting failed. Reads that
+		have not been submitted keep their result of -1. Either way, no reads
+		are in flight when this function returns.*/
+static int submit_io_uring_reads(io_uring_t* ring, direct_read_t* reads, uint32_t read_begin, uint32_t read_end) {
+	const struct io_uring_params* params = &ring->params;
+	uint32_t* tail_pointer = get_ring_member(ring->submission_ring, params->sq_off.tail);
+	uint32_t mask = *get_ring_member(ring->submission_ring, params->sq_off.ring_mask);
+	uint32_t* indices = get_ring_member(ring->submission_ring, params->sq_off.array);
+	// Fill the submission queue
+	uint32_t tail = *tail_pointer;
+	for (uint32_t i = read_begin; i != read_end; ++i, ++tail) {
+		uint32_t index = tail & mask;
+		struct io_uring_sqe* entry = &ring->entries[index];
+		memset(entry, 0, sizeof(*entry));
+		entry->opcode = IORING_OP_READ;
+		entry->fd = reads[i].file->descriptor;
+		entry->off = reads[i].offset;
+		entry->addr = (uint64_t) (uintptr_t) reads[i].destination;
+		entry->len = (uint32_t) reads[i].size;
+		entry->user_data = i;
+		indices[index] = index;
+	}
+	__atomic_store_n(tail_pointer, tail, __ATOMIC_RELEASE);
+	// Submit everything and wait until nothing is in flight anymore
+	uint32_t count = read_end - read_begin;
+	uint32_t submitted = 0, completed = 0;
+	bool failed = false;
+	while ((!failed && submitted != count) || completed != submitted) {
+		uint32_t submission_count = failed ? 0 : (count - submitted);
+		int result = (int) syscall(__NR_io_uring_enter, ring->descriptor, submission_count, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+		if (result < 0) {
+			if (errno == EINTR)
+				continue;
+			// Wait for reads in flight, then give up
+			if (completed == submitted)
+				break;
+			failed = true;
+			continue;
+		}
+		submitted += (uint32_t) result;
+		completed += reap_io_uring_completions(ring, reads);
+	}
+	return failed || submitted != count;
+}
+#endif
+
+
+//! A task for run_parallel() that performs the direct_read_t with the given
+//! index using pread(), unless it has succeeded already
+int pread_task(void* raw_reads, uint32_t read_index) {
+	direct_read_t* read = &((direct_read_t*) raw_reads)[read_index];
+	if (read->result >= 0)
+		return 0;
+#ifdef __linux__
+	size_t total = 0;
+	while (total < read->size) {
+		ssize_t count = pread(read->file->descriptor, (uint8_t*) read->destination + total, read->size - total, (off_t) (read->offset + total));
+		if (count < 0 && errno == EINTR)
+			continue;
+		if (count < 0)
+			return 0;
+		// The end of the file has been reached
+		if (count == 0)
+			break;
+		total += (size_t) count;
+	}
+	read->result = (int64_t) total;
+#endif
+	return 0;
+}
+
+
+void read_direct(direct_read_t* reads, uint32_t read_count) {
+	for (uint32_t i = 0; i != read_count; ++i)
+		reads[i].result = -1;
+	if (read_count == 0)
+		return;
+#if USE_IO_URING
+	io_uring_t ring;
+	if (!create_io_uring(&ring, (read_count < DIRECT_READ_QUEUE_SIZE) ? read_count : DIRECT_READ_QUEUE_SIZE)) {
+		for (uint32_t begin = 0; begin < read_count; begin += ring.params.sq_entries) {
+			uint32_t end = (read_count - begin < ring.params.sq_entries) ? read_count : (begin + ring.params.sq_entries);
+			if (submit_io_uring_reads(&ring, reads, begin, end))
+				break;
+		}
+		destroy_io_uring(&ring);
+	}
+#endif
+	// Whatever io_uring has not done falls back to pread()
+	run_parallel(&pread_task, reads, read_count, 0);
+}
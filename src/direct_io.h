@@ -0,0 +1,67 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+
+//! File offsets, sizes and destination addresses of direct reads must be
+//! multiples of this many bytes
+#define DIRECT_READ_ALIGNMENT 4096
+
+
+//! A handle for a file that is read without going through the page cache
+//! (O_DIRECT on Linux)
+typedef struct {
+	//! The file descriptor
+	int descriptor;
+	//! false if the file could not be opened for direct reads
+	bool open;
+} direct_file_t;
+
+
+//! A single read of a range of a direct_file_t into memory
+typedef struct {
+	//! The file to read from
+	const direct_file_t* file;
+	//! The offset in bytes within the file. A multiple of
+	//! DIRECT_READ_ALIGNMENT.
+	uint64_t offset;
+	//! The destination and the number of bytes to read. Both are multiples of
+	//! DIRECT_READ_ALIGNMENT.
+	void* destination;
+	size_t size;
+	//! Written by read_direct(): The number of bytes read, which may be less
+	//! than size at the end of the file, or -1 upon failure
+	int64_t result;
+} direct_read_t;
+
+
+/*! Opens the file at the given path for direct reads. This is only supported
+	on Linux and only by some file systems.
+	\param file The output. If opening fails, file->open is false. Clean up
+		with close_direct_file().
+	\param file_path The path of the file.
+	\return 0 upon success.*/
+int open_direct_file(direct_file_t* file, const char* file_path);
+
+
+//! Closes a file opened by open_direct_file() (if it is open)
+void close_direct_file(direct_file_t* file);
+
+
+//! \return true iff the given address, offset and size are suitable for a
+//!		direct read
+static inline bool is_direct_read_aligned(const void* destination, uint64_t offset, size_t size) {
+	return ((uintptr_t) destination % DIRECT_READ_ALIGNMENT) == 0 && (offset % DIRECT_READ_ALIGNMENT) == 0 && (size % DIRECT_READ_ALIGNMENT) == 0;
+}
+
+
+/*! Performs the given reads and writes their results. Where io_uring is
+	available, all reads are submitted as one batch (or several, if there are
+	too many for one submission queue). Otherwise, or for reads that io_uring
+	fails to perform, pread() is used on worker threads. Individual reads may
+	fail, so callers should check their results and fall back to buffered
+	I/O as needed.
+	\param reads The reads to perform. Their results get overwritten.
+	\param read_count The number of reads.*/
+void read_direct(direct_read_t* reads, uint32_t read_count);
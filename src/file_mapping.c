@@ -0,0 +1,90 @@
+#include "file_mapping.h"
+#include <string.h>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+int map_file(file_mapping_t* mapping, const char* file_path) {
+	memset(mapping, 0, sizeof(*mapping));
+#ifdef _WIN32
+	HANDLE file = CreateFileA(file_path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return 1;
+	mapping->file_handle = file;
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+		unmap_file(mapping);
+		return 1;
+	}
+	mapping->size = (size_t) size.QuadPart;
+	mapping->mapping_handle = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (!mapping->mapping_handle) {
+		unmap_file(mapping);
+		return 1;
+	}
+	mapping->data = (const uint8_t*) MapViewOfFile(mapping->mapping_handle, FILE_MAP_READ, 0, 0, 0);
+	if (!mapping->data) {
+		unmap_file(mapping);
+		return 1;
+	}
+#else
+	int file = open(file_path, O_RDONLY);
+	if (file < 0)
+		return 1;
+	struct stat status;
+	if (fstat(file, &status) || status.st_size == 0) {
+		close(file);
+		return 1;
+	}
+	mapping->size = (size_t) status.st_size;
+	void* data = mmap(NULL, mapping->size, PROT_READ, MAP_PRIVATE, file, 0);
+	// The mapping remains valid after the file descriptor is closed
+	close(file);
+	if (data == MAP_FAILED) {
+		memset(mapping, 0, sizeof(*mapping));
+		return 1;
+	}
+	// We read mostly front to back. Only vertex positions get read a second
+	// time for the BVH build.
+	madvise(data, mapping->size, MADV_SEQUENTIAL);
+	mapping->data = (const uint8_t*) data;
+#endif
+	return 0;
+}
+
+
+void unmap_file(file_mapping_t* mapping) {
+#ifdef _WIN32
+	if (mapping->data) UnmapViewOfFile(mapping->data);
+	if (mapping->mapping_handle) CloseHandle(mapping->mapping_handle);
+	if (mapping->file_handle) CloseHandle(mapping->file_handle);
+#else
+	if (mapping->data) munmap((void*) mapping->data, mapping->size);
+#endif
+	memset(mapping, 0, sizeof(*mapping));
+}
+
+
+const void* skip_mapped_file(size_t size, const file_mapping_t* mapping, size_t* cursor) {
+	if (!mapping->data || (*cursor) > mapping->size || size > mapping->size - (*cursor))
+		return NULL;
+	const void* result = mapping->data + (*cursor);
+	(*cursor) += size;
+	return result;
+}
+
+
+int read_mapped_file(void* destination, size_t size, const file_mapping_t* mapping, size_t* cursor) {
+	const void* source = skip_mapped_file(size, mapping, cursor);
+	if (!source)
+		return 1;
+	memcpy(destination, source, size);
+	return 0;
+}
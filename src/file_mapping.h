@@ -0,0 +1,41 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+
+//! A read-only view of a whole file that has been mapped into the address
+//! space of this process
+typedef struct {
+	//! Pointer to the first byte of the file or NULL if it is not mapped
+	const uint8_t* data;
+	//! The size of the file in bytes
+	size_t size;
+	//! Operating system handles for the file and the mapping (only on Windows)
+	void* file_handle;
+	void* mapping_handle;
+} file_mapping_t;
+
+
+/*! Maps the file at the given path into memory for reading. Pages are read
+	lazily by the operating system upon first access.
+	\param mapping The output. Clean up using unmap_file().
+	\param file_path Path to the file that is to be mapped.
+	\return 0 upon success.*/
+int map_file(file_mapping_t* mapping, const char* file_path);
+
+
+//! Unmaps a file that has been mapped using map_file(). Safe to call for
+//! partially initialized or zeroed objects.
+void unmap_file(file_mapping_t* mapping);
+
+
+/*! Copies the given number of bytes from the mapped file to the given
+	destination, starting at the given cursor and advances the cursor.
+	\return 0 upon success, 1 if the file ends prematurely. In that case,
+		nothing gets copied and the cursor is left untouched.*/
+int read_mapped_file(void* destination, size_t size, const file_mapping_t* mapping, size_t* cursor);
+
+
+/*! Like read_mapped_file() but does not copy. Instead it returns a pointer to
+	the data in the mapping, or NULL if the file ends prematurely.*/
+const void* skip_mapped_file(size_t size, const file_mapping_t* mapping, size_t* cursor);
@@ -0,0 +1,75 @@
+#include "hashing.h"
+#include "threading.h"
+#include <stdlib.h>
+#include <string.h>
+
+
+//! hash_bytes() hashes blocks of this many bytes independently
+#define HASH_BLOCK_SIZE (4 << 20)
+
+
+//! Mixes a 64-bit word into the given hash state
+static inline uint64_t mix_hash(uint64_t hash, uint64_t word) {
+	hash ^= word * 0x87c37b91114253d5ull;
+	hash = (hash << 31) | (hash >> 33);
+	return hash * 0x4cf5ad432745937full;
+}
+
+
+//! Hashes a contiguous range of bytes on the calling thread, finishing with
+//! the avalanche step of MurmurHash3
+uint64_t hash_block(const uint8_t* data, size_t size, uint64_t seed) {
+	uint64_t hash = seed ^ ((uint64_t) size * 0x9e3779b97f4a7c15ull);
+	size_t word_count = size / sizeof(uint64_t);
+	for (size_t i = 0; i != word_count; ++i) {
+		uint64_t word;
+		memcpy(&word, data + i * sizeof(uint64_t), sizeof(word));
+		hash = mix_hash(hash, word);
+	}
+	uint64_t tail = 0;
+	memcpy(&tail, data + word_count * sizeof(uint64_t), size % sizeof(uint64_t));
+	hash = mix_hash(hash, tail);
+	hash ^= hash >> 33;
+	hash *= 0xff51afd7ed558ccdull;
+	hash ^= hash >> 33;
+	hash *= 0xc4ceb9fe1a85ec53ull;
+	hash ^= hash >> 33;
+	return hash;
+}
+
+
+//! Shared state for hash_block_task()
+typedef struct {
+	//! \see hash_bytes()
+	const uint8_t* data;
+	size_t size;
+	//! One hash per block of HASH_BLOCK_SIZE bytes
+	uint64_t* block_hashes;
+} hash_bytes_t;
+
+
+//! A task for run_parallel() that hashes the block with the given index using
+//! a hash_bytes_t as context
+int hash_block_task(void* raw_hash, uint32_t block_index) {
+	hash_bytes_t* hash = (hash_bytes_t*) raw_hash;
+	size_t begin = (size_t) block_index * HASH_BLOCK_SIZE;
+	size_t size = (hash->size - begin < HASH_BLOCK_SIZE) ? (hash->size - begin) : HASH_BLOCK_SIZE;
+	hash->block_hashes[block_index] = hash_block(hash->data + begin, size, block_index);
+	return 0;
+}
+
+
+uint64_t hash_bytes(const void* data, size_t size) {
+	if (size <= HASH_BLOCK_SIZE)
+		return hash_block((const uint8_t*) data, size, 0);
+	uint32_t block_count = (uint32_t) ((size + HASH_BLOCK_SIZE - 1) / HASH_BLOCK_SIZE);
+	hash_bytes_t hash = {
+		.data = (const uint8_t*) data,
+		.size = size,
+		.block_hashes = calloc(block_count, sizeof(uint64_t)),
+	};
+	run_parallel(&hash_block_task, &hash, block_count, 0);
+	uint64_t result = hash_block((const uint8_t*) hash.block_hashes, block_count * sizeof(uint64_t), size);
+	free(hash.block_hashes);
+	return result;
+}
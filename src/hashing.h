@@ -0,0 +1,13 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+
+/*! Computes a 64-bit hash of the given bytes. It is meant to detect changes of
+	file contents, not to withstand attacks. Large inputs are split into blocks
+	that are hashed concurrently. The result does not depend on the number of
+	threads.
+	\param data Pointer to size bytes that are to be hashed.
+	\param size The number of bytes to hash.
+	\return The hash.*/
+uint64_t hash_bytes(const void* data, size_t size);
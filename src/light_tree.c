@@ -0,0 +1,233 @@
+#include "light_tree.h"
+#include <float.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+//! The number of bins into which light centers are sorted along the split
+//! axis. Splits are only considered between bins.
+#define LIGHT_TREE_BIN_COUNT 16
+
+
+//! An axis-aligned box around some lights along with their total power
+typedef struct {
+	float min[3], max[3];
+	//! The sum of squared radii
+	float power;
+} light_bounds_t;
+
+
+//! A node of a light tree that still has to be written
+typedef struct {
+	//! The index of the node in the output array
+	uint32_t node_index;
+	//! The node holds the lights with indices light_indices[begin] up to
+	//! light_indices[end - 1]
+	uint32_t begin, end;
+	//! The depth of the node, where the root has depth 0
+	uint32_t depth;
+} light_tree_task_t;
+
+
+//! Turns the given bounds into empty bounds
+static void clear_light_bounds(light_bounds_t* bounds) {
+	for (uint32_t i = 0; i != 3; ++i) {
+		bounds->min[i] = FLT_MAX;
+		bounds->max[i] = -FLT_MAX;
+	}
+	bounds->power = 0.0f;
+}
+
+
+//! Grows the bounds to include the given light (center xyz and radius)
+static void add_light_to_bounds(light_bounds_t* bounds, const float* light) {
+	for (uint32_t i = 0; i != 3; ++i) {
+		if (light[i] - light[3] < bounds->min[i]) bounds->min[i] = light[i] - light[3];
+		if (light[i] + light[3] > bounds->max[i]) bounds->max[i] = light[i] + light[3];
+	}
+	bounds->power += light[3] * light[3];
+}
+
+
+//! Grows the bounds to include the other bounds
+static void merge_light_bounds(light_bounds_t* bounds, const light_bounds_t* other) {
+	for (uint32_t i = 0; i != 3; ++i) {
+		if (other->min[i] < bounds->min[i]) bounds->min[i] = other->min[i];
+		if (other->max[i] > bounds->max[i]) bounds->max[i] = other->max[i];
+	}
+	bounds->power += other->power;
+}
+
+
+//! \return The power times half the surface area of the box, which is what
+//!		splits minimize for their children. Zero for empty bounds.
+static float get_light_bounds_cost(const light_bounds_t* bounds) {
+	float extent[3];
+	for (uint32_t i = 0; i != 3; ++i)
+		extent[i] = (bounds->max[i] > bounds->min[i]) ? (bounds->max[i] - bounds->min[i]) : 0.0f;
+	return bounds->power * (extent[0] * extent[1] + extent[1] * extent[2] + extent[2] * extent[0]);
+}
+
+
+//! \return The index of the bin for the given center coordinate along the
+//!		split axis
+static uint32_t get_light_bin(float center, float center_min, float bin_factor) {
+	uint32_t bin = (uint32_t) ((center - center_min) * bin_factor);
+	return (bin < LIGHT_TREE_BIN_COUNT) ? bin : (LIGHT_TREE_BIN_COUNT - 1);
+}
+
+
+//! \return The smallest integer n such that 2^n >= x
+static uint32_t get_ceil_log2(uint32_t x) {
+	uint32_t n = 0;
+	while ((1ull << n) < x)
+		++n;
+	return n;
+}
+
+
+/*! Reorders the given light indices such that the one at index k is the one
+	that it would be if they were sorted by their center coordinate along the
+	given axis, with no greater ones before it and no smaller ones after it.*/
+static void select_light(uint32_t* indices, uint32_t count, uint32_t k, const float* lights, uint32_t axis) {
+	int64_t left = 0, right = (int64_t) count - 1;
+	while (left < right) {
+		// Hoare partition around the center of the middle light
+		float pivot = lights[4 * indices[(left + right) / 2] + axis];
+		int64_t i = left, j = right;
+		while (i <= j) {
+			while (lights[4 * indices[i] + axis] < pivot) ++i;
+			while (lights[4 * indices[j] + axis] > pivot) --j;
+			if (i <= j) {
+				uint32_t swap = indices[i];
+				indices[i] = indices[j];
+				indices[j] = swap;
+				++i;
+				--j;
+			}
+		}
+		// Continue with the part that contains k
+		if ((int64_t) k <= j) right = j;
+		else if ((int64_t) k >= i) left = i;
+		else break;
+	}
+}
+
+
+int build_light_tree(light_tree_node_t* nodes, const float* lights, uint32_t light_count) {
+	if (light_count == 0)
+		return 0;
+	// There are never more unfinished nodes than lights, because each one
+	// holds at least one light
+	uint32_t* indices = malloc(sizeof(uint32_t) * light_count);
+	light_tree_task_t* tasks = malloc(sizeof(light_tree_task_t) * light_count);
+	if (!indices || !tasks) {
+		free(indices);
+		free(tasks);
+		return 1;
+	}
+	for (uint32_t i = 0; i != light_count; ++i)
+		indices[i] = i;
+	uint32_t task_count = 1, node_count = 1;
+	tasks[0] = (light_tree_task_t) { .node_index = 0, .begin = 0, .end = light_count, .depth = 0 };
+	while (task_count > 0) {
+		light_tree_task_t task = tasks[--task_count];
+		light_tree_node_t* node = &nodes[task.node_index];
+		uint32_t count = task.end - task.begin;
+		// Bound the lights and their centers
+		light_bounds_t bounds;
+		clear_light_bounds(&bounds);
+		float center_min[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+		float center_max[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+		for (uint32_t i = task.begin; i != task.end; ++i) {
+			const float* light = &lights[4 * indices[i]];
+			add_light_to_bounds(&bounds, light);
+			for (uint32_t j = 0; j != 3; ++j) {
+				if (light[j] < center_min[j]) center_min[j] = light[j];
+				if (light[j] > center_max[j]) center_max[j] = light[j];
+			}
+		}
+		memcpy(node->box_min, bounds.min, sizeof(node->box_min));
+		memcpy(node->box_max, bounds.max, sizeof(node->box_max));
+		node->power = bounds.power;
+		if (count == 1) {
+			node->child = LIGHT_TREE_LEAF_BIT | indices[task.begin];
+			continue;
+		}
+		// Split along the axis where the centers are spread out the most
+		uint32_t axis = 0;
+		for (uint32_t i = 1; i != 3; ++i)
+			if (center_max[i] - center_min[i] > center_max[axis] - center_min[axis])
+				axis = i;
+		float extent = center_max[axis] - center_min[axis];
+		// Median splits keep the depth in check. Once the remaining depth
+		// does not permit anything else, they are used exclusively.
+		bool median = (extent <= 0.0f || task.depth + 1 + get_ceil_log2(count) > LIGHT_TREE_MAX_DEPTH);
+		uint32_t split = task.begin + count / 2;
+		if (!median) {
+			// Sort the lights into bins by their centers
+			light_bounds_t bins[LIGHT_TREE_BIN_COUNT];
+			uint32_t bin_counts[LIGHT_TREE_BIN_COUNT] = { 0 };
+			for (uint32_t i = 0; i != LIGHT_TREE_BIN_COUNT; ++i)
+				clear_light_bounds(&bins[i]);
+			float bin_factor = ((float) LIGHT_TREE_BIN_COUNT) / extent;
+			for (uint32_t i = task.begin; i != task.end; ++i) {
+				const float* light = &lights[4 * indices[i]];
+				uint32_t bin = get_light_bin(light[axis], center_min[axis], bin_factor);
+				add_light_to_bounds(&bins[bin], light);
+				++bin_counts[bin];
+			}
+			// Sweep from the right to get the costs of all right children
+			float right_costs[LIGHT_TREE_BIN_COUNT];
+			light_bounds_t sweep;
+			clear_light_bounds(&sweep);
+			for (uint32_t i = LIGHT_TREE_BIN_COUNT - 1; i != 0; --i) {
+				merge_light_bounds(&sweep, &bins[i]);
+				right_costs[i] = get_light_bounds_cost(&sweep);
+			}
+			// Sweep from the left to find the cheapest split with lights on
+			// both sides. Children begin at the first bin of the right child.
+			clear_light_bounds(&sweep);
+			uint32_t best_bin = 0, left_count = 0;
+			float best_cost = FLT_MAX;
+			for (uint32_t i = 1; i != LIGHT_TREE_BIN_COUNT; ++i) {
+				merge_light_bounds(&sweep, &bins[i - 1]);
+				left_count += bin_counts[i - 1];
+				if (left_count == 0 || left_count == count)
+					continue;
+				float cost = get_light_bounds_cost(&sweep) + right_costs[i];
+				if (cost < best_cost) {
+					best_cost = cost;
+					best_bin = i;
+				}
+			}
+			if (best_bin == 0)
+				median = true;
+			else {
+				// Partition the lights accordingly
+				uint32_t i = task.begin, j = task.end;
+				while (i < j) {
+					if (get_light_bin(lights[4 * indices[i] + axis], center_min[axis], bin_factor) < best_bin)
+						++i;
+					else {
+						uint32_t swap = indices[i];
+						indices[i] = indices[--j];
+						indices[j] = swap;
+					}
+				}
+				split = i;
+			}
+		}
+		if (median)
+			select_light(&indices[task.begin], count, count / 2, lights, axis);
+		// Queue the children
+		node->child = node_count;
+		tasks[task_count++] = (light_tree_task_t) { .node_index = node_count, .begin = task.begin, .end = split, .depth = task.depth + 1 };
+		tasks[task_count++] = (light_tree_task_t) { .node_index = node_count + 1, .begin = split, .end = task.end, .depth = task.depth + 1 };
+		node_count += 2;
+	}
+	free(indices);
+	free(tasks);
+	return 0;
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include <stdint.h>
+
+
+//! Set in light_tree_node_t::child for leaves. The remaining bits hold the
+//! index of the light.
+#define LIGHT_TREE_LEAF_BIT 0x80000000u
+
+//! No leaf of a light tree is deeper than this (where the root has depth 0).
+//! Shaders use it to size their traversal stacks.
+#define LIGHT_TREE_MAX_DEPTH 24
+
+
+/*! A node of a light tree, i.e. a bounding volume hierarchy over spherical
+	lights with power bounds, which is used to sample lights efficiently in
+	scenes with many of them. Mirrors light_tree_node_t in
+	shaders/path_tracing.glsl. Node 0 is the root.*/
+typedef struct {
+	//! The minimal corner of an axis-aligned box around all lights below this
+	//! node
+	float box_min[3];
+	//! The sum of squared radii of all lights below this node. All lights
+	//! share the same radiance, so this is proportional to their total power.
+	float power;
+	//! The maximal corner of the box
+	float box_max[3];
+	//! For inner nodes, the index of the first child. The second child comes
+	//! right after it. For leaves, LIGHT_TREE_LEAF_BIT | light index.
+	uint32_t child;
+} light_tree_node_t;
+
+
+//! \return The number of nodes in a light tree with the given number of
+//!		lights
+static inline uint32_t get_light_tree_node_count(uint32_t light_count) {
+	return (light_count > 0) ? (2 * light_count - 1) : 0;
+}
+
+
+/*! Builds a light tree top-down. Each inner node is split such that the sum
+	of power times surface area of the two children is minimal among a few
+	candidate planes along the longest axis. Since spherical lights emit
+	uniformly in all directions, there are no orientation bounds on the
+	emission, only the receiving shading point bounds orientation. Close to
+	LIGHT_TREE_MAX_DEPTH, splits fall back to the median.
+	\param nodes Output array of get_light_tree_node_count(light_count)
+		nodes.
+	\param lights light_count lights with four floats each: The center xyz and
+		the radius.
+	\param light_count The number of lights. At most 2^LIGHT_TREE_MAX_DEPTH.
+	\return 0 upon success, 1 if memory allocation failed.*/
+int build_light_tree(light_tree_node_t* nodes, const float* lights, uint32_t light_count);
@@ -3,6 +3,7 @@
 #include "math_utilities.h"
 #include "timer.h"
 #include "stb_image_write.h"
+#include <stddef.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
@@ -110,8 +111,10 @@ int quickload(scene_spec_t* spec, app_update_t* update, const char* save_path) {
 
 
 void get_scene_spec_updates(app_update_t* update, const scene_spec_t* old_spec, const scene_spec_t* new_spec) {
+	// The scene subpass depends on the lit scene and gets recreated once the
+	// new scene is available
 	if (old_spec->scene_file != new_spec->scene_file)
-		update->lit_scene = update->scene_subpass = true;
+		update->lit_scene = true;
 	if (old_spec->tonemapper != new_spec->tonemapper)
 		update->tonemap_subpass = true;
 }
@@ -150,6 +153,7 @@ void init_render_settings(render_settings_t* settings) {
 	render_settings_t default_settings = {
 		.sampling_strategy = sampling_strategy_nee,
 		.path_length = 4,
+		.split_count = 1,
 	};
 	(*settings) = default_settings;
 }
@@ -656,7 +660,10 @@ int write_constant_buffer(constant_buffers_t* constant_buffers, const app_t* app
 		cts.emission_material_radiance[i] = app->scene_spec.emission_material_color[i] * app->scene_spec.emission_material_strength;
 	}
 	memcpy(cts.params, app->scene_spec.params, sizeof(cts.params));
-	memcpy(cts.spherical_lights, app->lit_scene.spherical_lights, sizeof(cts.spherical_lights));
+	cts.emission_material_index = app->lit_scene.emission_material_index;
+	cts.spherical_light_count = app->lit_scene.spherical_light_count;
+	cts.indexed_mesh = (scene->header.version >= 2) ? 1 : 0;
+	cts.material_count = (uint32_t) scene->header.material_count;
 	float aspect = ((float) app->swapchain.extent.width) / ((float) app->swapchain.extent.height);
 	get_world_to_projection_space(cts.world_to_projection_space, &app->scene_spec.camera, aspect);
 	invert_mat4(cts.projection_to_world_space, cts.world_to_projection_space);
@@ -676,7 +683,77 @@ int write_constant_buffer(constant_buffers_t* constant_buffers, const app_t* app
 }
 
 
-int create_lit_scene(lit_scene_t* lit_scene, const device_t* device, const scene_spec_t* scene_spec) {
+//! Callback for fill_buffers() that copies spherical lights or light tree
+//! nodes from an array of two pointers passed as context
+void write_light_buffer(void* buffer_data, uint32_t buffer_index, VkDeviceSize offset, VkDeviceSize size, const void* context) {
+	const void* const* sources = (const void* const*) context;
+	memcpy(buffer_data, (const uint8_t*) sources[buffer_index] + offset, size);
+}
+
+
+int create_light_buffers(lit_scene_t* lit_scene, const device_t* device, const char* lights_path) {
+	// Load the spherical light file
+	uint32_t light_count = 0;
+	float* lights = NULL;
+	FILE* file = fopen(lights_path, "rb");
+	if (file) {
+		if (fread(&light_count, sizeof(uint32_t), 1, file) != 1)
+			light_count = 0;
+		if (light_count > (1u << LIGHT_TREE_MAX_DEPTH)) {
+			printf("Warning: At most %u spherical lights are supported but %u were found in the file. Dropping some of them.\n", 1u << LIGHT_TREE_MAX_DEPTH, light_count);
+			light_count = 1u << LIGHT_TREE_MAX_DEPTH;
+		}
+		lights = malloc(sizeof(float) * 4 * (light_count ? light_count : 1));
+		light_count = lights ? (uint32_t) fread(lights, sizeof(float) * 4, light_count, file) : 0;
+		printf("Loaded %u spherical lights from %s.\n", light_count, lights_path);
+		fclose(file);
+	}
+	// Build the light tree. Buffers get at least one zeroed entry.
+	uint32_t node_count = get_light_tree_node_count(light_count);
+	if (light_count == 0) {
+		free(lights);
+		lights = calloc(4, sizeof(float));
+	}
+	light_tree_node_t* nodes = calloc(node_count ? node_count : 1, sizeof(light_tree_node_t));
+	if (!lights || !nodes || build_light_tree(nodes, lights, light_count)) {
+		printf("Failed to build a light tree over %u spherical lights.\n", light_count);
+		free(lights);
+		free(nodes);
+		return 1;
+	}
+	// Upload both
+	buffer_request_t requests[2] = {
+		{
+			.buffer_info = {
+				.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+				.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+				.size = sizeof(float) * 4 * (light_count ? light_count : 1),
+			},
+		},
+		{
+			.buffer_info = {
+				.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+				.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+				.size = sizeof(light_tree_node_t) * (node_count ? node_count : 1),
+			},
+		},
+	};
+	const void* sources[2] = { lights, nodes };
+	int result = create_buffers(&lit_scene->light_buffers, device, requests, COUNT_OF(requests), VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 1)
+		|| fill_buffers(&lit_scene->light_buffers, device, &write_light_buffer, sources);
+	free(lights);
+	free(nodes);
+	if (result) {
+		printf("Failed to create buffers for spherical lights and their light tree.\n");
+		free_buffers(&lit_scene->light_buffers, device);
+		return 1;
+	}
+	lit_scene->spherical_light_count = light_count;
+	return 0;
+}
+
+
+int create_lit_scene(lit_scene_t* lit_scene, const device_t* device, const scene_spec_t* scene_spec, texture_registry_t* texture_registry) {
 	const char* scene_path;
 	const char* textures_path;
 	const char* lights_path;
@@ -684,32 +761,240 @@ int create_lit_scene(lit_scene_t* lit_scene, const device_t* device, const scene
 		printf("Failed to load the scene, because the requested scene file is unknown.\n");
 		return 1;
 	}
-	// Load the spherical light file
-	FILE* file = fopen(lights_path, "rb");
-	if (file) {
-		fread(&lit_scene->spherical_light_count, sizeof(uint32_t), 1, file);
-		if (lit_scene->spherical_light_count > MAX_SPHERICAL_LIGHT_COUNT) {
-			printf("Warning: At most %u spherical lights are supported but %u were found in the file. Dropping some of them.\n", MAX_SPHERICAL_LIGHT_COUNT, lit_scene->spherical_light_count);
-			lit_scene->spherical_light_count = MAX_SPHERICAL_LIGHT_COUNT;
-		}
-		lit_scene->spherical_light_count = (uint32_t) fread(&lit_scene->spherical_lights, sizeof(float) * 4, lit_scene->spherical_light_count, file);
-		printf("Loaded %u spherical lights from %s.\n", lit_scene->spherical_light_count, lights_path);
-		fclose(file);
-	}
+	lit_scene->scene_file = scene_spec->scene_file;
 	// Load the scene
-	int result = load_scene(&lit_scene->scene, device, scene_path, textures_path);
-	if (!result)
-		printf("Loaded %lu triangles and %lu materials from %s.\n", lit_scene->scene.header.triangle_count, lit_scene->scene.header.material_count, scene_path);
+	double load_begin = glfwGetTime();
+	int result = load_scene(&lit_scene->scene, device, scene_path, textures_path, texture_registry, BVH_CACHE_PATH);
+	if (!result && lit_scene->scene.header.material_count > MAX_MATERIAL_COUNT) {
+		printf("The scene file at %s has %lu materials but at most %u are supported.\n", scene_path, lit_scene->scene.header.material_count, MAX_MATERIAL_COUNT);
+		free_lit_scene(lit_scene, device);
+		return 1;
+	}
+	// Load the spherical lights
+	if (!result && create_light_buffers(lit_scene, device, lights_path)) {
+		free_lit_scene(lit_scene, device);
+		return 1;
+	}
+	if (!result) {
+		// Shaders identify emissive surfaces by the index of this material
+		lit_scene->emission_material_index = 0;
+		for (uint32_t i = 0; i != lit_scene->scene.header.material_count; ++i)
+			if (strcmp(lit_scene->scene.header.material_names[i], "_emission") == 0)
+				lit_scene->emission_material_index = i;
+		const bvhs_t* bvhs = &lit_scene->scene.bvhs;
+		VkDeviceSize bvh_size = bvhs->buffers[bvh_level_bottom].size + bvhs->buffers[bvh_level_top].size;
+		printf("Loaded %lu triangles with %lu vertices and %lu materials from %s.\n", lit_scene->scene.header.triangle_count, lit_scene->scene.header.vertex_count, lit_scene->scene.header.material_count, scene_path);
+		printf("Acceleration structures take %.1f MiB (%.1f MiB before compaction).\n", (double) bvh_size / (1024.0 * 1024.0), (double) bvhs->uncompacted_size / (1024.0 * 1024.0));
+		printf("Loading took %.3f s. Peak resident memory since the process started is %.1f MiB.\n", glfwGetTime() - load_begin, get_peak_memory_usage());
+	}
 	return result;
 }
 
 
 void free_lit_scene(lit_scene_t* lit_scene, const device_t* device) {
 	free_scene(&lit_scene->scene, device);
+	free_buffers(&lit_scene->light_buffers, device);
 	memset(lit_scene, 0, sizeof(*lit_scene));
 }
 
 
+int create_scene_cache(scene_cache_t* cache, VkDeviceSize budget) {
+	memset(cache, 0, sizeof(*cache));
+	cache->budget = budget;
+	return create_texture_registry(&cache->texture_registry);
+}
+
+
+void free_scene_cache(scene_cache_t* cache, const device_t* device) {
+	for (uint32_t i = 0; i != cache->entry_count; ++i)
+		free_lit_scene(&cache->entries[i].lit_scene, device);
+	free_texture_registry(&cache->texture_registry);
+	memset(cache, 0, sizeof(*cache));
+}
+
+
+void stash_lit_scene(scene_cache_t* cache, lit_scene_t* lit_scene, const device_t* device) {
+	bool cached = false;
+	for (uint32_t i = 0; i != cache->entry_count; ++i)
+		cached |= (cache->entries[i].lit_scene.scene_file == lit_scene->scene_file);
+	if (cached || !lit_scene->scene.header.triangle_count || cache->entry_count == COUNT_OF(cache->entries))
+		free_lit_scene(lit_scene, device);
+	else {
+		cached_scene_t* entry = &cache->entries[cache->entry_count++];
+		entry->lit_scene = *lit_scene;
+		entry->last_use = ++cache->use_count;
+		memset(lit_scene, 0, sizeof(*lit_scene));
+	}
+	evict_cached_lit_scenes(cache, NULL, device);
+}
+
+
+bool take_cached_lit_scene(scene_cache_t* cache, lit_scene_t* lit_scene, scene_file_t scene_file) {
+	for (uint32_t i = 0; i != cache->entry_count; ++i) {
+		if (cache->entries[i].lit_scene.scene_file == scene_file) {
+			(*lit_scene) = cache->entries[i].lit_scene;
+			cache->entries[i] = cache->entries[--cache->entry_count];
+			return true;
+		}
+	}
+	return false;
+}
+
+
+//! \return The number of bytes of device memory used by the given scenes with
+//!		each texture batch counted once
+VkDeviceSize get_lit_scenes_size(const lit_scene_t* const* lit_scenes, uint32_t scene_count) {
+	VkDeviceSize size = 0;
+	for (uint32_t i = 0; i != scene_count; ++i) {
+		const scene_t* scene = &lit_scenes[i]->scene;
+		size += get_scene_device_size(scene, false);
+		size += lit_scenes[i]->light_buffers.size;
+		for (uint32_t j = 0; j != scene->texture_batch_count; ++j) {
+			bool shared = false;
+			for (uint32_t k = 0; k != i; ++k)
+				for (uint32_t l = 0; l != lit_scenes[k]->scene.texture_batch_count; ++l)
+					shared |= (lit_scenes[k]->scene.texture_batches[l] == scene->texture_batches[j]);
+			if (!shared)
+				size += get_texture_batch_size(scene->texture_batches[j]);
+		}
+	}
+	return size;
+}
+
+
+void evict_cached_lit_scenes(scene_cache_t* cache, const lit_scene_t* current, const device_t* device) {
+	while (cache->entry_count > 0) {
+		// Measure everything that is resident
+		const lit_scene_t* lit_scenes[scene_file_count + 1];
+		uint32_t scene_count = 0;
+		uint32_t oldest = 0;
+		for (uint32_t i = 0; i != cache->entry_count; ++i) {
+			lit_scenes[scene_count++] = &cache->entries[i].lit_scene;
+			if (cache->entries[i].last_use < cache->entries[oldest].last_use)
+				oldest = i;
+		}
+		if (current)
+			lit_scenes[scene_count++] = current;
+		if (get_lit_scenes_size(lit_scenes, scene_count) <= cache->budget)
+			break;
+		// Evict the least recently used scene
+		const char* scene_name = NULL;
+		get_scene_file(cache->entries[oldest].lit_scene.scene_file, &scene_name, NULL, NULL, NULL, NULL);
+		printf("Evicting the scene %s from the scene cache.\n", scene_name ? scene_name : "");
+		free_lit_scene(&cache->entries[oldest].lit_scene, device);
+		cache->entries[oldest] = cache->entries[--cache->entry_count];
+	}
+}
+
+
+//! The thread function for background loaders
+int run_background_loader(void* raw_loader) {
+	background_loader_t* loader = (background_loader_t*) raw_loader;
+	return create_lit_scene(&loader->lit_scene, &loader->device, &loader->scene_spec, loader->texture_registry);
+}
+
+
+int start_background_loader(background_loader_t* loader, const device_t* device, const scene_spec_t* scene_spec, texture_registry_t* texture_registry) {
+	memset(loader, 0, sizeof(*loader));
+	loader->scene_spec = *scene_spec;
+	loader->texture_registry = texture_registry;
+	if (create_thread_device(&loader->device, device)) {
+		free_background_loader(loader);
+		return 1;
+	}
+	if (create_thread(&loader->thread, &run_background_loader, loader)) {
+		printf("Failed to launch a worker thread for loading a scene.\n");
+		free_background_loader(loader);
+		return 1;
+	}
+	return 0;
+}
+
+
+void poll_background_loader(background_loader_t* loader, app_update_t* update) {
+	if (!loader->thread || !is_thread_finished(loader->thread))
+		return;
+	if (join_thread(&loader->thread)) {
+		printf("Failed to load the scene in the background. Keeping the previous scene.\n");
+		free_background_loader(loader);
+		return;
+	}
+	loader->ready = true;
+	update->lit_scene = true;
+}
+
+
+void free_background_loader(background_loader_t* loader) {
+	join_thread(&loader->thread);
+	if (loader->device.device)
+		free_lit_scene(&loader->lit_scene, &loader->device);
+	free_thread_device(&loader->device);
+	memset(loader, 0, sizeof(*loader));
+}
+
+
+/*! Takes care of a requested change of the lit scene using the background
+	loader of the given app, if that is possible.
+	\return true if the lit scene should be left untouched by update_app() for
+		now, false if it should be recreated right away. In the latter case,
+		the background loader may hold a finished scene to be swapped in.*/
+bool defer_lit_scene_update(app_t* app) {
+	background_loader_t* loader = &app->background_loader;
+	// A finished scene that matches the specification is swapped in
+	if (loader->ready && loader->scene_spec.scene_file == app->scene_spec.scene_file)
+		return false;
+	// Anything else that has finished is outdated
+	if (loader->ready)
+		free_background_loader(loader);
+	// The requested scene may have been taken from the scene cache while the
+	// worker was busy
+	if (app->lit_scene.scene.header.triangle_count && app->lit_scene.scene_file == app->scene_spec.scene_file)
+		return true;
+	// Cached scenes are swapped in right away
+	for (uint32_t i = 0; i != app->scene_cache.entry_count; ++i)
+		if (app->scene_cache.entries[i].lit_scene.scene_file == app->scene_spec.scene_file)
+			return false;
+	// If a worker is busy, we wait for it and start over if needed
+	if (loader->thread)
+		return true;
+	// Without a scene to render in the meantime, there is no point in loading
+	// in the background. Slideshows take screenshots at fixed sample counts,
+	// so they have to be deterministic.
+	if (!app->lit_scene.scene.header.triangle_count || !app->device.background_queue
+		|| app->slideshow.slide_begin < app->slideshow.slide_end)
+		return false;
+	const char* scene_name = NULL;
+	get_scene_file(app->scene_spec.scene_file, &scene_name, NULL, NULL, NULL, NULL);
+	if (start_background_loader(loader, &app->device, &app->scene_spec, &app->scene_cache.texture_registry))
+		return false;
+	printf("Loading the scene %s in the background.\n", scene_name ? scene_name : "");
+	return true;
+}
+
+
+//! Moves the lit scene out of the scene cache or the background loader of the
+//! given app if it is there. Otherwise, it loads the lit scene right away
+//! using create_lit_scene(). Afterwards, the scene cache is trimmed to its
+//! budget.
+int adopt_or_create_lit_scene(app_t* app) {
+	background_loader_t* loader = &app->background_loader;
+	if (take_cached_lit_scene(&app->scene_cache, &app->lit_scene, app->scene_spec.scene_file)) {
+		const char* scene_name = NULL;
+		get_scene_file(app->scene_spec.scene_file, &scene_name, NULL, NULL, NULL, NULL);
+		printf("Took the scene %s from the scene cache.\n", scene_name ? scene_name : "");
+	}
+	else if (loader->ready) {
+		app->lit_scene = loader->lit_scene;
+		memset(&loader->lit_scene, 0, sizeof(loader->lit_scene));
+		free_background_loader(loader);
+	}
+	else if (create_lit_scene(&app->lit_scene, &app->device, &app->scene_spec, &app->scene_cache.texture_registry))
+		return 1;
+	evict_cached_lit_scenes(&app->scene_cache, &app->lit_scene, &app->device);
+	return 0;
+}
+
+
 int create_render_pass(render_pass_t* render_pass, const device_t* device, const swapchain_t* swapchain, const render_targets_t* targets) {
 	memset(render_pass, 0, sizeof(*render_pass));
 	// Define the render pass
@@ -859,7 +1144,6 @@ void free_render_pass(render_pass_t* render_pass, const device_t* device) {
 
 int create_scene_subpass(scene_subpass_t* subpass, const device_t* device, const scene_spec_t* scene_spec, const render_settings_t* render_settings, const swapchain_t* swapchain, const constant_buffers_t* constant_buffers, const lit_scene_t* lit_scene, const render_pass_t* render_pass) {
 	memset(subpass, 0, sizeof(*subpass));
-	const scene_t* scene = &lit_scene->scene;
 	// Create a sampler for material textures
 	VkSamplerCreateInfo sampler_info = {
 		.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
@@ -876,16 +1160,62 @@ int create_scene_subpass(scene_subpass_t* subpass, const device_t* device, const
 		free_scene_subpass(subpass, device);
 		return 1;
 	}
+	// Create a buffer for statistics and, if needed, buffers for the
+	// wavefront path tracer
+	bool wavefront = (render_settings->sampling_strategy == sampling_strategy_nee_wavefront);
+	buffer_request_t statistics_request = {
+		.buffer_info = {
+			.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+			.size = sizeof(frame_statistics_t),
+			.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		},
+	};
+	if (create_buffers(&subpass->statistics, device, &statistics_request, 1, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 1)) {
+		printf("Failed to create a buffer for frame statistics.\n");
+		free_scene_subpass(subpass, device);
+		return 1;
+	}
+	if (wavefront) {
+		VkDeviceSize pixel_count = (VkDeviceSize) swapchain->extent.width * swapchain->extent.height;
+		buffer_request_t wavefront_buffer_requests[] = {
+			// Path states
+			{
+				.buffer_info = {
+					.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+					.size = pixel_count * WAVEFRONT_PATH_STATE_SIZE,
+					.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+				},
+			},
+			// Queues
+			{
+				.buffer_info = {
+					.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+					.size = sizeof(wavefront_queues_header_t) + WAVEFRONT_QUEUE_COUNT * pixel_count * sizeof(uint32_t),
+					.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+				},
+			},
+		};
+		if (create_buffers(&subpass->wavefront_buffers, device, wavefront_buffer_requests, COUNT_OF(wavefront_buffer_requests), VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 1)) {
+			printf("Failed to create buffers for path states and queues of the wavefront path tracer.\n");
+			free_scene_subpass(subpass, device);
+			return 1;
+		}
+	}
 	// Create a descriptor set
 	#define MESH_BINDING_START 3
-	VkDescriptorSetLayoutBinding bindings[MESH_BINDING_START + mesh_buffer_type_count] = {
+	#define MATERIAL_CONSTANTS_BINDING (MESH_BINDING_START + mesh_buffer_type_count)
+	#define WAVEFRONT_BINDING_START (MATERIAL_CONSTANTS_BINDING + 1)
+	#define STATISTICS_BINDING (WAVEFRONT_BINDING_START + 2)
+	#define LIGHT_BINDING_START (STATISTICS_BINDING + 1)
+	VkDescriptorSetLayoutBinding bindings[LIGHT_BINDING_START + 2] = {
 		// The constant buffer
 		{ .binding = 0, .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER },
-		// All material textures
+		// All material textures. The array is big enough for any scene and
+		// only the entries for the current scene are written.
 		{
 			.binding = 1,
 			.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-			.descriptorCount = material_texture_type_count * scene->header.material_count,
+			.descriptorCount = material_texture_type_count * MAX_MATERIAL_COUNT,
 		},
 		// The acceleration structure (BVH) containing all scene geometry
 		{ .binding = 2, .descriptorType = VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR },
@@ -896,9 +1226,19 @@ int create_scene_subpass(scene_subpass_t* subpass, const device_t* device, const
 		binding->binding = MESH_BINDING_START + i;
 		binding->descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER;
 	}
-	complete_descriptor_set_layout_bindings(bindings, COUNT_OF(bindings), 1, VK_SHADER_STAGE_FRAGMENT_BIT);
-	if (create_descriptor_sets(&subpass->descriptor_set, device, bindings, COUNT_OF(bindings), 1)) {
-		printf("Failed to create a descriptor set for the scene subpass.\n");
+	// Colors of single-colored material textures, path states and queues of
+	// the wavefront path tracer, statistics, spherical lights and the light
+	// tree
+	for (uint32_t i = MATERIAL_CONSTANTS_BINDING; i != LIGHT_BINDING_START + 2; ++i) {
+		bindings[i].binding = i;
+		bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	}
+	complete_descriptor_set_layout_bindings(bindings, COUNT_OF(bindings), 1, VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_COMPUTE_BIT);
+	VkDescriptorBindingFlags binding_flags[COUNT_OF(bindings)] = {
+		[1] = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT,
+	};
+	if (create_descriptor_sets(&subpass->descriptor_set, device, bindings, COUNT_OF(bindings), binding_flags, FRAME_IN_FLIGHT_COUNT)) {
+		printf("Failed to create descriptor sets for the scene subpass.\n");
 		free_scene_subpass(subpass, device);
 		return 1;
 	}
@@ -907,45 +1247,40 @@ int create_scene_subpass(scene_subpass_t* subpass, const device_t* device, const
 		.buffer = constant_buffers->buffer.buffers[0].buffer,
 		.range = VK_WHOLE_SIZE,
 	};
-	VkDescriptorImageInfo* image_infos = calloc(scene->textures.image_count, sizeof(VkDescriptorImageInfo));
-	for (uint32_t i = 0; i != scene->textures.image_count; ++i) {
-		image_infos[i].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-		image_infos[i].imageView = scene->textures.images[i].view;
-		image_infos[i].sampler = subpass->sampler;
-	}
-	VkWriteDescriptorSetAccelerationStructureKHR bvh_info = {
-		.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET_ACCELERATION_STRUCTURE_KHR,
-		.pAccelerationStructures = &scene->bvhs.bvhs[bvh_level_top],
-		.accelerationStructureCount = 1,
+	VkDescriptorBufferInfo statistics_info = {
+		.buffer = subpass->statistics.buffers[0].buffer,
+		.range = VK_WHOLE_SIZE,
 	};
-	VkWriteDescriptorSet writes[MESH_BINDING_START + mesh_buffer_type_count] = {
-		{ .dstBinding = 0, .pBufferInfo = &constant_buffer_info, },
-		{ .dstBinding = 1, .pImageInfo = image_infos, },
-		{ .dstBinding = 2, .pNext = &bvh_info, },
+	VkDescriptorBufferInfo wavefront_infos[2];
+	VkWriteDescriptorSet buffer_writes[2 + COUNT_OF(wavefront_infos)] = {
+		{ .dstBinding = 0, .pBufferInfo = &constant_buffer_info },
+		{ .dstBinding = STATISTICS_BINDING, .pBufferInfo = &statistics_info },
 	};
-	for (uint32_t i = 0; i != mesh_buffer_type_count; ++i) {
-		VkWriteDescriptorSet* write = &writes[MESH_BINDING_START + i];
-		write->dstBinding = MESH_BINDING_START + i;
-		write->pTexelBufferView = &scene->mesh_buffers.buffers[i].view;
+	uint32_t buffer_write_count = 2;
+	for (uint32_t i = 0; i != subpass->wavefront_buffers.buffer_count; ++i) {
+		wavefront_infos[i] = (VkDescriptorBufferInfo) {
+			.buffer = subpass->wavefront_buffers.buffers[i].buffer,
+			.range = VK_WHOLE_SIZE,
+		};
+		buffer_writes[buffer_write_count++] = (VkWriteDescriptorSet) { .dstBinding = WAVEFRONT_BINDING_START + i, .pBufferInfo = &wavefront_infos[i] };
 	}
-	complete_descriptor_set_writes(writes, COUNT_OF(writes), bindings, COUNT_OF(bindings), subpass->descriptor_set.descriptor_sets[0]);
-	vkUpdateDescriptorSets(device->device, COUNT_OF(writes), writes, 0, NULL);
-	free(image_infos);
-	image_infos = NULL;
-	// Compile the shaders and create the shader modules
-	uint32_t emission_material_index = 0;
-	for (uint32_t i = 0; i != scene->header.material_count; ++i)
-		if (strcmp(scene->header.material_names[i], "_emission") == 0)
-			emission_material_index = i;
+	for (uint32_t i = 0; i != subpass->descriptor_set.descriptor_set_count; ++i) {
+		complete_descriptor_set_writes(buffer_writes, buffer_write_count, bindings, COUNT_OF(bindings), subpass->descriptor_set.descriptor_sets[i]);
+		vkUpdateDescriptorSets(device->device, buffer_write_count, buffer_writes, 0, NULL);
+	}
+	write_scene_subpass_scene(subpass, device, lit_scene);
+	// Compile the shaders and create the shader modules. They do not depend
+	// on the scene, so switching scenes does not require recompilation.
 	char* defines[] = {
-		format_uint("MATERIAL_COUNT=%u", scene->header.material_count),
-		format_uint("EMISSION_MATERIAL_INDEX=%u", emission_material_index),
-		format_uint("SPHERICAL_LIGHT_COUNT=%u", lit_scene->spherical_light_count),
 		format_uint("PATH_LENGTH=%u", render_settings->path_length),
 		format_uint("SAMPLING_STRATEGY_SPHERICAL=%u", render_settings->sampling_strategy == sampling_strategy_spherical),
 		format_uint("SAMPLING_STRATEGY_PSA=%u", render_settings->sampling_strategy == sampling_strategy_psa),
 		format_uint("SAMPLING_STRATEGY_BRDF=%u", render_settings->sampling_strategy == sampling_strategy_brdf),
 		format_uint("SAMPLING_STRATEGY_NEE=%u", render_settings->sampling_strategy == sampling_strategy_nee),
+		format_uint("RUSSIAN_ROULETTE_MIN_DEPTH=%u", render_settings->russian_roulette_min_depth),
+		format_uint("SPLIT_COUNT=%u", render_settings->split_count),
+		format_uint("WAVEFRONT_GROUP_SIZE=%u", WAVEFRONT_GROUP_SIZE),
+		format_uint("LIGHT_TREE_MAX_DEPTH=%u", LIGHT_TREE_MAX_DEPTH),
 	};
 	shader_compilation_request_t vert_request = {
 		.shader_path = "src/shaders/pathtrace.vert.glsl",
@@ -955,13 +1290,31 @@ int create_scene_subpass(scene_subpass_t* subpass, const device_t* device, const
 		.define_count = COUNT_OF(defines),
 	};
 	shader_compilation_request_t frag_request = {
-		.shader_path = "src/shaders/pathtrace.frag.glsl",
+		.shader_path = wavefront ? "src/shaders/wavefront_resolve.frag.glsl" : "src/shaders/pathtrace.frag.glsl",
 		.stage = VK_SHADER_STAGE_FRAGMENT_BIT,
 		.entry_point = "main",
 		.defines = defines,
 		.define_count = COUNT_OF(defines),
 	};
-	if (compile_and_create_shader_module(&subpass->vert_shader, device, &vert_request, true)
+	shader_compilation_request_t wavefront_requests[wavefront_kernel_count];
+	char* wavefront_paths[wavefront_kernel_count];
+	wavefront_paths[wavefront_kernel_raygen] = "src/shaders/wavefront_raygen.comp.glsl";
+	wavefront_paths[wavefront_kernel_extend] = "src/shaders/wavefront_extend.comp.glsl";
+	wavefront_paths[wavefront_kernel_shade] = "src/shaders/wavefront_shade.comp.glsl";
+	wavefront_paths[wavefront_kernel_connect] = "src/shaders/wavefront_connect.comp.glsl";
+	int compile_result = 0;
+	for (uint32_t i = 0; i != wavefront_kernel_count && wavefront && !compile_result; ++i) {
+		wavefront_requests[i] = (shader_compilation_request_t) {
+			.shader_path = wavefront_paths[i],
+			.stage = VK_SHADER_STAGE_COMPUTE_BIT,
+			.entry_point = "main",
+			.defines = defines,
+			.define_count = COUNT_OF(defines),
+		};
+		compile_result = compile_and_create_shader_module(&subpass->wavefront_shaders[i], device, &wavefront_requests[i], true);
+	}
+	if (compile_result
+	 || compile_and_create_shader_module(&subpass->vert_shader, device, &vert_request, true)
 	 || compile_and_create_shader_module(&subpass->frag_shader, device, &frag_request, true)
 	) {
 		printf("Failed to compile one of the shaders for the scene subpass.\n");
@@ -972,6 +1325,24 @@ int create_scene_subpass(scene_subpass_t* subpass, const device_t* device, const
 	}
 	for (uint32_t i = 0; i != COUNT_OF(defines); ++i)
 		free(defines[i]);
+	// Create compute pipelines for the wavefront path tracer
+	for (uint32_t i = 0; i != wavefront_kernel_count && wavefront; ++i) {
+		VkComputePipelineCreateInfo compute_info = {
+			.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+			.stage = {
+				.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+				.stage = VK_SHADER_STAGE_COMPUTE_BIT,
+				.module = subpass->wavefront_shaders[i],
+				.pName = wavefront_requests[i].entry_point,
+			},
+			.layout = subpass->descriptor_set.pipeline_layout,
+		};
+		if (vkCreateComputePipelines(device->device, NULL, 1, &compute_info, NULL, &subpass->wavefront_pipelines[i])) {
+			printf("Failed to create a compute pipeline for the wavefront path tracer.\n");
+			free_scene_subpass(subpass, device);
+			return 1;
+		}
+	}
 	// Define the graphics pipeline state
 	VkPipelineVertexInputStateCreateInfo vertex_input_info = {
 		.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
@@ -1073,13 +1444,166 @@ int create_scene_subpass(scene_subpass_t* subpass, const device_t* device, const
 }
 
 
+void write_scene_subpass_textures(const scene_subpass_t* subpass, const device_t* device, const scene_t* scene, uint32_t set_index) {
+	if (scene->header.material_count == 0)
+		return;
+	uint32_t texture_count = (uint32_t) (material_texture_type_count * scene->header.material_count);
+	VkDescriptorImageInfo* image_infos = calloc(texture_count, sizeof(VkDescriptorImageInfo));
+	VkWriteDescriptorSet* writes = calloc(texture_count, sizeof(VkWriteDescriptorSet));
+	uint32_t write_count = 0;
+	for (uint32_t i = 0; i != texture_count; ++i) {
+		// Single-colored textures come from material constants. The array is
+		// partially bound, so their descriptors can be left alone.
+		const shared_texture_t* texture = scene->textures[i];
+		if (texture->image_index == CONSTANT_TEXTURE_IMAGE_INDEX)
+			continue;
+		image_infos[i].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		image_infos[i].imageView = texture->batch->images.images[texture->image_index].view;
+		image_infos[i].sampler = subpass->sampler;
+		// Consecutive textures share a write
+		if (write_count > 0 && writes[write_count - 1].dstArrayElement + writes[write_count - 1].descriptorCount == i)
+			++writes[write_count - 1].descriptorCount;
+		else {
+			writes[write_count++] = (VkWriteDescriptorSet) {
+				.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+				.dstSet = subpass->descriptor_set.descriptor_sets[set_index],
+				.dstBinding = 1,
+				.dstArrayElement = i,
+				.descriptorCount = 1,
+				.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+				.pImageInfo = &image_infos[i],
+			};
+		}
+	}
+	vkUpdateDescriptorSets(device->device, write_count, writes, 0, NULL);
+	free(writes);
+	free(image_infos);
+}
+
+
+void write_scene_subpass_scene(const scene_subpass_t* subpass, const device_t* device, const lit_scene_t* lit_scene) {
+	const scene_t* scene = &lit_scene->scene;
+	VkWriteDescriptorSetAccelerationStructureKHR bvh_info = {
+		.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET_ACCELERATION_STRUCTURE_KHR,
+		.pAccelerationStructures = &scene->bvhs.bvhs[bvh_level_top],
+		.accelerationStructureCount = 1,
+	};
+	VkDescriptorBufferInfo material_constants_info = {
+		.buffer = scene->material_constants.buffers[0].buffer,
+		.range = VK_WHOLE_SIZE,
+	};
+	VkDescriptorBufferInfo light_infos[2];
+	VkWriteDescriptorSet writes[2 + mesh_buffer_type_count + COUNT_OF(light_infos)] = {
+		{
+			.dstBinding = 2,
+			.pNext = &bvh_info,
+			.descriptorType = VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR,
+		},
+		{
+			.dstBinding = MATERIAL_CONSTANTS_BINDING,
+			.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+			.pBufferInfo = &material_constants_info,
+		},
+	};
+	for (uint32_t i = 0; i != mesh_buffer_type_count; ++i) {
+		VkWriteDescriptorSet* write = &writes[2 + i];
+		write->dstBinding = MESH_BINDING_START + i;
+		write->descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER;
+		write->pTexelBufferView = &scene->mesh_buffers.buffers[i].view;
+	}
+	for (uint32_t i = 0; i != COUNT_OF(light_infos); ++i) {
+		light_infos[i] = (VkDescriptorBufferInfo) {
+			.buffer = lit_scene->light_buffers.buffers[i].buffer,
+			.range = VK_WHOLE_SIZE,
+		};
+		VkWriteDescriptorSet* write = &writes[2 + mesh_buffer_type_count + i];
+		write->dstBinding = LIGHT_BINDING_START + i;
+		write->descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		write->pBufferInfo = &light_infos[i];
+	}
+	for (uint32_t i = 0; i != COUNT_OF(writes); ++i) {
+		writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		writes[i].descriptorCount = 1;
+	}
+	for (uint32_t i = 0; i != subpass->descriptor_set.descriptor_set_count; ++i) {
+		write_scene_subpass_textures(subpass, device, scene, i);
+		for (uint32_t j = 0; j != COUNT_OF(writes); ++j)
+			writes[j].dstSet = subpass->descriptor_set.descriptor_sets[i];
+		vkUpdateDescriptorSets(device->device, COUNT_OF(writes), writes, 0, NULL);
+	}
+}
+
+
+bool update_scene_subpass_textures(scene_subpass_t* subpass, const device_t* device, const scene_t* scene, uint32_t workload_index) {
+	bool outdated = false, updated = false;
+	for (uint32_t i = 0; i != FRAME_IN_FLIGHT_COUNT; ++i) {
+		if (subpass->outdated_textures[i] && (i == workload_index || workload_index == FRAME_IN_FLIGHT_COUNT)) {
+			write_scene_subpass_textures(subpass, device, scene, i);
+			subpass->outdated_textures[i] = false;
+			updated = true;
+		}
+		outdated |= subpass->outdated_textures[i];
+	}
+	// Each descriptor set has been rewritten after the frames that used it
+	// with the old views had finished, so these views are not in use anymore
+	if (!outdated) {
+		for (uint32_t i = 0; i != subpass->retired_view_count; ++i)
+			vkDestroyImageView(device->device, subpass->retired_views[i], NULL);
+		free(subpass->retired_views);
+		subpass->retired_views = NULL;
+		subpass->retired_view_count = 0;
+	}
+	return updated && !outdated;
+}
+
+
+void stream_scene_textures(app_t* app) {
+	scene_t* scene = &app->lit_scene.scene;
+	scene_subpass_t* subpass = &app->scene_subpass;
+	// Slideshows take screenshots at fixed sample counts, so they cannot wait
+	// for mipmaps to trickle in
+	bool everything = app->slideshow.slide_begin < app->slideshow.slide_end;
+	uint32_t retired_view_count = subpass->retired_view_count;
+	// Batches are streamed one after the other
+	for (uint32_t i = 0; i != scene->texture_batch_count; ++i) {
+		texture_batch_t* batch = scene->texture_batches[i];
+		if (!batch->stream)
+			continue;
+		int result;
+		do
+			result = stream_textures(batch->stream, &batch->images, &app->device, TEXTURE_STREAMING_BYTES_PER_FRAME, everything, &subpass->retired_views, &subpass->retired_view_count);
+		while (!result && everything && !is_texture_stream_complete(batch->stream));
+		if (result)
+			printf("Failed to stream finer mipmaps of textures. Keeping the mipmaps that are there already.\n");
+		if (result || is_texture_stream_complete(batch->stream))
+			free_texture_stream(&batch->stream, &app->device);
+		if (!everything)
+			break;
+	}
+	// Frames in flight may still use the old views, so descriptor sets get
+	// updated once their frames have finished
+	if (subpass->retired_view_count != retired_view_count)
+		for (uint32_t i = 0; i != FRAME_IN_FLIGHT_COUNT; ++i)
+			subpass->outdated_textures[i] = true;
+}
+
+
 void free_scene_subpass(scene_subpass_t* subpass, const device_t* device) {
+	for (uint32_t i = 0; i != wavefront_kernel_count; ++i) {
+		if (subpass->wavefront_pipelines[i]) vkDestroyPipeline(device->device, subpass->wavefront_pipelines[i], NULL);
+		if (subpass->wavefront_shaders[i]) vkDestroyShaderModule(device->device, subpass->wavefront_shaders[i], NULL);
+	}
 	if (subpass->pipeline_discard) vkDestroyPipeline(device->device, subpass->pipeline_discard, NULL);
 	if (subpass->pipeline_accum) vkDestroyPipeline(device->device, subpass->pipeline_accum, NULL);
 	free_descriptor_sets(&subpass->descriptor_set, device);
 	if (subpass->vert_shader) vkDestroyShaderModule(device->device, subpass->vert_shader, NULL);
 	if (subpass->frag_shader) vkDestroyShaderModule(device->device, subpass->frag_shader, NULL);
 	if (subpass->sampler) vkDestroySampler(device->device, subpass->sampler, NULL);
+	for (uint32_t i = 0; i != subpass->retired_view_count; ++i)
+		vkDestroyImageView(device->device, subpass->retired_views[i], NULL);
+	free(subpass->retired_views);
+	free_buffers(&subpass->wavefront_buffers, device);
+	free_buffers(&subpass->statistics, device);
 	memset(subpass, 0, sizeof(*subpass));
 }
 
@@ -1094,7 +1618,7 @@ int create_tonemap_subpass(tonemap_subpass_t* subpass, const device_t* device, c
 		{ .binding = 1, .descriptorType = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT, .stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT },
 	};
 	complete_descriptor_set_layout_bindings(bindings, COUNT_OF(bindings), 1, 0);
-	if (create_descriptor_sets(&subpass->descriptor_set, device, bindings, COUNT_OF(bindings), 1)) {
+	if (create_descriptor_sets(&subpass->descriptor_set, device, bindings, COUNT_OF(bindings), NULL, 1)) {
 		printf("Failed to create a descriptor set for the tonemapping subpass.\n");
 		free_tonemap_subpass(subpass, device);
 		return 1;
@@ -1264,7 +1788,7 @@ int create_gui_subpass(gui_subpass_t* subpass, const device_t* device, const gui
 		{ .binding = 1, .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, .stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT },
 	};
 	complete_descriptor_set_layout_bindings(bindings, COUNT_OF(bindings), 1, 0);
-	if (create_descriptor_sets(&subpass->descriptor_set, device, bindings, COUNT_OF(bindings), 1)) {
+	if (create_descriptor_sets(&subpass->descriptor_set, device, bindings, COUNT_OF(bindings), NULL, 1)) {
 		printf("Failed to create a descriptor set for the GUI subpass.\n");
 		free_gui_subpass(subpass, device);
 		return 1;
@@ -1447,6 +1971,23 @@ int create_frame_workloads(frame_workloads_t* workloads, const device_t* device)
 			return 1;
 		}
 	}
+	// Create and map buffers to read back statistics
+	buffer_request_t readback_requests[FRAME_IN_FLIGHT_COUNT];
+	for (uint32_t i = 0; i != FRAME_IN_FLIGHT_COUNT; ++i)
+		readback_requests[i] = (buffer_request_t) {
+			.buffer_info = {
+				.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+				.size = sizeof(frame_statistics_t),
+				.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			},
+		};
+	if (create_buffers(&workloads->statistics_readback, device, readback_requests, COUNT_OF(readback_requests), VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, device->physical_device_properties.limits.nonCoherentAtomSize)
+	 || vkMapMemory(device->device, workloads->statistics_readback.allocation, 0, VK_WHOLE_SIZE, 0, &workloads->statistics_readback_data))
+	{
+		printf("Failed to create or map buffers to read back frame statistics.\n");
+		free_frame_workloads(workloads, device);
+		return 1;
+	}
 	return 0;
 }
 
@@ -1461,6 +2002,9 @@ void free_frame_workloads(frame_workloads_t* workloads, const device_t* device)
 		if (frame->queue_finished[1]) vkDestroySemaphore(device->device, frame->queue_finished[1], NULL);
 		if (frame->frame_finished) vkDestroyFence(device->device, frame->frame_finished, NULL);
 	}
+	if (workloads->statistics_readback_data)
+		vkUnmapMemory(device->device, workloads->statistics_readback.allocation);
+	free_buffers(&workloads->statistics_readback, device);
 	memset(workloads, 0, sizeof(*workloads));
 }
 
@@ -1511,35 +2055,51 @@ bool update_needed(const app_update_t* update) {
 
 
 int update_app(app_t* app, const app_update_t* update, bool recreate) {
-	// Early out if there is nothing to do
+	// Scene changes may be handled in the background, while the current scene
+	// keeps being rendered
 	app_update_t up = *update;
-	if (!update_needed(update))
+	if (recreate && up.lit_scene && !up.device && !up.scene_cache && defer_lit_scene_update(app))
+		up.lit_scene = false;
+	// Early out if there is nothing to do
+	if (!update_needed(&up))
 		return 0;
 	// Reset accmulation
 	app->render_targets.accum_frame_count = 0;
-	// Let all GPU work finish before destroying objects it may rely on
-	if (app->device.device)
-		vkDeviceWaitIdle(app->device.device);
+	// Let all GPU work finish before destroying objects it may rely on. A busy
+	// background loader owns the background queue, so then we can only wait
+	// for our own queue.
+	if (app->device.device) {
+		if (app->background_loader.thread)
+			vkQueueWaitIdle(app->device.queue);
+		else
+			vkDeviceWaitIdle(app->device.device);
+		// Replaced texture views are not in use anymore
+		update_scene_subpass_textures(&app->scene_subpass, &app->device, &app->lit_scene.scene, FRAME_IN_FLIGHT_COUNT);
+	}
 	// Propagate dependencies
 	for (uint32_t i = 0; i != sizeof(app_update_t) / sizeof(bool); ++i) {
 		up.gui |= up.device | up.window;		
 		up.swapchain |= up.device | up.window;
 		up.render_targets |= up.device | up.swapchain;
 		up.constant_buffers |= up.device;
-		up.lit_scene |= up.device;
+		up.scene_cache |= up.device;
+		up.lit_scene |= up.device | up.scene_cache;
 		up.render_pass |= up.device | up.swapchain | up.render_targets;
-		up.scene_subpass |= up.device | up.swapchain | up.constant_buffers | up.lit_scene | up.render_pass;
+		up.scene_subpass |= up.device | up.swapchain | up.constant_buffers | up.render_pass;
 		up.tonemap_subpass |= up.device | up.render_targets | up.constant_buffers | up.render_pass;
 		up.gui_subpass |= up.device | up.gui | up.swapchain | up.constant_buffers | up.render_pass;
 		up.frame_workloads |= up.device;
 	}
 	// Free objects in reversed order
+	if (up.scene_cache) free_background_loader(&app->background_loader);
 	if (up.frame_workloads) free_frame_workloads(&app->frame_workloads, &app->device);
 	if (up.gui_subpass) free_gui_subpass(&app->gui_subpass, &app->device);
 	if (up.tonemap_subpass) free_tonemap_subpass(&app->tonemap_subpass, &app->device);
 	if (up.scene_subpass) free_scene_subpass(&app->scene_subpass, &app->device);
 	if (up.render_pass) free_render_pass(&app->render_pass, &app->device);
-	if (up.lit_scene) free_lit_scene(&app->lit_scene, &app->device);
+	if (up.lit_scene && up.scene_cache) free_lit_scene(&app->lit_scene, &app->device);
+	if (up.lit_scene && !up.scene_cache) stash_lit_scene(&app->scene_cache, &app->lit_scene, &app->device);
+	if (up.scene_cache) free_scene_cache(&app->scene_cache, &app->device);
 	if (up.constant_buffers) free_constant_buffers(&app->constant_buffers, &app->device);
 	if (up.render_targets) free_render_targets(&app->render_targets, &app->device);
 	if (up.swapchain) free_swapchain(&app->swapchain, &app->device);
@@ -1557,7 +2117,8 @@ int update_app(app_t* app, const app_update_t* update, bool recreate) {
 	 || up.swapchain && (ret = create_swapchain(&app->swapchain, &app->device, app->window, app->params.v_sync))
 	 || up.render_targets && (ret = create_render_targets(&app->render_targets, &app->device, &app->swapchain))
 	 || up.constant_buffers && (ret = create_constant_buffers(&app->constant_buffers, &app->device))
-	 || up.lit_scene && (ret = create_lit_scene(&app->lit_scene, &app->device, &app->scene_spec))
+	 || up.scene_cache && (ret = create_scene_cache(&app->scene_cache, app->params.scene_cache_budget))
+	 || up.lit_scene && (ret = adopt_or_create_lit_scene(app))
 	 || up.render_pass && (ret = create_render_pass(&app->render_pass, &app->device, &app->swapchain, &app->render_targets))
 	 || up.scene_subpass && (ret = create_scene_subpass(&app->scene_subpass, &app->device, &app->scene_spec, &app->render_settings, &app->swapchain, &app->constant_buffers, &app->lit_scene, &app->render_pass))
 	 || up.tonemap_subpass && (ret = create_tonemap_subpass(&app->tonemap_subpass, &app->device, &app->render_targets, &app->constant_buffers, &app->render_pass, &app->scene_spec))
@@ -1570,6 +2131,9 @@ int update_app(app_t* app, const app_update_t* update, bool recreate) {
 			return ret;
 		}
 	}
+	// The scene subpass does not depend on the scene, only its descriptors do
+	if (up.lit_scene && !up.scene_subpass)
+		write_scene_subpass_scene(&app->scene_subpass, &app->device, &app->lit_scene);
 	return 0;
 }
 
@@ -1629,7 +2193,7 @@ int handle_user_input(app_t* app, app_update_t* update) {
 	handle_gui_input(&app->gui, app->window);
 	// Define the GUI
 	if (app->params.gui)
-		define_gui(&app->gui.context, &app->scene_spec, &app->render_settings, update, &app->render_targets, app->frame_workloads.timestamps, app->device.physical_device_properties.limits.timestampPeriod);
+		define_gui(&app->gui.context, &app->scene_spec, &app->render_settings, update, &app->render_targets, app->frame_workloads.timestamps, app->device.physical_device_properties.limits.timestampPeriod, &app->frame_workloads.statistics);
 	// Use camera controls and update corresponding constants
 	control_camera(&app->scene_spec.camera, app->window);
 	// Quicksave and quickload
@@ -1714,7 +2278,7 @@ void color_picker(struct nk_context* ctx, float* rgb_color) {
 }
 
 
-void define_gui(struct nk_context* ctx, scene_spec_t* scene_spec, render_settings_t* render_settings, app_update_t* update, const render_targets_t* render_targets, uint64_t timestamps[timestamp_index_count], float timestamp_period) {
+void define_gui(struct nk_context* ctx, scene_spec_t* scene_spec, render_settings_t* render_settings, app_update_t* update, const render_targets_t* render_targets, uint64_t timestamps[timestamp_index_count], float timestamp_period, const frame_statistics_t* statistics) {
 	struct nk_rect bounds = { .x = 20.0f, .y = 20.0f, .w = 400.0f, .h = 380.0f };
 	if (nk_begin(ctx, "Path tracer", bounds, NK_WINDOW_BORDER | NK_WINDOW_MOVABLE | NK_WINDOW_SCALABLE | NK_WINDOW_MINIMIZABLE)) {
 		// Display the frame rate and an indicator whether the UI is refreshing
@@ -1734,7 +2298,11 @@ void define_gui(struct nk_context* ctx, scene_spec_t* scene_spec, render_setting
 		nk_label(ctx, indicator[frame_index % COUNT_OF(indicator)], NK_TEXT_ALIGN_RIGHT);
 		++frame_index;
 		nk_layout_row_dynamic(ctx, 30, 1);
-		nk_labelf(ctx, NK_TEXT_ALIGN_LEFT, "Shading time: %.2f ms", 1.0e-6f * timestamp_period * (float) (timestamps[timestamp_index_shading_end] - timestamps[timestamp_index_shading_begin]));
+		float shading_time = 1.0e-9f * timestamp_period * (float) (timestamps[timestamp_index_shading_end] - timestamps[timestamp_index_shading_begin]);
+		nk_labelf(ctx, NK_TEXT_ALIGN_LEFT, "Shading time: %.2f ms", 1.0e3f * shading_time);
+		nk_layout_row_dynamic(ctx, 30, 2);
+		nk_labelf(ctx, NK_TEXT_ALIGN_LEFT, "Ray throughput: %.1f Mrays/s", (shading_time > 0.0f) ? (1.0e-6f * (float) statistics->ray_count / shading_time) : 0.0f);
+		nk_labelf(ctx, NK_TEXT_ALIGN_LEFT, "Average path length: %.2f", (statistics->path_count > 0) ? ((float) statistics->path_vertex_count / (float) statistics->path_count) : 0.0f);
 		// Display the sample count
 		nk_layout_row_dynamic(ctx, 30, 1);
 		nk_labelf(ctx, NK_TEXT_ALIGN_LEFT, "Sample count: %u", render_targets->accum_frame_count);
@@ -1784,10 +2352,21 @@ void define_gui(struct nk_context* ctx, scene_spec_t* scene_spec, render_setting
 		nk_layout_row_dynamic(ctx, 15, 0);
 		nk_layout_row_dynamic(ctx, 30, 1);
 		int new_path_length = (int) render_settings->path_length;
-		nk_property_int(ctx, "Path length:", 0, &new_path_length, 10, 1, 0.001f);
+		nk_property_int(ctx, "Path length:", 0, &new_path_length, 64, 1, 0.001f);
 		if (((int) render_settings->path_length) != new_path_length)
 			update->scene_subpass = true;
 		render_settings->path_length = (uint32_t) new_path_length;
+		// Russian roulette (0 to turn it off) and splitting
+		int new_min_depth = (int) render_settings->russian_roulette_min_depth;
+		nk_property_int(ctx, "Russian roulette from vertex:", 0, &new_min_depth, 64, 1, 0.001f);
+		if (((int) render_settings->russian_roulette_min_depth) != new_min_depth)
+			update->scene_subpass = true;
+		render_settings->russian_roulette_min_depth = (uint32_t) new_min_depth;
+		int new_split_count = (int) render_settings->split_count;
+		nk_property_int(ctx, "Splits at first diffuse vertex:", 0, &new_split_count, 16, 1, 0.001f);
+		if (((int) render_settings->split_count) != new_split_count)
+			update->scene_subpass = true;
+		render_settings->split_count = (uint32_t) new_split_count;
 		// Sampling strategies for path tracing
 		nk_layout_row_dynamic(ctx, 30, 2);
 		const char* sampling_strategies[sampling_strategy_count];
@@ -1795,6 +2374,7 @@ void define_gui(struct nk_context* ctx, scene_spec_t* scene_spec, render_setting
 		sampling_strategies[sampling_strategy_psa] = "Projected solid angle";
 		sampling_strategies[sampling_strategy_brdf] = "BRDF";
 		sampling_strategies[sampling_strategy_nee] = "Next event estimation";
+		sampling_strategies[sampling_strategy_nee_wavefront] = "NEE (wavefront)";
 		sampling_strategy_t new_sampling_strategy = nk_combo(ctx, sampling_strategies, COUNT_OF(sampling_strategies), render_settings->sampling_strategy, 30, (struct nk_vec2) { .x = 240.0f, .y = 180.0f });
 		nk_label(ctx, "Sampling strategy", NK_TEXT_ALIGN_LEFT);
 		if (render_settings->sampling_strategy != new_sampling_strategy)
@@ -1823,6 +2403,83 @@ void define_gui(struct nk_context* ctx, scene_spec_t* scene_spec, render_setting
 }
 
 
+//! Records a barrier between two steps of the wavefront path tracer, which
+//! may communicate through buffers, indirect dispatches and transfers
+void record_wavefront_barrier(VkCommandBuffer cmd) {
+	VkMemoryBarrier barrier = {
+		.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+		.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT,
+		.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT,
+	};
+	VkPipelineStageFlags stages = VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT;
+	vkCmdPipelineBarrier(cmd, stages, stages | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 1, &barrier, 0, NULL, 0, NULL);
+}
+
+
+/*! Records the kernels of the wavefront path tracer. Once they are done, the
+	path states hold radiance estimates for all pixels, which the scene
+	subpass outputs. Each bounce extends all queued rays, shades the hits,
+	which queues rays for the next bounce and shadow rays, and then traces the
+	shadow rays. Queues only hold paths that are still alive, so dispatch
+	sizes shrink with each bounce.*/
+void record_wavefront_commands(VkCommandBuffer cmd, const app_t* app, uint32_t workload_index) {
+	const scene_subpass_t* subpass = &app->scene_subpass;
+	VkBuffer queues = subpass->wavefront_buffers.buffers[1].buffer;
+	uint32_t pixel_count = app->swapchain.extent.width * app->swapchain.extent.height;
+	uint32_t group_count = (pixel_count + WAVEFRONT_GROUP_SIZE - 1) / WAVEFRONT_GROUP_SIZE;
+	// Ray generation puts all paths into the first ray queue
+	wavefront_queues_header_t header = {
+		.headers = {
+			{ .group_count = { group_count, 1, 1 }, .count = pixel_count },
+			{ .group_count = { 0, 1, 1 } },
+			{ .group_count = { 0, 1, 1 } },
+		},
+		.depth = 1,
+	};
+	// The previous frame in flight may still read path states and queues in
+	// its kernels or its resolve
+	VkMemoryBarrier reuse_barrier = {
+		.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+		.srcAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT,
+		.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT,
+	};
+	VkPipelineStageFlags reuse_stages = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT;
+	vkCmdPipelineBarrier(cmd, reuse_stages | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, reuse_stages, 0, 1, &reuse_barrier, 0, NULL, 0, NULL);
+	vkCmdUpdateBuffer(cmd, queues, 0, sizeof(header), &header);
+	vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, subpass->descriptor_set.pipeline_layout, 0, 1, &subpass->descriptor_set.descriptor_sets[workload_index], 0, NULL);
+	vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, subpass->wavefront_pipelines[wavefront_kernel_raygen]);
+	vkCmdDispatch(cmd, group_count, 1, 1);
+	record_wavefront_barrier(cmd);
+	uint32_t path_length = app->render_settings.path_length;
+	for (uint32_t depth = 1; depth <= path_length; ++depth) {
+		// Empty the queues that shading appends to
+		uint32_t current_queue = (depth - 1) % 2;
+		uint32_t next_queue = depth % 2;
+		if (depth > 1) {
+			wavefront_queue_header_t empty = { .group_count = { 0, 1, 1 } };
+			vkCmdUpdateBuffer(cmd, queues, next_queue * sizeof(empty), sizeof(empty), &empty);
+			vkCmdUpdateBuffer(cmd, queues, (WAVEFRONT_QUEUE_COUNT - 1) * sizeof(empty), sizeof(empty), &empty);
+			vkCmdUpdateBuffer(cmd, queues, offsetof(wavefront_queues_header_t, depth), sizeof(depth), &depth);
+			record_wavefront_barrier(cmd);
+		}
+		// Find the next path vertices
+		vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, subpass->wavefront_pipelines[wavefront_kernel_extend]);
+		vkCmdDispatchIndirect(cmd, queues, current_queue * sizeof(wavefront_queue_header_t));
+		record_wavefront_barrier(cmd);
+		// Shade them
+		vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, subpass->wavefront_pipelines[wavefront_kernel_shade]);
+		vkCmdDispatchIndirect(cmd, queues, current_queue * sizeof(wavefront_queue_header_t));
+		record_wavefront_barrier(cmd);
+		// At the last vertex, shading does not sample lights
+		if (depth < path_length) {
+			vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, subpass->wavefront_pipelines[wavefront_kernel_connect]);
+			vkCmdDispatchIndirect(cmd, queues, (WAVEFRONT_QUEUE_COUNT - 1) * sizeof(wavefront_queue_header_t));
+			record_wavefront_barrier(cmd);
+		}
+	}
+}
+
+
 //! Fills a command buffer for rendering a single frame
 VkResult record_render_frame_commands(app_t* app, frame_workload_t* frame, uint32_t swapchain_image_index, uint32_t workload_index) {
 	// Begin recording into the command buffer anew
@@ -1862,9 +2519,28 @@ VkResult record_render_frame_commands(app_t* app, frame_workload_t* frame, uint3
 		.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
 		.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT,
 	};
+	// Reset statistics once the previous frame in flight is done writing and
+	// copying them
+	VkBufferMemoryBarrier statistics_barrier = {
+		.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+		.buffer = app->scene_subpass.statistics.buffers[0].buffer,
+		.size = VK_WHOLE_SIZE,
+		.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_READ_BIT,
+		.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+	};
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, NULL, 1, &statistics_barrier, 0, NULL);
+	vkCmdFillBuffer(cmd, app->scene_subpass.statistics.buffers[0].buffer, 0, VK_WHOLE_SIZE, 0);
+	statistics_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	statistics_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
 	// Place a barrier before these buffers are used
-	VkBufferMemoryBarrier buffer_barriers[] = { constant_barrier, gui_barrier };
-	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_GRAPHICS_BIT, 0, 0, NULL, COUNT_OF(buffer_barriers), buffer_barriers, 0, NULL);
+	VkBufferMemoryBarrier buffer_barriers[] = { constant_barrier, gui_barrier, statistics_barrier };
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_GRAPHICS_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, NULL, COUNT_OF(buffer_barriers), buffer_barriers, 0, NULL);
+	// The wavefront path tracer does its work before the render pass
+	bool wavefront = (app->scene_subpass.wavefront_buffers.buffer_count > 0);
+	if (wavefront) {
+		vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, frame->query_pool, timestamp_index_shading_begin);
+		record_wavefront_commands(cmd, app, workload_index);
+	}
 	// Begin the render pass
 	VkClearValue clear_values[] = {
 		{ .color = { .float32 = { 0.0f, 0.0f, 0.0f, 0.0f } } },
@@ -1886,8 +2562,9 @@ VkResult record_render_frame_commands(app_t* app, frame_workload_t* frame, uint3
 	else
 		vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, app->scene_subpass.pipeline_accum);
 	++app->render_targets.accum_frame_count;
-	vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, app->scene_subpass.descriptor_set.pipeline_layout, 0, 1, app->scene_subpass.descriptor_set.descriptor_sets, 0, NULL);
-	vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_ALL_GRAPHICS_BIT, frame->query_pool, timestamp_index_shading_begin);
+	vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, app->scene_subpass.descriptor_set.pipeline_layout, 0, 1, &app->scene_subpass.descriptor_set.descriptor_sets[workload_index], 0, NULL);
+	if (!wavefront)
+		vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_ALL_GRAPHICS_BIT, frame->query_pool, timestamp_index_shading_begin);
 	vkCmdDraw(cmd, 3, 1, 0, 0);
 	vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_ALL_GRAPHICS_BIT, frame->query_pool, timestamp_index_shading_end);
 	// Begin the next subpass and perform tonemapping
@@ -1902,6 +2579,20 @@ VkResult record_render_frame_commands(app_t* app, frame_workload_t* frame, uint3
 	vkCmdDraw(cmd, 3 * app->gui.used_triangle_counts[workload_index], 1, 0, 0);
 	// End the render pass
 	vkCmdEndRenderPass(cmd);
+	// Copy statistics for the host
+	statistics_barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	statistics_barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, NULL, 1, &statistics_barrier, 0, NULL);
+	VkBufferCopy statistics_copy = { .size = sizeof(frame_statistics_t) };
+	vkCmdCopyBuffer(cmd, app->scene_subpass.statistics.buffers[0].buffer, app->frame_workloads.statistics_readback.buffers[workload_index].buffer, 1, &statistics_copy);
+	VkBufferMemoryBarrier readback_barrier = {
+		.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+		.buffer = app->frame_workloads.statistics_readback.buffers[workload_index].buffer,
+		.size = VK_WHOLE_SIZE,
+		.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+		.dstAccessMask = VK_ACCESS_HOST_READ_BIT,
+	};
+	vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 0, NULL, 1, &readback_barrier, 0, NULL);
 	// End recording
 	if (ret = vkEndCommandBuffer(cmd))
 		return ret;
@@ -1927,10 +2618,27 @@ VkResult render_frame(app_t* app, app_update_t* update) {
 		printf("Failed to wait for a fence or to reset it. Vulkan error code %d.\n", ret);
 		return ret;
 	}
+	// The descriptor set of this workload is not in use anymore. If streaming
+	// has changed it for all frames, accumulation restarts.
+	if (update_scene_subpass_textures(&app->scene_subpass, device, &app->lit_scene.scene, workload_index))
+		app->render_targets.accum_frame_count = 0;
 	// Read queries of this workload from its last use
-	if (app->frame_workloads.frame_index >= FRAME_IN_FLIGHT_COUNT)
+	if (app->frame_workloads.frame_index >= FRAME_IN_FLIGHT_COUNT) {
 		if (vkGetQueryPoolResults(device->device, frame->query_pool, 0, timestamp_index_count, sizeof(uint64_t) * timestamp_index_count, app->frame_workloads.timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT))
 			printf("Failed to retrieve results of timestamp queries.\n");
+		// Read statistics of this workload from its last use
+		const buffer_t* readback = &app->frame_workloads.statistics_readback.buffers[workload_index];
+		VkMappedMemoryRange range = {
+			.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE,
+			.memory = app->frame_workloads.statistics_readback.allocation,
+			.offset = readback->memory_offset,
+			.size = readback->memory_size,
+		};
+		if (vkInvalidateMappedMemoryRanges(device->device, 1, &range))
+			printf("Failed to invalidate memory of a buffer for frame statistics.\n");
+		else
+			memcpy(&app->frame_workloads.statistics, (uint8_t*) app->frame_workloads.statistics_readback_data + readback->memory_offset, sizeof(frame_statistics_t));
+	}
 	// Acquire an image from the swapchain
 	uint32_t swapchain_image_index = 0;
 	if (ret = vkAcquireNextImageKHR(device->device, app->swapchain.swapchain, UINT64_MAX, frame->image_acquired, NULL, &swapchain_image_index)) {
@@ -2101,6 +2809,7 @@ int main(int argc, char** argv) {
 		.slide_screenshots = true,
 		.v_sync = true,
 		.gui = true,
+		.scene_cache_budget = SCENE_CACHE_BUDGET,
 	};
 	slideshow_t slideshow = { .slide_begin = 0 };
 	for (int i = 1; i < argc; ++i) {
@@ -2122,12 +2831,15 @@ int main(int argc, char** argv) {
 	// Main loop
 	while (true) {
 		app_update_t update = { false };
+		// Swap in scenes that have been loaded in the background
+		poll_background_loader(&app.background_loader, &update);
 		if (handle_user_input(&app, &update))
 			break;
 		// If an update is needed, the state of app objects is inconsistent
 		// with application state. The frame might look odd, so we do not
 		// render it.
 		if (!update_needed(&update)) {
+			stream_scene_textures(&app);
 			VkResult ret;
 			if (ret = render_frame(&app, &update)) {
 				if (ret == VK_ERROR_OUT_OF_DATE_KHR || ret == VK_ERROR_SURFACE_LOST_KHR || ret == VK_ERROR_FULL_SCREEN_EXCLUSIVE_MODE_LOST_EXT)
@@ -2,7 +2,9 @@
 #include "vulkan_basics.h"
 #include "scene.h"
 #include "camera.h"
+#include "light_tree.h"
 #include "nuklear.h"
+#include "threading.h"
 #include <stdbool.h>
 #include <stdio.h>
 
@@ -10,11 +12,27 @@
 //! The number of frames in flight, i.e. how many frames the host submits to
 //! the GPU before waiting for the oldest one to finish
 #define FRAME_IN_FLIGHT_COUNT 3
-//! The maximal number of spherical lights that can be placed in the scene.
-//! When changing this, also change the array size in shaders/constants.glsl.
-#define MAX_SPHERICAL_LIGHT_COUNT 32
+//! The maximal number of materials in a scene. Material indices are stored as
+//! 8-bit integers. The scene subpass binds an array of textures of this size
+//! once, such that its shaders do not depend on the scene.
+#define MAX_MATERIAL_COUNT 256
 //! The maximal number of slides
 #define MAX_SLIDE_COUNT 100
+//! The number of bytes of texture data that may be streamed to the GPU per
+//! frame, while finer mipmaps of a newly loaded scene are still missing
+#define TEXTURE_STREAMING_BYTES_PER_FRAME (32 << 20)
+//! The directory in which serialized acceleration structures are cached
+#define BVH_CACHE_PATH "data/bvh_cache"
+//! The default for app_params_t::scene_cache_budget
+#define SCENE_CACHE_BUDGET (4ull << 30)
+//! The number of invocations per workgroup in the compute shaders of the
+//! wavefront path tracer
+#define WAVEFRONT_GROUP_SIZE 64
+//! The size in bytes of path_state_t in shaders/wavefront.glsl
+#define WAVEFRONT_PATH_STATE_SIZE 112
+//! The number of queues used by the wavefront path tracer (two for rays that
+//! alternate between path vertices and one for shadow rays)
+#define WAVEFRONT_QUEUE_COUNT 3
 
 
 //! An enumeration of available scenes (i.e. *.vks files)
@@ -89,6 +107,9 @@ typedef enum {
 	sampling_strategy_brdf,
 	//! Next event estimation
 	sampling_strategy_nee,
+	//! Next event estimation with the same estimator but using a wavefront
+	//! path tracer made of compute shaders instead of a single fragment shader
+	sampling_strategy_nee_wavefront,
 	//! The number of different sampling strategies
 	sampling_strategy_count,
 } sampling_strategy_t;
@@ -102,6 +123,14 @@ typedef struct {
 	//! The maximal number of vertices along a path, excluding the one at the
 	//! eye
 	uint32_t path_length;
+	//! If this is greater than 0, paths get terminated stochastically with
+	//! Russian roulette based on the luminance of their throughput weight.
+	//! It is only applied when continuing paths from vertices with at least
+	//! this index (1 for the first vertex after the eye).
+	uint32_t russian_roulette_min_depth;
+	//! If this is greater than 1, paths traced with sampling_strategy_nee get
+	//! split into this many continuations at their first diffuse vertex
+	uint32_t split_count;
 } render_settings_t;
 
 
@@ -161,6 +190,9 @@ typedef struct {
 	bool gui;
 	//! Whether vertical synchronization should be enabled
 	bool v_sync;
+	//! The number of bytes of device memory that the current scene and
+	//! scenes in the scene cache may use together
+	VkDeviceSize scene_cache_budget;
 } app_params_t;
 
 
@@ -250,9 +282,9 @@ typedef struct {
 	float sky_radiance[3];
 	float pad_5;
 	float emission_material_radiance[3];
-	float pad_6;
+	uint32_t emission_material_index;
+	uint32_t spherical_light_count, indexed_mesh, material_count, pad_6;
 	float params[4];
-	float spherical_lights[MAX_SPHERICAL_LIGHT_COUNT][4];
 } constants_t;
 
 
@@ -274,15 +306,71 @@ typedef struct {
 //! The triangle mesh that is being displayed and a specification of the light
 //! sources in this scene
 typedef struct {
+	//! The scene file from which this scene has been loaded
+	scene_file_t scene_file;
 	//! The triangle mesh that is being displayed
 	scene_t scene;
+	//! The index of the material called _emission or 0 if there is none
+	uint32_t emission_material_index;
 	//! The number of spherical lights placed in the scene
 	uint32_t spherical_light_count;
-	//! Positions and radii of all spherical lights
-	float spherical_lights[MAX_SPHERICAL_LIGHT_COUNT][4];
+	//! Two storage buffers: Positions and radii of all spherical lights and
+	//! the nodes of a light tree over them (see light_tree_node_t). Each holds
+	//! at least one entry, even if there are no lights.
+	buffers_t light_buffers;
 } lit_scene_t;
 
 
+/*! Loads a lit scene on a worker thread while the previously loaded scene
+	keeps being rendered. Once the worker has finished, update_app() swaps the
+	new scene in between two frames.*/
+typedef struct {
+	//! The worker thread or NULL if no scene is being loaded
+	thread_t* thread;
+	//! A copy of the application device with its own queue and command pool
+	//! for use on the worker thread
+	device_t device;
+	//! A copy of the scene specification at the time loading began
+	scene_spec_t scene_spec;
+	//! The texture registry from the scene cache of the app
+	texture_registry_t* texture_registry;
+	//! The scene being loaded. Only the worker thread accesses it while thread
+	//! is not NULL.
+	lit_scene_t lit_scene;
+	//! Set once the worker has finished successfully and lit_scene is ready to
+	//! be swapped in
+	bool ready;
+} background_loader_t;
+
+
+//! A lit scene held by scene_cache_t
+typedef struct {
+	//! The resident scene
+	lit_scene_t lit_scene;
+	//! The value of scene_cache_t::use_count when this scene was last used
+	uint64_t last_use;
+} cached_scene_t;
+
+
+/*! Keeps recently used lit scenes resident in device memory, such that
+	switching back to them does not require loading them again. Once the
+	budget is exceeded, the least recently used scenes get evicted. Scenes
+	that use the same texture files share them.*/
+typedef struct {
+	//! Textures that are shared among all loaded scenes
+	texture_registry_t texture_registry;
+	//! The scenes that are resident but not in use. There is at most one
+	//! entry per scene file.
+	cached_scene_t entries[scene_file_count];
+	//! The number of valid entries in entries
+	uint32_t entry_count;
+	//! Incremented whenever a scene enters the cache
+	uint64_t use_count;
+	//! \see app_params_t::scene_cache_budget
+	VkDeviceSize budget;
+} scene_cache_t;
+
+
 //! The render pass that performs all rasterization work for rendering one
 //! frame of the application and the framebuffers that it uses
 typedef struct {
@@ -296,20 +384,93 @@ typedef struct {
 } render_pass_t;
 
 
+//! The compute shaders that make up the wavefront path tracer. They run in
+//! this order, where extend, shade and connect are repeated once per bounce.
+typedef enum {
+	//! Generates primary rays and initializes path states
+	wavefront_kernel_raygen,
+	//! Traces all queued rays to find the next path vertex
+	wavefront_kernel_extend,
+	//! Evaluates emission, samples lights and the BRDF and queues new rays
+	wavefront_kernel_shade,
+	//! Traces all queued shadow rays and adds light contributions
+	wavefront_kernel_connect,
+	//! The number of kernels
+	wavefront_kernel_count,
+} wavefront_kernel_t;
+
+
+//! The header of a queue of the wavefront path tracer. Mirrors queue_header_t
+//! in shaders/wavefront.glsl.
+typedef struct {
+	//! Arguments for vkCmdDispatchIndirect()
+	uint32_t group_count[3];
+	//! The number of queued paths
+	uint32_t count;
+} wavefront_queue_header_t;
+
+
+//! The beginning of the buffer holding the queues of the wavefront path
+//! tracer. The entries of all queues follow.
+typedef struct {
+	//! The headers for all queues
+	wavefront_queue_header_t headers[WAVEFRONT_QUEUE_COUNT];
+	//! The index of the path vertex found by the current bounce
+	uint32_t depth;
+	//! Unused, only here for alignment
+	uint32_t padding[3];
+} wavefront_queues_header_t;
+
+
+//! Statistics gathered on the GPU while rendering a frame. Mirrors the
+//! statistics buffer in shaders/path_tracing.glsl.
+typedef struct {
+	//! The number of traced rays, including shadow rays
+	uint32_t ray_count;
+	//! The number of traced paths, i.e. the number of pixels
+	uint32_t path_count;
+	//! The number of path vertices found along all paths (excluding the
+	//! vertex at the eye). Divide by path_count to get the average path
+	//! length.
+	uint32_t path_vertex_count;
+} frame_statistics_t;
+
+
 //! The objects needed for a subpass that renders the scene
 typedef struct {
 	//! A sampler for material textures
 	VkSampler sampler;
-	//! The descriptor set used to render the scene
+	//! One descriptor set per frame in flight used to render the scene. All
+	//! of them are written identically, but texture descriptors of one set
+	//! can be updated while frames using the others are still in flight.
 	descriptor_sets_t descriptor_set;
+	//! For each frame in flight, whether its descriptor set still refers to
+	//! texture views that streaming has replaced
+	bool outdated_textures[FRAME_IN_FLIGHT_COUNT];
+	//! The number of texture views that streaming has replaced
+	uint32_t retired_view_count;
+	//! Texture views that streaming has replaced. They are destroyed once no
+	//! descriptor set refers to them anymore.
+	VkImageView* retired_views;
 	//! A graphics pipelines used to render the scene, which discards the
 	//! current contents of the render target
 	VkPipeline pipeline_discard;
 	//! Like pipeline_discard but adds onto the current contents of the render
 	//! target for the purpose of progressive rendering
 	VkPipeline pipeline_accum;
-	//! The fragment and vertex shaders used to render the scene
+	//! The fragment and vertex shaders used to render the scene. For the
+	//! wavefront path tracer, the fragment shader only outputs its results.
 	VkShaderModule vert_shader, frag_shader;
+	//! Storage for path states and queues of the wavefront path tracer. Only
+	//! created if it is used.
+	buffers_t wavefront_buffers;
+	//! A single buffer of type frame_statistics_t, which is reset and copied
+	//! to frame_workload_t::statistics_readback each frame
+	buffers_t statistics;
+	//! The compute shaders and pipelines of the wavefront path tracer (if it
+	//! is used)
+	VkShaderModule wavefront_shaders[wavefront_kernel_count];
+	VkPipeline wavefront_pipelines[wavefront_kernel_count];
 } scene_subpass_t;
 
 
@@ -375,6 +536,13 @@ typedef struct {
 	uint64_t frame_index;
 	//! The most recently retrieved values of GPU timestamps
 	uint64_t timestamps[timestamp_index_count];
+	//! Host-visible buffers of type frame_statistics_t, one per frame in
+	//! flight, to which scene_subpass_t::statistics is copied
+	buffers_t statistics_readback;
+	//! The mapped memory of statistics_readback
+	void* statistics_readback_data;
+	//! The most recently retrieved statistics
+	frame_statistics_t statistics;
 } frame_workloads_t;
 
 
@@ -396,7 +564,11 @@ typedef struct {
 	swapchain_t swapchain;
 	render_targets_t render_targets;
 	constant_buffers_t constant_buffers;
+	//! Holds scenes that have been used recently and shared textures
+	scene_cache_t scene_cache;
 	lit_scene_t lit_scene;
+	//! Used to load a new lit_scene without blocking rendering
+	background_loader_t background_loader;
 	render_pass_t render_pass;
 	scene_subpass_t scene_subpass;
 	tonemap_subpass_t tonemap_subpass;
@@ -409,7 +581,7 @@ typedef struct {
 	the boolean is true, the object and all objects that depend on it will be
 	freed and recreated by update_app().*/
 typedef struct {
-	bool device, window, gui, swapchain, render_targets, constant_buffers, lit_scene, render_pass, scene_subpass, tonemap_subpass, gui_subpass, frame_workloads;
+	bool device, window, gui, swapchain, render_targets, constant_buffers, scene_cache, lit_scene, render_pass, scene_subpass, tonemap_subpass, gui_subpass, frame_workloads;
 } app_update_t;
 
 
@@ -519,14 +691,68 @@ void free_constant_buffers(constant_buffers_t* constant_buffers, const device_t*
 int write_constant_buffer(constant_buffers_t* constant_buffers, const app_t* app, uint32_t buffer_index);
 
 
+/*! Loads spherical lights from the given *.lights file, builds a light tree
+	over them and uploads both to lit_scene->light_buffers. If the file does
+	not exist, there are no lights.
+	\return 0 upon success.*/
+int create_light_buffers(lit_scene_t* lit_scene, const device_t* device, const char* lights_path);
+
+
 //! Forwards to load_scene() using parameters that are appropriate for the
-//! given scene specification and additionally loads light sources
-int create_lit_scene(lit_scene_t* lit_scene, const device_t* device, const scene_spec_t* scene_spec);
+//! given scene specification and additionally loads light sources. Textures
+//! are shared through the given registry (which may be NULL).
+int create_lit_scene(lit_scene_t* lit_scene, const device_t* device, const scene_spec_t* scene_spec, texture_registry_t* texture_registry);
 
 
 void free_lit_scene(lit_scene_t* lit_scene, const device_t* device);
 
 
+//! \see scene_cache_t
+int create_scene_cache(scene_cache_t* cache, VkDeviceSize budget);
+
+
+//! Frees all scenes in the cache. Scenes outside the cache that share
+//! textures through it must have been freed before.
+void free_scene_cache(scene_cache_t* cache, const device_t* device);
+
+
+/*! Moves the given lit scene into the cache. If the cache already holds a
+	scene for the same scene file or if the given scene is empty, the given
+	scene is freed instead. Either way, lit_scene is zeroed.*/
+void stash_lit_scene(scene_cache_t* cache, lit_scene_t* lit_scene, const device_t* device);
+
+
+//! If the cache holds a lit scene for the given scene file, it gets moved to
+//! lit_scene and the function returns true. Otherwise, it returns false.
+bool take_cached_lit_scene(scene_cache_t* cache, lit_scene_t* lit_scene, scene_file_t scene_file);
+
+
+/*! Evicts least recently used scenes from the cache until the scenes in the
+	cache, together with the given scene that is in use (may be NULL), fit
+	into the budget. Each texture batch is counted once.*/
+void evict_cached_lit_scenes(scene_cache_t* cache, const lit_scene_t* current, const device_t* device);
+
+
+/*! Starts a worker thread that invokes create_lit_scene() for the given scene
+	specification.
+	\param loader The output. Clean up with free_background_loader().
+	\param device Output of create_device(). Needs a background queue.
+	\param scene_spec The scene specification. It is copied.
+	\param texture_registry Passed to create_lit_scene(). Must stay valid until
+		the loader has been freed.
+	\return 0 upon success.*/
+int start_background_loader(background_loader_t* loader, const device_t* device, const scene_spec_t* scene_spec, texture_registry_t* texture_registry);
+
+
+//! Checks whether the worker of the given loader has finished. If so, it sets
+//! update->lit_scene such that update_app() swaps in the new scene.
+void poll_background_loader(background_loader_t* loader, app_update_t* update);
+
+
+//! Waits for the worker thread (if any) and frees the scene it has loaded
+void free_background_loader(background_loader_t* loader);
+
+
 //! \see render_pass_t
 int create_render_pass(render_pass_t* render_pass, const device_t* device, const swapchain_t* swapchain, const render_targets_t* targets);
 
@@ -541,6 +767,40 @@ int create_scene_subpass(scene_subpass_t* subpass, const device_t* device, const
 void free_scene_subpass(scene_subpass_t* subpass, const device_t* device);
 
 
+//! Updates the descriptors in the descriptor set with the given index of the
+//! given scene subpass that refer to material textures of the given scene,
+//! e.g. because views have been recreated. The descriptor set must not be in
+//! use by the device.
+void write_scene_subpass_textures(const scene_subpass_t* subpass, const device_t* device, const scene_t* scene, uint32_t set_index);
+
+
+/*! Brings texture descriptors of the scene subpass up to date after
+	streaming has replaced views. Once no descriptor set refers to replaced
+	views anymore, they are destroyed.
+	\param workload_index The index of the frame in flight whose descriptor
+		set should be updated. Its previous work must have finished.
+		FRAME_IN_FLIGHT_COUNT to update all descriptor sets, which requires
+		the queue to be idle.
+	\return true iff all descriptor sets have just become up to date.*/
+bool update_scene_subpass_textures(scene_subpass_t* subpass, const device_t* device, const scene_t* scene, uint32_t workload_index);
+
+
+//! Updates all descriptors of the given scene subpass that refer to the given
+//! scene, i.e. material textures, the BVH, mesh buffers and light buffers.
+//! Thus, the subpass can be reused when the scene changes. The descriptor set
+//! must not be in use by the device.
+void write_scene_subpass_scene(const scene_subpass_t* subpass, const device_t* device, const lit_scene_t* lit_scene);
+
+
+/*! Loads finer mipmaps for the textures of the current scene of the given app
+	if some are still missing. It never waits for the device, except during
+	slideshows, where all remaining mipmaps are loaded at once. Once views
+	change, the descriptor sets of all frames in flight are marked as
+	outdated and update_scene_subpass_textures() updates them. Once all
+	mipmaps are there or something fails, the texture stream gets freed.*/
+void stream_scene_textures(app_t* app);
+
+
 //! \see tonemap_subpass_t
 int create_tonemap_subpass(tonemap_subpass_t* subpass, const device_t* device, const render_targets_t* render_targets, const constant_buffers_t* constant_buffers, const render_pass_t* render_pass, const scene_spec_t* scene_spec);
 
@@ -613,8 +873,9 @@ int handle_user_input(app_t* app, app_update_t* update);
 	\param update Used to report required updates.
 	\param render_targets Used to query the sample count.
 	\param timestamps The timestamps from frame_workloads_t.
-	\param timestamp_period The value from VkPhysicalDeviceLimits::timestampPeriod.*/
-void define_gui(struct nk_context* ctx, scene_spec_t* scene_spec, render_settings_t* render_settings, app_update_t* update, const render_targets_t* render_targets, uint64_t timestamps[timestamp_index_count], float timestamp_period);
+	\param timestamp_period The value from VkPhysicalDeviceLimits::timestampPeriod.
+	\param statistics The statistics from frame_workloads_t.*/
+void define_gui(struct nk_context* ctx, scene_spec_t* scene_spec, render_settings_t* render_settings, app_update_t* update, const render_targets_t* render_targets, uint64_t timestamps[timestamp_index_count], float timestamp_period, const frame_statistics_t* statistics);
 
 
 /*! Updates constant buffers, takes care of synchronization, renders a single
@@ -0,0 +1,230 @@
+#include "mesh_quantization.h"
+#include "threading.h"
+#include <stddef.h>
+
+// The SIMD kernels are available on x86 with GCC, Clang and MSVC. The AVX2
+// kernel gets compiled for AVX2 regardless of compiler flags and is only used
+// if the CPU supports it.
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define DEQUANTIZATION_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define TARGET_AVX2
+#else
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#else
+#define DEQUANTIZATION_X86 0
+#endif
+
+
+//! Dequantization tasks cover this many vertices each
+#define DEQUANTIZATION_BLOCK_SIZE (1 << 16)
+
+
+//! Dequantizes vertex positions one at a time. It is also used for the
+//! remainder of vertices that the SIMD kernels do not handle.
+void dequantize_positions_scalar(float* positions, const uint32_t* quantized_positions, uint64_t vertex_count, const float factor[3], const float summand[3]) {
+	for (uint64_t i = 0; i != vertex_count; ++i) {
+		uint32_t a = quantized_positions[2 * i + 0];
+		uint32_t b = quantized_positions[2 * i + 1];
+		float pos[3] = {
+			(float) (a & 0x1fffff),
+			(float) (((a & 0xffe00000) >> 21) | ((b & 0x3ff) << 11)),
+			(float) ((b & 0x7ffffc00) >> 10),
+		};
+		for (uint32_t j = 0; j != 3; ++j)
+			positions[3 * i + j] = pos[j] * factor[j] + summand[j];
+	}
+}
+
+
+#if DEQUANTIZATION_X86
+/*! Dequantizes vertex positions four at a time using SSE2. The arithmetic
+	matches dequantize_positions_scalar() exactly: Integers below 2^21 convert
+	to floats without rounding and we use a separate multiply and add, no
+	FMA.*/
+void dequantize_positions_sse2(float* positions, const uint32_t* quantized_positions, uint64_t vertex_count, const float factor[3], const float summand[3]) {
+	const __m128i mask_21 = _mm_set1_epi32(0x1fffff);
+	const __m128i mask_10 = _mm_set1_epi32(0x3ff);
+	__m128 factors[3], summands[3];
+	for (uint32_t j = 0; j != 3; ++j) {
+		factors[j] = _mm_set1_ps(factor[j]);
+		summands[j] = _mm_set1_ps(summand[j]);
+	}
+	uint64_t simd_count = vertex_count & ~(uint64_t) 3;
+	for (uint64_t i = 0; i != simd_count; i += 4) {
+		// Separate the two 32-bit halves of four vertices
+		__m128 lo = _mm_loadu_ps((const float*) (quantized_positions + 2 * i + 0));
+		__m128 hi = _mm_loadu_ps((const float*) (quantized_positions + 2 * i + 4));
+		__m128i a = _mm_castps_si128(_mm_shuffle_ps(lo, hi, _MM_SHUFFLE(2, 0, 2, 0)));
+		__m128i b = _mm_castps_si128(_mm_shuffle_ps(lo, hi, _MM_SHUFFLE(3, 1, 3, 1)));
+		// Unpack 21-bit integers, convert and apply the affine map
+		__m128i xyz_int[3] = {
+			_mm_and_si128(a, mask_21),
+			_mm_or_si128(_mm_srli_epi32(a, 21), _mm_slli_epi32(_mm_and_si128(b, mask_10), 11)),
+			_mm_and_si128(_mm_srli_epi32(b, 10), mask_21),
+		};
+		__m128 xyz[3];
+		for (uint32_t j = 0; j != 3; ++j)
+			xyz[j] = _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(xyz_int[j]), factors[j]), summands[j]);
+		// Interleave: x0 y0 z0 x1 | y1 z1 x2 y2 | z2 x3 y3 z3
+		__m128 xy = _mm_shuffle_ps(xyz[0], xyz[1], _MM_SHUFFLE(2, 0, 2, 0));
+		__m128 yz = _mm_shuffle_ps(xyz[1], xyz[2], _MM_SHUFFLE(3, 1, 3, 1));
+		__m128 zx = _mm_shuffle_ps(xyz[2], xyz[0], _MM_SHUFFLE(3, 1, 2, 0));
+		_mm_storeu_ps(positions + 3 * i + 0, _mm_shuffle_ps(xy, zx, _MM_SHUFFLE(2, 0, 2, 0)));
+		_mm_storeu_ps(positions + 3 * i + 4, _mm_shuffle_ps(yz, xy, _MM_SHUFFLE(3, 1, 2, 0)));
+		_mm_storeu_ps(positions + 3 * i + 8, _mm_shuffle_ps(zx, yz, _MM_SHUFFLE(3, 1, 3, 1)));
+	}
+	dequantize_positions_scalar(positions + 3 * simd_count, quantized_positions + 2 * simd_count, vertex_count - simd_count, factor, summand);
+}
+
+
+//! Like dequantize_positions_sse2() but using AVX2 for eight vertices at a
+//! time
+TARGET_AVX2 void dequantize_positions_avx2(float* positions, const uint32_t* quantized_positions, uint64_t vertex_count, const float factor[3], const float summand[3]) {
+	const __m256i mask_21 = _mm256_set1_epi32(0x1fffff);
+	const __m256i mask_10 = _mm256_set1_epi32(0x3ff);
+	__m256 factors[3], summands[3];
+	for (uint32_t j = 0; j != 3; ++j) {
+		factors[j] = _mm256_set1_ps(factor[j]);
+		summands[j] = _mm256_set1_ps(summand[j]);
+	}
+	uint64_t simd_count = vertex_count & ~(uint64_t) 7;
+	for (uint64_t i = 0; i != simd_count; i += 8) {
+		// Separate the two 32-bit halves of eight vertices. Shuffles operate
+		// within 128-bit lanes, so the order of 64-bit pairs needs fixing.
+		__m256 lo = _mm256_loadu_ps((const float*) (quantized_positions + 2 * i + 0));
+		__m256 hi = _mm256_loadu_ps((const float*) (quantized_positions + 2 * i + 8));
+		__m256i a = _mm256_castps_si256(_mm256_shuffle_ps(lo, hi, _MM_SHUFFLE(2, 0, 2, 0)));
+		__m256i b = _mm256_castps_si256(_mm256_shuffle_ps(lo, hi, _MM_SHUFFLE(3, 1, 3, 1)));
+		a = _mm256_permute4x64_epi64(a, _MM_SHUFFLE(3, 1, 2, 0));
+		b = _mm256_permute4x64_epi64(b, _MM_SHUFFLE(3, 1, 2, 0));
+		// Unpack 21-bit integers, convert and apply the affine map
+		__m256i xyz_int[3] = {
+			_mm256_and_si256(a, mask_21),
+			_mm256_or_si256(_mm256_srli_epi32(a, 21), _mm256_slli_epi32(_mm256_and_si256(b, mask_10), 11)),
+			_mm256_and_si256(_mm256_srli_epi32(b, 10), mask_21),
+		};
+		__m256 xyz[3];
+		for (uint32_t j = 0; j != 3; ++j)
+			xyz[j] = _mm256_add_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(xyz_int[j]), factors[j]), summands[j]);
+		// Interleave within each lane as in the SSE2 kernel, then combine
+		// lanes
+		__m256 xy = _mm256_shuffle_ps(xyz[0], xyz[1], _MM_SHUFFLE(2, 0, 2, 0));
+		__m256 yz = _mm256_shuffle_ps(xyz[1], xyz[2], _MM_SHUFFLE(3, 1, 3, 1));
+		__m256 zx = _mm256_shuffle_ps(xyz[2], xyz[0], _MM_SHUFFLE(3, 1, 2, 0));
+		__m256 out_0 = _mm256_shuffle_ps(xy, zx, _MM_SHUFFLE(2, 0, 2, 0));
+		__m256 out_1 = _mm256_shuffle_ps(yz, xy, _MM_SHUFFLE(3, 1, 2, 0));
+		__m256 out_2 = _mm256_shuffle_ps(zx, yz, _MM_SHUFFLE(3, 1, 3, 1));
+		_mm256_storeu_ps(positions + 3 * i + 0, _mm256_permute2f128_ps(out_0, out_1, 0x20));
+		_mm256_storeu_ps(positions + 3 * i + 8, _mm256_permute2f128_ps(out_2, out_0, 0x30));
+		_mm256_storeu_ps(positions + 3 * i + 16, _mm256_permute2f128_ps(out_1, out_2, 0x31));
+	}
+	dequantize_positions_scalar(positions + 3 * simd_count, quantized_positions + 2 * simd_count, vertex_count - simd_count, factor, summand);
+}
+#endif
+
+
+bool is_dequantization_kernel_supported(dequantization_kernel_t kernel) {
+	switch (kernel) {
+		case dequantization_kernel_scalar:
+			return true;
+#if DEQUANTIZATION_X86
+		case dequantization_kernel_sse2:
+			return true;
+		case dequantization_kernel_avx2: {
+#ifdef _MSC_VER
+			// AVX2 needs support by the CPU and the OS has to save YMM
+			// registers
+			int info[4];
+			__cpuid(info, 0);
+			if (info[0] < 7)
+				return false;
+			__cpuid(info, 1);
+			bool os_saves_ymm = (info[2] & (1 << 27)) && (info[2] & (1 << 28)) && ((_xgetbv(0) & 6) == 6);
+			__cpuidex(info, 7, 0);
+			return os_saves_ymm && (info[1] & (1 << 5));
+#else
+			__builtin_cpu_init();
+			return __builtin_cpu_supports("avx2");
+#endif
+		}
+#endif
+		default:
+			return false;
+	}
+}
+
+
+dequantization_kernel_t get_best_dequantization_kernel() {
+	dequantization_kernel_t best = dequantization_kernel_scalar;
+	for (uint32_t i = 0; i != dequantization_kernel_count; ++i)
+		if (is_dequantization_kernel_supported((dequantization_kernel_t) i))
+			best = (dequantization_kernel_t) i;
+	return best;
+}
+
+
+const char* get_dequantization_kernel_name(dequantization_kernel_t kernel) {
+	switch (kernel) {
+		case dequantization_kernel_scalar: return "scalar";
+		case dequantization_kernel_sse2: return "SSE2";
+		case dequantization_kernel_avx2: return "AVX2";
+		default: return "unknown";
+	}
+}
+
+
+//! Shared state for dequantize_block_task()
+typedef struct {
+	//! \see dequantize_positions()
+	float* positions;
+	const uint32_t* quantized_positions;
+	uint64_t vertex_count;
+	const float* factor;
+	const float* summand;
+	dequantization_kernel_t kernel;
+} dequantize_positions_t;
+
+
+//! A task for run_parallel() that dequantizes the block of
+//! DEQUANTIZATION_BLOCK_SIZE vertices with the given index using a
+//! dequantize_positions_t as context
+int dequantize_block_task(void* raw_dequantize, uint32_t block_index) {
+	const dequantize_positions_t* dequantize = (const dequantize_positions_t*) raw_dequantize;
+	uint64_t begin = (uint64_t) block_index * DEQUANTIZATION_BLOCK_SIZE;
+	uint64_t count = dequantize->vertex_count - begin;
+	count = (count < DEQUANTIZATION_BLOCK_SIZE) ? count : DEQUANTIZATION_BLOCK_SIZE;
+	float* positions = dequantize->positions + 3 * begin;
+	const uint32_t* quantized_positions = dequantize->quantized_positions + 2 * begin;
+	switch (dequantize->kernel) {
+#if DEQUANTIZATION_X86
+		case dequantization_kernel_sse2:
+			dequantize_positions_sse2(positions, quantized_positions, count, dequantize->factor, dequantize->summand);
+			break;
+		case dequantization_kernel_avx2:
+			dequantize_positions_avx2(positions, quantized_positions, count, dequantize->factor, dequantize->summand);
+			break;
+#endif
+		default:
+			dequantize_positions_scalar(positions, quantized_positions, count, dequantize->factor, dequantize->summand);
+			break;
+	}
+	return 0;
+}
+
+
+void dequantize_positions(float* positions, const uint32_t* quantized_positions, uint64_t vertex_count, const float factor[3], const float summand[3], dequantization_kernel_t kernel, uint32_t thread_count) {
+	dequantize_positions_t dequantize = {
+		.positions = positions,
+		.quantized_positions = quantized_positions,
+		.vertex_count = vertex_count,
+		.factor = factor,
+		.summand = summand,
+		.kernel = kernel,
+	};
+	uint32_t block_count = (uint32_t) ((vertex_count + DEQUANTIZATION_BLOCK_SIZE - 1) / DEQUANTIZATION_BLOCK_SIZE);
+	run_parallel(&dequantize_block_task, &dequantize, block_count, thread_count);
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+
+//! Implementations of dequantize_positions(), which differ in the used
+//! instruction set but produce identical results
+typedef enum {
+	//! Portable C code that handles one vertex at a time
+	dequantization_kernel_scalar,
+	//! SSE2 code that handles four vertices at a time (x86 only)
+	dequantization_kernel_sse2,
+	//! AVX2 code that handles eight vertices at a time (x86 only)
+	dequantization_kernel_avx2,
+	//! The number of available kernels
+	dequantization_kernel_count,
+} dequantization_kernel_t;
+
+
+//! \return The fastest kernel that is supported by this build and by the CPU
+//!		at hand
+dequantization_kernel_t get_best_dequantization_kernel();
+
+
+//! \return true iff the given kernel can be used on this CPU
+bool is_dequantization_kernel_supported(dequantization_kernel_t kernel);
+
+
+//! \return A human-readable name for the given kernel
+const char* get_dequantization_kernel_name(dequantization_kernel_t kernel);
+
+
+/*! Turns vertex positions from the 64-bit quantized representation of the
+	*.vks format into floats, just like dequantize_position() in
+	shaders/mesh_quantization.glsl.
+	\param positions Output array of 3 * vertex_count floats (xyzxyz...).
+	\param quantized_positions Array of 2 * vertex_count integers holding 21
+		bits per coordinate.
+	\param vertex_count The number of vertices to dequantize.
+	\param factor, summand Dequantization constants from the scene file
+		header. Quantized integer coordinates get multiplied by factor,
+		followed by addition of summand.
+	\param kernel The implementation to use. It must be supported.
+	\param thread_count The maximal number of threads to use or 0 to use all
+		logical processors.*/
+void dequantize_positions(float* positions, const uint32_t* quantized_positions, uint64_t vertex_count, const float factor[3], const float summand[3], dequantization_kernel_t kernel, uint32_t thread_count);
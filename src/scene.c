@@ -1,6 +1,11 @@
 #include "scene.h"
 #include "textures.h"
 #include "string_utilities.h"
+#include "file_mapping.h"
+#include "chunked_payload.h"
+#include "hashing.h"
+#include "mesh_quantization.h"
+#include <stddef.h>
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -12,47 +17,101 @@ typedef struct {
 	const device_t* device;
 	//! A pointer to the scene being loaded or NULL once it is loaded
 	scene_t* scene;
-	//! A temporary copy of the quantized positions
-	uint32_t* quantized_poss;
+	//! Pointers into the mapped scene file (or into the decompressed payload)
+	//! for each mesh buffer
+	const void* mesh_data[mesh_buffer_type_count];
+	//! The quantized positions, pointing into the mapped scene file
+	const uint32_t* quantized_poss;
 	//! One buffer for geometry/instance data per BVH level
 	buffers_t geometry_buffers;
 	//! Scratch memory buffers for acceleration structure build
 	buffers_t scratch_buffers;
 	//! The command buffer used to record build commands
 	VkCommandBuffer cmd;
-	//! The file from which the scene is being loaded
-	FILE* file;
+	//! The memory-mapped file from which the scene is being loaded
+	file_mapping_t file;
+	//! The chunk table for compressed scene files
+	chunked_payload_t compressed_payload;
+	//! For compressed scene files, the complete decompressed payload
+	uint8_t* decompressed_payload;
+	//! hash_bytes() for the complete scene file, if BVH caching is enabled
+	uint64_t scene_hash;
+	//! The path of the file that caches the serialized bottom-level
+	//! acceleration structure for this scene on this device or NULL if
+	//! caching is disabled
+	char* bvh_cache_file_path;
+	//! The serialized bottom-level acceleration structure from the cache file
+	//! or NULL if there was no compatible cache entry. In the latter case,
+	//! the bottom level gets built from scratch.
+	uint8_t* serialized_blas;
+	//! The size of serialized_blas in bytes
+	uint64_t serialized_blas_size;
+	//! A buffer holding the serialized bottom-level acceleration structure
+	//! during deserialization or serialization
+	buffers_t serialized_buffers;
+	//! A query pool for the size of the serialized acceleration structure
+	VkQueryPool query_pool;
+	//! A query pool for the size of the compacted bottom-level acceleration
+	//! structure
+	VkQueryPool compaction_query_pool;
+	//! The bottom-level acceleration structure before compaction and its
+	//! buffer. They are kept until the compacting copy has finished.
+	VkAccelerationStructureKHR uncompacted_blas;
+	buffers_t uncompacted_buffers;
 } scene_loader_t;
 
 
+//! The header of a file that caches a serialized bottom-level acceleration
+//! structure. It is followed by the data that
+//! vkCmdCopyAccelerationStructureToMemoryKHR() wrote.
+typedef struct {
+	//! Should be 0xb1a5ca to mark the file as a BVH cache file
+	uint32_t marker;
+	//! Should be 1
+	uint32_t version;
+	//! hash_bytes() for the complete scene file
+	uint64_t scene_hash;
+	//! VkPhysicalDeviceIDProperties::deviceUUID and driverUUID of the device
+	//! that serialized the acceleration structure
+	uint8_t device_uuid[VK_UUID_SIZE], driver_uuid[VK_UUID_SIZE];
+	//! VkPhysicalDeviceProperties::driverVersion of this device
+	uint32_t driver_version;
+	//! Zero
+	uint32_t padding;
+	//! The size of the serialized acceleration structure in bytes
+	uint64_t serialized_size;
+} bvh_cache_header_t;
+
+
+/*! Serialized acceleration structures begin with a header of this size. It
+	holds the version data for vkGetDeviceAccelerationStructureCompatibilityKHR()
+	(2 * VK_UUID_SIZE bytes), followed by the serialized size, the deserialized
+	size and the number of bottom-level handles as uint64_t.*/
+#define BVH_SERIALIZATION_HEADER_SIZE (2 * VK_UUID_SIZE + 3 * sizeof(uint64_t))
+
+
+//! Serialized acceleration structures have to be 256-byte aligned
+#define BVH_SERIALIZATION_ALIGNMENT 256
+
+
 void free_scene_loader(scene_loader_t* loader, const device_t* device);
 
 
 //! Callback for fill_buffers() to write geometry data for BVHs
-void write_geometry_buffers(void* buffer_data, uint32_t buffer_index, VkDeviceSize buffer_size, const void* context) {
+void write_geometry_buffers(void* buffer_data, uint32_t buffer_index, VkDeviceSize offset, VkDeviceSize size, const void* context) {
 	const scene_loader_t* loader = (const scene_loader_t*) context;
 	const scene_t* scene = loader->scene;
 	const device_t* device = loader->device;
 	switch (buffer_index) {
 		case bvh_level_bottom: {
-			// Dequantize all vertex positions
-			scene_file_header_t header = scene->header;
-			uint32_t vertex_count = 3 * scene->header.triangle_count;
-			const uint32_t* src = loader->quantized_poss;
-			float* dst = (float*) buffer_data;
-			for (uint32_t i = 0; i != vertex_count; ++i) {
-				uint32_t a = src[2 * i + 0];
-				uint32_t b = src[2 * i + 1];
-				float pos[3] = {
-					(float) (a & 0x1fffff),
-					(float) (((a & 0xffe00000) >> 21) | ((b & 0x3ff) << 11)),
-					(float) ((b & 0x7ffffc00) >> 10),
-				};
-				for (uint32_t j = 0; j != 3; ++j) {
-					(*dst) = pos[j] * header.dequantization_factor[j] + header.dequantization_summand[j];
-					++dst;
-				}
-			}
+			// A deserialized bottom level does not need vertex positions
+			if (loader->serialized_blas)
+				break;
+			// Dequantize the vertex positions in this range using SIMD on all
+			// cores. The range granularity is a multiple of the 12-byte stride.
+			const scene_file_header_t* header = &scene->header;
+			uint64_t first_vertex = offset / (3 * sizeof(float));
+			dequantize_positions((float*) buffer_data, loader->quantized_poss + 2 * first_vertex, size / (3 * sizeof(float)), header->dequantization_factor, header->dequantization_summand, get_best_dequantization_kernel(), 0);
 			break;
 		}
 		case bvh_level_top: {
@@ -82,7 +141,277 @@ void write_geometry_buffers(void* buffer_data, uint32_t buffer_index, VkDeviceSi
 }
 
 
-/*! Creates a BVH for a scene being loaded.
+//! Callback for fill_buffers() that copies the serialized bottom-level
+//! acceleration structure from the cache file to a staging buffer
+void write_serialized_blas(void* buffer_data, uint32_t buffer_index, VkDeviceSize offset, VkDeviceSize size, const void* context) {
+	const scene_loader_t* loader = (const scene_loader_t*) context;
+	memcpy(buffer_data, (const uint8_t*) loader->serialized_blas + offset, size);
+}
+
+
+//! Creates the header of the BVH cache file for a scene file with the given
+//! hash on the given device. Its serialized size is zero.
+bvh_cache_header_t get_bvh_cache_key(uint64_t scene_hash, const device_t* device) {
+	bvh_cache_header_t key;
+	memset(&key, 0, sizeof(key));
+	key.marker = 0xb1a5ca;
+	key.version = 1;
+	key.scene_hash = scene_hash;
+	memcpy(key.device_uuid, device->id_properties.deviceUUID, VK_UUID_SIZE);
+	memcpy(key.driver_uuid, device->id_properties.driverUUID, VK_UUID_SIZE);
+	key.driver_version = device->physical_device_properties.driverVersion;
+	return key;
+}
+
+
+/*! Determines the path of the BVH cache file for the scene being loaded and
+	reads the serialized bottom-level acceleration structure from it, if it
+	exists and is compatible with the device. A missing or incompatible cache
+	file is not an error. It merely leaves loader->serialized_blas at NULL.
+	\param loader A scene loader with the scene file mapped.
+	\param device Output of create_device().
+	\param bvh_cache_path The directory holding BVH cache files.*/
+void read_bvh_cache(scene_loader_t* loader, const device_t* device, const char* bvh_cache_path) {
+	VK_LOAD(vkGetDeviceAccelerationStructureCompatibilityKHR);
+	// The file name is a hash of everything that is part of the key
+	loader->scene_hash = hash_bytes(loader->file.data, loader->file.size);
+	bvh_cache_header_t key = get_bvh_cache_key(loader->scene_hash, device);
+	char file_name[32];
+	sprintf(file_name, "/%016llx.blas", (unsigned long long) hash_bytes(&key, sizeof(key)));
+	const char* parts[] = { bvh_cache_path, file_name };
+	loader->bvh_cache_file_path = cat_strings(parts, COUNT_OF(parts));
+	FILE* file = fopen(loader->bvh_cache_file_path, "rb");
+	if (!file)
+		return;
+	// Read the header and the serialized data and make sure that they match
+	bvh_cache_header_t header;
+	uint64_t serialized_size = 0, handle_count = 0;
+	if (fread(&header, sizeof(header), 1, file) != 1
+		|| memcmp(&header, &key, offsetof(bvh_cache_header_t, serialized_size))
+		|| header.serialized_size < BVH_SERIALIZATION_HEADER_SIZE)
+	{
+		printf("Ignoring the outdated or invalid BVH cache file at %s.\n", loader->bvh_cache_file_path);
+		fclose(file);
+		return;
+	}
+	loader->serialized_blas_size = header.serialized_size;
+	loader->serialized_blas = malloc(loader->serialized_blas_size);
+	if (fread(loader->serialized_blas, sizeof(uint8_t), loader->serialized_blas_size, file) == loader->serialized_blas_size) {
+		memcpy(&serialized_size, loader->serialized_blas + 2 * VK_UUID_SIZE, sizeof(uint64_t));
+		memcpy(&handle_count, loader->serialized_blas + 2 * VK_UUID_SIZE + 2 * sizeof(uint64_t), sizeof(uint64_t));
+	}
+	fclose(file);
+	// Ask the driver whether it can deserialize this data
+	VkAccelerationStructureCompatibilityKHR compatibility = VK_ACCELERATION_STRUCTURE_COMPATIBILITY_INCOMPATIBLE_KHR;
+	if (serialized_size == loader->serialized_blas_size && handle_count == 0) {
+		VkAccelerationStructureVersionInfoKHR version_info = {
+			.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_VERSION_INFO_KHR,
+			.pVersionData = loader->serialized_blas,
+		};
+		(*pvkGetDeviceAccelerationStructureCompatibilityKHR)(device->device, &version_info, &compatibility);
+	}
+	if (compatibility != VK_ACCELERATION_STRUCTURE_COMPATIBILITY_COMPATIBLE_KHR) {
+		printf("Ignoring the BVH cache file at %s because it is truncated or incompatible with the driver.\n", loader->bvh_cache_file_path);
+		free(loader->serialized_blas);
+		loader->serialized_blas = NULL;
+		loader->serialized_blas_size = 0;
+	}
+}
+
+
+/*! Submits the command buffer of the given loader to the queue of the device
+	and waits for the queue to become idle.
+	\return 0 upon success.*/
+int submit_and_wait(scene_loader_t* loader, const device_t* device) {
+	VkSubmitInfo cmd_submit = {
+		.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+		.commandBufferCount = 1, .pCommandBuffers = &loader->cmd,
+	};
+	if (vkEndCommandBuffer(loader->cmd) || vkQueueSubmit(device->queue, 1, &cmd_submit, NULL) || vkQueueWaitIdle(device->queue))
+		return 1;
+	return 0;
+}
+
+
+/*! Serializes the freshly built bottom-level acceleration structure of the
+	scene being loaded and writes it to loader->bvh_cache_file_path.
+	\param loader A scene loader for which create_bvh() has submitted its
+		commands.
+	\param device Output of create_device().
+	\return 0 upon success.*/
+int write_bvh_cache(scene_loader_t* loader, const device_t* device) {
+	VK_LOAD(vkCmdWriteAccelerationStructuresPropertiesKHR);
+	VK_LOAD(vkCmdCopyAccelerationStructureToMemoryKHR);
+	VkAccelerationStructureKHR blas = loader->scene->bvhs.bvhs[bvh_level_bottom];
+	// Wait for the build to finish and query the size of the serialized
+	// bottom level
+	VkQueryPoolCreateInfo pool_info = {
+		.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+		.queryType = VK_QUERY_TYPE_ACCELERATION_STRUCTURE_SERIALIZATION_SIZE_KHR,
+		.queryCount = 1,
+	};
+	VkCommandBufferBeginInfo begin_info = {
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+		.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+	};
+	if (vkQueueWaitIdle(device->queue) || vkCreateQueryPool(device->device, &pool_info, NULL, &loader->query_pool)
+		|| vkBeginCommandBuffer(loader->cmd, &begin_info))
+		return printf("Failed to prepare a query for the serialized size of an acceleration structure.\n");
+	vkCmdResetQueryPool(loader->cmd, loader->query_pool, 0, 1);
+	(*pvkCmdWriteAccelerationStructuresPropertiesKHR)(loader->cmd, 1, &blas, pool_info.queryType, loader->query_pool, 0);
+	uint64_t serialized_size = 0;
+	if (submit_and_wait(loader, device)
+		|| vkGetQueryPoolResults(device->device, loader->query_pool, 0, 1, sizeof(serialized_size), &serialized_size, sizeof(serialized_size), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT)
+		|| serialized_size < BVH_SERIALIZATION_HEADER_SIZE)
+		return printf("Failed to query the serialized size of an acceleration structure.\n");
+	// Serialize it into host-visible memory
+	buffer_request_t request = {
+		.buffer_info = {
+			.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+			.size = serialized_size,
+			.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+		},
+	};
+	// The CPU reads this memory, so cached memory is much faster if available
+	if (create_buffers(&loader->serialized_buffers, device, &request, 1, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT, BVH_SERIALIZATION_ALIGNMENT)
+		&& create_buffers(&loader->serialized_buffers, device, &request, 1, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, BVH_SERIALIZATION_ALIGNMENT))
+		return printf("Failed to create a host-visible buffer of %lu bytes for a serialized acceleration structure.\n", serialized_size);
+	VkBufferDeviceAddressInfo address_info = {
+		.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO,
+		.buffer = loader->serialized_buffers.buffers[0].buffer,
+	};
+	VkCopyAccelerationStructureToMemoryInfoKHR copy_info = {
+		.sType = VK_STRUCTURE_TYPE_COPY_ACCELERATION_STRUCTURE_TO_MEMORY_INFO_KHR,
+		.src = blas,
+		.dst = { .deviceAddress = vkGetBufferDeviceAddress(device->device, &address_info) },
+		.mode = VK_COPY_ACCELERATION_STRUCTURE_MODE_SERIALIZE_KHR,
+	};
+	if (vkBeginCommandBuffer(loader->cmd, &begin_info))
+		return printf("Failed to begin recording a command buffer for serializing an acceleration structure.\n");
+	(*pvkCmdCopyAccelerationStructureToMemoryKHR)(loader->cmd, &copy_info);
+	if (submit_and_wait(loader, device))
+		return printf("Failed to serialize an acceleration structure.\n");
+	// Write it to the cache file
+	void* serialized_data = NULL;
+	if (vkMapMemory(device->device, loader->serialized_buffers.allocation, 0, loader->serialized_buffers.size, 0, &serialized_data))
+		return printf("Failed to map the memory of a serialized acceleration structure.\n");
+	// Cached memory need not be coherent
+	VkMappedMemoryRange range = {
+		.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE,
+		.memory = loader->serialized_buffers.allocation,
+		.offset = 0, .size = VK_WHOLE_SIZE,
+	};
+	if (vkInvalidateMappedMemoryRanges(device->device, 1, &range)) {
+		vkUnmapMemory(device->device, loader->serialized_buffers.allocation);
+		return printf("Failed to invalidate the mapped memory of a serialized acceleration structure.\n");
+	}
+	bvh_cache_header_t header = get_bvh_cache_key(loader->scene_hash, device);
+	header.serialized_size = serialized_size;
+	// Write to a temporary file first, such that an interrupted or concurrent
+	// writer never leaves a truncated file at the path that readers use
+	const char* parts[] = { loader->bvh_cache_file_path, ".tmp" };
+	char* temp_path = cat_strings(parts, COUNT_OF(parts));
+	FILE* file = fopen(temp_path, "wb");
+	int result = 0;
+	if (!file)
+		result = printf("Failed to create the BVH cache file at %s. Please check that the directory exists and that you have write permissions.\n", temp_path);
+	else {
+		if (fwrite(&header, sizeof(header), 1, file) != 1
+			|| fwrite((uint8_t*) serialized_data + loader->serialized_buffers.buffers[0].memory_offset, sizeof(uint8_t), serialized_size, file) != serialized_size)
+			result = printf("Failed to write the BVH cache file at %s.\n", temp_path);
+		if (fclose(file) && !result)
+			result = printf("Failed to write the BVH cache file at %s.\n", temp_path);
+#ifdef _WIN32
+		// On Windows, rename() does not replace existing files
+		if (!result)
+			remove(loader->bvh_cache_file_path);
+#endif
+		if (!result && rename(temp_path, loader->bvh_cache_file_path))
+			result = printf("Failed to move the BVH cache file from %s to %s.\n", temp_path, loader->bvh_cache_file_path);
+		if (result)
+			remove(temp_path);
+	}
+	free(temp_path);
+	vkUnmapMemory(device->device, loader->serialized_buffers.allocation);
+	return result;
+}
+
+
+/*! Replaces the freshly built bottom-level acceleration structure of the
+	scene being loaded by a compacted copy. The caller has recorded the build
+	and a query for the compacted size into loader->cmd. This function submits
+	these commands, waits for them and begins recording loader->cmd anew. It
+	records the compacting copy and an update of the instance in the geometry
+	buffer of the top level, which has to point to the compacted copy. The
+	uncompacted bottom level is freed along with the loader.
+	\return 0 upon success.*/
+int compact_blas(scene_loader_t* loader, const device_t* device) {
+	VK_LOAD(vkCreateAccelerationStructureKHR);
+	VK_LOAD(vkCmdCopyAccelerationStructureKHR);
+	VK_LOAD(vkGetAccelerationStructureDeviceAddressKHR);
+	bvhs_t* bvhs = &loader->scene->bvhs;
+	uint64_t compacted_size = 0;
+	if (submit_and_wait(loader, device)
+		|| vkGetQueryPoolResults(device->device, loader->compaction_query_pool, 0, 1, sizeof(compacted_size), &compacted_size, sizeof(compacted_size), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT)
+		|| compacted_size == 0)
+		return printf("Failed to build the bottom-level acceleration structure or to query its compacted size.\n");
+	// Create the compacted bottom level
+	loader->uncompacted_blas = bvhs->bvhs[bvh_level_bottom];
+	loader->uncompacted_buffers = bvhs->buffers[bvh_level_bottom];
+	bvhs->bvhs[bvh_level_bottom] = VK_NULL_HANDLE;
+	memset(&bvhs->buffers[bvh_level_bottom], 0, sizeof(bvhs->buffers[bvh_level_bottom]));
+	buffer_request_t request = {
+		.buffer_info = {
+			.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+			.size = compacted_size,
+			.usage = VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_STORAGE_BIT_KHR | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+		},
+	};
+	if (create_buffers(&bvhs->buffers[bvh_level_bottom], device, &request, 1, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 1))
+		return printf("Failed to create a buffer for the compacted bottom-level acceleration structure.\n");
+	VkAccelerationStructureCreateInfoKHR bvh_info = {
+		.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_CREATE_INFO_KHR,
+		.buffer = bvhs->buffers[bvh_level_bottom].buffers[0].buffer,
+		.size = compacted_size,
+		.type = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR,
+	};
+	if ((*pvkCreateAccelerationStructureKHR)(device->device, &bvh_info, NULL, &bvhs->bvhs[bvh_level_bottom]))
+		return printf("Failed to create the compacted bottom-level acceleration structure.\n");
+	// Record the copy
+	VkCommandBufferBeginInfo begin_info = { .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO };
+	if (vkBeginCommandBuffer(loader->cmd, &begin_info))
+		return printf("Failed to begin recording a command buffer for compacting an acceleration structure.\n");
+	VkCopyAccelerationStructureInfoKHR copy_info = {
+		.sType = VK_STRUCTURE_TYPE_COPY_ACCELERATION_STRUCTURE_INFO_KHR,
+		.src = loader->uncompacted_blas,
+		.dst = bvhs->bvhs[bvh_level_bottom],
+		.mode = VK_COPY_ACCELERATION_STRUCTURE_MODE_COMPACT_KHR,
+	};
+	(*pvkCmdCopyAccelerationStructureKHR)(loader->cmd, &copy_info);
+	// Point the instance of the top level to the compacted bottom level
+	VkAccelerationStructureDeviceAddressInfoKHR address_info = {
+		.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_DEVICE_ADDRESS_INFO_KHR,
+		.accelerationStructure = bvhs->bvhs[bvh_level_bottom],
+	};
+	VkDeviceAddress blas_address = (*pvkGetAccelerationStructureDeviceAddressKHR)(device->device, &address_info);
+	vkCmdUpdateBuffer(loader->cmd, loader->geometry_buffers.buffers[bvh_level_top].buffer,
+		offsetof(VkAccelerationStructureInstanceKHR, accelerationStructureReference), sizeof(blas_address), &blas_address);
+	VkMemoryBarrier update_barrier = {
+		.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+		.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+		.dstAccessMask = VK_ACCESS_SHADER_READ_BIT,
+	};
+	vkCmdPipelineBarrier(loader->cmd, VK_PIPELINE_STAGE_TRANSFER_BIT,
+			VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, 0,
+			1, &update_barrier, 0, NULL, 0, NULL);
+	return 0;
+}
+
+
+/*! Creates a BVH for a scene being loaded. If loader->serialized_blas is
+	available, the bottom level gets deserialized from it. Otherwise, it gets
+	built and compacted. The top level with its single instance gets built
+	either way.
 	\param loader An active scene loader with quantized positions readily
 		available. The calling side is responsible for freeing it.
 	\param device Output of create_device.
@@ -92,18 +421,22 @@ int create_bvh(scene_loader_t* loader, const device_t* device) {
 	VK_LOAD(vkGetAccelerationStructureBuildSizesKHR);
 	VK_LOAD(vkCreateAccelerationStructureKHR);
 	VK_LOAD(vkCmdBuildAccelerationStructuresKHR);
+	VK_LOAD(vkCmdCopyMemoryToAccelerationStructureKHR);
+	VK_LOAD(vkCmdWriteAccelerationStructuresPropertiesKHR);
+	bool cached = (loader->serialized_blas != NULL);
 	// Map levels to BVH types
 	VkAccelerationStructureTypeKHR types[bvh_level_count];
 	types[bvh_level_bottom] = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR;
 	types[bvh_level_top] = VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_KHR;
 	// Create buffers for geometry/instance data
 	uint32_t triangle_count = loader->scene->header.triangle_count;
-	uint32_t vertex_count = 3 * triangle_count;
+	uint32_t vertex_count = (uint32_t) loader->scene->header.vertex_count;
+	bool indexed = loader->scene->header.version >= 2;
 	buffer_request_t geo_requests[bvh_level_count];
 	buffer_request_t bottom_geo_request = {
 		.buffer_info = {
 			.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
-			.size = vertex_count * 3 * sizeof(float),
+			.size = (cached ? 1 : vertex_count) * 3 * sizeof(float),
 			.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
 		},
 	};
@@ -139,6 +472,15 @@ int create_bvh(scene_loader_t* loader, const device_t* device) {
 			},
 		},
 	};
+	// Indexed geometry uses the index buffer of the scene directly
+	if (indexed) {
+		VkBufferDeviceAddressInfo index_buffer_address = {
+			.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO,
+			.buffer = loader->scene->mesh_buffers.buffers[mesh_buffer_type_indices].buffer,
+		};
+		bottom_geometry.geometry.triangles.indexType = VK_INDEX_TYPE_UINT32;
+		bottom_geometry.geometry.triangles.indexData.deviceAddress = vkGetBufferDeviceAddress(device->device, &index_buffer_address);
+	}
 	geometries[bvh_level_bottom] = bottom_geometry;
 	VkBufferDeviceAddressInfo top_buffer_address = {
 		.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO,
@@ -173,7 +515,15 @@ int create_bvh(scene_loader_t* loader, const device_t* device) {
 			.geometryCount = 1,
 			.pGeometries = &geometries[i],
 		};
+		// The bottom level gets compacted after the build
+		if (i == bvh_level_bottom)
+			build_info.flags |= VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_COMPACTION_BIT_KHR;
 		build_infos[i] = build_info;
+		// The serialized data knows the size of the deserialized bottom level
+		if (i == bvh_level_bottom && cached) {
+			memcpy(&sizes[i].accelerationStructureSize, loader->serialized_blas + 2 * VK_UUID_SIZE + sizeof(uint64_t), sizeof(uint64_t));
+			continue;
+		}
 		sizes[i].sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_SIZES_INFO_KHR;
 		(*pvkGetAccelerationStructureBuildSizesKHR)(device->device, VK_ACCELERATION_STRUCTURE_BUILD_TYPE_DEVICE_KHR, &build_infos[i], &primitive_counts[i], &sizes[i]);
 	}
@@ -189,13 +539,16 @@ int create_bvh(scene_loader_t* loader, const device_t* device) {
 		};
 		bvh_buffer_requests[i] = request;
 	}
-	if (create_buffers(&bvhs->buffers, device, bvh_buffer_requests, COUNT_OF(bvh_buffer_requests), VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 1))
-		return printf("Failed to create buffers to hold acceleration structures.\n");
+	for (uint32_t i = 0; i != bvh_level_count; ++i) {
+		if (create_buffers(&bvhs->buffers[i], device, &bvh_buffer_requests[i], 1, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 1))
+			return printf("Failed to create buffers to hold acceleration structures.\n");
+		bvhs->uncompacted_size += bvhs->buffers[i].size;
+	}
 	// Create acceleration structures
 	for (uint32_t i = 0; i != bvh_level_count; ++i) {
 		VkAccelerationStructureCreateInfoKHR bvh_info = {
 			.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_CREATE_INFO_KHR,
-			.buffer = bvhs->buffers.buffers[i].buffer,
+			.buffer = bvhs->buffers[i].buffers[0].buffer,
 			.size = sizes[i].accelerationStructureSize,
 			.type = types[i],
 		};
@@ -206,13 +559,27 @@ int create_bvh(scene_loader_t* loader, const device_t* device) {
 	// fill the geometry buffers
 	if (fill_buffers(&loader->geometry_buffers, device, &write_geometry_buffers, loader))
 		return printf("Failed to upload geometry data for building acceleration structures to the GPU.\n");
-	// Create buffers for scratch data
+	// Upload the serialized bottom level
+	if (cached) {
+		buffer_request_t serialized_request = {
+			.buffer_info = {
+				.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+				.size = loader->serialized_blas_size,
+				.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+			},
+		};
+		if (create_buffers(&loader->serialized_buffers, device, &serialized_request, 1, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, BVH_SERIALIZATION_ALIGNMENT)
+			|| fill_buffers(&loader->serialized_buffers, device, &write_serialized_blas, loader))
+			return printf("Failed to upload a serialized acceleration structure to the GPU.\n");
+	}
+	// Create buffers for scratch data. Deserialization does not need scratch
+	// memory but buffers must not be empty.
 	buffer_request_t scratch_requests[bvh_level_count];
 	for (int i = 0; i != bvh_level_count; ++i) {
 		buffer_request_t request = {
 			.buffer_info = {
 				.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
-				.size = sizes[i].buildScratchSize,
+				.size = (sizes[i].buildScratchSize > 0) ? sizes[i].buildScratchSize : 1,
 				.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
 			},
 		};
@@ -221,6 +588,14 @@ int create_bvh(scene_loader_t* loader, const device_t* device) {
 	if (create_buffers(&loader->scratch_buffers, device, scratch_requests, COUNT_OF(scratch_requests), VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, device->bvh_properties.minAccelerationStructureScratchOffsetAlignment))
 		return printf("Failed to create scratch buffers for the acceleration structure build.\n");
 
+	// Create a query pool for the compacted size
+	VkQueryPoolCreateInfo pool_info = {
+		.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+		.queryType = VK_QUERY_TYPE_ACCELERATION_STRUCTURE_COMPACTED_SIZE_KHR,
+		.queryCount = 1,
+	};
+	if (!cached && vkCreateQueryPool(device->device, &pool_info, NULL, &loader->compaction_query_pool))
+		return printf("Failed to create a query pool for the compacted size of an acceleration structure.\n");
 	// Prepare to record commands
 	VkCommandBufferAllocateInfo cmd_info = {
 		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
@@ -232,17 +607,35 @@ int create_bvh(scene_loader_t* loader, const device_t* device) {
 	VkCommandBufferBeginInfo begin_info = { .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO };
 	if (vkBeginCommandBuffer(loader->cmd, &begin_info))
 		return printf("Failed to begin recording a command buffer for building acceleration structures.\n");
-	// Build bottom- and top-level acceleration structures in this order
+	if (!cached)
+		vkCmdResetQueryPool(loader->cmd, loader->compaction_query_pool, 0, 1);
+	// Build (or deserialize) bottom- and top-level acceleration structures in
+	// this order
 	for (uint32_t i = 0; i != bvh_level_count; ++i) {
-		build_infos[i].dstAccelerationStructure = bvhs->bvhs[i];
-		VkBufferDeviceAddressInfo scratch_adress_info = {
-			.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO,
-			.buffer = loader->scratch_buffers.buffers[i].buffer,
-		};
-		build_infos[i].scratchData.deviceAddress = vkGetBufferDeviceAddress(device->device, &scratch_adress_info);
-		VkAccelerationStructureBuildRangeInfoKHR build_range = { .primitiveCount = primitive_counts[i] };
-		const VkAccelerationStructureBuildRangeInfoKHR* build_range_ptr = &build_range;
-		pvkCmdBuildAccelerationStructuresKHR(loader->cmd, 1, &build_infos[i], &build_range_ptr);
+		if (i == bvh_level_bottom && cached) {
+			VkBufferDeviceAddressInfo serialized_address_info = {
+				.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO,
+				.buffer = loader->serialized_buffers.buffers[0].buffer,
+			};
+			VkCopyMemoryToAccelerationStructureInfoKHR copy_info = {
+				.sType = VK_STRUCTURE_TYPE_COPY_MEMORY_TO_ACCELERATION_STRUCTURE_INFO_KHR,
+				.src = { .deviceAddress = vkGetBufferDeviceAddress(device->device, &serialized_address_info) },
+				.dst = bvhs->bvhs[i],
+				.mode = VK_COPY_ACCELERATION_STRUCTURE_MODE_DESERIALIZE_KHR,
+			};
+			(*pvkCmdCopyMemoryToAccelerationStructureKHR)(loader->cmd, &copy_info);
+		}
+		else {
+			build_infos[i].dstAccelerationStructure = bvhs->bvhs[i];
+			VkBufferDeviceAddressInfo scratch_adress_info = {
+				.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO,
+				.buffer = loader->scratch_buffers.buffers[i].buffer,
+			};
+			build_infos[i].scratchData.deviceAddress = vkGetBufferDeviceAddress(device->device, &scratch_adress_info);
+			VkAccelerationStructureBuildRangeInfoKHR build_range = { .primitiveCount = primitive_counts[i] };
+			const VkAccelerationStructureBuildRangeInfoKHR* build_range_ptr = &build_range;
+			pvkCmdBuildAccelerationStructuresKHR(loader->cmd, 1, &build_infos[i], &build_range_ptr);
+		}
 		// Enforce synchronization
 		VkMemoryBarrier after_build_barrier = {
 			.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
@@ -252,6 +645,17 @@ int create_bvh(scene_loader_t* loader, const device_t* device) {
 		vkCmdPipelineBarrier(loader->cmd, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR,
 				VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, 0,
 				1, &after_build_barrier, 0, NULL, 0, NULL);
+		// Compact the freshly built bottom level. A deserialized one has been
+		// compacted before serialization.
+		if (i == bvh_level_bottom && !cached) {
+			(*pvkCmdWriteAccelerationStructuresPropertiesKHR)(loader->cmd, 1, &bvhs->bvhs[i], pool_info.queryType, loader->compaction_query_pool, 0);
+			if (compact_blas(loader, device))
+				return 1;
+			// The copy writes the compacted bottom level
+			vkCmdPipelineBarrier(loader->cmd, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR,
+					VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, 0,
+					1, &after_build_barrier, 0, NULL, 0, NULL);
+		}
 	}
 	// Submit the command buffer
 	VkSubmitInfo cmd_submit = {
@@ -264,55 +668,256 @@ int create_bvh(scene_loader_t* loader, const device_t* device) {
 }
 
 
-//! Callback for fill_buffers() that writes mesh data from the scene file
-//! directly to staging buffers
-void write_mesh_buffer(void* buffer_data, uint32_t buffer_index, VkDeviceSize buffer_size, const void* context) {
+//! Callback for fill_buffers() that copies mesh data from the mapped scene
+//! file directly to staging buffers. Buffers that are not in the file are
+//! zeroed.
+void write_mesh_buffer(void* buffer_data, uint32_t buffer_index, VkDeviceSize offset, VkDeviceSize size, const void* context) {
 	const scene_loader_t* loader = (const scene_loader_t*) context;
-	if (buffer_index == mesh_buffer_type_positions) {
-		// Create a temporary copy of the quantized positions for acceleration
-		// structure build
-		fread(loader->quantized_poss, sizeof(uint8_t), buffer_size, loader->file);
-		memcpy(buffer_data, loader->quantized_poss, buffer_size);
-	}
+	if (loader->mesh_data[buffer_index])
+		memcpy(buffer_data, (const uint8_t*) loader->mesh_data[buffer_index] + offset, size);
 	else
-		fread(buffer_data, sizeof(uint8_t), buffer_size, loader->file);
+		memset(buffer_data, 0, size);
+}
+
+
+//! Callback for fill_buffers() that copies material constants from the
+//! material_constant_t array passed as context
+void write_material_constants(void* buffer_data, uint32_t buffer_index, VkDeviceSize offset, VkDeviceSize size, const void* context) {
+	memcpy(buffer_data, (const uint8_t*) context + offset, size);
+}
+
+
+int create_texture_registry(texture_registry_t* registry) {
+	memset(registry, 0, sizeof(*registry));
+	if (create_mutex(&registry->mutex)) {
+		printf("Failed to create a mutex for the texture registry.\n");
+		return 1;
+	}
+	return 0;
+}
+
+
+void free_texture_registry(texture_registry_t* registry) {
+	if (registry->texture_count)
+		printf("Warning: %u textures are still in use while their registry is freed.\n", registry->texture_count);
+	for (uint32_t i = 0; i != registry->texture_count; ++i)
+		registry->textures[i]->owner = NULL;
+	free(registry->textures);
+	free_mutex(&registry->mutex);
+	memset(registry, 0, sizeof(*registry));
+}
+
+
+//! \return The registered texture with the given file path or NULL if there
+//!		is none. The caller has to hold the mutex of the registry.
+shared_texture_t* find_shared_texture(const texture_registry_t* registry, const char* file_path) {
+	for (uint32_t i = 0; i != registry->texture_count; ++i)
+		if (strcmp(registry->textures[i]->file_path, file_path) == 0)
+			return registry->textures[i];
+	return NULL;
+}
+
+
+//! Frees a texture batch that holds no textures in use anymore
+void free_texture_batch(texture_batch_t* batch, const device_t* device) {
+	free_texture_stream(&batch->stream, device);
+	free_images(&batch->images, device);
+	free(batch);
+}
+
+
+VkDeviceSize get_texture_batch_size(const texture_batch_t* batch) {
+	VkDeviceSize size = 0;
+	for (uint32_t i = 0; i != batch->images.image_count; ++i)
+		size += batch->images.images[i].memory_size;
+	return size;
+}
+
+
+//! Drops one reference to the given texture. If that was the last one, it
+//! gets freed along with its batch, if that was the last texture in there.
+void release_shared_texture(shared_texture_t* texture, const device_t* device) {
+	texture_registry_t* owner = texture->owner;
+	if (owner) lock_mutex(owner->mutex);
+	bool unused = (--texture->reference_count == 0);
+	bool batch_unused = false;
+	if (unused && owner) {
+		uint32_t index = 0;
+		while (owner->textures[index] != texture)
+			++index;
+		owner->textures[index] = owner->textures[--owner->texture_count];
+	}
+	if (unused && texture->batch)
+		batch_unused = (--texture->batch->texture_count == 0);
+	if (owner) unlock_mutex(owner->mutex);
+	if (batch_unused)
+		free_texture_batch(texture->batch, device);
+	if (unused) {
+		free(texture->file_path);
+		free(texture);
+	}
 }
 
 
-int load_scene(scene_t* scene, const device_t* device, const char* file_path, const char* texture_path) {
+/*! Writes the constant colors of single-colored textures of the given scene.
+	\param material_constants Receives one entry per texture for
+		scene_t::material_constants.*/
+void map_scene_textures(const scene_t* scene, material_constant_t* material_constants, uint32_t texture_count) {
+	for (uint32_t i = 0; i != texture_count; ++i) {
+		const shared_texture_t* texture = scene->textures[i];
+		memcpy(material_constants[i].color, texture->constant_color, sizeof(material_constants[i].color));
+		material_constants[i].constant = (texture->image_index == CONSTANT_TEXTURE_IMAGE_INDEX) ? 1 : 0;
+	}
+}
+
+
+/*! Fills scene->textures and scene->texture_batches. Registered textures are
+	shared. All others are loaded in a new batch and registered.
+	\param material_constants Receives one entry per texture. \see
+		map_scene_textures()
+	\see load_scene()
+	\return 0 upon success.*/
+int acquire_scene_textures(scene_t* scene, material_constant_t* material_constants, const device_t* device, texture_registry_t* registry, const char* texture_path, const char* const* file_paths, uint32_t texture_count) {
+	scene->textures = calloc(texture_count + 1, sizeof(shared_texture_t*));
+	// Take references to registered textures and list the others once. Two
+	// loaders may load the same texture concurrently. Then both copies get
+	// registered and later lookups find either one.
+	const char** missing_paths = calloc(texture_count + 1, sizeof(char*));
+	uint32_t* missing_indices = calloc(texture_count + 1, sizeof(uint32_t));
+	uint32_t missing_count = 0;
+	if (registry) lock_mutex(registry->mutex);
+	for (uint32_t i = 0; i != texture_count; ++i) {
+		shared_texture_t* texture = registry ? find_shared_texture(registry, file_paths[i]) : NULL;
+		if (texture) {
+			++texture->reference_count;
+			scene->textures[i] = texture;
+			continue;
+		}
+		uint32_t index = 0;
+		while (index != missing_count && strcmp(missing_paths[index], file_paths[i]) != 0)
+			++index;
+		if (index == missing_count)
+			missing_paths[missing_count++] = file_paths[i];
+		missing_indices[i] = index;
+	}
+	if (registry) unlock_mutex(registry->mutex);
+	int result = 0;
+	if (missing_count > 0) {
+		// Load the missing textures. All textures of a directory may be
+		// packed into <texture_path>.vkp.
+		texture_batch_t* batch = calloc(1, sizeof(texture_batch_t));
+		uint32_t* image_indices = calloc(missing_count, sizeof(uint32_t));
+		float* constant_colors = calloc(4 * missing_count, sizeof(float));
+		const char* pack_parts[] = { texture_path, ".vkp" };
+		char* texture_pack_path = cat_strings(pack_parts, COUNT_OF(pack_parts));
+		result = load_textures(&batch->images, image_indices, constant_colors, device, missing_paths, missing_count, texture_pack_path, VK_IMAGE_USAGE_SAMPLED_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, &batch->stream);
+		free(texture_pack_path);
+		shared_texture_t** loaded = calloc(missing_count, sizeof(shared_texture_t*));
+		for (uint32_t i = 0; i != missing_count && !result; ++i) {
+			shared_texture_t* texture = loaded[i] = calloc(1, sizeof(shared_texture_t));
+			texture->file_path = copy_string(missing_paths[i]);
+			texture->image_index = image_indices[i];
+			if (image_indices[i] == CONSTANT_TEXTURE_IMAGE_INDEX)
+				memcpy(texture->constant_color, &constant_colors[4 * i], sizeof(texture->constant_color));
+			else {
+				texture->batch = batch;
+				++batch->texture_count;
+			}
+		}
+		// Hand out references and register the new textures
+		for (uint32_t i = 0; i != texture_count && !result; ++i) {
+			if (!scene->textures[i]) {
+				scene->textures[i] = loaded[missing_indices[i]];
+				++scene->textures[i]->reference_count;
+			}
+		}
+		if (!result && registry) {
+			lock_mutex(registry->mutex);
+			registry->textures = realloc(registry->textures, (registry->texture_count + missing_count) * sizeof(shared_texture_t*));
+			for (uint32_t i = 0; i != missing_count; ++i) {
+				loaded[i]->owner = registry;
+				registry->textures[registry->texture_count++] = loaded[i];
+			}
+			unlock_mutex(registry->mutex);
+		}
+		if (result || batch->texture_count == 0)
+			free_texture_batch(batch, device);
+		free(loaded);
+		free(constant_colors);
+		free(image_indices);
+	}
+	free(missing_indices);
+	free(missing_paths);
+	if (result)
+		return 1;
+	// List the batches that this scene uses
+	scene->texture_batches = calloc(texture_count + 1, sizeof(texture_batch_t*));
+	for (uint32_t i = 0; i != texture_count; ++i) {
+		texture_batch_t* batch = scene->textures[i]->batch;
+		uint32_t index = 0;
+		while (index != scene->texture_batch_count && scene->texture_batches[index] != batch)
+			++index;
+		if (batch && index == scene->texture_batch_count)
+			scene->texture_batches[scene->texture_batch_count++] = batch;
+	}
+	map_scene_textures(scene, material_constants, texture_count);
+	return 0;
+}
+
+
+int load_scene(scene_t* scene, const device_t* device, const char* file_path, const char* texture_path, texture_registry_t* texture_registry, const char* bvh_cache_path) {
 	memset(scene, 0, sizeof(*scene));
 	scene_loader_t loader = { .scene = scene, .device = device };
-	// Open the source file
-	FILE* file = loader.file = fopen(file_path, "rb");
-	if (!file) {
+	// Map the source file into memory
+	file_mapping_t* file = &loader.file;
+	size_t cursor = 0;
+	if (map_file(file, file_path)) {
 		printf("Failed to open the scene file at %s. Please check path and permissions.\n", file_path);
 		free_scene_loader(&loader, device);
 		return 1;
 	}
 	// Load the header
-	fread(&scene->header.marker, sizeof(uint32_t), 1, file);
-	if (scene->header.marker != 0xabcabc) {
+	if (read_mapped_file(&scene->header.marker, sizeof(uint32_t), file, &cursor) || scene->header.marker != 0xabcabc) {
 		printf("The scene file at %s is not a valid *.vks file. Its marker does not match.\n", file_path);
 		free_scene_loader(&loader, device);
 		return 1;
 	}
-	fread(&scene->header.version, sizeof(uint32_t), 1, file);
-	if (scene->header.version != 1) {
-		printf("This renderer only supports *.vks files using version 1 of the file format, but the scene file at %s uses version %u.\n", file_path, scene->header.version);
+	read_mapped_file(&scene->header.version, sizeof(uint32_t), file, &cursor);
+	if (scene->header.version < 1 || scene->header.version > 3) {
+		printf("This renderer only supports *.vks files using version 1, 2 or 3 of the file format, but the scene file at %s uses version %u.\n", file_path, scene->header.version);
 		free_scene_loader(&loader, device);
 		return 1;
 	}
-	fread(&scene->header.material_count, sizeof(uint64_t), 1, file);
-	fread(&scene->header.triangle_count, sizeof(uint64_t), 1, file);
-	fread(&scene->header.dequantization_factor, sizeof(float), 3, file);
-	fread(&scene->header.dequantization_summand, sizeof(float), 3, file);
+	// Version 3 is version 2 with a compressed payload
+	bool indexed = (scene->header.version >= 2);
+	bool compressed = (scene->header.version == 3);
+	if (read_mapped_file(&scene->header.material_count, sizeof(uint64_t), file, &cursor)
+		|| read_mapped_file(&scene->header.triangle_count, sizeof(uint64_t), file, &cursor)
+		|| (indexed && read_mapped_file(&scene->header.vertex_count, sizeof(uint64_t), file, &cursor))
+		|| read_mapped_file(&scene->header.dequantization_factor, 3 * sizeof(float), file, &cursor)
+		|| read_mapped_file(&scene->header.dequantization_summand, 3 * sizeof(float), file, &cursor))
+	{
+		printf("The scene file at %s ends prematurely within the header.\n", file_path);
+		free_scene_loader(&loader, device);
+		return 1;
+	}
+	if (!indexed)
+		scene->header.vertex_count = 3 * scene->header.triangle_count;
 	// Load material names
 	scene->header.material_names = calloc(scene->header.material_count, sizeof(char*));
 	for (uint64_t i = 0; i != scene->header.material_count; ++i) {
 		uint64_t length = 0;
-		fread(&length, sizeof(length), 1, file);
+		// Bound the length by the rest of the file before adding one
+		const char* name = NULL;
+		if (!read_mapped_file(&length, sizeof(length), file, &cursor) && length < file->size - cursor)
+			name = (const char*) skip_mapped_file((size_t) length + 1, file, &cursor);
+		if (!name) {
+			printf("The scene file at %s ends prematurely within the material names.\n", file_path);
+			free_scene_loader(&loader, device);
+			return 1;
+		}
 		scene->header.material_names[i] = malloc(length + 1);
-		fread(scene->header.material_names[i], sizeof(char), length + 1, file);
+		memcpy(scene->header.material_names[i], name, length + 1);
 	}
 	// Create buffers for the geometry
 	buffer_request_t buffer_requests[mesh_buffer_type_count];
@@ -323,10 +928,15 @@ int load_scene(scene_t* scene, const device_t* device, const char* file_path, co
 		buffer_info->usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_UNIFORM_TEXEL_BUFFER_BIT;
 		if (i == mesh_buffer_type_positions || i == mesh_buffer_type_normals_and_tex_coords) {
 			buffer_info->usage |= VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
-			buffer_info->size = sizeof(uint32_t) * 2 * scene->header.triangle_count * 3;
+			buffer_info->size = sizeof(uint32_t) * 2 * scene->header.vertex_count;
 		}
 		else if (i == mesh_buffer_type_material_indices)
 			buffer_info->size = sizeof(uint8_t) * scene->header.triangle_count;
+		else if (i == mesh_buffer_type_indices) {
+			// The acceleration structure build reads indices from this buffer
+			buffer_info->usage |= VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT;
+			buffer_info->size = sizeof(uint32_t) * (indexed ? (3 * scene->header.triangle_count) : 1);
+		}
 		VkBufferViewCreateInfo* view_info = &buffer_requests[i].view_info;
 		view_info->sType = VK_STRUCTURE_TYPE_BUFFER_VIEW_CREATE_INFO;
 		switch (i) {
@@ -339,6 +949,9 @@ int load_scene(scene_t* scene, const device_t* device, const char* file_path, co
 			case mesh_buffer_type_material_indices:
 				view_info->format = VK_FORMAT_R8_UINT;
 				break;
+			case mesh_buffer_type_indices:
+				view_info->format = VK_FORMAT_R32_UINT;
+				break;
 			default:
 				view_info->sType = 0;
 				break;
@@ -349,31 +962,87 @@ int load_scene(scene_t* scene, const device_t* device, const char* file_path, co
 		free_scene_loader(&loader, device);
 		return 1;
 	}
-	// While filling buffers, we keep quantized positions around for acceleration structure build
-	loader.quantized_poss = malloc(buffer_requests[mesh_buffer_type_positions].buffer_info.size);
-	// Fill the geometry buffers with data from the file
-	if (fill_buffers(&scene->mesh_buffers, device, &write_mesh_buffer, &loader)) {
-		printf("Failed to write mesh data of the scene file at %s to device-local buffers.\n", file_path);
-		free_scene_loader(&loader, device);
-		return 1;
+	// A compressed payload gets decompressed on all cores. Positions and
+	// indices are needed on the host again later, so we decompress into host
+	// memory rather than into staging buffers.
+	file_mapping_t decompressed = { .data = NULL };
+	size_t decompressed_cursor = 0;
+	if (compressed) {
+		if (read_mapped_chunked_payload(&loader.compressed_payload, file, &cursor)) {
+			printf("Failed to read the chunk table of the compressed scene file at %s.\n", file_path);
+			free_scene_loader(&loader, device);
+			return 1;
+		}
+		decompressed.size = (size_t) get_uncompressed_payload_size(&loader.compressed_payload);
+		loader.decompressed_payload = malloc(decompressed.size ? decompressed.size : 1);
+		decompressed.data = loader.decompressed_payload;
+		if (decompress_mapped_payload(loader.decompressed_payload, &loader.compressed_payload, 0)) {
+			printf("Failed to decompress the scene file at %s.\n", file_path);
+			free_scene_loader(&loader, device);
+			return 1;
+		}
 	}
+	// Locate the mesh data within the mapped file or the decompressed
+	// payload. It gets copied straight into staging buffers and quantized
+	// positions are read from there again for the acceleration structure
+	// build.
+	const file_mapping_t* mesh_source = compressed ? &decompressed : file;
+	size_t* mesh_cursor = compressed ? &decompressed_cursor : &cursor;
+	bool mesh_data_complete = true;
+	for (uint32_t i = 0; i != mesh_buffer_type_count; ++i) {
+		if (i == mesh_buffer_type_indices && !indexed)
+			continue;
+		if (!(loader.mesh_data[i] = skip_mapped_file(buffer_requests[i].buffer_info.size, mesh_source, mesh_cursor)))
+			mesh_data_complete = false;
+	}
+	if (compressed && decompressed_cursor != decompressed.size)
+		mesh_data_complete = false;
+	loader.quantized_poss = (const uint32_t*) loader.mesh_data[mesh_buffer_type_positions];
 	// If everything went well, we have reached an end of file marker now
 	uint32_t eof_marker = 0;
-	fread(&eof_marker, sizeof(eof_marker), 1, file);
-	if (eof_marker != 0xe0fe0f) {
+	read_mapped_file(&eof_marker, sizeof(eof_marker), file, &cursor);
+	if (!mesh_data_complete || eof_marker != 0xe0fe0f) {
 		printf("Finished reading data from the scene file at %s but did not encounter an end-of-file marker where expected. Either the file is invalid or the loader is buggy.\n", file_path);
 		free_scene_loader(&loader, device);
 		return 1;
 	}
-	// Close the scene file
-	fclose(file);
-	file = loader.file = NULL;
-	// Build acceleration structures
+	// Out-of-bounds indices would lead to undefined behavior in the
+	// acceleration structure build
+	if (indexed) {
+		const uint32_t* indices = (const uint32_t*) loader.mesh_data[mesh_buffer_type_indices];
+		uint32_t max_index = 0;
+		for (uint64_t i = 0; i != 3 * scene->header.triangle_count; ++i)
+			max_index = (indices[i] > max_index) ? indices[i] : max_index;
+		if (scene->header.triangle_count > 0 && max_index >= scene->header.vertex_count) {
+			printf("The scene file at %s uses vertex index %u but only has %lu vertices.\n", file_path, max_index, scene->header.vertex_count);
+			free_scene_loader(&loader, device);
+			return 1;
+		}
+	}
+	// Fill the geometry buffers with data from the file
+	if (fill_buffers(&scene->mesh_buffers, device, &write_mesh_buffer, &loader)) {
+		printf("Failed to write mesh data of the scene file at %s to device-local buffers.\n", file_path);
+		free_scene_loader(&loader, device);
+		return 1;
+	}
+	// Build acceleration structures or take the bottom level from the cache
+	if (bvh_cache_path)
+		read_bvh_cache(&loader, device, bvh_cache_path);
 	if (create_bvh(&loader, device)) {
 		printf("Failed to create ray-tracing acceleration structures for the scene file at %s.\n", file_path);
 		free_scene_loader(&loader, device);
 		return 1;
 	}
+	if (loader.serialized_blas)
+		printf("Deserialized the bottom-level acceleration structure from %s.\n", loader.bvh_cache_file_path);
+	else if (loader.bvh_cache_file_path && !write_bvh_cache(&loader, device))
+		printf("Wrote the bottom-level acceleration structure to %s.\n", loader.bvh_cache_file_path);
+	// Unmap the scene file
+	unmap_file(file);
+	free(loader.decompressed_payload);
+	loader.decompressed_payload = NULL;
+	loader.quantized_poss = NULL;
+	memset(loader.mesh_data, 0, sizeof(loader.mesh_data));
 	// Load textures
 	VkDeviceSize texture_count = scene->header.material_count * material_texture_type_count;
 	char** texture_file_paths = calloc(texture_count, sizeof(char*));
@@ -387,16 +1056,36 @@ int load_scene(scene_t* scene, const device_t* device, const char* file_path, co
 			texture_file_paths[i * material_texture_type_count + j] = cat_strings(parts, COUNT_OF(parts));
 		}
 	}
-	int result = load_textures(&scene->textures, device, (const char* const*) texture_file_paths, (uint32_t) texture_count, VK_IMAGE_USAGE_SAMPLED_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+	material_constant_t* material_constants = calloc(texture_count + 1, sizeof(material_constant_t));
+	int result = acquire_scene_textures(scene, material_constants, device, texture_registry, texture_path, (const char* const*) texture_file_paths, (uint32_t) texture_count);
 	for (VkDeviceSize i = 0; i != texture_count; ++i)
 		free(texture_file_paths[i]);
 	free(texture_file_paths);
 	texture_file_paths = NULL;
 	if (result) {
 		printf("Failed to load textures for the scene file at %s.\n", file_path);
+		free(material_constants);
 		free_scene_loader(&loader, device);
 		return 1;
 	}
+	// Upload the colors of single-colored textures
+	buffer_request_t constants_request = {
+		.buffer_info = {
+			.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+			.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+			.size = sizeof(material_constant_t) * (texture_count ? texture_count : 1),
+		},
+	};
+	if (create_buffers(&scene->material_constants, device, &constants_request, 1, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 1)
+		|| fill_buffers(&scene->material_constants, device, &write_material_constants, material_constants))
+	{
+		printf("Failed to create a buffer with material constants for the scene file at %s.\n", file_path);
+		free(material_constants);
+		free_scene_loader(&loader, device);
+		return 1;
+	}
+	free(material_constants);
+	material_constants = NULL;
 	// Tidy up temporary objects created whilst loading
 	loader.scene = NULL;
 	free_scene_loader(&loader, device);
@@ -406,24 +1095,51 @@ int load_scene(scene_t* scene, const device_t* device, const char* file_path, co
 
 void free_scene(scene_t* scene, const device_t* device) {
 	VK_LOAD(vkDestroyAccelerationStructureKHR);
-	free_images(&scene->textures, device);
+	if (scene->textures)
+		for (uint64_t i = 0; i != material_texture_type_count * scene->header.material_count; ++i)
+			if (scene->textures[i])
+				release_shared_texture(scene->textures[i], device);
+	free(scene->textures);
+	free(scene->texture_batches);
+	free_buffers(&scene->material_constants, device);
 	free_buffers(&scene->mesh_buffers, device);
 	if (scene->header.material_names)
 		for (uint64_t i = 0; i != scene->header.material_count; ++i)
 			free(scene->header.material_names[i]);
-	for (uint32_t i = 0; i != bvh_level_count; ++i)
+	for (uint32_t i = 0; i != bvh_level_count; ++i) {
 		if (scene->bvhs.bvhs[i])
 			(*pvkDestroyAccelerationStructureKHR)(device->device, scene->bvhs.bvhs[i], NULL);
-	free_buffers(&scene->bvhs.buffers, device);
+		free_buffers(&scene->bvhs.buffers[i], device);
+	}
 	free(scene->header.material_names);
 	memset(scene, 0, sizeof(*scene));
 }
 
 
+VkDeviceSize get_scene_device_size(const scene_t* scene, bool include_textures) {
+	VkDeviceSize size = scene->mesh_buffers.size + scene->material_constants.size;
+	for (uint32_t i = 0; i != bvh_level_count; ++i)
+		size += scene->bvhs.buffers[i].size;
+	if (include_textures)
+		for (uint32_t i = 0; i != scene->texture_batch_count; ++i)
+			size += get_texture_batch_size(scene->texture_batches[i]);
+	return size;
+}
+
+
 void free_scene_loader(scene_loader_t* loader, const device_t* device) {
+	VK_LOAD(vkDestroyAccelerationStructureKHR);
 	if (loader->scene) free_scene(loader->scene, device);
-	free(loader->quantized_poss);
-	if (loader->file) fclose(loader->file);
+	unmap_file(&loader->file);
+	free_chunked_payload(&loader->compressed_payload);
+	free(loader->decompressed_payload);
+	free(loader->bvh_cache_file_path);
+	free(loader->serialized_blas);
+	free_buffers(&loader->serialized_buffers, device);
+	if (loader->query_pool) vkDestroyQueryPool(device->device, loader->query_pool, NULL);
+	if (loader->compaction_query_pool) vkDestroyQueryPool(device->device, loader->compaction_query_pool, NULL);
+	if (loader->uncompacted_blas) (*pvkDestroyAccelerationStructureKHR)(device->device, loader->uncompacted_blas, NULL);
+	free_buffers(&loader->uncompacted_buffers, device);
 	free_buffers(&loader->geometry_buffers, device);
 	free_buffers(&loader->scratch_buffers, device);
 	if (loader->cmd) vkFreeCommandBuffers(device->device, device->cmd_pool, 1, &loader->cmd);
@@ -1,16 +1,23 @@
 #include "vulkan_basics.h"
+#include "textures.h"
+#include "threading.h"
 
 
 //! Holds all header data for a scene file
 typedef struct {
 	//! Should be 0xabcabc to mark a file as the right file format
 	uint32_t marker;
-	//! Should be 1 for a static scene
+	//! Should be 1 for a static scene with three vertices per triangle, 2
+	//! for a static scene with indexed vertices or 3 for version 2 with a
+	//! compressed payload (see chunked_payload_t)
 	uint32_t version;
 	//! The number of unique materials
 	uint64_t material_count;
 	//! The number of triangles
 	uint64_t triangle_count;
+	//! The number of vertices. Only stored in version 2 and 3 files. For
+	//! version 1, it is 3 * triangle_count.
+	uint64_t vertex_count;
 	//! Component-wise multiplication of quantized integer xyz coordinates by
 	//! these factors followed by addition of these summands gives world-space
 	//! coordinates
@@ -24,7 +31,8 @@ typedef struct {
 //! Enumeration of the different buffers that are needed to store a mesh
 typedef enum {
 	//! Each position is stored in 64 bits using 21-bit quantization for each
-	//! coordinate. Three subsequent positions form a triangle.
+	//! coordinate. Without an index buffer, three subsequent positions form a
+	//! triangle.
 	mesh_buffer_type_positions,
 	/*! Per position, this buffer provides 64 bits for the corresponding normal
 		and texture coordinate. The normal uses 2x16 bits for an octahedral map
@@ -32,6 +40,9 @@ typedef enum {
 	mesh_buffer_type_normals_and_tex_coords,
 	//! An 8-bit index per triangle indicating the used material
 	mesh_buffer_type_material_indices,
+	//! Three 32-bit vertex indices per triangle. Version 1 files do not have
+	//! them and then this buffer only holds a single dummy index.
+	mesh_buffer_type_indices,
 	//! The number of valid values for this enum
 	mesh_buffer_type_count,
 } mesh_buffer_type_t;
@@ -75,19 +86,110 @@ typedef enum {
 typedef struct {
 	//! The top- and bottom-level acceleration structure
 	VkAccelerationStructureKHR bvhs[bvh_level_count];
-	//! The buffers that hold the acceleration structures
-	buffers_t buffers;
+	//! The buffers that hold the acceleration structures. Each level has its
+	//! own allocation, such that the bottom level can be replaced by a
+	//! compacted copy.
+	buffers_t buffers[bvh_level_count];
+	//! The combined size in bytes of the buffers for both levels, before the
+	//! bottom level was compacted
+	VkDeviceSize uncompacted_size;
 } bvhs_t;
 
 
+typedef struct texture_registry_s texture_registry_t;
+
+
+/*! Textures that have been loaded by one invocation of load_textures(). Their
+	images share memory allocations, so the batch is freed as a whole once
+	none of its textures are in use anymore.*/
+typedef struct {
+	//! The textures in device-local memory
+	images_t images;
+	//! Loads the finer mipmaps of the textures progressively. NULL once all
+	//! of them are there.
+	texture_stream_t* stream;
+	//! The number of shared textures with an image in this batch. Protected
+	//! by the mutex of the registry, if they are registered.
+	uint32_t texture_count;
+} texture_batch_t;
+
+
+/*! A texture loaded from a *.vkt file. Scenes that use the same texture file
+	share it. It is freed once the last scene releases it.*/
+typedef struct {
+	//! The path of the *.vkt file, which identifies the texture
+	char* file_path;
+	//! The batch holding the image of this texture or NULL if the texture has
+	//! a single color
+	texture_batch_t* batch;
+	//! The index of the image in batch->images. Textures with identical
+	//! contents in one batch share an image. CONSTANT_TEXTURE_IMAGE_INDEX if
+	//! the texture has a single color.
+	uint32_t image_index;
+	//! The color of the texture if it has a single color, zero otherwise
+	float constant_color[4];
+	//! The number of references held by scenes. Protected by owner->mutex.
+	uint32_t reference_count;
+	//! The registry through which this texture can be found or NULL if it is
+	//! not shared
+	texture_registry_t* owner;
+} shared_texture_t;
+
+
+//! A registry of textures that are in use, such that scenes can share them.
+//! It is safe to use it from multiple threads.
+struct texture_registry_s {
+	//! Protects all other members, the reference counts of textures and the
+	//! texture counts of their batches
+	mutex_t* mutex;
+	//! The number of registered textures
+	uint32_t texture_count;
+	//! Pointers to all registered textures
+	shared_texture_t** textures;
+};
+
+
+//! Creates an empty texture registry. Returns 0 upon success.
+int create_texture_registry(texture_registry_t* registry);
+
+
+//! Frees a texture registry. All textures must have been released.
+void free_texture_registry(texture_registry_t* registry);
+
+
+//! \return The number of bytes of device memory used by the given batch
+VkDeviceSize get_texture_batch_size(const texture_batch_t* batch);
+
+
+//! The entry of scene_t::material_constants for one texture. Mirrors
+//! material_constant_t in shaders/shading_data.glsl.
+typedef struct {
+	//! For textures with a single color, this color in RGBA. Otherwise, it is
+	//! zero.
+	float color[4];
+	//! 1 if the texture has a single color and no descriptor, 0 if it has to
+	//! be sampled
+	uint32_t constant;
+	//! Pads the struct to the alignment of a vec4
+	uint32_t padding[3];
+} material_constant_t;
+
+
 //! A scene that has been loaded from a scene file and is now device-local
 typedef struct {
 	//! Header data as it was found in the scene file
 	scene_file_header_t header;
 	//! mesh_buffer_type_count buffers providing geometry information
 	buffers_t mesh_buffers;
-	//! material_texture_type_count consecutive textures per material
-	images_t textures;
+	//! One texture per material and material_texture_type_t, possibly shared
+	//! with other scenes. Each entry holds one reference.
+	shared_texture_t** textures;
+	//! The number of distinct batches holding images of textures
+	uint32_t texture_batch_count;
+	//! All distinct batches holding images of textures, without ownership
+	texture_batch_t** texture_batches;
+	//! A storage buffer with one material_constant_t per entry of textures
+	buffers_t material_constants;
 	//! The ray-tracing acceleration structures
 	bvhs_t bvhs;
 } scene_t;
@@ -99,9 +201,28 @@ typedef struct {
 	\param device Output of create_device().
 	\param file_path Path to a *.vks file that is to be loaded.
 	\param texture_path Path to a directory containing texture files in the
-		*.vkt format.
+		*.vkt format. If a texture pack <texture_path>.vkp exists, textures
+		are loaded from it where possible.
+	\param texture_registry A registry of textures. Registered textures get
+		shared. Only the remaining ones are loaded and then registered. NULL
+		to load textures for this scene alone.
+	\param bvh_cache_path Path to a directory in which the bottom-level
+		acceleration structure is cached, keyed by the contents of the scene
+		file and the device and driver. If a compatible cache file exists,
+		the acceleration structure gets deserialized from it rather than
+		built. Otherwise, it gets built and written to the cache. NULL
+		disables caching.
+	\note Initially, only coarse mipmaps of textures are loaded. The finer
+		mipmaps have to be loaded through the streams in
+		scene->texture_batches.
 	\return 0 upon success.*/
-int load_scene(scene_t* scene, const device_t* device, const char* file_path, const char* texture_path);
+int load_scene(scene_t* scene, const device_t* device, const char* file_path, const char* texture_path, texture_registry_t* texture_registry, const char* bvh_cache_path);
 
 
+//! Frees the scene and releases its textures
 void free_scene(scene_t* scene, const device_t* device);
+
+
+//! \return The number of bytes of device memory used by the given scene. With
+//!		include_textures == false, texture batches are not counted.
+VkDeviceSize get_scene_device_size(const scene_t* scene, bool include_textures);
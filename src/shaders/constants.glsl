@@ -31,9 +31,16 @@ layout (row_major, std140, binding = 0) uniform constants {
 	vec3 g_sky_radiance;
 	//! The radiance emitted by the material called _emission (Rec. 709)
 	vec3 g_emission_material_radiance;
+	//! The index of the material called _emission in the current scene
+	uint g_emission_material_index;
+	//! The number of spherical lights in the current scene, i.e. the number of
+	//! entries in g_spherical_lights (declared in path_tracing.glsl)
+	uint g_spherical_light_count;
+	//! 1 if the current scene has a vertex index buffer, 0 otherwise
+	uint g_indexed_mesh;
+	//! The number of materials in the current scene
+	uint g_material_count;
 	//! Four floats that can be controlled from the GUI directly and can be
 	//! used for any purpose while developing shaders
 	vec4 g_params;
-	//! Positions and radii for all spherical lights
-	vec4 g_spherical_lights[32];
 };
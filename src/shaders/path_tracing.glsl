@@ -0,0 +1,434 @@
+// Shared by all shaders that perform path tracing. Users have to enable the
+// extensions GL_EXT_nonuniform_qualifier, GL_EXT_control_flow_attributes and
+// GL_EXT_ray_query. LIGHT_TREE_MAX_DEPTH has to be defined.
+#include "camera_utilities.glsl"
+// Lots of other includes and bindings come indirectly through this one
+#include "brdfs.glsl"
+
+
+//! The BVH containing all scene geometry
+layout(binding = 2) uniform accelerationStructureEXT g_bvh;
+
+//! Statistics about the current frame, mirroring frame_statistics_t on the
+//! host. The host resets them to zero before each frame.
+layout (std430, binding = 10) buffer statistics {
+	//! The number of rays traced in this frame, including shadow rays
+	uint g_ray_count;
+	//! The number of paths that have been traced, i.e. one per pixel
+	uint g_path_count;
+	//! The number of vertices found along all of these paths (excluding the
+	//! one at the eye), i.e. the number of traced rays excluding shadow rays
+	uint g_path_vertex_count;
+};
+
+//! A node of the light tree, mirroring light_tree_node_t in light_tree.h
+struct light_tree_node_t {
+	//! An axis-aligned box around all lights below this node
+	vec3 box_min;
+	//! The sum of squared radii of all lights below this node
+	float power;
+	vec3 box_max;
+	//! For inner nodes, the index of the first child, followed by the second
+	//! one. For leaves, LIGHT_TREE_LEAF_BIT | light index.
+	uint child;
+};
+
+//! Marks leaves of the light tree, mirroring LIGHT_TREE_LEAF_BIT in
+//! light_tree.h
+#define LIGHT_TREE_LEAF_BIT 0x80000000u
+
+//! Positions and radii for all spherical lights
+layout (std430, binding = 11) readonly buffer spherical_lights {
+	vec4 g_spherical_lights[];
+};
+
+//! The nodes of the light tree over g_spherical_lights, root first
+layout (std430, binding = 12) readonly buffer light_tree {
+	light_tree_node_t g_light_tree[];
+};
+
+//! The number of rays traced by trace_ray() and trace_ray_emission() in the
+//! current invocation, such that it can be added to g_ray_count at once
+uint g_local_ray_count = 0;
+//! The number of rays traced by trace_ray() in the current invocation, to be
+//! added to g_path_vertex_count
+uint g_local_path_vertex_count = 0;
+//! The ray differential for the next ray traced by trace_ray(), which resets
+//! it to NO_RAY_DIFFERENTIAL. The fragment shader sets it for primary rays.
+ray_differential_t g_next_ray_differential = NO_RAY_DIFFERENTIAL;
+
+
+/*! Generates a pair of pseudo-random numbers.
+	\param seed Integers that change with each invocation. They get updated so
+		that you can reuse them.
+	\return A uniform, pseudo-random point in [0,1)^2.*/
+vec2 get_random_numbers(inout uvec2 seed) {
+	// PCG2D, as described here: https://jcgt.org/published/0009/03/02/
+	seed = 1664525u * seed + 1013904223u;
+	seed.x += 1664525u * seed.y;
+	seed.y += 1664525u * seed.x;
+	seed ^= (seed >> 16u);
+	seed.x += 1664525u * seed.y;
+	seed.y += 1664525u * seed.x;
+	seed ^= (seed >> 16u);
+	// Multiply by 2^-32 to get floats
+	return vec2(seed) * 2.32830643654e-10;
+}
+
+
+//! The inverse of the error function (used to sample Gaussians).
+float erfinv(float x) {
+	float w = -log(max(1.0e-37, 1.0 - x * x));
+	float a = w - 2.5;
+	float b = sqrt(w) - 3.0;
+	return x * ((w < 5.0)
+		? fma(fma(fma(fma(fma(fma(fma(fma(2.81022636e-08, a, 3.43273939e-07), a, -3.5233877e-06), a, -4.39150654e-06), a, 0.00021858087), a, -0.00125372503), a, -0.00417768164), a, 0.246640727), a, 1.50140941)
+		: fma(fma(fma(fma(fma(fma(fma(fma(-0.000200214257, b, 0.000100950558), b, 0.00134934322), b, -0.00367342844), b, 0.00573950773), b, -0.0076224613), b, 0.00943887047), b, 1.00167406), b, 2.83297682));
+}
+
+
+//! Samples a direction vector in the upper hemisphere (non-negative z) by
+//! sampling spherical coordinates uniformly. Not a good strategy.
+vec3 sample_hemisphere_spherical(vec2 randoms) {
+	float azimuth = (2.0 * M_PI) * randoms[0] - M_PI;
+	float inclination = (0.5 * M_PI) * randoms[1];
+	float radius = sin(inclination);
+	return vec3(radius * cos(azimuth), radius * sin(azimuth), cos(inclination));
+}
+
+
+//! Returns the density w.r.t. solid angle sampled by
+//! sample_hemisphere_spherical(). Only needs the local z-coordinate as input.
+float get_hemisphere_spherical_density(float sampled_dir_z) {
+	if (sampled_dir_z < 0.0)
+		return 0.0;
+	return 1.0 / ((M_PI * M_PI) * sqrt(max(0.0, 1.0 - sampled_dir_z * sampled_dir_z)));
+}
+
+
+//! Returns the solid angle of the given spherical light for the given shading
+//! point divided by 2.0 * M_PI, or 0.0 if it is completely below the horizon.
+float get_spherical_light_importance(vec3 center, float radius, vec3 shading_pos, vec3 normal) {
+	// If the light is completely below the horizon, return 0
+	vec3 center_dir = center - shading_pos;
+	if (dot(normal, center_dir) < -radius)
+		return 0.0;
+	// Compute the solid angle. We want z_range = 1.0 - z_min, where
+	// z_min = sqrt(1.0 - sin_2). Computing it like that results in
+	// cancelation for small sin_2, so instead we put the square root into
+	// the denominator to solve the same quadratic equation:
+	// https://en.wikipedia.org/wiki/Quadratic_formula#Square_root_in_the_denominator
+	float center_dist_2 = dot(center_dir, center_dir);
+	float sin_2 = radius * radius / center_dist_2;
+	float z_range = sin_2 / (1.0 + sqrt(max(0.0, 1.0 - sin_2)));
+	return z_range;
+}
+
+
+/*! Samples a direction in the solid angle of the given spherical light
+	uniformly.
+	\param center The center position of the spherical light.
+	\param importance The importance of the spherical light as returned by
+		get_spherical_light_importance(). Must not be zero. The sampled density
+		w.r.t. solid angle is 1.0 / (2.0 * M_PI * importance) or zero.
+	\param shading_pos The position of the shading point.
+	\param randoms A uniformly distributed point in [0,1)^2.
+	\return A normalized direction vector towards the spherical light.*/
+vec3 sample_spherical_light(vec3 center, float importance, vec3 shading_pos, vec2 randoms) {
+	// Produce a sample in local coordinates
+	float azimuth = (2.0 * M_PI) * randoms[0] - M_PI;
+	float z_range = importance;
+	float z = 1.0 - z_range * randoms[1];
+	float r = sqrt(max(0.0, 1.0 - z * z));
+	vec3 local_dir = vec3(r * cos(azimuth), r * sin(azimuth), z);
+	// Construct a coordinate frame where the vector towards the spherical
+	// light is the z-axis and transform to world space
+	mat3 light_to_world_space = get_shading_space(normalize(center - shading_pos));
+	return light_to_world_space * local_dir;
+}
+
+
+/*! Returns the importance of all lights below the given node of the light
+	tree for the given shading point. For inner nodes, that is half their
+	power over the squared distance to the box, which approximates their
+	solid angle over 2.0 * M_PI. Leaves use get_spherical_light_importance()
+	instead. Either way, the result is multiplied by a bound for the cosine
+	between the normal and directions towards the box. Zero means that no
+	light below the node is above the horizon.*/
+float get_light_tree_node_importance(light_tree_node_t node, vec3 shading_pos, vec3 normal) {
+	// Bound the box by a sphere
+	vec3 center_dir = 0.5 * (node.box_min + node.box_max) - shading_pos;
+	vec3 half_extent = 0.5 * (node.box_max - node.box_min);
+	float radius_2 = dot(half_extent, half_extent);
+	float center_dist_2 = dot(center_dir, center_dir);
+	// Bound the angle between the normal and directions towards the sphere
+	// from below and take the cosine, unless the shading point is inside
+	float cos_bound = 1.0;
+	if (center_dist_2 > radius_2) {
+		float cos_center = dot(normal, center_dir) * inversesqrt(center_dist_2);
+		float sin_center = sqrt(max(0.0, 1.0 - cos_center * cos_center));
+		float sin_2_cone = radius_2 / center_dist_2;
+		float cos_cone = sqrt(max(0.0, 1.0 - sin_2_cone));
+		if (cos_center < cos_cone)
+			cos_bound = cos_center * cos_cone + sin_center * sqrt(sin_2_cone);
+	}
+	if (cos_bound <= 0.0)
+		return 0.0;
+	if ((node.child & LIGHT_TREE_LEAF_BIT) != 0) {
+		vec4 light = g_spherical_lights[node.child & ~LIGHT_TREE_LEAF_BIT];
+		return cos_bound * get_spherical_light_importance(light.xyz, light.w, shading_pos, normal);
+	}
+	else
+		return cos_bound * 0.5 * node.power / max(center_dist_2, radius_2);
+}
+
+
+/*! Randomly picks one of the spherical lights in the scene by traversing the
+	light tree from the root. At each inner node, a child is chosen with
+	probability proportional to get_light_tree_node_importance(). Then it
+	samples a direction towards the light, sampling its solid angle
+	uniformly.
+	\param out_density The density w.r.t. solid angle with which the light
+		has been sampled. Other lights in the same direction are ignored, see
+		get_lights_density() for that. Zero if nothing was sampled.
+	\param shading_pos Position of the shading point w.r.t. which the solid
+		angle is computed.
+	\param normal The shading normal at the shading point.
+	\param randoms A random point distributed uniformly in [0, 1)^2.
+	\return The sampled direction towards a light as normalized vector. Zero if
+		there are no lights above the horizon.*/
+vec3 sample_lights(out float out_density, vec3 shading_pos, vec3 normal, vec2 randoms) {
+	out_density = 0.0;
+	if (g_spherical_light_count == 0)
+		return vec3(0.0);
+	// Descend to a leaf
+	light_tree_node_t node = g_light_tree[0];
+	float probability = 1.0;
+	[[loop]]
+	while ((node.child & LIGHT_TREE_LEAF_BIT) == 0) {
+		light_tree_node_t left = g_light_tree[node.child];
+		light_tree_node_t right = g_light_tree[node.child + 1];
+		float left_importance = get_light_tree_node_importance(left, shading_pos, normal);
+		float right_importance = get_light_tree_node_importance(right, shading_pos, normal);
+		if (left_importance + right_importance <= 0.0)
+			return vec3(0.0);
+		float left_probability = left_importance / (left_importance + right_importance);
+		// Pick a child and reuse the random number
+		if (randoms[0] < left_probability) {
+			randoms[0] /= left_probability;
+			probability *= left_probability;
+			node = left;
+		}
+		else {
+			randoms[0] = (randoms[0] - left_probability) / (1.0 - left_probability);
+			probability *= 1.0 - left_probability;
+			node = right;
+		}
+		// Guard against rounding errors in the reuse
+		randoms[0] = min(randoms[0], 0.99999994);
+	}
+	// Sample the light
+	vec4 light = g_spherical_lights[node.child & ~LIGHT_TREE_LEAF_BIT];
+	float importance = get_spherical_light_importance(light.xyz, light.w, shading_pos, normal);
+	if (importance <= 0.0)
+		return vec3(0.0);
+	out_density = probability / (2.0 * M_PI * importance);
+	return sample_spherical_light(light.xyz, importance, shading_pos, randoms);
+}
+
+
+/*! Returns the density w.r.t. solid angle that is sampled by sample_lights().
+	It traverses all nodes of the light tree whose boxes are intersected by
+	the given ray and sums up densities for all intersected lights.
+	sampled_dir must be above the horizon, otherwise results may be incorrect.
+	If sampled_dir has been generated by sample_lights(), pass the density
+	that it returned as sampled_density, otherwise 0.0. This is a work around
+	for numerical issues.*/
+float get_lights_density(vec3 shading_pos, vec3 normal, vec3 sampled_dir, float sampled_density) {
+	if (g_spherical_light_count == 0)
+		return 0.0;
+	vec3 inv_dir = 1.0 / sampled_dir;
+	// A stack of nodes to visit along with the probabilities that
+	// sample_lights() reaches them. Pushing both children of a node
+	// increases its size by one, so it does not exceed the depth.
+	uint stack_nodes[LIGHT_TREE_MAX_DEPTH + 1];
+	float stack_probabilities[LIGHT_TREE_MAX_DEPTH + 1];
+	stack_nodes[0] = 0;
+	stack_probabilities[0] = 1.0;
+	uint stack_size = 1;
+	float density = 0.0;
+	[[loop]]
+	while (stack_size > 0) {
+		--stack_size;
+		light_tree_node_t node = g_light_tree[stack_nodes[stack_size]];
+		float probability = stack_probabilities[stack_size];
+		if ((node.child & LIGHT_TREE_LEAF_BIT) != 0) {
+			// Check whether the ray intersects the light with a non-negative
+			// ray parameter t
+			vec4 light = g_spherical_lights[node.child & ~LIGHT_TREE_LEAF_BIT];
+			vec3 center_dir = light.xyz - shading_pos;
+			float center_dot_dir = dot(center_dir, sampled_dir);
+			float in_sphere = dot(center_dir, center_dir) - light.w * light.w;
+			float discriminant = center_dot_dir * center_dot_dir - in_sphere;
+			if (discriminant >= 0.0 && in_sphere >= 0.0 && center_dot_dir >= 0.0) {
+				float importance = get_spherical_light_importance(light.xyz, light.w, shading_pos, normal);
+				if (importance > 0.0)
+					density += probability / (2.0 * M_PI * importance);
+			}
+			continue;
+		}
+		// Compute selection probabilities for both children like
+		// sample_lights() and visit those whose boxes the ray intersects
+		light_tree_node_t children[2] = { g_light_tree[node.child], g_light_tree[node.child + 1] };
+		float importances[2] = {
+			get_light_tree_node_importance(children[0], shading_pos, normal),
+			get_light_tree_node_importance(children[1], shading_pos, normal)
+		};
+		float total_importance = importances[0] + importances[1];
+		[[unroll]]
+		for (uint i = 0; i != 2; ++i) {
+			vec3 t_0 = (children[i].box_min - shading_pos) * inv_dir;
+			vec3 t_1 = (children[i].box_max - shading_pos) * inv_dir;
+			vec3 t_near = min(t_0, t_1);
+			vec3 t_far = max(t_0, t_1);
+			float t_min = max(max(t_near.x, t_near.y), max(t_near.z, 0.0));
+			float t_max = min(min(t_far.x, t_far.y), t_far.z);
+			if (importances[i] > 0.0 && t_min <= t_max) {
+				stack_nodes[stack_size] = node.child + i;
+				stack_probabilities[stack_size] = probability * (importances[i] / total_importance);
+				++stack_size;
+			}
+		}
+	}
+	// For small distant light sources, the intersection test above will
+	// sometimes fail. If that results in a density of zero for light samples,
+	// it distorts Monte Carlo estimates heavily.
+	return max(density, sampled_density);
+}
+
+
+/*! Traces the given ray (with normalized ray_dir). If it hits a scene surface,
+	it constructs the shading data and returns true. Otherwise, it returns
+	false and only writes the sky emission to the shading data.*/
+bool trace_ray(out shading_data_t out_shading_data, vec3 ray_origin, vec3 ray_dir) {
+	++g_local_ray_count;
+	++g_local_path_vertex_count;
+	ray_differential_t ray_diff = g_next_ray_differential;
+	g_next_ray_differential = NO_RAY_DIFFERENTIAL;
+	// Trace a ray
+	rayQueryEXT ray_query;
+	rayQueryInitializeEXT(ray_query, g_bvh, gl_RayFlagsOpaqueEXT, 0xff, ray_origin, 1.0e-3, ray_dir, 1e38);
+	while (rayQueryProceedEXT(ray_query)) {}
+	// If there was no hit, use the sky color
+	if (rayQueryGetIntersectionTypeEXT(ray_query, true) == gl_RayQueryCommittedIntersectionNoneEXT) {
+		out_shading_data.emission = g_sky_radiance;
+		return false;
+	}
+	// Construct shading data
+	else {
+		int triangle_index = rayQueryGetIntersectionPrimitiveIndexEXT(ray_query, true);
+		vec2 barys = rayQueryGetIntersectionBarycentricsEXT(ray_query, true);
+		bool front = rayQueryGetIntersectionFrontFaceEXT(ray_query, true);
+		float hit_distance = rayQueryGetIntersectionTEXT(ray_query, true);
+		out_shading_data = get_shading_data(triangle_index, barys, front, -ray_dir, hit_distance, ray_diff);
+		return true;
+	}
+}
+
+
+//! Like trace_ray() but only returns the emission of the shading data
+vec3 trace_ray_emission(vec3 ray_origin, vec3 ray_dir) {
+	++g_local_ray_count;
+	// Trace a ray
+	rayQueryEXT ray_query;
+	rayQueryInitializeEXT(ray_query, g_bvh, gl_RayFlagsOpaqueEXT, 0xff, ray_origin, 1.0e-3, ray_dir, 1e38);
+	while (rayQueryProceedEXT(ray_query)) {}
+	// If there was no hit, use the sky color
+	if (rayQueryGetIntersectionTypeEXT(ray_query, true) == gl_RayQueryCommittedIntersectionNoneEXT)
+		return g_sky_radiance;
+	// Otherwise, check if it is an emissive material
+	else {
+		int triangle_index = rayQueryGetIntersectionPrimitiveIndexEXT(ray_query, true);
+		if (texelFetch(g_material_indices, triangle_index).r == g_emission_material_index)
+			return g_emission_material_radiance;
+		else
+			return vec3(0.0);
+	}
+}
+
+
+/*! Implements Russian roulette, which terminates paths with a low throughput
+	weight stochastically. Surviving paths have their weights scaled up, so
+	the estimate remains unbiased. The survival probability is the luminance
+	of the throughput weight, clamped to at most one. Before vertex
+	RUSSIAN_ROULETTE_MIN_DEPTH, paths always survive. If it is 0, this
+	function always returns 1.0 and does not draw random numbers.
+	\param throughput_weight The throughput weight of the path after it has
+		been updated for the sampled direction at vertex k.
+	\param k The index of the current path vertex.
+	\param seed Used for get_random_numbers().
+	\return 0.0 if the path should be terminated. Otherwise, the factor by
+		which all throughput weights of the path have to be multiplied.*/
+float russian_roulette(vec3 throughput_weight, uint k, inout uvec2 seed) {
+#if RUSSIAN_ROULETTE_MIN_DEPTH > 0
+	if (k >= RUSSIAN_ROULETTE_MIN_DEPTH) {
+		float survival_probability = min(1.0, dot(throughput_weight, vec3(0.2126, 0.7152, 0.0722)));
+		if (get_random_numbers(seed)[0] >= survival_probability)
+			return 0.0;
+		return 1.0 / survival_probability;
+	}
+#endif
+	return 1.0;
+}
+
+
+/*! Computes a camera ray through the given location in pixel coordinates,
+	using either a pinhole camera or a hemispherical camera.
+	\param out_ray_origin The origin of the ray.
+	\param out_ray_dir The normalized direction of the ray.
+	\param pixel_pos The location on the viewport where (0, 0) is the left
+		top of the left top pixel.*/
+void get_camera_ray(out vec3 out_ray_origin, out vec3 out_ray_dir, vec2 pixel_pos) {
+	if (g_camera_type <= 1) {
+		vec2 ray_tex_coord = pixel_pos * g_inv_viewport_size;
+		out_ray_origin = get_camera_ray_origin(ray_tex_coord, g_projection_to_world_space);
+		out_ray_dir = get_camera_ray_direction(ray_tex_coord, g_world_to_projection_space);
+	}
+	else {
+		mat3 hemisphere_to_world_space = get_shading_space(g_hemispherical_camera_normal);
+		out_ray_origin = g_camera_pos;
+		vec2 sphere_factor = vec2(1.0, (g_camera_type == 3) ? 2.0 : 1.0);
+		out_ray_dir = hemisphere_to_world_space * sample_hemisphere_spherical(pixel_pos * sphere_factor * g_inv_viewport_size);
+	}
+}
+
+
+/*! Generates the primary ray for the given pixel along with the random seed
+	for the remainder of the path. The result only depends on the pixel and
+	g_frame_index, so it can be recomputed later.
+	\param out_ray_origin The origin of the primary ray.
+	\param out_ray_dir The normalized direction of the primary ray.
+	\param out_ray_diff The differential of the primary ray, i.e. the change
+		from one pixel to the next.
+	\param pixel The integer pixel coordinates.
+	\return The seed to use for get_random_numbers() along the path.*/
+uvec2 get_primary_ray(out vec3 out_ray_origin, out vec3 out_ray_dir, out ray_differential_t out_ray_diff, uvec2 pixel) {
+	// Jitter the subpixel position using a Gaussian with the given standard
+	// deviation in pixels
+	uvec2 seed = pixel ^ uvec2(g_frame_index << 16, (g_frame_index + 237) << 16);
+	const float std = 0.9;
+	vec2 randoms = 2.0 * get_random_numbers(seed) - vec2(1.0);
+	vec2 jitter = (std * sqrt(2.0)) * vec2(erfinv(randoms.x), erfinv(randoms.y));
+	vec2 jittered = vec2(pixel) + vec2(0.5) + jitter;
+	get_camera_ray(out_ray_origin, out_ray_dir, jittered);
+	// Use finite differences towards the neighboring pixels for the
+	// differential
+	vec3 origin_x, dir_x, origin_y, dir_y;
+	get_camera_ray(origin_x, dir_x, jittered + vec2(1.0, 0.0));
+	get_camera_ray(origin_y, dir_y, jittered + vec2(0.0, 1.0));
+	out_ray_diff.origin_dx = origin_x - out_ray_origin;
+	out_ray_diff.origin_dy = origin_y - out_ray_origin;
+	out_ray_diff.dir_dx = dir_x - out_ray_dir;
+	out_ray_diff.dir_dy = dir_y - out_ray_dir;
+	return seed;
+}
@@ -3,8 +3,9 @@
 
 
 //! Three textures for each material providing base color, specular and normal
-//! parameters
-layout (binding = 1) uniform sampler2D g_textures[3 * MATERIAL_COUNT];
+//! parameters. The array is sized for the largest supported scene and only
+//! the first 3 * g_material_count entries are bound.
+layout (binding = 1) uniform sampler2D g_textures[];
 
 //! Provides quantized world-space positions for each vertex
 layout (binding = 3) uniform utextureBuffer g_quantized_vertex_poss;
@@ -12,6 +13,37 @@ layout (binding = 3) uniform utextureBuffer g_quantized_vertex_poss;
 layout (binding = 4) uniform textureBuffer g_octahedral_normal_and_tex_coords;
 //! Provides a material index for each triangle
 layout (binding = 5) uniform utextureBuffer g_material_indices;
+//! Provides three vertex indices for each triangle if g_indexed_mesh is 1
+layout (binding = 6) uniform utextureBuffer g_vertex_indices;
+//! Describes whether a material texture has a single color. Mirrors
+//! material_constant_t in scene.h.
+struct material_constant_t {
+	//! The color of a single-colored texture in RGBA, zero otherwise
+	vec4 color;
+	//! 1 if the texture has a single color and does not have a descriptor
+	uint constant;
+};
+
+//! One entry per entry of g_textures
+layout (std430, binding = 7) readonly buffer material_constants {
+	material_constant_t g_material_constants[];
+};
+
+
+/*! Returns the value of a material texture at the given texture coordinate,
+	which comes from g_material_constants for single-colored textures. The
+	texture footprint is given explicitly, because this function branches on
+	the material, so implicit derivatives would be undefined.
+	\param texture_index The index into g_textures.
+	\param tex_coord The texture coordinate to use.
+	\param tex_coord_dx, tex_coord_dy Derivatives of the texture coordinate
+		with respect to the pixel coordinates.
+	\return The RGBA value of the texture.*/
+vec4 sample_material_texture(uint texture_index, vec2 tex_coord, vec2 tex_coord_dx, vec2 tex_coord_dy) {
+	if (g_material_constants[texture_index].constant != 0)
+		return g_material_constants[texture_index].color;
+	return textureGrad(g_textures[nonuniformEXT(texture_index)], tex_coord, tex_coord_dx, tex_coord_dy);
+}
 
 
 //! Full description of a shading point on a surface and its BRDF. All vectors
@@ -39,6 +71,20 @@ struct shading_data_t {
 };
 
 
+//! Derivatives of a ray with respect to the pixel coordinates, which
+//! determine the footprint for texture filtering
+struct ray_differential_t {
+	//! Derivatives of the ray origin with respect to x and y
+	vec3 origin_dx, origin_dy;
+	//! Derivatives of the normalized ray direction with respect to x and y
+	vec3 dir_dx, dir_dy;
+};
+
+//! The ray differential for rays that do not come from the camera. It makes
+//! get_shading_data() sample the finest streamed mip.
+#define NO_RAY_DIFFERENTIAL ray_differential_t(vec3(0.0), vec3(0.0), vec3(0.0), vec3(0.0))
+
+
 /*! Assembles the shading data for a point on the surface of the scene.
 	\param triangle_index The index of the scene triangle on which a point is
 		given.
@@ -47,8 +93,12 @@ struct shading_data_t {
 	\param front true iff the ray hit the front of the triangle (i.e. the
 		triangle vertices are clockwise when observed from the ray origin).
 	\param out_dir The normalized direction towards the camera along the path.
+	\param hit_distance The distance from the ray origin to the point.
+	\param ray_diff The differential of the ray that found the point. Primary
+		rays use the one from get_primary_ray(), all others
+		NO_RAY_DIFFERENTIAL.
 	\return The complete shading data.*/
-shading_data_t get_shading_data(int triangle_index, vec2 barycentrics, bool front, vec3 out_dir) {
+shading_data_t get_shading_data(int triangle_index, vec2 barycentrics, bool front, vec3 out_dir, float hit_distance, ray_differential_t ray_diff) {
 	shading_data_t s;
 	// Interpolate all vertex attributes for all triangle vertices
 	vec3 barys = vec3(1.0 - barycentrics[0] - barycentrics[1], barycentrics[0], barycentrics[1]);
@@ -60,6 +110,8 @@ shading_data_t get_shading_data(int triangle_index, vec2 barycentrics, bool fron
 	[[unroll]]
 	for (int i = 0; i != 3; ++i) {
 		int vert_index = triangle_index * 3 + i;
+		if (g_indexed_mesh != 0)
+			vert_index = int(texelFetch(g_vertex_indices, vert_index).r);
 		uvec2 quantized_pos = texelFetch(g_quantized_vertex_poss, vert_index).rg;
 		vec4 normal_and_tex_coords = texelFetch(g_octahedral_normal_and_tex_coords, vert_index);
 		poss[i] = dequantize_position(quantized_pos, g_dequantization_factor, g_dequantization_summand);
@@ -69,16 +121,35 @@ shading_data_t get_shading_data(int triangle_index, vec2 barycentrics, bool fron
 		tex_coord += barys[i] * tex_coords[i];
 	}
 	normal_geo = normalize(normal_geo);
+	// Transfer the ray differential to the triangle plane (Igehy 1999,
+	// "Tracing Ray Differentials") and turn it into derivatives of the
+	// texture coordinate. Unlike dFdx(), this also works in compute shaders
+	// and in non-uniform control flow.
+	mat2 tex_edges = mat2(tex_coords[1] - tex_coords[0], tex_coords[2] - tex_coords[0]);
+	vec3 edge_1 = poss[1] - poss[0];
+	vec3 edge_2 = poss[2] - poss[0];
+	vec3 normal_tri = cross(edge_1, edge_2);
+	float out_dot_normal = dot(out_dir, normal_tri);
+	float inv_out_dot_normal = (out_dot_normal != 0.0) ? (1.0 / out_dot_normal) : 0.0;
+	float inv_normal_length_sq = 1.0 / max(1.0e-30, dot(normal_tri, normal_tri));
+	vec2 tex_coord_derivatives[2];
+	[[unroll]]
+	for (int i = 0; i != 2; ++i) {
+		vec3 offset = (i == 0) ? fma(vec3(hit_distance), ray_diff.dir_dx, ray_diff.origin_dx) : fma(vec3(hit_distance), ray_diff.dir_dy, ray_diff.origin_dy);
+		vec3 pos_derivative = offset - (dot(offset, normal_tri) * inv_out_dot_normal) * out_dir;
+		vec2 bary_derivative = vec2(dot(cross(pos_derivative, edge_2), normal_tri), dot(cross(edge_1, pos_derivative), normal_tri));
+		tex_coord_derivatives[i] = tex_edges * (bary_derivative * inv_normal_length_sq);
+	}
+	vec2 tex_coord_dx = tex_coord_derivatives[0], tex_coord_dy = tex_coord_derivatives[1];
 	// Sample the material textures
 	uint material_index = texelFetch(g_material_indices, triangle_index).r;
-	vec3 base_color_tex = texture(g_textures[nonuniformEXT(3 * material_index + 0)], tex_coord).rgb;
-	vec3 specular_tex = texture(g_textures[nonuniformEXT(3 * material_index + 1)], tex_coord).rgb;
-	vec2 normal_tex = texture(g_textures[nonuniformEXT(3 * material_index + 2)], tex_coord).rg;
+	vec3 base_color_tex = sample_material_texture(3 * material_index + 0, tex_coord, tex_coord_dx, tex_coord_dy).rgb;
+	vec3 specular_tex = sample_material_texture(3 * material_index + 1, tex_coord, tex_coord_dx, tex_coord_dy).rgb;
+	vec2 normal_tex = sample_material_texture(3 * material_index + 2, tex_coord, tex_coord_dx, tex_coord_dy).rg;
 	vec3 normal_local;
 	normal_local.xy = normal_tex * 2.0 - vec2(1.0);
 	normal_local.z = sqrt(max(0.0, (1.0 - normal_local.x * normal_local.x) - normal_local.y * normal_local.y));
 	// Transform the normal to world space
-	mat2 tex_edges = mat2(tex_coords[1] - tex_coords[0], tex_coords[2] - tex_coords[0]);
 	vec3 pre_tangent_0 = cross(normal_geo, poss[1] - poss[0]);
 	vec3 pre_tangent_1 = cross(normal_geo, poss[0] - poss[2]);
 	vec3 tangent_0 = pre_tangent_1 * tex_edges[0][0] + pre_tangent_0 * tex_edges[1][0];
@@ -98,6 +169,6 @@ shading_data_t get_shading_data(int triangle_index, vec2 barycentrics, bool fron
 	s.diffuse_albedo = base_color_tex - metalicity * base_color_tex;
 	s.fresnel_0 = mix(vec3(0.02), base_color_tex, metalicity);
 	s.roughness = max(0.006, specular_tex.g * specular_tex.g);
-	s.emission = (material_index == EMISSION_MATERIAL_INDEX) ? g_emission_material_radiance : vec3(0.0);
+	s.emission = (material_index == g_emission_material_index) ? g_emission_material_radiance : vec3(0.0);
 	return s;
 }
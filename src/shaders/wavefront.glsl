@@ -0,0 +1,121 @@
+// Declarations shared by the kernels of the wavefront path tracer and the
+// fragment shader that resolves its results. constants.glsl has to be
+// included first. WAVEFRONT_GROUP_SIZE has to be defined.
+
+//! The ray queues alternate between path vertices. Rays for vertex k (where k
+//! is g_depth) are in queue (k - 1) % 2.
+#define WAVEFRONT_RAY_QUEUE_0 0
+#define WAVEFRONT_RAY_QUEUE_1 1
+//! The queue of shadow rays towards lights from next-event estimation
+#define WAVEFRONT_SHADOW_QUEUE 2
+//! The total number of queues
+#define WAVEFRONT_QUEUE_COUNT 3
+
+
+//! The state of a single path of the wavefront path tracer. Paths are indexed
+//! by their pixel index, i.e. x + y * width.
+struct path_state_t {
+	//! The origin of the ray that is extended next. Also the origin of the
+	//! shadow ray.
+	vec3 ray_origin;
+	//! The first half of the random seed for get_random_numbers()
+	uint seed_0;
+	//! The normalized direction of the ray that is extended next
+	vec3 ray_dir;
+	//! The second half of the random seed
+	uint seed_1;
+	//! The throughput weight for the path as in path_trace_nee()
+	vec3 throughput_weight;
+	//! The index of the triangle hit by the extended ray or -1 for a miss
+	int triangle_index;
+	//! The throughput weight for emission at the next vertex, accounting for
+	//! MIS, as in path_trace_nee()
+	vec3 nee_throughput_weight;
+	//! 1 iff the extended ray hit the front of the triangle
+	uint front;
+	//! The radiance estimate accumulated along the path so far
+	vec3 radiance;
+	//! The first barycentric coordinate for the hit of the extended ray (as
+	//! used by get_shading_data())
+	float barycentric_0;
+	//! The normalized direction of the shadow ray towards a light
+	vec3 shadow_dir;
+	//! The second barycentric coordinate for the hit
+	float barycentric_1;
+	//! The factor by which emission found by the shadow ray is multiplied
+	//! before being added to radiance
+	vec3 shadow_weight;
+	//! The distance from the ray origin to the hit of the extended ray
+	float hit_distance;
+};
+
+
+//! The header of a queue of path indices, which is also used for indirect
+//! dispatches
+struct queue_header_t {
+	//! The arguments of vkCmdDispatchIndirect(). group_count_x is incremented
+	//! whenever an entry with an index that is a multiple of
+	//! WAVEFRONT_GROUP_SIZE is appended.
+	uint group_count_x, group_count_y, group_count_z;
+	//! The number of valid entries in the queue
+	uint count;
+};
+
+
+//! States for all paths (one per pixel)
+layout (std430, binding = 8) buffer path_states {
+	path_state_t g_path_states[];
+};
+
+//! Headers of all queues followed by their entries. The entries of queue i
+//! begin at index i * pixel count.
+layout (std430, binding = 9) buffer queues {
+	queue_header_t g_queue_headers[WAVEFRONT_QUEUE_COUNT];
+	//! The index of the path vertex that is found by the rays that are
+	//! currently extended, where primary rays find vertex 1. The host writes
+	//! it before each bounce.
+	uint g_depth;
+	//! Unused, only here for alignment
+	uint g_queue_padding[3];
+	uint g_queue_entries[];
+};
+
+
+//! \return The number of pixels, which is also the number of paths
+uint get_pixel_count() {
+	return uint(g_viewport_size.x) * uint(g_viewport_size.y);
+}
+
+
+/*! Appends a path index to the given queue, compacting all entries into a
+	contiguous range and updating the arguments for the indirect dispatch.
+	\param queue_index The index of the queue, e.g. WAVEFRONT_SHADOW_QUEUE.
+	\param path_index The path index to append.*/
+void append_to_queue(uint queue_index, uint path_index) {
+	uint entry_index = atomicAdd(g_queue_headers[queue_index].count, 1u);
+	g_queue_entries[queue_index * get_pixel_count() + entry_index] = path_index;
+	if (entry_index % WAVEFRONT_GROUP_SIZE == 0)
+		atomicAdd(g_queue_headers[queue_index].group_count_x, 1u);
+}
+
+
+/*! Retrieves the path index for an invocation of a kernel that processes the
+	given queue.
+	\param out_path_index The path index, if the invocation is in bounds.
+	\param queue_index The index of the queue that is being processed.
+	\param entry_index The index of the queue entry, i.e. the global
+		invocation index.
+	\return false if the invocation is out of bounds and should return.*/
+bool get_queued_path(out uint out_path_index, uint queue_index, uint entry_index) {
+	if (entry_index >= g_queue_headers[queue_index].count)
+		return false;
+	out_path_index = g_queue_entries[queue_index * get_pixel_count() + entry_index];
+	return true;
+}
+
+
+//! \return The index of the ray queue holding the rays that are currently
+//!		extended
+uint get_current_ray_queue() {
+	return (g_depth - 1) % 2;
+}
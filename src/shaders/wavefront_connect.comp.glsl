@@ -0,0 +1,23 @@
+#version 460
+#extension GL_GOOGLE_include_directive : enable
+#extension GL_EXT_nonuniform_qualifier : enable
+#extension GL_EXT_control_flow_attributes : enable
+#extension GL_EXT_ray_query : enable
+#include "path_tracing.glsl"
+#include "wavefront.glsl"
+
+
+layout (local_size_x = WAVEFRONT_GROUP_SIZE) in;
+
+
+//! Traces all queued shadow rays towards lights and adds the emission that
+//! they find to the radiance estimates of their paths
+void main() {
+	if (gl_GlobalInvocationID.x == 0)
+		g_ray_count += g_queue_headers[WAVEFRONT_SHADOW_QUEUE].count;
+	uint path_index;
+	if (!get_queued_path(path_index, WAVEFRONT_SHADOW_QUEUE, gl_GlobalInvocationID.x))
+		return;
+	vec3 light_emission = trace_ray_emission(g_path_states[path_index].ray_origin, g_path_states[path_index].shadow_dir);
+	g_path_states[path_index].radiance += g_path_states[path_index].shadow_weight * light_emission;
+}
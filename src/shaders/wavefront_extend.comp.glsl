@@ -0,0 +1,39 @@
+#version 460
+#extension GL_GOOGLE_include_directive : enable
+#extension GL_EXT_nonuniform_qualifier : enable
+#extension GL_EXT_control_flow_attributes : enable
+#extension GL_EXT_ray_query : enable
+#include "path_tracing.glsl"
+#include "wavefront.glsl"
+
+
+layout (local_size_x = WAVEFRONT_GROUP_SIZE) in;
+
+
+//! Traces the rays of all queued paths and stores where they hit the scene.
+//! Shading happens in a separate kernel, so this one is only about traversal.
+void main() {
+	uint queue_index = get_current_ray_queue();
+	if (gl_GlobalInvocationID.x == 0) {
+		g_ray_count += g_queue_headers[queue_index].count;
+		g_path_vertex_count += g_queue_headers[queue_index].count;
+	}
+	uint path_index;
+	if (!get_queued_path(path_index, queue_index, gl_GlobalInvocationID.x))
+		return;
+	vec3 ray_origin = g_path_states[path_index].ray_origin;
+	vec3 ray_dir = g_path_states[path_index].ray_dir;
+	rayQueryEXT ray_query;
+	rayQueryInitializeEXT(ray_query, g_bvh, gl_RayFlagsOpaqueEXT, 0xff, ray_origin, 1.0e-3, ray_dir, 1e38);
+	while (rayQueryProceedEXT(ray_query)) {}
+	if (rayQueryGetIntersectionTypeEXT(ray_query, true) == gl_RayQueryCommittedIntersectionNoneEXT)
+		g_path_states[path_index].triangle_index = -1;
+	else {
+		vec2 barys = rayQueryGetIntersectionBarycentricsEXT(ray_query, true);
+		g_path_states[path_index].triangle_index = rayQueryGetIntersectionPrimitiveIndexEXT(ray_query, true);
+		g_path_states[path_index].front = rayQueryGetIntersectionFrontFaceEXT(ray_query, true) ? 1u : 0u;
+		g_path_states[path_index].barycentric_0 = barys[0];
+		g_path_states[path_index].barycentric_1 = barys[1];
+		g_path_states[path_index].hit_distance = rayQueryGetIntersectionTEXT(ray_query, true);
+	}
+}
@@ -0,0 +1,40 @@
+#version 460
+#extension GL_GOOGLE_include_directive : enable
+#extension GL_EXT_nonuniform_qualifier : enable
+#extension GL_EXT_control_flow_attributes : enable
+#extension GL_EXT_ray_query : enable
+#include "path_tracing.glsl"
+#include "wavefront.glsl"
+
+
+layout (local_size_x = WAVEFRONT_GROUP_SIZE) in;
+
+
+//! Generates one primary ray per pixel and initializes all path states. The
+//! host has already written the header of WAVEFRONT_RAY_QUEUE_0 to account
+//! for all pixels, so this kernel only fills in its entries.
+void main() {
+	uint path_index = gl_GlobalInvocationID.x;
+	if (path_index == 0)
+		g_path_count += get_pixel_count();
+	if (path_index >= get_pixel_count())
+		return;
+	uint width = uint(g_viewport_size.x);
+	uvec2 pixel = uvec2(path_index % width, path_index / width);
+	path_state_t path;
+	// The shading kernel recomputes the ray differential
+	ray_differential_t ray_diff;
+	uvec2 seed = get_primary_ray(path.ray_origin, path.ray_dir, ray_diff, pixel);
+	path.seed_0 = seed[0];
+	path.seed_1 = seed[1];
+	path.throughput_weight = vec3(1.0);
+	path.nee_throughput_weight = vec3(1.0);
+	path.radiance = vec3(0.0);
+	path.triangle_index = -1;
+	path.front = 0u;
+	path.barycentric_0 = path.barycentric_1 = 0.0;
+	path.shadow_dir = path.shadow_weight = vec3(0.0);
+	path.hit_distance = 0.0;
+	g_path_states[path_index] = path;
+	g_queue_entries[WAVEFRONT_RAY_QUEUE_0 * get_pixel_count() + path_index] = path_index;
+}
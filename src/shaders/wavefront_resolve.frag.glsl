@@ -0,0 +1,17 @@
+#version 460
+#extension GL_GOOGLE_include_directive : enable
+#include "constants.glsl"
+#include "wavefront.glsl"
+
+
+//! The outgoing radiance towards the camera as sRGB color
+layout (location = 0) out vec4 g_out_color;
+
+
+//! Outputs the radiance estimate that the wavefront path tracer has computed
+//! for this pixel, such that blending can accumulate it as usual
+void main() {
+	uvec2 pixel = uvec2(gl_FragCoord.xy);
+	uint path_index = pixel.x + pixel.y * uint(g_viewport_size.x);
+	g_out_color = vec4(g_path_states[path_index].radiance, 1.0);
+}
@@ -0,0 +1,82 @@
+#version 460
+#extension GL_GOOGLE_include_directive : enable
+#extension GL_EXT_nonuniform_qualifier : enable
+#extension GL_EXT_control_flow_attributes : enable
+#extension GL_EXT_ray_query : enable
+#include "path_tracing.glsl"
+#include "wavefront.glsl"
+
+
+layout (local_size_x = WAVEFRONT_GROUP_SIZE) in;
+
+
+/*! Shades the hits found by the extension kernel. This is one iteration of
+	the loop in path_trace_nee() without the ray tracing: It accumulates
+	emission, samples a light and queues a shadow ray for it, then samples
+	the BRDF and queues the path for extension, unless it ends or gets
+	terminated by Russian roulette. Splitting is not supported.*/
+void main() {
+	uint queue_index = get_current_ray_queue();
+	uint path_index;
+	if (!get_queued_path(path_index, queue_index, gl_GlobalInvocationID.x))
+		return;
+	path_state_t path = g_path_states[path_index];
+	uvec2 seed = uvec2(path.seed_0, path.seed_1);
+	// Primary rays filter textures as in the fragment shader. Their
+	// differential is recomputed rather than stored in the path state.
+	ray_differential_t ray_diff = NO_RAY_DIFFERENTIAL;
+	if (g_depth == 1) {
+		uint width = uint(g_viewport_size.x);
+		vec3 primary_origin, primary_dir;
+		get_primary_ray(primary_origin, primary_dir, ray_diff, uvec2(path_index % width, path_index / width));
+	}
+	// Construct shading data or use the sky color
+	shading_data_t s;
+	bool hit = (path.triangle_index >= 0);
+	if (hit)
+		s = get_shading_data(path.triangle_index, vec2(path.barycentric_0, path.barycentric_1), path.front != 0, -path.ray_dir, path.hit_distance, ray_diff);
+	else
+		s.emission = g_sky_radiance;
+	path.radiance += path.nee_throughput_weight * s.emission;
+	if (hit && g_depth < PATH_LENGTH) {
+		// Sample a direction towards a light
+		float light_sample_density;
+		vec3 light_dir = sample_lights(light_sample_density, s.pos, s.normal, get_random_numbers(seed));
+		// Discard the sample if it is in the lower hemisphere, otherwise
+		// queue a shadow ray with the MIS weight
+		float lambert_in_0 = dot(s.normal, light_dir);
+		if (lambert_in_0 > 0.0) {
+			float light_density_0 = get_lights_density(s.pos, s.normal, light_dir, light_sample_density);
+			float brdf_density_0 = get_frostbite_brdf_density(s, light_dir);
+			path.shadow_dir = light_dir;
+			path.shadow_weight = path.throughput_weight * frostbite_brdf(s, light_dir) * (lambert_in_0 / (light_density_0 + brdf_density_0));
+			append_to_queue(WAVEFRONT_SHADOW_QUEUE, path_index);
+		}
+		// Sample the BRDF for MIS and to continue the path
+		path.ray_origin = s.pos;
+		path.ray_dir = sample_frostbite_brdf(s, get_random_numbers(seed));
+		float lambert_in_1 = dot(s.normal, path.ray_dir);
+		// Only queue the path for extension if the sample is in the upper
+		// hemisphere
+		if (lambert_in_1 > 0.0) {
+			// Compute the throughput weight for emission at the next vertex,
+			// accounting for MIS
+			float light_density_1 = get_lights_density(s.pos, s.normal, path.ray_dir, 0.0);
+			float brdf_density_1 = get_frostbite_brdf_density(s, path.ray_dir);
+			vec3 brdf_lambert_1 = frostbite_brdf(s, path.ray_dir) * lambert_in_1;
+			path.nee_throughput_weight = path.throughput_weight * (brdf_lambert_1 / (light_density_1 + brdf_density_1));
+			// Update the throughput-weight for the path
+			path.throughput_weight *= brdf_lambert_1 * (1.0 / brdf_density_1);
+			// Possibly terminate the path early
+			float survival_weight = russian_roulette(path.throughput_weight, g_depth, seed);
+			if (survival_weight != 0.0) {
+				path.throughput_weight *= survival_weight;
+				path.nee_throughput_weight *= survival_weight;
+				append_to_queue(1 - queue_index, path_index);
+			}
+		}
+	}
+	path.seed_0 = seed[0];
+	path.seed_1 = seed[1];
+	g_path_states[path_index] = path;
+}
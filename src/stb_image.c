@@ -0,0 +1,7 @@
+#define STB_IMAGE_IMPLEMENTATION
+// Only the zlib decoder is needed for compressed scene and texture files
+#define STBI_ONLY_ZLIB
+#define STBI_SUPPORT_ZLIB
+#define STBI_NO_LINEAR
+#define STBI_NO_STDIO
+#include "stb_image.h"
@@ -0,0 +1,62 @@
+#include "texture_pack.h"
+#include "hashing.h"
+#include <stdio.h>
+#include <string.h>
+
+
+int open_texture_pack(texture_pack_t* pack, const char* pack_file_path) {
+	memset(pack, 0, sizeof(*pack));
+	if (map_file(&pack->mapping, pack_file_path))
+		return 1;
+	// Read the header and the table of contents
+	size_t cursor = 0;
+	texture_pack_header_t* header = &pack->header;
+	if (read_mapped_file(header, sizeof(*header), &pack->mapping, &cursor) || header->marker != TEXTURE_PACK_MARKER || header->version != 1
+		|| header->slot_count == 0 || (header->slot_count & (header->slot_count - 1)) != 0 || header->entry_count >= header->slot_count
+		|| !(pack->slots = skip_mapped_file(header->slot_count * sizeof(texture_pack_slot_t), &pack->mapping, &cursor))
+		|| !(pack->names = skip_mapped_file((size_t) header->names_size, &pack->mapping, &cursor)))
+	{
+		printf("The texture pack at %s is invalid or truncated.\n", pack_file_path);
+		close_texture_pack(pack);
+		return 1;
+	}
+	// Check that all names and texture files are within the pack
+	for (uint32_t i = 0; i != header->slot_count; ++i) {
+		const texture_pack_slot_t* slot = &pack->slots[i];
+		if (slot->name_length == 0)
+			continue;
+		if ((uint64_t) slot->name_offset + slot->name_length > header->names_size
+			|| slot->offset > pack->mapping.size || slot->size > pack->mapping.size - slot->offset)
+		{
+			printf("Entry %u in the table of contents of the texture pack at %s is out of bounds.\n", i, pack_file_path);
+			close_texture_pack(pack);
+			return 1;
+		}
+	}
+	open_direct_file(&pack->direct_file, pack_file_path);
+	return 0;
+}
+
+
+void close_texture_pack(texture_pack_t* pack) {
+	close_direct_file(&pack->direct_file);
+	unmap_file(&pack->mapping);
+	memset(pack, 0, sizeof(*pack));
+}
+
+
+const texture_pack_slot_t* find_packed_texture(const texture_pack_t* pack, const char* file_name) {
+	if (!pack->slots)
+		return NULL;
+	size_t length = strlen(file_name);
+	uint64_t hash = hash_bytes(file_name, length);
+	uint32_t mask = pack->header.slot_count - 1;
+	// There is at least one unused slot, so this loop terminates
+	for (uint32_t i = (uint32_t) (hash & mask);; i = (i + 1) & mask) {
+		const texture_pack_slot_t* slot = &pack->slots[i];
+		if (slot->name_length == 0)
+			return NULL;
+		if (slot->name_hash == hash && slot->name_length == length && memcmp(pack->names + slot->name_offset, file_name, length) == 0)
+			return slot;
+	}
+}
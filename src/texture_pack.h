@@ -0,0 +1,87 @@
+#pragma once
+#include "direct_io.h"
+#include "file_mapping.h"
+#include <stdbool.h>
+
+
+//! The file marker at the beginning of each *.vkp texture pack
+#define TEXTURE_PACK_MARKER 0xbc1bcf
+
+
+/*! The header of a *.vkp texture pack. A pack concatenates the *.vkt files of
+	one texture directory, such that they can be loaded with a single open.
+	The header is followed by a hash table with slot_count entries of type
+	texture_pack_slot_t, a table of names and zero padding. Each texture file
+	begins at a multiple of DIRECT_READ_ALIGNMENT bytes from the beginning of
+	the pack, so aligned texture files remain aligned.*/
+typedef struct {
+	//! Should be TEXTURE_PACK_MARKER
+	uint32_t marker;
+	//! The file format version. Should be 1.
+	uint32_t version;
+	//! The number of texture files in the pack
+	uint32_t entry_count;
+	//! The number of slots in the hash table, a power of two that is greater
+	//! than entry_count
+	uint32_t slot_count;
+	//! The size in bytes of the table of names
+	uint64_t names_size;
+} texture_pack_header_t;
+
+
+/*! A slot in the hash table of a texture pack. Texture files are keyed by
+	their file name, i.e. material name and texture type suffix, e.g.
+	"Brick_BaseColor.vkt". The slot of a name is found by linear probing
+	from its hash (as computed by hash_bytes()) modulo slot_count. Unused slots
+	have a name_length of zero.*/
+typedef struct {
+	//! hash_bytes() of the name
+	uint64_t name_hash;
+	//! The offset in bytes from the beginning of the pack to the texture file
+	uint64_t offset;
+	//! The size in bytes of the texture file
+	uint64_t size;
+	//! The offset in bytes of the name in the table of names and its length
+	//! (without terminating null)
+	uint32_t name_offset;
+	uint32_t name_length;
+} texture_pack_slot_t;
+
+
+//! A texture pack that has been mapped into memory
+typedef struct {
+	//! The mapped pack
+	file_mapping_t mapping;
+	//! A second handle for the pack that bypasses the page cache. It is not
+	//! open if the file system does not support that.
+	direct_file_t direct_file;
+	//! The header of the pack
+	texture_pack_header_t header;
+	//! header.slot_count slots of the hash table (pointing into the mapping)
+	const texture_pack_slot_t* slots;
+	//! The table of names (pointing into the mapping)
+	const char* names;
+} texture_pack_t;
+
+
+/*! Maps the texture pack at the given path and validates its table of
+	contents.
+	\param pack The output. Clean up with close_texture_pack().
+	\param pack_file_path The path of the *.vkp file.
+	\return 0 upon success. 1 if the pack does not exist or is invalid. Only
+		the latter prints a message.*/
+int open_texture_pack(texture_pack_t* pack, const char* pack_file_path);
+
+
+//! Unmaps a texture pack opened by open_texture_pack(). Safe to call for
+//! zeroed objects.
+void close_texture_pack(texture_pack_t* pack);
+
+
+/*! Looks up a texture file in the given pack.
+	\param pack Output of open_texture_pack().
+	\param file_name The name of the texture file without its directory, e.g.
+		"Brick_BaseColor.vkt".
+	\return The slot of the texture file or NULL if the pack does not hold
+		it.*/
+const texture_pack_slot_t* find_packed_texture(const texture_pack_t* pack, const char* file_name);
@@ -1,15 +1,25 @@
 #include "textures.h"
+#include "threading.h"
+#include "chunked_payload.h"
+#include "direct_io.h"
+#include "texture_pack.h"
+#include "hashing.h"
+#include "vulkan_formats.h"
+#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 
-//! The header of a *.vkt texture file
+//! The header of a *.vkt texture file. Its layout matches the file.
 typedef struct {
 	//! This file format marker should be 0xbc1bc1 (although formats other than
 	//! BC1 are supported)
 	uint32_t marker;
-	//! The used file format version (should be 1)
+	//! The used file format version. Should be 1, 2 for a compressed
+	//! payload (see chunked_payload_t) or 3 for a payload in which the
+	//! payload and all mipmaps begin at multiples of DIRECT_READ_ALIGNMENT
+	//! bytes.
 	uint32_t version;
 	//! The number of mipmap levels
 	uint32_t mipmap_count;
@@ -17,12 +27,14 @@ typedef struct {
 	VkExtent2D extent;
 	//! The format used for the texture
 	VkFormat format;
-	//! The data size in bytes of all mipmaps combined (excluding headers)
+	//! The data size in bytes of all mipmaps combined (excluding headers but
+	//! including padding in version 3)
 	VkDeviceSize size;
 } texture_header_t;
 
 
-//! Each mipmap in a *.vkt file begins with such a header
+//! The header of a *.vkt file is followed by one such header per mipmap. Its
+//! layout matches the file.
 typedef struct {
 	//! The extent of this mipmap in pixels
 	VkExtent2D extent;
@@ -35,15 +47,53 @@ typedef struct {
 
 //! Handles data needed for loading a single texture
 typedef struct {
-	//! A file handle for the texture file that is being loaded
+	//! A file handle for the texture file that is being loaded or NULL if it
+	//! is loaded from a texture pack
 	FILE* file;
+	//! For textures from a texture pack, the mapped pack and the offset in
+	//! bytes from its beginning to the texture file. NULL and 0 otherwise.
+	const file_mapping_t* pack_mapping;
+	uint64_t pack_offset;
+	//! For version 3, a second handle for the same file, which bypasses the
+	//! page cache. If it could not be opened, file is used instead. Textures
+	//! from a pack share the handle of the pack.
+	direct_file_t direct_file;
 	//! The header of the texture file
 	texture_header_t header;
 	//! header.mipmap_count headers of mipmaps
 	mipmap_header_t* mipmap_headers;
+	//! The offset in bytes from the start of the texture file to the payload,
+	//! i.e. to the first mipmap (only for uncompressed files)
+	uint64_t payload_offset;
+	//! The chunk table for compressed texture files
+	chunked_payload_t compressed_payload;
+	//! A cheap hash of the coarsest mipmap and, for compressed files, the
+	//! chunk table. Only computed if another texture has an identical
+	//! header, 0 otherwise.
+	uint64_t key_hash;
+	//! A hash of the payload as stored in the file (i.e. of the compressed
+	//! data for compressed files). Only computed if another texture has an
+	//! identical header and key_hash, 0 otherwise.
+	uint64_t payload_hash;
+	//! Whether all texels of the finest mipmap have the same value
+	bool constant;
+	//! If constant is true, the value of all texels as returned by a sampler
+	float constant_color[4];
 } texture_t;
 
 
+//! Keeps track of the time span in which file contents are being read.
+//! Times are in seconds as produced by glfwGetTime().
+typedef struct {
+	//! Protects all other members
+	mutex_t* mutex;
+	//! The time at which the first mipmap began loading or 0.0
+	double begin;
+	//! The time at which the most recent mipmap finished loading
+	double end;
+} io_timing_t;
+
+
 /*! Handles data needed whilst loading textures. Unlike most other structures
 	like this, this one is freed once loading is finished and only the images
 	are preserved.*/
@@ -51,82 +101,699 @@ typedef struct {
 	//! \see load_textures()
 	images_t* images;
 	//! \see load_textures()
+	const char* const* texture_file_paths;
+	//! \see load_textures()
 	uint32_t texture_count;
 	//! Data about the individual textures being loaded
 	texture_t* textures;
+	//! The texture pack from which textures are loaded, if it holds them, or
+	//! NULL
+	texture_pack_t* pack;
+	//! Used to measure how long reading mipmaps takes. Mipmaps are read by
+	//! multiple threads. NULL if no measurements should be taken.
+	io_timing_t* io_timing;
 } textures_t;
 
 
+struct texture_stream_s {
+	//! The textures with open files. The image and file path pointers are
+	//! NULL.
+	textures_t textures;
+	//! For each texture, the index of the finest mipmap that has been loaded
+	//! and is covered by the view
+	uint32_t* loaded_levels;
+	//! The copies of the mipmaps that are being loaded or NULL
+	image_upload_t* upload;
+	//! For each texture, whether upload holds its next finer mipmap
+	bool* uploading;
+	//! \see load_textures()
+	VkImageLayout image_layout;
+};
+
+
+/*! Reads a range of a texture file, which is either a file of its own or
+	part of a mapped texture pack. Different textures can be read
+	concurrently but a single texture cannot.
+	\param destination Pointer to size bytes that receive the data.
+	\param texture The texture, which has been opened by init_texture().
+	\param offset The offset in bytes from the beginning of the texture file.
+	\param size The number of bytes to read.
+	\return 0 upon success.*/
+int read_texture_file(void* destination, const texture_t* texture, uint64_t offset, size_t size) {
+	if (texture->pack_mapping) {
+		size_t cursor = (size_t) (texture->pack_offset + offset);
+		return read_mapped_file(destination, size, texture->pack_mapping, &cursor);
+	}
+	if (fseek(texture->file, (long) offset, SEEK_SET))
+		return 1;
+	return fread(destination, sizeof(uint8_t), size, texture->file) != size;
+}
+
+
+//! \return A pointer to the file name at the end of the given path
+const char* get_file_name(const char* file_path) {
+	const char* file_name = file_path;
+	for (const char* character = file_path; *character; ++character)
+		if (*character == '/' || *character == '\\')
+			file_name = character + 1;
+	return file_name;
+}
+
+
 /*! Opens the given texture file, loads its header and the headers of its
-	mipmaps. Returns 0 upon success. Upon failure, the calling side must free
-	the partially initialized texture.*/
-int init_texture(texture_t* texture, const char* texture_file_path) {
+	mipmaps. If the given pack holds a file of the same name, it is used
+	instead of the file at the given path. Returns 0 upon success. Upon
+	failure, the calling side must free the partially initialized texture.*/
+int init_texture(texture_t* texture, const char* texture_file_path, const texture_pack_t* pack) {
 	memset(texture, 0, sizeof(*texture));
-	FILE* file = texture->file = fopen(texture_file_path, "rb");
-	if (!file) {
+	const texture_pack_slot_t* slot = pack ? find_packed_texture(pack, get_file_name(texture_file_path)) : NULL;
+	if (slot) {
+		texture->pack_mapping = &pack->mapping;
+		texture->pack_offset = slot->offset;
+	}
+	else if (!(texture->file = fopen(texture_file_path, "rb"))) {
 		printf("Failed to open the texture file at %s. Please check path and permissions.\n", texture_file_path);
 		return 1;
 	}
 	// Load the texture header
-	fread(&texture->header.marker, sizeof(uint32_t), 1, file);
-	if (texture->header.marker != 0xbc1bc1) {
+	if (read_texture_file(&texture->header, texture, 0, sizeof(texture->header)) || texture->header.marker != 0xbc1bc1) {
 		printf("The file at %s does not appear to be a valid *.vkt texture file as it does not start with the appropriate file marker. Images from widely used formats must be piped through a texture conversion tool before loading them.\n", texture_file_path);
 		return 1;
 	}
-	fread(&texture->header.version, sizeof(uint32_t), 1, file);
-	if (texture->header.version != 1) {
+	if (texture->header.version < 1 || texture->header.version > 3) {
 		printf("The texture file at %s uses file format version %u, which is not supported.\n", texture_file_path, texture->header.version);
 		return 1;
 	}
-	fread(&texture->header.mipmap_count, sizeof(uint32_t), 1, file);
-	fread(&texture->header.extent, sizeof(uint32_t), 2, file);
-	fread(&texture->header.format, sizeof(uint32_t), 1, file);
-	fread(&texture->header.size, sizeof(uint64_t), 1, file);
 	// Load mipmap headers
-	texture->mipmap_headers = calloc(texture->header.mipmap_count, sizeof(mipmap_header_t));
-	for (uint32_t i = 0; i != texture->header.mipmap_count; ++i) {
-		mipmap_header_t* header = &texture->mipmap_headers[i];
-		fread(&header->extent, sizeof(uint32_t), 2, file);
-		fread(&header->size, sizeof(uint64_t), 1, file);
-		fread(&header->offset, sizeof(uint64_t), 1, file);
+	texture->mipmap_headers = calloc(texture->header.mipmap_count + 1, sizeof(mipmap_header_t));
+	if (read_texture_file(texture->mipmap_headers, texture, sizeof(texture->header), texture->header.mipmap_count * sizeof(mipmap_header_t))) {
+		printf("The texture file at %s ends within the mipmap headers.\n", texture_file_path);
+		return 1;
+	}
+	texture->payload_offset = sizeof(texture->header) + texture->header.mipmap_count * sizeof(mipmap_header_t);
+	// Aligned files pad the headers and all mipmaps, such that they can be
+	// read directly into staging memory
+	if (texture->header.version == 3) {
+		texture->payload_offset = (texture->payload_offset + DIRECT_READ_ALIGNMENT - 1) & ~((uint64_t) DIRECT_READ_ALIGNMENT - 1);
+		for (uint32_t i = 0; i != texture->header.mipmap_count; ++i) {
+			if (texture->mipmap_headers[i].offset % DIRECT_READ_ALIGNMENT != 0 || texture->pack_offset % DIRECT_READ_ALIGNMENT != 0) {
+				printf("Mipmap %u of the aligned texture file at %s is not aligned.\n", i, texture_file_path);
+				return 1;
+			}
+		}
+		if (slot)
+			texture->direct_file = pack->direct_file;
+		else
+			open_direct_file(&texture->direct_file, texture_file_path);
+	}
+	// Compressed files have a chunk table in front of the mipmaps
+	if (texture->header.version == 2) {
+		int result;
+		if (slot) {
+			// The compressed data stays in the mapping but its offset is
+			// relative to the texture file like all others
+			size_t cursor = (size_t) (texture->pack_offset + texture->payload_offset);
+			result = read_mapped_chunked_payload(&texture->compressed_payload, texture->pack_mapping, &cursor);
+			if (!result)
+				texture->compressed_payload.data_offset -= texture->pack_offset;
+		}
+		else
+			result = fseek(texture->file, (long) texture->payload_offset, SEEK_SET) || read_chunked_payload(&texture->compressed_payload, texture->file);
+		if (result) {
+			printf("Failed to read the chunk table of the compressed texture file at %s.\n", texture_file_path);
+			return 1;
+		}
+		if (get_uncompressed_payload_size(&texture->compressed_payload) != texture->header.size) {
+			printf("The compressed payload of the texture file at %s has %lu bytes but the header claims %lu bytes.\n", texture_file_path, get_uncompressed_payload_size(&texture->compressed_payload), texture->header.size);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+
+//! Closes the files of the given texture and frees its memory
+void free_texture(texture_t* texture) {
+	if (texture->file) fclose(texture->file);
+	// The pack owns the direct handles of packed textures
+	if (!texture->pack_mapping) close_direct_file(&texture->direct_file);
+	free(texture->mipmap_headers);
+	free_chunked_payload(&texture->compressed_payload);
+}
+
+
+//! A task for run_parallel() that invokes init_texture() for the texture with
+//! the given index in a textures_t
+int init_texture_task(void* raw_textures, uint32_t texture_index) {
+	textures_t* textures = (textures_t*) raw_textures;
+	if (init_texture(&textures->textures[texture_index], textures->texture_file_paths[texture_index], textures->pack)) {
+		printf("Failed to load texture %u out of %u. Its file path is %s.\n", texture_index, textures->texture_count, textures->texture_file_paths[texture_index]);
+		return 1;
 	}
 	return 0;
 }
 
 
-//! A callback for fill_images() that loads a single mipmap from an already
-//! opened texture file
+/*! Reads the data of one mipmap of the given texture from its file.
+	\param destination Pointer to mipmap_headers[mip_level].size bytes.
+	\param texture The texture with its headers loaded.
+	\param mip_level The index of the mipmap to read.
+	\return 0 upon success.*/
+int read_mipmap(void* destination, const texture_t* texture, uint32_t mip_level) {
+	const mipmap_header_t* mipmap = &texture->mipmap_headers[mip_level];
+	// Compressed chunks are decompressed straight into the destination.
+	// Different textures are handled concurrently.
+	if (texture->header.version == 2)
+		return read_chunked_payload_range(destination, mipmap->offset, mipmap->size, &texture->compressed_payload, texture->file);
+	return read_texture_file(destination, texture, texture->payload_offset + mipmap->offset, (size_t) mipmap->size);
+}
+
+
+/*! Decodes all texels of a single block of texture data in one of the
+	formats produced by the texture conversion tool (or a plain RGBA8 format).
+	\param texels Receives RGBA values for all texels in the block. Channels
+		that the format lacks are 0 (or 255 for alpha).
+	\param block Pointer to the block data.
+	\param format The format of the texture.
+	\return The number of decoded texels, i.e. 16 for block-compressed
+		formats, 1 for uncompressed formats and 0 if the format is not
+		supported.*/
+uint32_t decode_block(uint8_t texels[16][4], const uint8_t* block, VkFormat format) {
+	switch (format) {
+		case VK_FORMAT_R8G8B8A8_UNORM:
+		case VK_FORMAT_R8G8B8A8_SRGB:
+			memcpy(texels[0], block, 4);
+			return 1;
+		case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+		case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+		case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+		case VK_FORMAT_BC1_RGBA_SRGB_BLOCK: {
+			// Two RGB565 endpoints and 2-bit indices into a palette of four
+			uint32_t endpoints[2] = { block[0] | (block[1] << 8), block[2] | (block[3] << 8) };
+			uint8_t palette[4][4];
+			for (uint32_t i = 0; i != 2; ++i) {
+				uint32_t r = (endpoints[i] >> 11) & 0x1f, g = (endpoints[i] >> 5) & 0x3f, b = endpoints[i] & 0x1f;
+				palette[i][0] = (uint8_t) ((r << 3) | (r >> 2));
+				palette[i][1] = (uint8_t) ((g << 2) | (g >> 4));
+				palette[i][2] = (uint8_t) ((b << 3) | (b >> 2));
+				palette[i][3] = 255;
+			}
+			for (uint32_t j = 0; j != 3; ++j) {
+				if (endpoints[0] > endpoints[1]) {
+					palette[2][j] = (uint8_t) ((2 * palette[0][j] + palette[1][j]) / 3);
+					palette[3][j] = (uint8_t) ((palette[0][j] + 2 * palette[1][j]) / 3);
+				}
+				else {
+					palette[2][j] = (uint8_t) ((palette[0][j] + palette[1][j]) / 2);
+					palette[3][j] = 0;
+				}
+			}
+			palette[2][3] = 255;
+			palette[3][3] = (endpoints[0] > endpoints[1] || format == VK_FORMAT_BC1_RGB_UNORM_BLOCK || format == VK_FORMAT_BC1_RGB_SRGB_BLOCK) ? 255 : 0;
+			uint32_t indices = block[4] | (block[5] << 8) | (block[6] << 16) | ((uint32_t) block[7] << 24);
+			for (uint32_t i = 0; i != 16; ++i)
+				memcpy(texels[i], palette[(indices >> (2 * i)) & 3], 4);
+			return 16;
+		}
+		case VK_FORMAT_BC4_UNORM_BLOCK:
+		case VK_FORMAT_BC5_UNORM_BLOCK: {
+			// One or two channels, each with two 8-bit endpoints and 3-bit
+			// indices into a palette of eight
+			uint32_t channel_count = (format == VK_FORMAT_BC5_UNORM_BLOCK) ? 2 : 1;
+			for (uint32_t i = 0; i != 16; ++i) {
+				texels[i][0] = texels[i][1] = texels[i][2] = 0;
+				texels[i][3] = 255;
+			}
+			for (uint32_t j = 0; j != channel_count; ++j) {
+				const uint8_t* channel = block + 8 * j;
+				uint32_t palette[8] = { channel[0], channel[1] };
+				for (uint32_t k = 1; k != 7; ++k) {
+					if (channel[0] > channel[1])
+						palette[k + 1] = ((7 - k) * channel[0] + k * channel[1]) / 7;
+					else if (k < 5)
+						palette[k + 1] = ((5 - k) * channel[0] + k * channel[1]) / 5;
+					else
+						palette[k + 1] = (k == 5) ? 0 : 255;
+				}
+				uint64_t indices = 0;
+				for (uint32_t k = 0; k != 6; ++k)
+					indices |= ((uint64_t) channel[2 + k]) << (8 * k);
+				for (uint32_t i = 0; i != 16; ++i)
+					texels[i][j] = (uint8_t) palette[(indices >> (3 * i)) & 7];
+			}
+			return 16;
+		}
+		default:
+			return 0;
+	}
+}
+
+
+/*! Checks whether all texels of the given mipmap have the same value.
+	\param color Receives that value as a sampler would return it, i.e.
+		normalized and converted to linear RGB for sRGB formats.
+	\param data The data of the mipmap.
+	\param size The size of data in bytes.
+	\param format The format of the texture.
+	\return true iff all texels are equal and the format is supported by
+		decode_block().*/
+bool get_constant_mipmap_color(float color[4], const uint8_t* data, VkDeviceSize size, VkFormat format) {
+	format_description_t description = get_format_description(format);
+	VkDeviceSize block_size = description.block_size;
+	if (block_size == 0 || size < block_size)
+		return false;
+	uint8_t reference[16][4];
+	uint32_t texel_count = decode_block(reference, data, format);
+	if (texel_count == 0)
+		return false;
+	for (uint32_t i = 1; i != texel_count; ++i)
+		if (memcmp(reference[i], reference[0], 4) != 0)
+			return false;
+	// Most blocks of a constant mipmap are bitwise identical, but encoders
+	// may produce different blocks that decode to the same color
+	uint8_t texels[16][4];
+	for (VkDeviceSize offset = block_size; offset + block_size <= size; offset += block_size) {
+		if (memcmp(data + offset, data, block_size) == 0)
+			continue;
+		decode_block(texels, data + offset, format);
+		for (uint32_t i = 0; i != texel_count; ++i)
+			if (memcmp(texels[i], reference[0], 4) != 0)
+				return false;
+	}
+	bool srgb = (format == VK_FORMAT_R8G8B8A8_SRGB || format == VK_FORMAT_BC1_RGB_SRGB_BLOCK || format == VK_FORMAT_BC1_RGBA_SRGB_BLOCK);
+	for (uint32_t i = 0; i != 4; ++i) {
+		color[i] = (float) reference[0][i] / 255.0f;
+		if (srgb && i < 3)
+			color[i] = (color[i] <= 0.04045f) ? (color[i] / 12.92f) : powf((color[i] + 0.055f) / 1.055f, 2.4f);
+	}
+	return true;
+}
+
+
+//! A task for run_parallel() that sets constant and constant_color for the
+//! texture with the given index in a textures_t
+int find_constant_texture_task(void* raw_textures, uint32_t texture_index) {
+	textures_t* textures = (textures_t*) raw_textures;
+	texture_t* texture = &textures->textures[texture_index];
+	texture->constant = false;
+	if (texture->header.mipmap_count == 0)
+		return 0;
+	// Reading the finest mipmap is expensive, so a coarse mipmap that is big
+	// enough to hold complete blocks gets checked first
+	uint32_t probe_level = 0;
+	while (probe_level + 1 < texture->header.mipmap_count
+		&& texture->mipmap_headers[probe_level + 1].extent.width >= 4
+		&& texture->mipmap_headers[probe_level + 1].extent.height >= 4)
+		++probe_level;
+	uint8_t* data = NULL;
+	for (uint32_t i = 0; i != 2; ++i) {
+		uint32_t level = (i == 0) ? probe_level : 0;
+		if (i == 1 && probe_level == 0)
+			break;
+		VkDeviceSize size = texture->mipmap_headers[level].size;
+		data = realloc(data, (size_t) (size ? size : 1));
+		if (read_mipmap(data, texture, level)) {
+			printf("Failed to read mipmap %u of texture %u to check whether it is constant.\n", level, texture_index);
+			free(data);
+			return 1;
+		}
+		texture->constant = get_constant_mipmap_color(texture->constant_color, data, size, texture->header.format);
+		if (!texture->constant)
+			break;
+	}
+	free(data);
+	return 0;
+}
+
+
+/*! Drops textures whose finest mipmap has a single color from the given
+	textures, such that no image is created for them.
+	\param image_indices For each requested texture, the index of a texture
+		in textures (as output by deduplicate_textures()). Gets updated to the
+		index after dropping or CONSTANT_TEXTURE_IMAGE_INDEX.
+	\param constant_colors Receives four floats per requested texture.
+	\param textures The textures with all headers loaded. texture_count gets
+		reduced accordingly.
+	\param requested_count The number of entries in image_indices.
+	\return 0 upon success.*/
+int drop_constant_textures(uint32_t* image_indices, float* constant_colors, textures_t* textures, uint32_t requested_count) {
+	if (run_parallel(&find_constant_texture_task, textures, textures->texture_count, 0))
+		return 1;
+	for (uint32_t i = 0; i != requested_count; ++i) {
+		const texture_t* texture = &textures->textures[image_indices[i]];
+		for (uint32_t j = 0; j != 4; ++j)
+			constant_colors[4 * i + j] = texture->constant ? texture->constant_color[j] : 0.0f;
+	}
+	uint32_t* new_indices = calloc(textures->texture_count + 1, sizeof(uint32_t));
+	uint32_t kept_count = 0;
+	VkDeviceSize saved_size = 0;
+	for (uint32_t i = 0; i != textures->texture_count; ++i) {
+		texture_t* texture = &textures->textures[i];
+		if (!texture->constant) {
+			new_indices[i] = kept_count;
+			textures->textures[kept_count++] = (*texture);
+		}
+		else {
+			new_indices[i] = CONSTANT_TEXTURE_IMAGE_INDEX;
+			saved_size += texture->header.size;
+			free_texture(texture);
+		}
+	}
+	for (uint32_t i = 0; i != requested_count; ++i)
+		image_indices[i] = new_indices[image_indices[i]];
+	if (kept_count != textures->texture_count)
+		printf("Constant texture folding: %u textures have a single color and become material constants, saving %.1f MiB.\n",
+			textures->texture_count - kept_count, (double) saved_size / (1024.0 * 1024.0));
+	textures->texture_count = kept_count;
+	free(new_indices);
+	return 0;
+}
+
+
+//! \return true iff the given textures have identical headers and mipmap
+//!		headers, which is necessary for them to have identical contents
+bool texture_headers_equal(const texture_t* lhs, const texture_t* rhs) {
+	const texture_header_t* l = &lhs->header;
+	const texture_header_t* r = &rhs->header;
+	if (l->version != r->version || l->mipmap_count != r->mipmap_count
+		|| l->extent.width != r->extent.width || l->extent.height != r->extent.height
+		|| l->format != r->format || l->size != r->size)
+		return false;
+	if (get_uncompressed_payload_size(&lhs->compressed_payload) != get_uncompressed_payload_size(&rhs->compressed_payload)
+		|| lhs->compressed_payload.chunk_count != rhs->compressed_payload.chunk_count)
+		return false;
+	return memcmp(lhs->mipmap_headers, rhs->mipmap_headers, l->mipmap_count * sizeof(mipmap_header_t)) == 0;
+}
+
+
+//! A task for run_parallel() that reads the coarsest mipmap of the texture
+//! with the given index in a textures_t and computes its key_hash, unless it
+//! is the only texture with its header
+int hash_texture_key_task(void* raw_textures, uint32_t texture_index) {
+	textures_t* textures = (textures_t*) raw_textures;
+	texture_t* texture = &textures->textures[texture_index];
+	bool unique = true;
+	for (uint32_t i = 0; i != textures->texture_count && unique; ++i)
+		unique = (i == texture_index || !texture_headers_equal(texture, &textures->textures[i]));
+	if (unique || texture->header.mipmap_count == 0)
+		return 0;
+	uint32_t level = texture->header.mipmap_count - 1;
+	VkDeviceSize size = texture->mipmap_headers[level].size;
+	uint8_t* data = malloc((size_t) (size ? size : 1));
+	if (read_mipmap(data, texture, level)) {
+		printf("Failed to read mipmap %u of texture %u for deduplication.\n", level, texture_index);
+		free(data);
+		return 1;
+	}
+	uint64_t hash = hash_bytes(data, (size_t) size);
+	free(data);
+	// The compressed sizes of chunks depend on their contents
+	const chunked_payload_t* compressed = &texture->compressed_payload;
+	if (texture->header.version == 2)
+		hash ^= hash_bytes(compressed->chunks, (compressed->chunk_count + 1) * sizeof(payload_chunk_t));
+	// Zero marks textures that have not been hashed
+	texture->key_hash = hash ? hash : 1;
+	return 0;
+}
+
+
+//! A task for run_parallel() that reads the payload of the texture with the
+//! given index in a textures_t and computes its payload_hash, unless no other
+//! texture has the same header and key_hash
+int hash_texture_task(void* raw_textures, uint32_t texture_index) {
+	textures_t* textures = (textures_t*) raw_textures;
+	texture_t* texture = &textures->textures[texture_index];
+	bool unique = true;
+	for (uint32_t i = 0; i != textures->texture_count && unique && texture->key_hash != 0; ++i)
+		unique = (i == texture_index || textures->textures[i].key_hash != texture->key_hash
+			|| !texture_headers_equal(texture, &textures->textures[i]));
+	if (unique)
+		return 0;
+	// For compressed files, hashing the compressed data is enough, since the
+	// chunk boundaries have been compared already
+	const chunked_payload_t* compressed = &texture->compressed_payload;
+	uint64_t offset = (texture->header.version == 2) ? compressed->data_offset : texture->payload_offset;
+	size_t size = (size_t) ((texture->header.version == 2) ? compressed->chunks[compressed->chunk_count].compressed_offset : texture->header.size);
+	uint8_t* payload = malloc(size ? size : 1);
+	if (read_texture_file(payload, texture, offset, size)) {
+		printf("Failed to read the payload of texture %u for deduplication.\n", texture_index);
+		free(payload);
+		return 1;
+	}
+	uint64_t hash = hash_bytes(payload, size);
+	if (texture->header.version == 2)
+		hash ^= hash_bytes(compressed->chunks, (compressed->chunk_count + 1) * sizeof(payload_chunk_t));
+	// Zero marks textures that have not been hashed
+	texture->payload_hash = hash ? hash : 1;
+	free(payload);
+	return 0;
+}
+
+
+/*! Finds textures with identical contents and drops all but the first of
+	them from the given textures, such that only one image gets created for
+	each unique content.
+	\param image_indices Receives for each texture the index that it has after
+		deduplication.
+	\param textures The textures with all headers loaded. texture_count gets
+		reduced accordingly.
+	\return 0 upon success.*/
+int deduplicate_textures(uint32_t* image_indices, textures_t* textures) {
+	// Full payloads are only read if the cheap keys of textures collide
+	if (run_parallel(&hash_texture_key_task, textures, textures->texture_count, 0)
+		|| run_parallel(&hash_texture_task, textures, textures->texture_count, 0))
+		return 1;
+	uint32_t unique_count = 0;
+	VkDeviceSize saved_size = 0;
+	for (uint32_t i = 0; i != textures->texture_count; ++i) {
+		texture_t* texture = &textures->textures[i];
+		uint32_t match = unique_count;
+		for (uint32_t j = 0; j != unique_count && texture->payload_hash != 0; ++j) {
+			const texture_t* candidate = &textures->textures[j];
+			if (candidate->payload_hash == texture->payload_hash && texture_headers_equal(candidate, texture)) {
+				match = j;
+				break;
+			}
+		}
+		image_indices[i] = match;
+		if (match == unique_count)
+			textures->textures[unique_count++] = (*texture);
+		else {
+			saved_size += texture->header.size;
+			free_texture(texture);
+		}
+	}
+	if (unique_count != textures->texture_count)
+		printf("Texture deduplication: %u textures have identical contents to others. Creating %u images instead of %u saves %.1f MiB.\n",
+			textures->texture_count - unique_count, unique_count, textures->texture_count, (double) saved_size / (1024.0 * 1024.0));
+	textures->texture_count = unique_count;
+	// File paths do not correspond to textures anymore
+	textures->texture_file_paths = NULL;
+	return 0;
+}
+
+
+/*! Updates the given I/O timing (if any) at the beginning or end of reading
+	file contents.
+	\param timing The timing to update or NULL.
+	\param end false at the beginning, true at the end.*/
+void record_io_time(io_timing_t* timing, bool end) {
+	if (!timing)
+		return;
+	double time = glfwGetTime();
+	lock_mutex(timing->mutex);
+	if (!end && timing->begin == 0.0)
+		timing->begin = time;
+	if (end && timing->end < time)
+		timing->end = time;
+	unlock_mutex(timing->mutex);
+}
+
+
+//! Loads a single mipmap from an already opened texture file into staging
+//! memory. It is invoked concurrently for different textures.
 void write_mipmap(void* image_data, uint32_t image_index, const VkImageSubresource* subresource, VkDeviceSize buffer_size, const VkImageCreateInfo* image_info, const VkExtent3D* subresource_extent, const void* context) {
 	const textures_t* textures = (const textures_t*) context;
 	const texture_t* texture = &textures->textures[image_index];
-	if (buffer_size == texture->mipmap_headers[subresource->mipLevel].size)
-		fread(image_data, sizeof(uint8_t), buffer_size, texture->file);
-	else
-		printf("The data block for mipmap %u of texture %u was supposed to have %lu bytes but had %lu bytes. Skipping this mipmap.\n", subresource->mipLevel, image_index, buffer_size, texture->mipmap_headers[subresource->mipLevel].size);
+	const mipmap_header_t* mipmap = &texture->mipmap_headers[subresource->mipLevel];
+	record_io_time(textures->io_timing, false);
+	// Mipmaps are not necessarily loaded in the order in which they are stored
+	if (buffer_size != mipmap->size)
+		printf("The data block for mipmap %u of texture %u was supposed to have %lu bytes but had %lu bytes. Skipping this mipmap.\n", subresource->mipLevel, image_index, buffer_size, mipmap->size);
+	else if (read_mipmap(image_data, texture, subresource->mipLevel))
+		printf("Failed to read mipmap %u of texture %u. Skipping this mipmap.\n", subresource->mipLevel, image_index);
+	record_io_time(textures->io_timing, true);
+}
+
+
+//! Shared state for write_mipmap_fallback_task()
+typedef struct {
+	//! \see write_mipmap_batch()
+	const textures_t* textures;
+	uint8_t* staged_data;
+	const staged_subresource_t* subresources;
+	uint32_t subresource_count;
+	//! For each subresource, whether a direct read has written it already
+	const bool* done;
+} mipmap_fallback_t;
+
+
+//! A task for run_parallel() that uses write_mipmap() for all subresources of
+//! one image, which have not been read directly. The task index is the index
+//! of a subresource and only the first subresource of each image does work,
+//! because subresources of one image share a file handle.
+int write_mipmap_fallback_task(void* raw_fallback, uint32_t subresource_index) {
+	const mipmap_fallback_t* fallback = (const mipmap_fallback_t*) raw_fallback;
+	const staged_subresource_t* subresources = fallback->subresources;
+	if (subresource_index > 0 && subresources[subresource_index - 1].image_index == subresources[subresource_index].image_index)
+		return 0;
+	for (uint32_t i = subresource_index; i != fallback->subresource_count && subresources[i].image_index == subresources[subresource_index].image_index; ++i)
+		if (!fallback->done[i])
+			write_mipmap(fallback->staged_data + subresources[i].staging_offset, subresources[i].image_index, &subresources[i].subresource, subresources[i].size, NULL, &subresources[i].extent, fallback->textures);
+	return 0;
+}
+
+
+/*! A callback for fill_image_levels_batched(). Mipmaps of aligned texture
+	files are read straight into staging memory with a single batch of
+	direct reads (io_uring on Linux). All other mipmaps and those for which a
+	direct read fails are read through write_mipmap() concurrently.*/
+int write_mipmap_batch(uint8_t* staged_data, const staged_subresource_t* subresources, uint32_t subresource_count, const void* context) {
+	const textures_t* textures = (const textures_t*) context;
+	record_io_time(textures->io_timing, false);
+	direct_read_t* reads = calloc(subresource_count, sizeof(direct_read_t));
+	uint32_t* read_subresources = calloc(subresource_count, sizeof(uint32_t));
+	bool* done = calloc(subresource_count, sizeof(bool));
+	uint32_t read_count = 0;
+	for (uint32_t i = 0; i != subresource_count; ++i) {
+		const staged_subresource_t* staged = &subresources[i];
+		const texture_t* texture = &textures->textures[staged->image_index];
+		const mipmap_header_t* mipmap = &texture->mipmap_headers[staged->subresource.mipLevel];
+		direct_read_t read = {
+			.file = &texture->direct_file,
+			.offset = texture->pack_offset + texture->payload_offset + mipmap->offset,
+			.destination = staged_data + staged->staging_offset,
+			.size = (size_t) ((mipmap->size + DIRECT_READ_ALIGNMENT - 1) & ~((VkDeviceSize) DIRECT_READ_ALIGNMENT - 1)),
+		};
+		if (texture->direct_file.open && staged->size == mipmap->size && is_direct_read_aligned(read.destination, read.offset, read.size)) {
+			read_subresources[read_count] = i;
+			reads[read_count++] = read;
+		}
+	}
+	read_direct(reads, read_count);
+	uint32_t done_count = 0;
+	for (uint32_t i = 0; i != read_count; ++i) {
+		done[read_subresources[i]] = (reads[i].result >= (int64_t) subresources[read_subresources[i]].size);
+		done_count += done[read_subresources[i]] ? 1 : 0;
+	}
+	mipmap_fallback_t fallback = {
+		.textures = textures,
+		.staged_data = staged_data,
+		.subresources = subresources,
+		.subresource_count = subresource_count,
+		.done = done,
+	};
+	int result = 0;
+	if (done_count < subresource_count)
+		result = run_parallel(&write_mipmap_fallback_task, &fallback, subresource_count, 0);
+	record_io_time(textures->io_timing, true);
+	free(reads);
+	free(read_subresources);
+	free(done);
+	return result;
+}
+
+
+/*! \return The alignment of staged data for fill_image_levels_batched() that
+		allows direct reads of the given textures, or 16 if none of them have
+		an open direct_file.*/
+VkDeviceSize get_texture_staging_alignment(const textures_t* textures) {
+	for (uint32_t i = 0; i != textures->texture_count; ++i)
+		if (textures->textures[i].direct_file.open)
+			return DIRECT_READ_ALIGNMENT;
+	return 16;
 }
 
 
 void free_textures(textures_t* textures, const device_t* device);
 
 
-int load_textures(images_t* images, const device_t* device, const char* const* texture_file_paths, uint32_t texture_count, VkImageUsageFlags usage, VkImageLayout image_layout) {
+int load_textures(images_t* images, uint32_t* image_indices, float* constant_colors, const device_t* device, const char* const* texture_file_paths, uint32_t texture_count, const char* texture_pack_path, VkImageUsageFlags usage, VkImageLayout image_layout, texture_stream_t** stream) {
 	memset(images, 0, sizeof(*images));
+	if (stream)
+		(*stream) = NULL;
+	io_timing_t io_timing = { .begin = 0.0 };
 	textures_t textures = {
 		.images = images,
+		.texture_file_paths = texture_file_paths,
 		.texture_count = texture_count,
+		.io_timing = &io_timing,
 	};
 	textures.textures = calloc(texture_count, sizeof(texture_t));
-	// Load texture meta data and create images
+	if (create_mutex(&io_timing.mutex)) {
+		printf("Failed to create a mutex for loading textures.\n");
+		free_textures(&textures, device);
+		return 1;
+	}
+	// Prefer the texture pack, if there is one
+	double header_begin = glfwGetTime();
+	if (texture_pack_path) {
+		textures.pack = calloc(1, sizeof(texture_pack_t));
+		if (open_texture_pack(textures.pack, texture_pack_path)) {
+			free(textures.pack);
+			textures.pack = NULL;
+		}
+	}
+	// Open all texture files and load their meta data concurrently
+	if (run_parallel(&init_texture_task, &textures, texture_count, 0)) {
+		printf("Failed to load texture headers. Aborting.\n");
+		free_textures(&textures, device);
+		return 1;
+	}
+	if (textures.pack) {
+		uint32_t packed_count = 0;
+		for (uint32_t i = 0; i != texture_count; ++i)
+			packed_count += textures.textures[i].pack_mapping ? 1 : 0;
+		printf("Found %u out of %u texture files in the texture pack at %s.\n", packed_count, texture_count, texture_pack_path);
+	}
+	// Textures with identical contents share an image
+	uint32_t requested_count = texture_count;
+	if (image_indices) {
+		if (deduplicate_textures(image_indices, &textures)) {
+			printf("Failed to deduplicate textures. Aborting.\n");
+			free_textures(&textures, device);
+			return 1;
+		}
+		texture_count = textures.texture_count;
+	}
+	// Single-colored textures do not need images
+	if (image_indices && constant_colors) {
+		if (drop_constant_textures(image_indices, constant_colors, &textures, requested_count)) {
+			printf("Failed to check which textures are constant. Aborting.\n");
+			free_textures(&textures, device);
+			return 1;
+		}
+		texture_count = textures.texture_count;
+	}
+	double header_end = glfwGetTime();
+	// When streaming, only the coarse mipmaps are loaded now
+	uint32_t* base_levels = calloc(texture_count, sizeof(uint32_t));
+	bool streaming = false;
+	for (uint32_t i = 0; i != texture_count && stream; ++i) {
+		const texture_t* texture = &textures.textures[i];
+		uint32_t level = 0;
+		while (level + 1 < texture->header.mipmap_count
+			&& (texture->mipmap_headers[level].extent.width > TEXTURE_STREAMING_INITIAL_EXTENT
+			|| texture->mipmap_headers[level].extent.height > TEXTURE_STREAMING_INITIAL_EXTENT))
+			++level;
+		base_levels[i] = level;
+		streaming |= (level > 0);
+	}
+	// Create images
 	image_request_t* image_requests = calloc(texture_count, sizeof(image_request_t));
 	usage |= VK_IMAGE_USAGE_TRANSFER_DST_BIT;
 	for (uint32_t i = 0; i != texture_count; ++i) {
 		texture_t* texture = &textures.textures[i];
-		if (init_texture(texture, texture_file_paths[i])) {
-			printf("Failed to load texture %u out of %u. Its file path is %s. Aborting.\n", i, texture_count, texture_file_paths[i]);
-			free(image_requests);
-			free_textures(&textures, device);
-			return 1;
-		}
 		image_requests[i] = (image_request_t) {
 			.image_info = {
 				.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
@@ -144,6 +811,7 @@ int load_textures(images_t* images, const device_t* device, const char* const* t
 				.viewType = VK_IMAGE_VIEW_TYPE_2D,
 				.subresourceRange = {
 					.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+					.baseMipLevel = base_levels[i],
 				},
 			},
 		};
@@ -151,31 +819,175 @@ int load_textures(images_t* images, const device_t* device, const char* const* t
 	if (create_images(images, device, image_requests, texture_count, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)) {
 		printf("Failed to create/allocate images for %u textures.\n", texture_count);
 		free(image_requests);
+		free(base_levels);
 		free_textures(&textures, device);
 		return 1;
 	}
 	free(image_requests);
 	image_requests = NULL;
-	if (fill_images(images, device, &write_mipmap, VK_IMAGE_LAYOUT_UNDEFINED, image_layout, &textures)) {
+	// Read the mipmaps concurrently into staging buffers and upload them
+	if (fill_image_levels_batched(images, device, base_levels, NULL, &write_mipmap_batch, get_texture_staging_alignment(&textures), VK_IMAGE_LAYOUT_UNDEFINED, image_layout, &textures)) {
 		printf("Failed to copy texture data for %u textures from files onto the GPU.\n", texture_count);
+		free(base_levels);
 		free_textures(&textures, device);
 		return 1;
 	}
+	double fill_end = glfwGetTime();
+	double io_time = (io_timing.begin > 0.0) ? (io_timing.end - io_timing.begin) : 0.0;
+	printf("Loaded %u textures into %u images%s in %.3f s (headers, deduplication and constant folding: %.3f s, file I/O: %.3f s, image creation and upload: %.3f s).\n",
+		requested_count, texture_count, streaming ? " (coarse mipmaps only)" : "", fill_end - header_begin, header_end - header_begin, io_time, (fill_end - header_end) - io_time);
 	textures.images = NULL;
-	free_textures(&textures, device);
+	free_mutex(&io_timing.mutex);
+	textures.io_timing = NULL;
+	textures.texture_file_paths = NULL;
+	// Hand the open files over to a stream, if there is anything left to load
+	if (streaming) {
+		texture_stream_t* result = calloc(1, sizeof(texture_stream_t));
+		result->textures = textures;
+		result->loaded_levels = base_levels;
+		result->uploading = calloc(texture_count, sizeof(bool));
+		result->image_layout = image_layout;
+		(*stream) = result;
+	}
+	else {
+		free(base_levels);
+		free_textures(&textures, device);
+	}
 	return 0;
 }
 
 
-void free_textures(textures_t* textures, const device_t* device) {
-	if (textures->images) free_images(textures->images, device);
-	if (textures->textures) {
-		for (uint32_t i = 0; i != textures->texture_count; ++i) {
-			texture_t* texture = &textures->textures[i];
-			if (texture->file) fclose(texture->file);
-			free(texture->mipmap_headers);
+//! A mipmap that is a candidate for loading in stream_textures()
+typedef struct {
+	//! The index of the texture to which this mipmap belongs
+	uint32_t texture_index;
+	//! The size of the mipmap in bytes
+	VkDeviceSize size;
+} mipmap_candidate_t;
+
+
+//! Comparison function for qsort() to sort mipmap_candidate_t by size in
+//! ascending order. Ties are broken by texture index to be deterministic.
+int compare_mipmap_candidates(const void* raw_lhs, const void* raw_rhs) {
+	const mipmap_candidate_t* lhs = (const mipmap_candidate_t*) raw_lhs;
+	const mipmap_candidate_t* rhs = (const mipmap_candidate_t*) raw_rhs;
+	if (lhs->size != rhs->size)
+		return (lhs->size < rhs->size) ? -1 : 1;
+	return (lhs->texture_index < rhs->texture_index) ? -1 : ((lhs->texture_index > rhs->texture_index) ? 1 : 0);
+}
+
+
+/*! Checks whether the mipmaps that stream_textures() has submitted most
+	recently have arrived and if so, recreates the views of their images to
+	cover them.
+	\see stream_textures()
+	\return 0 upon success, even if the copies are still pending.*/
+int finish_mipmap_upload(texture_stream_t* stream, images_t* images, const device_t* device, bool wait, VkImageView** retired_views, uint32_t* retired_view_count) {
+	if (!stream->upload)
+		return 0;
+	VkResult status = poll_image_upload(stream->upload, device, wait);
+	if (status == VK_NOT_READY)
+		return 0;
+	free_image_upload(&stream->upload, device);
+	int result = (status != VK_SUCCESS);
+	if (result)
+		printf("Failed to copy streamed mipmaps onto the GPU. Vulkan error code %d.\n", status);
+	// Make the new mipmaps accessible
+	for (uint32_t i = 0; i != stream->textures.texture_count; ++i) {
+		if (!stream->uploading[i])
+			continue;
+		stream->uploading[i] = false;
+		VkImageView old_view = NULL;
+		if (result || set_image_view_mip_levels(&images->images[i], device, stream->loaded_levels[i] - 1, 0, &old_view)) {
+			result = 1;
+			continue;
 		}
+		--stream->loaded_levels[i];
+		(*retired_views) = realloc(*retired_views, ((*retired_view_count) + 1) * sizeof(VkImageView));
+		(*retired_views)[(*retired_view_count)++] = old_view;
+	}
+	return result;
+}
+
+
+int stream_textures(texture_stream_t* stream, images_t* images, const device_t* device, VkDeviceSize byte_budget, bool wait, VkImageView** retired_views, uint32_t* retired_view_count) {
+	const textures_t* textures = &stream->textures;
+	// Only one upload is in flight at a time
+	if (finish_mipmap_upload(stream, images, device, wait, retired_views, retired_view_count))
+		return 1;
+	if (stream->upload)
+		return 0;
+	// Gather the next finer mipmap of each texture that is not done yet
+	uint32_t candidate_count = 0;
+	mipmap_candidate_t* candidates = calloc(textures->texture_count, sizeof(mipmap_candidate_t));
+	for (uint32_t i = 0; i != textures->texture_count; ++i) {
+		if (stream->loaded_levels[i] == 0)
+			continue;
+		candidates[candidate_count].texture_index = i;
+		candidates[candidate_count].size = textures->textures[i].mipmap_headers[stream->loaded_levels[i] - 1].size;
+		++candidate_count;
+	}
+	// Pick the smallest ones until the budget is exhausted
+	qsort(candidates, candidate_count, sizeof(mipmap_candidate_t), &compare_mipmap_candidates);
+	uint32_t* base_levels = calloc(textures->texture_count, sizeof(uint32_t));
+	uint32_t* level_counts = calloc(textures->texture_count, sizeof(uint32_t));
+	VkDeviceSize total_size = 0;
+	uint32_t pick_count = 0;
+	for (; pick_count != candidate_count; ++pick_count) {
+		const mipmap_candidate_t* candidate = &candidates[pick_count];
+		if (pick_count > 0 && total_size + candidate->size > byte_budget)
+			break;
+		total_size += candidate->size;
+		base_levels[candidate->texture_index] = stream->loaded_levels[candidate->texture_index] - 1;
+		level_counts[candidate->texture_index] = 1;
 	}
+	// Submit the copies without waiting for them
+	int result = 0;
+	if (pick_count > 0 && fill_image_levels_batched_async(&stream->upload, images, device, base_levels, level_counts, &write_mipmap_batch, get_texture_staging_alignment(textures), VK_IMAGE_LAYOUT_UNDEFINED, stream->image_layout, textures)) {
+		printf("Failed to stream %u mipmaps with a total of %lu bytes onto the GPU.\n", pick_count, total_size);
+		result = 1;
+	}
+	for (uint32_t i = 0; i != pick_count && !result; ++i)
+		stream->uploading[candidates[i].texture_index] = true;
+	free(candidates);
+	free(base_levels);
+	free(level_counts);
+	if (!result && wait)
+		result = finish_mipmap_upload(stream, images, device, true, retired_views, retired_view_count);
+	return result;
+}
+
+
+bool is_texture_stream_complete(const texture_stream_t* stream) {
+	if (stream->upload)
+		return false;
+	for (uint32_t i = 0; i != stream->textures.texture_count; ++i)
+		if (stream->loaded_levels[i] > 0)
+			return false;
+	return true;
+}
+
+
+void free_texture_stream(texture_stream_t** stream, const device_t* device) {
+	if (!(*stream))
+		return;
+	free_image_upload(&(*stream)->upload, device);
+	free_textures(&(*stream)->textures, NULL);
+	free((*stream)->loaded_levels);
+	free((*stream)->uploading);
+	free(*stream);
+	(*stream) = NULL;
+}
+
+
+void free_textures(textures_t* textures, const device_t* device) {
+	if (textures->images) free_images(textures->images, device);
+	if (textures->textures)
+		for (uint32_t i = 0; i != textures->texture_count; ++i)
+			free_texture(&textures->textures[i]);
 	free(textures->textures);
+	if (textures->pack) close_texture_pack(textures->pack);
+	free(textures->pack);
+	if (textures->io_timing) free_mutex(&textures->io_timing->mutex);
 	memset(textures, 0, sizeof(*textures));
 }
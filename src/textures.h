@@ -2,14 +2,84 @@
 #include "vulkan_basics.h"
 
 
+//! Textures whose extent in pixels is at most this big along both axes are
+//! loaded completely by load_textures(), even if it streams
+#define TEXTURE_STREAMING_INITIAL_EXTENT 128
+
+
+//! The image index that load_textures() outputs for textures that have been
+//! folded into a constant color
+#define CONSTANT_TEXTURE_IMAGE_INDEX 0xffffffff
+
+
+//! An opaque handle for textures of which only the coarse mipmaps have been
+//! loaded. The finer mipmaps get loaded bit by bit using stream_textures().
+typedef struct texture_stream_s texture_stream_t;
+
+
 /*! Loads textures from *.vkt files into device-local memory.
 	\param images The output. Clean up using free_images().
+	\param image_indices NULL to create one image per texture. Otherwise,
+		textures with identical contents (identical headers and a matching
+		hash of the payload) share one image and this array receives for each
+		texture the index of its image in images->images.
+	\param constant_colors NULL or four floats per texture. If given (along
+		with image_indices), textures whose finest mipmap has a single color
+		do not get an image. Their image index is then
+		CONSTANT_TEXTURE_IMAGE_INDEX and this array receives their color as a
+		sampler would return it. Entries of other textures are zero.
 	\param device Output of create_device().
 	\param texture_file_paths An array of absolute or relative paths to *.vkt
-		files. Each entry corresponds to one entry of images->images.
+		files. Without deduplication, each entry corresponds to one entry of
+		images->images.
 	\param texture_count The number of array entries in texture_file_paths.
+	\param texture_pack_path NULL or the path of a *.vkp texture pack (see
+		texture_pack_t). If it exists, textures whose file name it holds are
+		loaded from it instead of their own files. Thus, a whole scene can be
+		loaded with a single open and large sequential reads.
 	\param usage The Vulkan usage flags that are to be used for all textures.
 		Transfer destination usage is always added.
 	\param image_layout The layout of all created images upon success.
+	\param stream NULL to load all mipmaps right away. Otherwise, only mipmaps
+		up to TEXTURE_STREAMING_INITIAL_EXTENT get loaded and the views of
+		the images only cover these mipmaps. The output is then a stream for
+		loading the rest. It is NULL if nothing is left to load. Clean up
+		with free_texture_stream().
 	\return 0 upon success.*/
-int load_textures(images_t* images, const device_t* device, const char* const* texture_file_paths, uint32_t texture_count, VkImageUsageFlags usage, VkImageLayout image_layout);
+int load_textures(images_t* images, uint32_t* image_indices, float* constant_colors, const device_t* device, const char* const* texture_file_paths, uint32_t texture_count, const char* texture_pack_path, VkImageUsageFlags usage, VkImageLayout image_layout, texture_stream_t** stream);
+
+
+/*! Loads the next mipmaps of textures that have been partially loaded by
+	load_textures(). Mipmaps are loaded from coarse to fine across all
+	textures and a texture only gets its next finer mipmap, once its coarser
+	mipmaps are there. Copies to the GPU are submitted without waiting for
+	them. A later invocation finds them finished, recreates the views of the
+	images to cover the new mipmaps and submits the next copies. The old views
+	may still be in use by the device, so they are handed to the caller.
+	\param stream Output of load_textures().
+	\param images The images output by the same invocation of
+		load_textures().
+	\param device Output of create_device().
+	\param byte_budget The number of bytes of mipmap data that should be
+		submitted at most. At least one mipmap is submitted, if any are left.
+	\param wait true to wait for the copies, such that the new mipmaps are
+		accessible once this function returns.
+	\param retired_views Pointer to a NULL pointer or to an array allocated by
+		malloc(). Each view that gets recreated is appended to it after
+		reallocation. Descriptors referring to them have to be updated and
+		they have to be destroyed once they are no longer in use.
+	\param retired_view_count The number of entries in *retired_views. It is
+		incremented accordingly.
+	\return 0 upon success. Upon failure, the images remain usable with the
+		mipmaps that are covered by their views.*/
+int stream_textures(texture_stream_t* stream, images_t* images, const device_t* device, VkDeviceSize byte_budget, bool wait, VkImageView** retired_views, uint32_t* retired_view_count);
+
+
+//! \return true iff all mipmaps of all textures handled by the given stream
+//!		have been loaded
+bool is_texture_stream_complete(const texture_stream_t* stream);
+
+
+//! Waits for pending copies, closes all files used by the given stream (which
+//! may be NULL) and sets it to NULL. The images remain intact.
+void free_texture_stream(texture_stream_t** stream, const device_t* device);
@@ -0,0 +1,234 @@
+#include "threading.h"
+#include <stdlib.h>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+
+struct thread_s {
+	//! The function to run and its argument
+	thread_function_t function;
+	void* argument;
+	//! The value returned by function once it has finished
+	int result;
+#ifdef _WIN32
+	HANDLE handle;
+#else
+	pthread_t handle;
+	//! Protects finished
+	pthread_mutex_t mutex;
+	//! Whether function has returned
+	bool finished;
+#endif
+};
+
+
+#ifdef _WIN32
+static DWORD WINAPI thread_entry(LPVOID raw_thread) {
+	thread_t* thread = (thread_t*) raw_thread;
+	thread->result = thread->function(thread->argument);
+	return 0;
+}
+#else
+static void* thread_entry(void* raw_thread) {
+	thread_t* thread = (thread_t*) raw_thread;
+	int result = thread->function(thread->argument);
+	pthread_mutex_lock(&thread->mutex);
+	thread->result = result;
+	thread->finished = true;
+	pthread_mutex_unlock(&thread->mutex);
+	return NULL;
+}
+#endif
+
+
+int create_thread(thread_t** thread, thread_function_t function, void* argument) {
+	thread_t* result = calloc(1, sizeof(thread_t));
+	result->function = function;
+	result->argument = argument;
+#ifdef _WIN32
+	result->handle = CreateThread(NULL, 0, &thread_entry, result, 0, NULL);
+	if (!result->handle) {
+		free(result);
+		(*thread) = NULL;
+		return 1;
+	}
+#else
+	pthread_mutex_init(&result->mutex, NULL);
+	if (pthread_create(&result->handle, NULL, &thread_entry, result)) {
+		pthread_mutex_destroy(&result->mutex);
+		free(result);
+		(*thread) = NULL;
+		return 1;
+	}
+#endif
+	(*thread) = result;
+	return 0;
+}
+
+
+bool is_thread_finished(thread_t* thread) {
+#ifdef _WIN32
+	return WaitForSingleObject(thread->handle, 0) == WAIT_OBJECT_0;
+#else
+	pthread_mutex_lock(&thread->mutex);
+	bool finished = thread->finished;
+	pthread_mutex_unlock(&thread->mutex);
+	return finished;
+#endif
+}
+
+
+int join_thread(thread_t** thread) {
+	if (!(*thread))
+		return 0;
+#ifdef _WIN32
+	WaitForSingleObject((*thread)->handle, INFINITE);
+	CloseHandle((*thread)->handle);
+#else
+	pthread_join((*thread)->handle, NULL);
+	pthread_mutex_destroy(&(*thread)->mutex);
+#endif
+	int result = (*thread)->result;
+	free(*thread);
+	(*thread) = NULL;
+	return result;
+}
+
+
+struct mutex_s {
+#ifdef _WIN32
+	CRITICAL_SECTION section;
+#else
+	pthread_mutex_t mutex;
+#endif
+};
+
+
+int create_mutex(mutex_t** mutex) {
+	(*mutex) = calloc(1, sizeof(mutex_t));
+#ifdef _WIN32
+	InitializeCriticalSection(&(*mutex)->section);
+#else
+	if (pthread_mutex_init(&(*mutex)->mutex, NULL)) {
+		free(*mutex);
+		(*mutex) = NULL;
+		return 1;
+	}
+#endif
+	return 0;
+}
+
+
+void lock_mutex(mutex_t* mutex) {
+#ifdef _WIN32
+	EnterCriticalSection(&mutex->section);
+#else
+	pthread_mutex_lock(&mutex->mutex);
+#endif
+}
+
+
+void unlock_mutex(mutex_t* mutex) {
+#ifdef _WIN32
+	LeaveCriticalSection(&mutex->section);
+#else
+	pthread_mutex_unlock(&mutex->mutex);
+#endif
+}
+
+
+void free_mutex(mutex_t** mutex) {
+	if (!(*mutex))
+		return;
+#ifdef _WIN32
+	DeleteCriticalSection(&(*mutex)->section);
+#else
+	pthread_mutex_destroy(&(*mutex)->mutex);
+#endif
+	free(*mutex);
+	(*mutex) = NULL;
+}
+
+
+uint32_t get_hardware_thread_count() {
+#ifdef _WIN32
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	long count = (long) info.dwNumberOfProcessors;
+#else
+	long count = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+	return (count > 0) ? (uint32_t) count : 1;
+}
+
+
+//! Shared state of all workers spawned by run_parallel()
+typedef struct {
+	//! \see run_parallel()
+	task_function_t function;
+	void* context;
+	uint32_t task_count;
+	//! Protects next_task and failure_count
+	mutex_t* mutex;
+	//! The index of the next task that has not been claimed yet
+	uint32_t next_task;
+	//! The number of tasks that returned a non-zero value
+	uint32_t failure_count;
+} parallel_tasks_t;
+
+
+//! The thread function for workers of run_parallel()
+int run_parallel_worker(void* raw_tasks) {
+	parallel_tasks_t* tasks = (parallel_tasks_t*) raw_tasks;
+	while (true) {
+		lock_mutex(tasks->mutex);
+		uint32_t task_index = tasks->next_task;
+		if (task_index < tasks->task_count)
+			++tasks->next_task;
+		unlock_mutex(tasks->mutex);
+		if (task_index >= tasks->task_count)
+			return 0;
+		if ((*tasks->function)(tasks->context, task_index)) {
+			lock_mutex(tasks->mutex);
+			++tasks->failure_count;
+			unlock_mutex(tasks->mutex);
+		}
+	}
+}
+
+
+int run_parallel(task_function_t function, void* context, uint32_t task_count, uint32_t thread_count) {
+	if (thread_count == 0)
+		thread_count = get_hardware_thread_count();
+	if (thread_count > task_count)
+		thread_count = task_count;
+	// Without any parallelism, we avoid the overhead of threads
+	if (thread_count <= 1) {
+		int result = 0;
+		for (uint32_t i = 0; i != task_count; ++i)
+			result |= (*function)(context, i);
+		return result;
+	}
+	parallel_tasks_t tasks = {
+		.function = function,
+		.context = context,
+		.task_count = task_count,
+	};
+	if (create_mutex(&tasks.mutex))
+		return 1;
+	// The calling thread works as well, so we need one thread less
+	thread_t** threads = calloc(thread_count - 1, sizeof(thread_t*));
+	for (uint32_t i = 0; i != thread_count - 1; ++i)
+		create_thread(&threads[i], &run_parallel_worker, &tasks);
+	run_parallel_worker(&tasks);
+	for (uint32_t i = 0; i != thread_count - 1; ++i)
+		join_thread(&threads[i]);
+	free(threads);
+	free_mutex(&tasks.mutex);
+	return (tasks.failure_count > 0) ? 1 : 0;
+}
@@ -0,0 +1,75 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+
+//! The signature of functions that can be run on a thread. The return value
+//! is 0 upon success.
+typedef int (*thread_function_t)(void* argument);
+
+
+//! An opaque handle to a thread running a thread_function_t
+typedef struct thread_s thread_t;
+
+
+/*! Launches a new thread that runs the given function once.
+	\param thread The output. Pass it to join_thread() eventually.
+	\param function The function to run on the new thread.
+	\param argument Passed to function. It must stay valid until the thread
+		has been joined.
+	\return 0 upon success.*/
+int create_thread(thread_t** thread, thread_function_t function, void* argument);
+
+
+//! \return true iff the function run by the given thread has returned, i.e.
+//!		join_thread() would not block
+bool is_thread_finished(thread_t* thread);
+
+
+/*! Waits for the given thread to finish, frees the handle and sets it to NULL.
+	Passing a pointer to NULL is legal and returns 0.
+	\return The value returned by the thread function.*/
+int join_thread(thread_t** thread);
+
+
+//! An opaque handle to a mutex
+typedef struct mutex_s mutex_t;
+
+
+//! Creates a mutex that is initially unlocked. Clean up with free_mutex().
+//! \return 0 upon success.
+int create_mutex(mutex_t** mutex);
+
+
+void lock_mutex(mutex_t* mutex);
+
+
+void unlock_mutex(mutex_t* mutex);
+
+
+//! Frees the given mutex (which must not be locked) and sets it to NULL
+void free_mutex(mutex_t** mutex);
+
+
+//! \return The number of logical processors available to this process (at
+//!		least one)
+uint32_t get_hardware_thread_count();
+
+
+//! The signature of functions that can be run by run_parallel(). The return
+//! value is 0 upon success.
+typedef int (*task_function_t)(void* context, uint32_t task_index);
+
+
+/*! Invokes the given function once for each task index from 0 to
+	task_count - 1. A pool of worker threads processes these tasks
+	concurrently, each worker claiming the next unclaimed index as soon as it
+	is done with its previous task.
+	\param function The function to run for each task. It must be thread safe.
+	\param context Passed to function.
+	\param task_count The number of tasks.
+	\param thread_count The maximal number of worker threads. Pass 0 to use
+		get_hardware_thread_count(). If it is one, all tasks run on the calling
+		thread.
+	\return 0 if all tasks returned 0.*/
+int run_parallel(task_function_t function, void* context, uint32_t task_count, uint32_t thread_count);
@@ -5,6 +5,13 @@
 #include <string.h>
 #define GLFW_INCLUDE_VULKAN
 #include <GLFW/glfw3.h>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
 
 
 //! A ring-buffer used to record times at which record_frame_time() was invoked
@@ -86,3 +93,18 @@ frame_time_stats_t get_frame_stats() {
 	}
 	return stats;
 }
+
+
+double get_peak_memory_usage() {
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters = { .cb = sizeof(counters) };
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+		return counters.PeakWorkingSetSize / (1024.0 * 1024.0);
+#else
+	struct rusage usage;
+	// ru_maxrss is in kilobytes on Linux
+	if (!getrusage(RUSAGE_SELF, &usage))
+		return usage.ru_maxrss / 1024.0;
+#endif
+	return 0.0;
+}
@@ -32,3 +32,9 @@ float get_frame_delta();
 //!		RECORDED_FRAME_COUNT frames or an all 0 object if less than two frames
 //!		have been recorded.
 frame_time_stats_t get_frame_stats();
+
+
+//! \return The peak resident set size over the whole lifetime of this process
+//!		so far in MiB or 0.0 if it cannot be determined. It never decreases,
+//!		so it does not isolate the memory used by any single operation.
+double get_peak_memory_usage();
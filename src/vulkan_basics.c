@@ -2,6 +2,7 @@
 #include "string_utilities.h"
 #include "math_utilities.h"
 #include "vulkan_formats.h"
+#include "threading.h"
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -10,6 +11,7 @@
 int create_device(device_t* device, const char* app_name, uint32_t physical_device_index) {
 	memset(device, 0, sizeof(*device));
 	device->physical_device_index = physical_device_index;
+	device->staging_size = DEFAULT_STAGING_SIZE;
 	// Initialize GLFW
 	if (!glfwInit()) {
 		printf("GLFW initialization failed.\n");
@@ -92,6 +94,15 @@ int create_device(device_t* device, const char* app_name, uint32_t physical_devi
 		free_device(device);
 		return 1;
 	}
+	// If there is a queue family dedicated to transfers, uploads go through it
+	device->transfer_queue_family_index = device->queue_family_count;
+	for (uint32_t i = 0; i != device->queue_family_count; ++i) {
+		VkQueueFlags flags = device->queue_family_properties[i].queueFlags;
+		if ((flags & VK_QUEUE_TRANSFER_BIT) && !(flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT))) {
+			device->transfer_queue_family_index = i;
+			break;
+		}
+	}
 	// Pick extensions
 	const char* extension_names[] = {
 		VK_KHR_SWAPCHAIN_EXTENSION_NAME,
@@ -104,15 +115,28 @@ int create_device(device_t* device, const char* app_name, uint32_t physical_devi
 		VK_KHR_RAY_QUERY_EXTENSION_NAME,
 	};
 	// Create a device
-	VkDeviceQueueCreateInfo queue_info = {
-		.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
-		.queueCount = 1,
-		.queueFamilyIndex = device->queue_family_index,
-		.pQueuePriorities = &(float) { 1.0f },
+	// If possible, we create a second queue with lower priority for background
+	// work
+	float queue_priorities[] = { 1.0f, 0.5f };
+	VkDeviceQueueCreateInfo queue_infos[] = {
+		{
+			.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+			.queueCount = (device->queue_family_properties[device->queue_family_index].queueCount >= 2) ? 2 : 1,
+			.queueFamilyIndex = device->queue_family_index,
+			.pQueuePriorities = queue_priorities,
+		},
+		{
+			.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+			.queueCount = 1,
+			.queueFamilyIndex = device->transfer_queue_family_index,
+			.pQueuePriorities = queue_priorities,
+		},
 	};
+	bool use_transfer_queue = (device->transfer_queue_family_index != device->queue_family_count);
 	VkPhysicalDeviceFeatures enabled_features = {
 		.samplerAnisotropy = VK_TRUE,
 		.shaderSampledImageArrayDynamicIndexing = VK_TRUE,
+		.fragmentStoresAndAtomics = VK_TRUE,
 	};
 	VkPhysicalDeviceVulkan12Features enabled_new_features = {
 		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES,
@@ -126,6 +150,9 @@ int create_device(device_t* device, const char* app_name, uint32_t physical_devi
 		},
 		.descriptorIndexing = VK_TRUE,
 		.shaderSampledImageArrayNonUniformIndexing = VK_TRUE,
+		.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE,
+		.descriptorBindingPartiallyBound = VK_TRUE,
+		.runtimeDescriptorArray = VK_TRUE,
 		.shaderUniformTexelBufferArrayDynamicIndexing = VK_TRUE,
 		.bufferDeviceAddress = VK_TRUE,
 	};
@@ -134,8 +161,8 @@ int create_device(device_t* device, const char* app_name, uint32_t physical_devi
 		.pNext = &enabled_new_features,
 		.ppEnabledExtensionNames = extension_names,
 		.enabledExtensionCount = COUNT_OF(extension_names),
-		.queueCreateInfoCount = 1,
-		.pQueueCreateInfos = &queue_info,
+		.queueCreateInfoCount = use_transfer_queue ? 2 : 1,
+		.pQueueCreateInfos = queue_infos,
 		.pEnabledFeatures = &enabled_features,
 	};
 	if (result = vkCreateDevice(device->physical_device, &device_info, NULL, &device->device)) {
@@ -147,8 +174,14 @@ int create_device(device_t* device, const char* app_name, uint32_t physical_devi
 	}
 	// Query the queue from the device
 	vkGetDeviceQueue(device->device, device->queue_family_index, 0, &device->queue);
-	// Query acceleration structure properties
+	if (queue_infos[0].queueCount >= 2)
+		vkGetDeviceQueue(device->device, device->queue_family_index, 1, &device->background_queue);
+	if (use_transfer_queue)
+		vkGetDeviceQueue(device->device, device->transfer_queue_family_index, 0, &device->transfer_queue);
+	// Query acceleration structure properties and device identifiers
+	device->id_properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ID_PROPERTIES;
 	device->bvh_properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ACCELERATION_STRUCTURE_PROPERTIES_KHR;
+	device->bvh_properties.pNext = &device->id_properties;
 	VkPhysicalDeviceProperties2KHR device_properties = {
 		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2_KHR,
 		.pNext = &device->bvh_properties,
@@ -165,11 +198,23 @@ int create_device(device_t* device, const char* app_name, uint32_t physical_devi
 		free_device(device);
 		return 1;
 	}
+	// Create a command pool for the transfer queue
+	if (device->transfer_queue) {
+		cmd_pool_info.queueFamilyIndex = device->transfer_queue_family_index;
+		if (vkCreateCommandPool(device->device, &cmd_pool_info, NULL, &device->transfer_cmd_pool) || create_mutex(&device->transfer_queue_mutex)) {
+			printf("Failed to create a command pool or a mutex for the transfer queue.\n");
+			free_device(device);
+			return 1;
+		}
+		printf("Uploads use the dedicated transfer queue family %u.\n", device->transfer_queue_family_index);
+	}
 	return 0;
 }
 
 
 void free_device(device_t* device) {
+	if (device->transfer_cmd_pool) vkDestroyCommandPool(device->device, device->transfer_cmd_pool, NULL);
+	free_mutex(&device->transfer_queue_mutex);
 	if (device->cmd_pool) vkDestroyCommandPool(device->device, device->cmd_pool, NULL);
 	if (device->device) vkDestroyDevice(device->device, NULL);
 	if (device->instance) vkDestroyInstance(device->instance, NULL);
@@ -180,6 +225,39 @@ void free_device(device_t* device) {
 }
 
 
+int create_thread_device(device_t* thread_device, const device_t* device) {
+	(*thread_device) = (*device);
+	thread_device->cmd_pool = thread_device->transfer_cmd_pool = VK_NULL_HANDLE;
+	if (!device->background_queue)
+		return 1;
+	thread_device->queue = device->background_queue;
+	VkCommandPoolCreateInfo cmd_pool_info = {
+		.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+		.queueFamilyIndex = device->queue_family_index,
+		.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+	};
+	if (vkCreateCommandPool(device->device, &cmd_pool_info, NULL, &thread_device->cmd_pool)) {
+		printf("Failed to create a command pool for a worker thread.\n");
+		free_thread_device(thread_device);
+		return 1;
+	}
+	cmd_pool_info.queueFamilyIndex = device->transfer_queue_family_index;
+	if (device->transfer_queue && vkCreateCommandPool(device->device, &cmd_pool_info, NULL, &thread_device->transfer_cmd_pool)) {
+		printf("Failed to create a transfer command pool for a worker thread.\n");
+		free_thread_device(thread_device);
+		return 1;
+	}
+	return 0;
+}
+
+
+void free_thread_device(device_t* thread_device) {
+	if (thread_device->transfer_cmd_pool) vkDestroyCommandPool(thread_device->device, thread_device->transfer_cmd_pool, NULL);
+	if (thread_device->cmd_pool) vkDestroyCommandPool(thread_device->device, thread_device->cmd_pool, NULL);
+	memset(thread_device, 0, sizeof(*thread_device));
+}
+
+
 swapchain_result_t create_swapchain(swapchain_t* swapchain, const device_t* device, GLFWwindow* window, bool use_vsync) {
 	memset(swapchain, 0, sizeof(*swapchain));
 	// Create a surface
@@ -599,6 +677,29 @@ int create_images(images_t* images, const device_t* device, const image_request_
 }
 
 
+int set_image_view_mip_levels(image_t* image, const device_t* device, uint32_t base_mip_level, uint32_t mip_level_count, VkImageView* old_view) {
+	if (image->request.view_info.sType != VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO)
+		return 1;
+	if (mip_level_count == 0)
+		mip_level_count = image->request.image_info.mipLevels - base_mip_level;
+	VkImageView view = NULL;
+	VkImageViewCreateInfo view_info = image->request.view_info;
+	view_info.subresourceRange.baseMipLevel = base_mip_level;
+	view_info.subresourceRange.levelCount = mip_level_count;
+	if (vkCreateImageView(device->device, &view_info, NULL, &view)) {
+		printf("Failed to recreate an image view for mipmap levels %u to %u.\n", base_mip_level, base_mip_level + mip_level_count - 1);
+		return 1;
+	}
+	if (old_view)
+		(*old_view) = image->view;
+	else if (image->view)
+		vkDestroyImageView(device->device, image->view, NULL);
+	image->view = view;
+	image->request.view_info = view_info;
+	return 0;
+}
+
+
 void free_images(images_t* images, const device_t* device) {
 	for (uint32_t i = 0; i != images->image_count; ++i) {
 		if (images->images[i].view) vkDestroyImageView(device->device, images->images[i].view, NULL);
@@ -682,32 +783,15 @@ int transition_image_layouts(images_t* images, const device_t* device, const VkI
 }
 
 
-int copy_buffers_or_images(const device_t* device, const copy_request_t* requests, uint32_t request_count) {
-	// Early out
-	if (request_count == 0)
-		return 0;
-	// Create a command buffer that will be used exactly once to perform these
-	// copies
-	VkCommandBufferAllocateInfo cmd_info = {
-		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
-		.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
-		.commandPool = device->cmd_pool,
-		.commandBufferCount = 1,
-	};
-	VkCommandBuffer cmd;
-	if (vkAllocateCommandBuffers(device->device, &cmd_info, &cmd)) {
-		printf("Failed to create a command buffer for copying.\n");
-		return 1;
-	}
-	VkCommandBufferBeginInfo begin_info = {
-		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
-		.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
-	};
-	if (vkBeginCommandBuffer(cmd, &begin_info)) {
-		printf("Failed to begin recording commands for copying.\n");
-		vkFreeCommandBuffers(device->device, device->cmd_pool, 1, &cmd);
-		return 1;
-	}
+/*! Records commands for the given copies (including layout transitions) into
+	the given command buffer, which must be in the recording state.
+	\param src_queue_family, dst_queue_family If they differ, the final
+		barriers for destinations of buffer-to-buffer and buffer-to-image
+		copies release ownership from the former family (which must be the
+		one that executes cmd) to the latter. Then the latter has to acquire
+		ownership using record_copy_acquisition(). Pass
+		VK_QUEUE_FAMILY_IGNORED twice otherwise.*/
+void record_copies(VkCommandBuffer cmd, const copy_request_t* requests, uint32_t request_count, uint32_t src_queue_family, uint32_t dst_queue_family) {
 	// Use barriers to transition all images to appropriate layouts for the
 	// following operations
 	VkImageMemoryBarrier* barriers = calloc(2 * request_count, sizeof(VkImageMemoryBarrier));
@@ -779,18 +863,38 @@ int copy_buffers_or_images(const device_t* device, const copy_request_t* request
 		}
 	}
 	// Use barriers to bring source images back to their original layouts and
-	// destination images to the new layout
+	// destination images to the new layout. Release ownership if requested.
+	bool release = (src_queue_family != dst_queue_family);
+	VkBufferMemoryBarrier* buffer_barriers = release ? calloc(request_count, sizeof(VkBufferMemoryBarrier)) : NULL;
+	uint32_t buffer_barrier_count = 0;
 	barrier_count = 0;
 	for (uint32_t i = 0; i != request_count; ++i) {
 		const copy_request_t* req = &requests[i];
 		switch (req->type) {
+			case copy_type_buffer_to_buffer: {
+				if (!release)
+					break;
+				VkBufferMemoryBarrier barrier = {
+					.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+					.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+					.srcQueueFamilyIndex = src_queue_family,
+					.dstQueueFamilyIndex = dst_queue_family,
+					.buffer = req->u.buffer_to_buffer.dst,
+					.offset = req->u.buffer_to_buffer.copy.dstOffset,
+					.size = req->u.buffer_to_buffer.copy.size,
+				};
+				buffer_barriers[buffer_barrier_count++] = barrier;
+				break;
+			}
 			case copy_type_buffer_to_image: {
 				VkImageMemoryBarrier barrier = {
 					.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
 					.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
-					.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT,
+					.dstAccessMask = release ? 0 : (VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT),
 					.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
 					.newLayout = req->u.buffer_to_image.dst_new_layout,
+					.srcQueueFamilyIndex = src_queue_family,
+					.dstQueueFamilyIndex = dst_queue_family,
 					.image = req->u.buffer_to_image.dst,
 					.subresourceRange = image_subresource_layers_to_range(&req->u.buffer_to_image.copy.imageSubresource),
 				};
@@ -828,10 +932,84 @@ int copy_buffers_or_images(const device_t* device, const copy_request_t* request
 				break;
 		}
 	}
-	if (barrier_count)
-		vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, NULL, 0, NULL, barrier_count, barriers);
+	if (barrier_count || buffer_barrier_count)
+		vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, NULL, buffer_barrier_count, buffer_barriers, barrier_count, barriers);
 	free(barriers);
+	free(buffer_barriers);
 	barriers = NULL;
+	buffer_barriers = NULL;
+}
+
+
+//! Records barriers into the given command buffer that acquire ownership of
+//! the destinations of the given copies for dst_queue_family, after
+//! record_copies() has released them with the same parameters
+void record_copy_acquisition(VkCommandBuffer cmd, const copy_request_t* requests, uint32_t request_count, uint32_t src_queue_family, uint32_t dst_queue_family) {
+	VkImageMemoryBarrier* barriers = calloc(request_count, sizeof(VkImageMemoryBarrier));
+	VkBufferMemoryBarrier* buffer_barriers = calloc(request_count, sizeof(VkBufferMemoryBarrier));
+	uint32_t barrier_count = 0, buffer_barrier_count = 0;
+	for (uint32_t i = 0; i != request_count; ++i) {
+		const copy_request_t* req = &requests[i];
+		if (req->type == copy_type_buffer_to_buffer) {
+			VkBufferMemoryBarrier barrier = {
+				.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+				.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT,
+				.srcQueueFamilyIndex = src_queue_family,
+				.dstQueueFamilyIndex = dst_queue_family,
+				.buffer = req->u.buffer_to_buffer.dst,
+				.offset = req->u.buffer_to_buffer.copy.dstOffset,
+				.size = req->u.buffer_to_buffer.copy.size,
+			};
+			buffer_barriers[buffer_barrier_count++] = barrier;
+		}
+		else if (req->type == copy_type_buffer_to_image) {
+			VkImageMemoryBarrier barrier = {
+				.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+				.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT,
+				.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+				.newLayout = req->u.buffer_to_image.dst_new_layout,
+				.srcQueueFamilyIndex = src_queue_family,
+				.dstQueueFamilyIndex = dst_queue_family,
+				.image = req->u.buffer_to_image.dst,
+				.subresourceRange = image_subresource_layers_to_range(&req->u.buffer_to_image.copy.imageSubresource),
+			};
+			barriers[barrier_count++] = barrier;
+		}
+	}
+	if (barrier_count || buffer_barrier_count)
+		vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, NULL, buffer_barrier_count, buffer_barriers, barrier_count, barriers);
+	free(barriers);
+	free(buffer_barriers);
+}
+
+
+int copy_buffers_or_images(const device_t* device, const copy_request_t* requests, uint32_t request_count) {
+	// Early out
+	if (request_count == 0)
+		return 0;
+	// Create a command buffer that will be used exactly once to perform these
+	// copies
+	VkCommandBufferAllocateInfo cmd_info = {
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+		.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+		.commandPool = device->cmd_pool,
+		.commandBufferCount = 1,
+	};
+	VkCommandBuffer cmd;
+	if (vkAllocateCommandBuffers(device->device, &cmd_info, &cmd)) {
+		printf("Failed to create a command buffer for copying.\n");
+		return 1;
+	}
+	VkCommandBufferBeginInfo begin_info = {
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+		.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+	};
+	if (vkBeginCommandBuffer(cmd, &begin_info)) {
+		printf("Failed to begin recording commands for copying.\n");
+		vkFreeCommandBuffers(device->device, device->cmd_pool, 1, &cmd);
+		return 1;
+	}
+	record_copies(cmd, requests, request_count, VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED);
 	// Submit the commands and wait for it to finish
 	vkEndCommandBuffer(cmd);
 	VkSubmitInfo submit_info = {
@@ -882,83 +1060,478 @@ int copy_images(const device_t* device, const copy_image_to_image_t* requests, u
 }
 
 
+//! The number of batches of uploads that fill_buffers() and fill_images() may
+//! have in flight at once. While the device copies one, the next one is
+//! written.
+#define STAGING_SLOT_COUNT 2
+
+
+//! A batch of uploads handled by staging_ring_t
+typedef struct {
+	//! The command buffer used to copy this batch or, if there is a transfer
+	//! queue, to acquire ownership of the copied resources
+	VkCommandBuffer cmd;
+	//! The command buffer used to copy this batch on the transfer queue or
+	//! VK_NULL_HANDLE if there is none
+	VkCommandBuffer transfer_cmd;
+	//! Signaled once the copies on the transfer queue have completed
+	VkSemaphore transferred;
+	//! Signaled once the copies for this batch have completed and ownership
+	//! of the copied resources has been acquired by the queue of the device
+	VkFence fence;
+	//! true iff commands for this batch have been submitted and the fence has
+	//! not been waited for yet
+	bool pending;
+	//! A temporary staging buffer for a subresource that is too big for a
+	//! slot. It is freed once the slot is used again or the ring is freed.
+	buffers_t big_staging;
+} staging_slot_t;
+
+
+//! A fixed-size host-visible staging buffer that is split into equally large
+//! slots, which are used round robin for batches of uploads
+typedef struct {
+	//! A single persistently mapped buffer holding all slots
+	buffers_t staging;
+	//! The mapped memory of the buffer
+	uint8_t* data;
+	//! The size in bytes of each slot. It is a multiple of
+	//! FILL_BUFFER_GRANULARITY and of the alignment of the slots.
+	VkDeviceSize slot_size;
+	//! The number of used slots, at most STAGING_SLOT_COUNT
+	uint32_t slot_count;
+	//! The slot that is to be used for the next batch
+	uint32_t current_slot;
+	//! Per-slot command buffers and fences
+	staging_slot_t slots[STAGING_SLOT_COUNT];
+} staging_ring_t;
+
+
+void free_staging_ring(staging_ring_t* ring, const device_t* device);
+
+
+/*! Creates a staging ring of at most device->staging_size bytes.
+	\param ring The output. Clean up with free_staging_ring().
+	\param device Output of create_device().
+	\param required_size The total number of bytes that are to be uploaded.
+		If it is small, the ring gets smaller accordingly.
+	\param alignment A power of two. Slots begin at multiples of it.
+	\return 0 upon success.*/
+int create_staging_ring(staging_ring_t* ring, const device_t* device, VkDeviceSize required_size, VkDeviceSize alignment) {
+	memset(ring, 0, sizeof(*ring));
+	// The least common multiple of FILL_BUFFER_GRANULARITY and the alignment
+	VkDeviceSize granularity = FILL_BUFFER_GRANULARITY;
+	while (granularity % alignment)
+		granularity *= 2;
+	ring->slot_size = device->staging_size / STAGING_SLOT_COUNT;
+	if (ring->slot_size > required_size)
+		ring->slot_size = required_size;
+	ring->slot_size = align_offset(ring->slot_size, granularity);
+	if (ring->slot_size == 0)
+		ring->slot_size = granularity;
+	ring->slot_count = (required_size > ring->slot_size) ? STAGING_SLOT_COUNT : 1;
+	// Create and map the staging buffer
+	buffer_request_t request = {
+		.buffer_info = {
+			.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+			.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+			.size = ring->slot_size * ring->slot_count,
+		},
+	};
+	void* data = NULL;
+	if (create_buffers(&ring->staging, device, &request, 1, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, 16)
+		|| vkMapMemory(device->device, ring->staging.allocation, 0, ring->staging.size, 0, &data))
+	{
+		printf("Failed to create and map a staging buffer with %lu bytes.\n", request.buffer_info.size);
+		free_staging_ring(ring, device);
+		return 1;
+	}
+	ring->data = (uint8_t*) data;
+	// Create command buffers and fences for all slots
+	for (uint32_t i = 0; i != ring->slot_count; ++i) {
+		VkCommandBufferAllocateInfo cmd_info = {
+			.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+			.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+			.commandPool = device->cmd_pool,
+			.commandBufferCount = 1,
+		};
+		VkFenceCreateInfo fence_info = { .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO };
+		if (vkAllocateCommandBuffers(device->device, &cmd_info, &ring->slots[i].cmd)
+			|| vkCreateFence(device->device, &fence_info, NULL, &ring->slots[i].fence))
+		{
+			printf("Failed to create a command buffer or a fence for staging.\n");
+			free_staging_ring(ring, device);
+			return 1;
+		}
+		if (!device->transfer_queue)
+			continue;
+		cmd_info.commandPool = device->transfer_cmd_pool;
+		VkSemaphoreCreateInfo semaphore_info = { .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO };
+		if (vkAllocateCommandBuffers(device->device, &cmd_info, &ring->slots[i].transfer_cmd)
+			|| vkCreateSemaphore(device->device, &semaphore_info, NULL, &ring->slots[i].transferred))
+		{
+			printf("Failed to create a command buffer or a semaphore for the transfer queue.\n");
+			free_staging_ring(ring, device);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+
+/*! Waits until the current slot of the given ring is no longer in use by the
+	device, such that its memory can be overwritten.
+	\param slot_offset Set to the offset in bytes of the slot within the
+		staging buffer.
+	\return 0 upon success.*/
+int begin_staging_slot(VkDeviceSize* slot_offset, staging_ring_t* ring, const device_t* device) {
+	staging_slot_t* slot = &ring->slots[ring->current_slot];
+	if (slot->pending) {
+		slot->pending = false;
+		if (vkWaitForFences(device->device, 1, &slot->fence, VK_TRUE, UINT64_MAX) || vkResetFences(device->device, 1, &slot->fence)) {
+			printf("Failed to wait for a staging buffer to become available.\n");
+			return 1;
+		}
+	}
+	free_buffers(&slot->big_staging, device);
+	(*slot_offset) = ring->current_slot * ring->slot_size;
+	return 0;
+}
+
+
+/*! Submits the given copies for the current slot of the given ring and moves
+	on to the next slot without waiting for the copies to finish. If the
+	device has a transfer queue, the copies run there. Afterwards, ownership
+	of the destinations goes to the queue family of the device and the queue
+	of the device acquires it once a semaphore is signaled.
+	\return 0 upon success.*/
+int submit_staging_slot(staging_ring_t* ring, const device_t* device, const copy_request_t* requests, uint32_t request_count) {
+	staging_slot_t* slot = &ring->slots[ring->current_slot];
+	VkCommandBufferBeginInfo begin_info = {
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+		.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+	};
+	VkPipelineStageFlags wait_stage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+	VkSubmitInfo submit_info = {
+		.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+		.pCommandBuffers = &slot->cmd,
+		.commandBufferCount = 1,
+	};
+	if (slot->transfer_cmd) {
+		// Copy on the transfer queue and release ownership
+		if (vkBeginCommandBuffer(slot->transfer_cmd, &begin_info)) {
+			printf("Failed to begin recording commands for copying from a staging buffer.\n");
+			return 1;
+		}
+		record_copies(slot->transfer_cmd, requests, request_count, device->transfer_queue_family_index, device->queue_family_index);
+		VkSubmitInfo transfer_info = {
+			.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+			.pCommandBuffers = &slot->transfer_cmd,
+			.commandBufferCount = 1,
+			.pSignalSemaphores = &slot->transferred,
+			.signalSemaphoreCount = 1,
+		};
+		lock_mutex(device->transfer_queue_mutex);
+		VkResult result = vkEndCommandBuffer(slot->transfer_cmd);
+		if (!result)
+			result = vkQueueSubmit(device->transfer_queue, 1, &transfer_info, NULL);
+		unlock_mutex(device->transfer_queue_mutex);
+		if (result) {
+			printf("Failed to submit copies from a staging buffer to the transfer queue.\n");
+			return 1;
+		}
+		// Acquire ownership on the queue of the device
+		submit_info.pWaitSemaphores = &slot->transferred;
+		submit_info.pWaitDstStageMask = &wait_stage;
+		submit_info.waitSemaphoreCount = 1;
+	}
+	if (vkBeginCommandBuffer(slot->cmd, &begin_info)) {
+		printf("Failed to begin recording commands for copying from a staging buffer.\n");
+		return 1;
+	}
+	if (slot->transfer_cmd)
+		record_copy_acquisition(slot->cmd, requests, request_count, device->transfer_queue_family_index, device->queue_family_index);
+	else
+		record_copies(slot->cmd, requests, request_count, VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED);
+	if (vkEndCommandBuffer(slot->cmd) || vkQueueSubmit(device->queue, 1, &submit_info, slot->fence)) {
+		printf("Failed to submit copies from a staging buffer.\n");
+		return 1;
+	}
+	slot->pending = true;
+	ring->current_slot = (ring->current_slot + 1) % ring->slot_count;
+	return 0;
+}
+
+
+//! Waits for all copies submitted through the given ring to finish. Returns 0
+//! upon success.
+int finish_staging_ring(staging_ring_t* ring, const device_t* device) {
+	int result = 0;
+	for (uint32_t i = 0; i != ring->slot_count; ++i) {
+		staging_slot_t* slot = &ring->slots[i];
+		if (slot->pending) {
+			slot->pending = false;
+			result |= (vkWaitForFences(device->device, 1, &slot->fence, VK_TRUE, UINT64_MAX) != VK_SUCCESS);
+		}
+		free_buffers(&slot->big_staging, device);
+	}
+	return result;
+}
+
+
+//! Waits for pending copies and frees all objects held by the given ring
+void free_staging_ring(staging_ring_t* ring, const device_t* device) {
+	finish_staging_ring(ring, device);
+	for (uint32_t i = 0; i != STAGING_SLOT_COUNT; ++i) {
+		if (ring->slots[i].fence) vkDestroyFence(device->device, ring->slots[i].fence, NULL);
+		if (ring->slots[i].cmd) vkFreeCommandBuffers(device->device, device->cmd_pool, 1, &ring->slots[i].cmd);
+		if (ring->slots[i].transferred) vkDestroySemaphore(device->device, ring->slots[i].transferred, NULL);
+		if (ring->slots[i].transfer_cmd) vkFreeCommandBuffers(device->device, device->transfer_cmd_pool, 1, &ring->slots[i].transfer_cmd);
+		free_buffers(&ring->slots[i].big_staging, device);
+	}
+	if (ring->data) vkUnmapMemory(device->device, ring->staging.allocation);
+	free_buffers(&ring->staging, device);
+	memset(ring, 0, sizeof(*ring));
+}
+
+
 int fill_buffers(const buffers_t* buffers, const device_t* device, write_buffer_t write_buffer, const void* context) {
 	// Early out
 	if (buffers->buffer_count == 0)
 		return 0;
-	// Create staging buffers
-	buffers_t staging;
-	buffer_request_t* requests = calloc(buffers->buffer_count, sizeof(buffer_request_t));
-	for (uint32_t i = 0; i != buffers->buffer_count; ++i) {
-		requests[i] = buffers->buffers[i].request;
-		requests[i].buffer_info.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-		memset(&requests[i].view_info, 0, sizeof(requests[i].view_info));
-	}
-	int result = create_buffers(&staging, device, requests, buffers->buffer_count, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, 16);
-	free(requests);
-	requests = NULL;
-	if (result) {
+	// Create a staging ring
+	VkDeviceSize total_size = 0;
+	for (uint32_t i = 0; i != buffers->buffer_count; ++i)
+		total_size += align_offset(buffers->buffers[i].request.buffer_info.size, 16);
+	staging_ring_t ring;
+	if (create_staging_ring(&ring, device, total_size, 16)) {
 		printf("Failed to create staging buffers.\n");
-		free(requests);
 		return 1;
 	}
-	// Map their memory
-	void* staged_data = NULL;
-	if (vkMapMemory(device->device, staging.allocation, 0, staging.size, 0, &staged_data)) {
-		printf("Failed to map the memory of staging buffers.\n");
-		free_buffers(&staging, device);
-		return 1;
-	}
-	// Fill the staging buffers with data
-	for (uint32_t i = 0; i != buffers->buffer_count; ++i) {
-		const buffer_t* buffer = &staging.buffers[i];
-		(*write_buffer)((void*) ((uint8_t*) staged_data + buffer->memory_offset), i, buffer->request.buffer_info.size, context);
-	}
-	// Unmap memory
-	vkUnmapMemory(device->device, staging.allocation);
-	// Copy the staging buffers to the device-local buffers
-	copy_buffer_to_buffer_t* copy_requests = calloc(buffers->buffer_count, sizeof(copy_buffer_to_buffer_t));
-	for (uint32_t i = 0; i != buffers->buffer_count; ++i) {
-		copy_buffer_to_buffer_t copy_request = {
-			.src = staging.buffers[i].buffer,
-			.dst = buffers->buffers[i].buffer,
-			.copy = {
-				.size = buffers->buffers[i].request.buffer_info.size,
-			},
-		};
-		copy_requests[i] = copy_request;
+	// Each buffer contributes at most one range to each batch
+	copy_request_t* copy_requests = calloc(buffers->buffer_count, sizeof(copy_request_t));
+	uint32_t buffer_index = 0;
+	VkDeviceSize buffer_offset = 0;
+	while (buffer_index != buffers->buffer_count) {
+		VkDeviceSize slot_offset;
+		if (begin_staging_slot(&slot_offset, &ring, device)) {
+			free(copy_requests);
+			free_staging_ring(&ring, device);
+			return 1;
+		}
+		// Pack as many ranges into the slot as possible and fill them
+		VkDeviceSize slot_end = slot_offset + ring.slot_size;
+		uint32_t copy_count = 0;
+		while (buffer_index != buffers->buffer_count) {
+			const buffer_t* buffer = &buffers->buffers[buffer_index];
+			VkDeviceSize buffer_size = buffer->request.buffer_info.size;
+			VkDeviceSize range_size = buffer_size - buffer_offset;
+			if (range_size > slot_end - slot_offset) {
+				// Buffers are only split at multiples of the granularity
+				range_size = slot_end - slot_offset;
+				range_size -= range_size % FILL_BUFFER_GRANULARITY;
+				if (range_size == 0)
+					break;
+			}
+			(*write_buffer)((void*) (ring.data + slot_offset), buffer_index, buffer_offset, range_size, context);
+			copy_requests[copy_count].type = copy_type_buffer_to_buffer;
+			copy_buffer_to_buffer_t copy_request = {
+				.src = ring.staging.buffers[0].buffer,
+				.dst = buffer->buffer,
+				.copy = {
+					.srcOffset = slot_offset,
+					.dstOffset = buffer_offset,
+					.size = range_size,
+				},
+			};
+			copy_requests[copy_count++].u.buffer_to_buffer = copy_request;
+			slot_offset = align_offset(slot_offset + range_size, 16);
+			buffer_offset += range_size;
+			if (buffer_offset == buffer_size) {
+				++buffer_index;
+				buffer_offset = 0;
+			}
+			if (slot_offset >= slot_end)
+				break;
+		}
+		// Copy them while the next batch is being written
+		if (submit_staging_slot(&ring, device, copy_requests, copy_count)) {
+			printf("Failed to copy staging buffers to device-local buffers.\n");
+			free(copy_requests);
+			free_staging_ring(&ring, device);
+			return 1;
+		}
 	}
-	result = copy_buffers(device, copy_requests, buffers->buffer_count);
 	free(copy_requests);
-	copy_requests = NULL;
-	if (result) {
+	// Wait for the last copies and tidy up
+	int result = finish_staging_ring(&ring, device);
+	if (result)
 		printf("Failed to copy staging buffers to device-local buffers.\n");
-		free_buffers(&staging, device);
-		return 1;
+	free_staging_ring(&ring, device);
+	return result;
+}
+
+
+//! Shared state for write_image_task()
+typedef struct {
+	//! \see fill_image_levels_batched()
+	const images_t* images;
+	//! Exactly one of these callbacks is not NULL
+	write_image_subresource_t write_subresource;
+	write_image_batch_t write_batch;
+	const void* context;
+	//! Staged data of each subresource begins at a multiple of this power of
+	//! two and the staging memory up to the next multiple is reserved for it
+	VkDeviceSize staging_alignment;
+	//! The mapped memory of the current staging buffer
+	uint8_t* staged_data;
+	//! All subresources that are to be filled
+	const staged_subresource_t* subresources;
+	//! Task i writes the subresources from task_begins[i] to
+	//! task_begins[i + 1] - 1, which all belong to the same image
+	const uint32_t* task_begins;
+} fill_images_t;
+
+
+//! A task for run_parallel() that writes a run of consecutive subresources of
+//! one image using a fill_images_t as context
+int write_image_task(void* raw_fill, uint32_t task_index) {
+	const fill_images_t* fill = (const fill_images_t*) raw_fill;
+	for (uint32_t i = fill->task_begins[task_index]; i != fill->task_begins[task_index + 1]; ++i) {
+		const staged_subresource_t* staged = &fill->subresources[i];
+		const VkImageCreateInfo* image_info = &fill->images->images[staged->image_index].request.image_info;
+		(*fill->write_subresource)(fill->staged_data + staged->staging_offset, staged->image_index, &staged->subresource, staged->size, image_info, &staged->extent, fill->context);
 	}
-	// Tidy up
-	free_buffers(&staging, device);
 	return 0;
 }
 
 
+/*! Writes the given subresources to staging memory using one task per image
+	or a single invocation of the batch callback.
+	\param fill The shared state. task_begins must have room for
+		subresource_end - subresource_begin + 1 entries.
+	\param subresource_begin, subresource_end The range of subresources to
+		write (excluding the end).
+	\return 0 upon success.*/
+int write_subresources(fill_images_t* fill, uint32_t* task_begins, uint32_t subresource_begin, uint32_t subresource_end) {
+	if (fill->write_batch)
+		return (*fill->write_batch)(fill->staged_data, fill->subresources + subresource_begin, subresource_end - subresource_begin, fill->context);
+	uint32_t task_count = 0;
+	for (uint32_t i = subresource_begin; i != subresource_end; ++i)
+		if (i == subresource_begin || fill->subresources[i].image_index != fill->subresources[i - 1].image_index)
+			task_begins[task_count++] = i;
+	task_begins[task_count] = subresource_end;
+	fill->task_begins = task_begins;
+	return run_parallel(&write_image_task, fill, task_count, 0);
+}
+
+
+//! Turns the given subresource into a request for copying it from the given
+//! staging buffer
+copy_request_t get_subresource_copy_request(const staged_subresource_t* staged, const images_t* images, VkBuffer staging, VkImageLayout old_layout, VkImageLayout new_layout) {
+	copy_request_t request = {
+		.type = copy_type_buffer_to_image,
+		.u.buffer_to_image = {
+			.src = staging,
+			.dst = images->images[staged->image_index].image,
+			.dst_old_layout = old_layout,
+			.dst_new_layout = new_layout,
+			.copy = {
+				.bufferOffset = staged->staging_offset,
+				.imageExtent = staged->extent,
+				.imageSubresource = {
+					.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+					.mipLevel = staged->subresource.mipLevel,
+					.baseArrayLayer = staged->subresource.arrayLayer,
+					.layerCount = 1,
+				},
+			},
+		},
+	};
+	return request;
+}
+
+
+/*! Fills a single subresource, which is too big for a slot of the staging
+	ring, using a temporary staging buffer. The buffer takes the place of the
+	current slot, so the copy runs on the same queue as all other batches and
+	gets retired along with the slot, without waiting for it.
+	The staging offset of the subresource has to be zero.
+	\return 0 upon success.*/
+int fill_big_subresource(fill_images_t* fill, uint32_t* task_begins, uint32_t subresource_index, staging_ring_t* ring, const device_t* device, VkImageLayout old_layout, VkImageLayout new_layout) {
+	const staged_subresource_t* staged = &fill->subresources[subresource_index];
+	VkDeviceSize slot_offset;
+	if (begin_staging_slot(&slot_offset, ring, device))
+		return 1;
+	buffers_t* staging = &ring->slots[ring->current_slot].big_staging;
+	buffer_request_t request = {
+		.buffer_info = {
+			.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+			.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+			.size = align_offset(staged->size, fill->staging_alignment),
+		},
+	};
+	void* staged_data = NULL;
+	if (create_buffers(staging, device, &request, 1, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, 16)
+		|| vkMapMemory(device->device, staging->allocation, 0, staging->size, 0, &staged_data))
+	{
+		printf("Failed to create and map a staging buffer with %lu bytes for mipmap %u of image %u.\n", staged->size, staged->subresource.mipLevel, staged->image_index);
+		free_buffers(staging, device);
+		return 1;
+	}
+	uint8_t* ring_data = fill->staged_data;
+	fill->staged_data = (uint8_t*) staged_data;
+	int result = write_subresources(fill, task_begins, subresource_index, subresource_index + 1);
+	fill->staged_data = ring_data;
+	vkUnmapMemory(device->device, staging->allocation);
+	copy_request_t copy_request = get_subresource_copy_request(staged, fill->images, staging->buffers[0].buffer, old_layout, new_layout);
+	if (!result)
+		result = submit_staging_slot(ring, device, &copy_request, 1);
+	return result;
+}
+
+
 int fill_images(const images_t* images, const device_t* device, write_image_subresource_t write_subresource, VkImageLayout old_layout, VkImageLayout new_layout, const void* context) {
+	return fill_image_levels(images, device, NULL, NULL, write_subresource, old_layout, new_layout, context);
+}
+
+
+struct image_upload_s {
+	//! The staging ring with the pending copies
+	staging_ring_t ring;
+};
+
+
+/*! Implements fill_image_levels(), fill_image_levels_batched() and
+	fill_image_levels_batched_async(). Exactly one of write_subresource and
+	write_batch must not be NULL. If upload is not NULL, the staging ring is
+	handed over to *upload rather than waiting for the last copies.*/
+int fill_image_levels_common(image_upload_t** upload, const images_t* images, const device_t* device, const uint32_t* base_levels, const uint32_t* level_counts, write_image_subresource_t write_subresource, write_image_batch_t write_batch, VkDeviceSize staging_alignment, VkImageLayout old_layout, VkImageLayout new_layout, const void* context) {
+	if (upload)
+		(*upload) = NULL;
 	// Early out
 	if (images->image_count == 0)
 		return 0;
-	// Count subresources
+	// Figure out which mipmaps to fill and count subresources
 	uint32_t subresource_count = 0;
-	for (uint32_t i = 0; i != images->image_count; ++i)
-		subresource_count += images->images[i].request.image_info.mipLevels * images->images[i].request.image_info.arrayLayers;
-	// Create staging buffers of appropriate size
-	buffers_t staging;
-	buffer_request_t* requests = calloc(subresource_count, sizeof(buffer_request_t));
-	VkExtent3D* extents = calloc(subresource_count, sizeof(VkExtent3D));
+	for (uint32_t i = 0; i != images->image_count; ++i) {
+		const VkImageCreateInfo* image_info = &images->images[i].request.image_info;
+		uint32_t base_level = base_levels ? base_levels[i] : 0;
+		uint32_t level_count = level_counts ? level_counts[i] : (image_info->mipLevels - base_level);
+		subresource_count += level_count * image_info->arrayLayers;
+	}
+	if (subresource_count == 0)
+		return 0;
+	// List all subresources along with their sizes
+	staged_subresource_t* subresources = calloc(subresource_count, sizeof(staged_subresource_t));
 	uint32_t subresource_index = 0;
+	VkDeviceSize total_size = 0;
 	for (uint32_t i = 0; i != images->image_count; ++i) {
-		VkImageCreateInfo* image_info = &images->images[i].request.image_info;
+		const VkImageCreateInfo* image_info = &images->images[i].request.image_info;
 		format_description_t format = get_format_description(image_info->format);
-		for (uint32_t mip_level = 0; mip_level != image_info->mipLevels; ++mip_level) {
+		uint32_t base_level = base_levels ? base_levels[i] : 0;
+		uint32_t level_count = level_counts ? level_counts[i] : (image_info->mipLevels - base_level);
+		for (uint32_t mip_level = base_level; mip_level != base_level + level_count; ++mip_level) {
 			for (uint32_t layer = 0; layer != image_info->arrayLayers; ++layer) {
 				// Correct according to: https://registry.khronos.org/vulkan/specs/1.3-khr-extensions/html/chap12.html#resources-image-mip-level-sizing
 				VkExtent3D extent = {
@@ -970,93 +1543,137 @@ int fill_images(const images_t* images, const device_t* device, write_image_subr
 					extent.height = extent.depth = 1;
 				else if (image_info->imageType == VK_IMAGE_TYPE_2D)
 					extent.depth = 1;
-				extents[subresource_index] = extent;
-				uint32_t texel_count = extent.width * extent.height * extent.depth;
-				VkBufferCreateInfo request = {
-					.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
-					.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-					.size = (texel_count / format.texels_per_block) * format.block_size,
+				// Block-compressed mipmaps smaller than a block still take a
+				// whole block
+				VkDeviceSize block_count = (VkDeviceSize) ((extent.width + format.block_extent.width - 1) / format.block_extent.width)
+					* ((extent.height + format.block_extent.height - 1) / format.block_extent.height)
+					* ((extent.depth + format.block_extent.depth - 1) / format.block_extent.depth);
+				staged_subresource_t staged = {
+					.image_index = i,
+					.subresource = {
+						.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+						.mipLevel = mip_level,
+						.arrayLayer = layer,
+					},
+					.extent = extent,
+					.size = block_count * format.block_size,
 				};
-				requests[subresource_index++].buffer_info = request;
+				subresources[subresource_index++] = staged;
+				total_size += align_offset(staged.size, staging_alignment);
 			}
 		}
 	}
-	if (create_buffers(&staging, device, requests, subresource_count, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, 16)) {
+	// Create a staging ring
+	staging_ring_t ring;
+	if (create_staging_ring(&ring, device, total_size, staging_alignment)) {
 		printf("Failed to create staging buffers for images.\n");
-		free(requests);
-		free(extents);
+		free(subresources);
 		return 1;
 	}
-	free(requests);
-	requests = NULL;
-	// Map their memory
-	void* staged_data = NULL;
-	if (vkMapMemory(device->device, staging.allocation, 0, staging.size, 0, &staged_data)) {
-		printf("Failed to map the memory of staging buffers for images.\n");
-		free_buffers(&staging, device);
-		free(extents);
-		return 1;
-	}
-	// Fill the staging buffers with data
-	subresource_index = 0;
-	for (uint32_t i = 0; i != images->image_count; ++i) {
-		VkImageCreateInfo* image_info = &images->images[i].request.image_info;
-		for (uint32_t mip_level = 0; mip_level != image_info->mipLevels; ++mip_level) {
-			for (uint32_t layer = 0; layer != image_info->arrayLayers; ++layer) {
-				VkExtent3D extent = extents[subresource_index];
-				const buffer_t* buffer = &staging.buffers[subresource_index++];
-				VkImageSubresource subresource = {
-					.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-					.mipLevel = mip_level,
-					.arrayLayer = layer,
-				};
-				(*write_subresource)((uint8_t*) staged_data + buffer->memory_offset, i, &subresource, buffer->request.buffer_info.size, image_info, &extent, context);
-			}
+	// Fill the subresources batch by batch
+	fill_images_t fill = {
+		.images = images,
+		.write_subresource = write_subresource,
+		.write_batch = write_batch,
+		.context = context,
+		.staging_alignment = staging_alignment,
+		.staged_data = ring.data,
+		.subresources = subresources,
+	};
+	uint32_t* task_begins = calloc(subresource_count + 1, sizeof(uint32_t));
+	copy_request_t* copy_requests = calloc(subresource_count, sizeof(copy_request_t));
+	int result = 0;
+	uint32_t batch_begin = 0;
+	while (batch_begin != subresource_count && !result) {
+		// Subresources that do not fit into a slot get a buffer of their own
+		if (align_offset(subresources[batch_begin].size, staging_alignment) > ring.slot_size) {
+			subresources[batch_begin].staging_offset = 0;
+			result = fill_big_subresource(&fill, task_begins, batch_begin, &ring, device, old_layout, new_layout);
+			++batch_begin;
+			continue;
 		}
-	}
-	// Unmap memory
-	vkUnmapMemory(device->device, staging.allocation);
-	// Copy the staging buffers to the device-local images
-	copy_buffer_to_image_t* copy_requests = calloc(subresource_count, sizeof(copy_buffer_to_image_t));
-	subresource_index = 0;
-	for (uint32_t i = 0; i != images->image_count; ++i) {
-		VkImageCreateInfo* image_info = &images->images[i].request.image_info;
-		for (uint32_t mip_level = 0; mip_level != image_info->mipLevels; ++mip_level) {
-			for (uint32_t layer = 0; layer != image_info->arrayLayers; ++layer) {
-				VkExtent3D extent = extents[subresource_index];
-				const buffer_t* buffer = &staging.buffers[subresource_index];
-				copy_buffer_to_image_t copy_request = {
-					.src = buffer->buffer,
-					.dst = images->images[i].image,
-					.dst_old_layout = old_layout,
-					.dst_new_layout = new_layout,
-					.copy = {
-						.imageExtent = extent,
-						.imageSubresource = {
-							.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-							.mipLevel = mip_level,
-							.baseArrayLayer = layer,
-							.layerCount = 1,
-						},
-					},
-				};
-				copy_requests[subresource_index] = copy_request;
-				++subresource_index;
-			}
+		// Pack as many subresources into the slot as possible
+		VkDeviceSize slot_offset;
+		if (begin_staging_slot(&slot_offset, &ring, device)) {
+			result = 1;
+			break;
 		}
+		VkDeviceSize slot_end = slot_offset + ring.slot_size;
+		uint32_t batch_end = batch_begin;
+		for (; batch_end != subresource_count && slot_offset + align_offset(subresources[batch_end].size, staging_alignment) <= slot_end; ++batch_end) {
+			subresources[batch_end].staging_offset = slot_offset;
+			slot_offset += align_offset(subresources[batch_end].size, staging_alignment);
+		}
+		// Fill them and copy them while the next batch is being written
+		if (write_subresources(&fill, task_begins, batch_begin, batch_end)) {
+			printf("Failed to write %u subresources to staging memory.\n", batch_end - batch_begin);
+			result = 1;
+			break;
+		}
+		for (uint32_t i = batch_begin; i != batch_end; ++i)
+			copy_requests[i - batch_begin] = get_subresource_copy_request(&subresources[i], images, ring.staging.buffers[0].buffer, old_layout, new_layout);
+		result = submit_staging_slot(&ring, device, copy_requests, batch_end - batch_begin);
+		batch_begin = batch_end;
 	}
-	free(extents);
-	extents = NULL;
-	if (copy_buffers_to_images(device, copy_requests, subresource_count)) {
+	if (!upload || result)
+		result |= finish_staging_ring(&ring, device);
+	if (result)
 		printf("Failed to copy staging buffers to device-local images.\n");
-		free_buffers(&staging, device);
-		free(copy_requests);
-		return 1;
-	}
 	// Tidy up
-	free_buffers(&staging, device);
 	free(copy_requests);
-	return 0;
+	free(task_begins);
+	free(subresources);
+	if (upload && !result) {
+		(*upload) = malloc(sizeof(image_upload_t));
+		(*upload)->ring = ring;
+	}
+	else
+		free_staging_ring(&ring, device);
+	return result;
+}
+
+
+int fill_image_levels(const images_t* images, const device_t* device, const uint32_t* base_levels, const uint32_t* level_counts, write_image_subresource_t write_subresource, VkImageLayout old_layout, VkImageLayout new_layout, const void* context) {
+	return fill_image_levels_common(NULL, images, device, base_levels, level_counts, write_subresource, NULL, 16, old_layout, new_layout, context);
+}
+
+
+int fill_image_levels_batched(const images_t* images, const device_t* device, const uint32_t* base_levels, const uint32_t* level_counts, write_image_batch_t write_batch, VkDeviceSize staging_alignment, VkImageLayout old_layout, VkImageLayout new_layout, const void* context) {
+	if (staging_alignment < 16)
+		staging_alignment = 16;
+	return fill_image_levels_common(NULL, images, device, base_levels, level_counts, NULL, write_batch, staging_alignment, old_layout, new_layout, context);
+}
+
+
+int fill_image_levels_batched_async(image_upload_t** upload, const images_t* images, const device_t* device, const uint32_t* base_levels, const uint32_t* level_counts, write_image_batch_t write_batch, VkDeviceSize staging_alignment, VkImageLayout old_layout, VkImageLayout new_layout, const void* context) {
+	if (staging_alignment < 16)
+		staging_alignment = 16;
+	return fill_image_levels_common(upload, images, device, base_levels, level_counts, NULL, write_batch, staging_alignment, old_layout, new_layout, context);
+}
+
+
+VkResult poll_image_upload(image_upload_t* upload, const device_t* device, bool wait) {
+	staging_ring_t* ring = &upload->ring;
+	for (uint32_t i = 0; i != ring->slot_count; ++i) {
+		staging_slot_t* slot = &ring->slots[i];
+		if (!slot->pending)
+			continue;
+		VkResult result = wait ? vkWaitForFences(device->device, 1, &slot->fence, VK_TRUE, UINT64_MAX) : vkGetFenceStatus(device->device, slot->fence);
+		if (result != VK_SUCCESS)
+			return result;
+		slot->pending = false;
+		free_buffers(&slot->big_staging, device);
+	}
+	return VK_SUCCESS;
+}
+
+
+void free_image_upload(image_upload_t** upload, const device_t* device) {
+	if (!(*upload))
+		return;
+	free_staging_ring(&(*upload)->ring, device);
+	free(*upload);
+	(*upload) = NULL;
 }
 
 
@@ -1236,10 +1853,20 @@ void complete_descriptor_set_writes(VkWriteDescriptorSet* writes, uint32_t write
 }
 
 
-int create_descriptor_sets(descriptor_sets_t* descriptor_sets, const device_t* device, VkDescriptorSetLayoutBinding* bindings, uint32_t binding_count, uint32_t descriptor_set_count) {
+int create_descriptor_sets(descriptor_sets_t* descriptor_sets, const device_t* device, VkDescriptorSetLayoutBinding* bindings, uint32_t binding_count, const VkDescriptorBindingFlags* binding_flags, uint32_t descriptor_set_count) {
 	memset(descriptor_sets, 0, sizeof(*descriptor_sets));
+	bool update_after_bind = false;
+	for (uint32_t i = 0; binding_flags && i != binding_count; ++i)
+		update_after_bind |= (binding_flags[i] & VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT) != 0;
+	VkDescriptorSetLayoutBindingFlagsCreateInfo flags_info = {
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO,
+		.pBindingFlags = binding_flags,
+		.bindingCount = binding_count,
+	};
 	VkDescriptorSetLayoutCreateInfo set_layout_info = {
 		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+		.pNext = binding_flags ? &flags_info : NULL,
+		.flags = update_after_bind ? VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT : 0,
 		.pBindings = bindings,
 		.bindingCount = binding_count,
 	};
@@ -1265,6 +1892,7 @@ int create_descriptor_sets(descriptor_sets_t* descriptor_sets, const device_t* d
 	}
 	VkDescriptorPoolCreateInfo pool_info = {
 		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+		.flags = update_after_bind ? VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT : 0,
 		.maxSets = descriptor_set_count,
 		.pPoolSizes = pool_sizes,
 		.poolSizeCount = binding_count,
@@ -1,10 +1,21 @@
 #pragma once
 #define GLFW_INCLUDE_VULKAN
 #include <GLFW/glfw3.h>
+#include "threading.h"
 #include <stdint.h>
 #include <stdbool.h>
 
 
+//! The default for device_t::staging_size in bytes
+#define DEFAULT_STAGING_SIZE (64 << 20)
+
+
+//! fill_buffers() splits buffers into ranges whose offsets are multiples of
+//! this many bytes. It is divisible by sizes of common records such as 12-byte
+//! positions or 64-byte instances, so these never get split.
+#define FILL_BUFFER_GRANULARITY (3 * 256)
+
+
 //! Uses device_t* device to load the Vulkan function with the given name. The
 //! identifier for the function pointer is the name prefixed with p.
 #define VK_LOAD(FUNCTION_NAME) PFN_##FUNCTION_NAME p##FUNCTION_NAME = (PFN_##FUNCTION_NAME) glfwGetInstanceProcAddress(device->instance, #FUNCTION_NAME);
@@ -26,6 +37,9 @@ typedef struct {
 	VkPhysicalDeviceMemoryProperties memory_properties;
 	//! Properties for acceleration structures (also known as BVHs)
 	VkPhysicalDeviceAccelerationStructurePropertiesKHR bvh_properties;
+	//! Identifiers for the physical device and its driver. They are used to
+	//! tell whether cached acceleration structures may be compatible.
+	VkPhysicalDeviceIDProperties id_properties;
 	//! The Vulkan device created using physical_device
 	VkDevice device;
 	//! A queue that supports graphics and compute
@@ -37,6 +51,26 @@ typedef struct {
 	uint32_t queue_family_count, queue_family_index;
 	//! A command pool for the device and queue above
 	VkCommandPool cmd_pool;
+	//! A second queue from the same family as queue, which is used for work
+	//! submitted by worker threads. VK_NULL_HANDLE if the queue family only
+	//! offers a single queue.
+	VkQueue background_queue;
+	//! A queue from a family that supports transfers but neither graphics nor
+	//! compute. fill_buffers() and fill_images() copy through it, such that
+	//! copies overlap with rendering. VK_NULL_HANDLE if there is no such
+	//! family, e.g. on lavapipe.
+	VkQueue transfer_queue;
+	//! The index of the queue family of transfer_queue
+	uint32_t transfer_queue_family_index;
+	//! A command pool for transfer_queue
+	VkCommandPool transfer_cmd_pool;
+	//! Serializes submissions to transfer_queue, which is shared by the device
+	//! and all of its thread devices
+	mutex_t* transfer_queue_mutex;
+	//! The size in bytes of host-visible staging memory that fill_buffers()
+	//! and fill_images() use at once. Larger uploads are split into batches.
+	//! Defaults to DEFAULT_STAGING_SIZE and may be changed at any time.
+	VkDeviceSize staging_size;
 } device_t;
 
 
@@ -287,6 +321,21 @@ int create_device(device_t* device, const char* app_name, uint32_t physical_devi
 void free_device(device_t* device);
 
 
+/*! Prepares a copy of the given device for use on a worker thread. It refers
+	to the same Vulkan device, but uses device->background_queue and its own
+	command pools. It shares the transfer queue. Thus, functions that submit
+	work and wait for the queue to become idle can run on it concurrently
+	with rendering on the original device.
+	\param thread_device The output. Clean up with free_thread_device() (not
+		free_device()) before the original device gets freed.
+	\param device Output of create_device().
+	\return 0 upon success. Fails if there is no background queue.*/
+int create_thread_device(device_t* thread_device, const device_t* device);
+
+
+void free_thread_device(device_t* thread_device);
+
+
 /*! Creates a swapchain in the given window.
 	\param swapchain The output. Clean up with free_swapchain().
 	\param device Output of create_device().
@@ -363,6 +412,23 @@ void print_image_requests(const image_request_t* requests, uint32_t request_coun
 int create_images(images_t* images, const device_t* device, const image_request_t* requests, uint32_t request_count, VkMemoryPropertyFlags memory_properties);
 
 
+/*! Replaces the view of the given image by a new view that only covers the
+	given range of mipmap levels. Other parameters of the view remain as they
+	were in the original request.
+	\param image An image from the output of create_images(), which has a
+		view.
+	\param device Output of create_device().
+	\param base_mip_level The first mipmap level that is accessible through the
+		new view.
+	\param mip_level_count The number of accessible mipmap levels or 0 to use
+		all levels from base_mip_level onwards.
+	\param old_view NULL to destroy the old view right away, in which case it
+		must not be in use by the device anymore. Otherwise, it receives the
+		old view and the caller has to destroy it.
+	\return 0 upon success. Upon failure, the old view remains intact.*/
+int set_image_view_mip_levels(image_t* image, const device_t* device, uint32_t base_mip_level, uint32_t mip_level_count, VkImageView* old_view);
+
+
 void free_images(images_t* images, const device_t* device);
 
 
@@ -419,22 +485,25 @@ int copy_images(const device_t* device, const copy_image_to_image_t* requests, u
 
 
 /*! A callback type used for fill_buffers(). It has to fill a range of mapped
-	memory for a buffer with the data that is to go into that buffer.
+	memory with the data that is to go into a range of a buffer.
 	\param buffer_data The start of the mapped memory range into which the
-		buffer data should be written.
+		buffer data should be written. It is aligned to 16 bytes.
 	\param buffer_index The index of the buffer for which data is to be written
-		within its buffers_t object. Upon success, it is guaranteed that
-		fill_buffers() invokes this callback exactly once with each valid value
-		of buffer_index in increasing order.
-	\param buffer_size The number of bytes that should be written to
-		buffer_data.
-	\param context Passed through by fill_buffers().*/
-typedef void (*write_buffer_t)(void* buffer_data, uint32_t buffer_index, VkDeviceSize buffer_size, const void* context);
-
-
-/*! Creates a host-local staging buffer for each of the given buffers, maps it
-	and lets a callback fill it with arbitrary data. Then these staging buffers
-	are copied to the given buffers and destroyed.
+		within its buffers_t object.
+	\param offset The offset in bytes of the range within the buffer. It is a
+		multiple of FILL_BUFFER_GRANULARITY.
+	\param size The number of bytes that should be written to buffer_data.
+	\param context Passed through by fill_buffers().
+	\note Upon success, it is guaranteed that fill_buffers() covers each
+		buffer completely with non-overlapping ranges. Ranges are written in
+		increasing order of buffer_index and offset.*/
+typedef void (*write_buffer_t)(void* buffer_data, uint32_t buffer_index, VkDeviceSize offset, VkDeviceSize size, const void* context);
+
+
+/*! Lets a callback write data for the given buffers into host-visible staging
+	memory and copies it to the buffers. At most device->staging_size bytes of
+	staging memory are used. Larger buffers are split into ranges. While the
+	device copies one batch of ranges, the callback writes the next one.
 	\param buffers Output of create_buffers(). The data stored by these buffers
 		will be overwritten.
 	\param device Output of create_device().
@@ -463,14 +532,20 @@ int fill_buffers(const buffers_t* buffers, const device_t* device, write_buffer_
 	\param subresource_extent The resolution of the subresource being written.
 	\param context Passed through by fill_images().
 	\note fill_images will use each valid tuple (image_index,
-		subresource.mipLevel, subresource.arrayLayer) exactly once and in
-		lexicographic order.*/
+		subresource.mipLevel, subresource.arrayLayer) exactly once. All
+		subresources of one image are written in lexicographic order and never
+		concurrently, but different images may be written concurrently on
+		multiple threads. Thus, the callback must be thread safe.*/
 typedef void (*write_image_subresource_t)(void* image_data, uint32_t image_index, const VkImageSubresource* subresource, VkDeviceSize buffer_size, const VkImageCreateInfo* image_info, const VkExtent3D* subresource_extent, const void* context);
 
 
-/*! Creates a host-local staging buffer for each subresource of the given
-	images, maps it and lets a callback fill it with image data. Then these
-	staging buffers are copied to the given images and destroyed.
+/*! Lets a callback write data for each subresource of the given images into
+	host-visible staging memory and copies it to the images. At most
+	device->staging_size bytes of staging memory are used, except for
+	subresources that are bigger than a batch (half of that). Each of these
+	gets a temporary staging buffer and forms a batch by itself. While the
+	device copies one batch of subresources, the callback writes the next
+	one.
 	\param images Output of create_images(). The contents of these images will
 		be overwritten. All of these images must have aspect color and any
 		other aspects will be silently ignored.
@@ -488,6 +563,83 @@ typedef void (*write_image_subresource_t)(void* image_data, uint32_t image_index
 		undefined.*/
 int fill_images(const images_t* images, const device_t* device, write_image_subresource_t write_subresource, VkImageLayout old_layout, VkImageLayout new_layout, const void* context);
 
+/*! Like fill_images() but only fills a range of mipmap levels for each
+	image. Levels outside this range remain untouched and keep their layouts.
+	\param base_levels For each image, the index of the first mipmap level to
+		fill. NULL means zero for all images.
+	\param level_counts For each image, the number of mipmap levels to fill.
+		Images with a count of zero are skipped. NULL means that all levels
+		from the base level onwards are filled.
+	\see fill_images() for all other parameters.*/
+int fill_image_levels(const images_t* images, const device_t* device, const uint32_t* base_levels, const uint32_t* level_counts, write_image_subresource_t write_subresource, VkImageLayout old_layout, VkImageLayout new_layout, const void* context);
+
+
+//! A single subresource that is written to staging memory by
+//! fill_image_levels() or fill_image_levels_batched()
+typedef struct {
+	//! The index of the image in images_t
+	uint32_t image_index;
+	//! The mipmap level and array layer
+	VkImageSubresource subresource;
+	//! The extent of the mipmap
+	VkExtent3D extent;
+	//! The size in bytes of the staged data
+	VkDeviceSize size;
+	//! The offset in bytes of the staged data in the current staging buffer
+	VkDeviceSize staging_offset;
+} staged_subresource_t;
+
+
+/*! A callback type used for fill_image_levels_batched(). It has to write the
+	data of all given subresources to staging memory at once, which allows it
+	to issue all underlying file reads as one batch.
+	\param staged_data The start of the mapped staging buffer.
+	\param subresources The subresources to write. The data of each one
+		belongs at staged_data + staging_offset and the staging memory up to
+		the next multiple of the staging alignment is reserved for it.
+	\param subresource_count The number of subresources.
+	\param context Passed through by fill_image_levels_batched().
+	\return 0 upon success.*/
+typedef int (*write_image_batch_t)(uint8_t* staged_data, const staged_subresource_t* subresources, uint32_t subresource_count, const void* context);
+
+
+/*! Like fill_image_levels() but the callback writes all subresources of a
+	batch at once and staged data is aligned more strictly.
+	\param write_batch See write_image_batch_t.
+	\param staging_alignment A power of two. The staged data of each
+		subresource starts at a multiple of it (relative to mapped memory that
+		is aligned at least as strictly) and the size that is reserved for it
+		is rounded up to a multiple of it. Values below 16 are raised to 16.
+	\see fill_image_levels() for all other parameters.*/
+int fill_image_levels_batched(const images_t* images, const device_t* device, const uint32_t* base_levels, const uint32_t* level_counts, write_image_batch_t write_batch, VkDeviceSize staging_alignment, VkImageLayout old_layout, VkImageLayout new_layout, const void* context);
+
+
+//! Copies submitted by fill_image_levels_batched_async(), which may still be
+//! running on the device
+typedef struct image_upload_s image_upload_t;
+
+
+/*! Like fill_image_levels_batched() but it does not wait for the last copies
+	to finish. Subresources that are bigger than a batch are still copied
+	synchronously.
+	\param upload Receives the pending copies. Use poll_image_upload() to find
+		out when they are done and free it with free_image_upload().
+	\see fill_image_levels_batched() for all other parameters.
+	\return 0 upon success. Upon failure, *upload is NULL.*/
+int fill_image_levels_batched_async(image_upload_t** upload, const images_t* images, const device_t* device, const uint32_t* base_levels, const uint32_t* level_counts, write_image_batch_t write_batch, VkDeviceSize staging_alignment, VkImageLayout old_layout, VkImageLayout new_layout, const void* context);
+
+
+/*! Checks whether the copies of the given upload have finished.
+	\param wait true to wait for them, false to return right away.
+	\return VK_SUCCESS once all copies have finished, VK_NOT_READY while some
+		are pending (never if wait is true) or an error code.*/
+VkResult poll_image_upload(image_upload_t* upload, const device_t* device, bool wait);
+
+
+//! Waits for the copies of the given upload (which may be NULL) to finish,
+//! frees it and sets it to NULL
+void free_image_upload(image_upload_t** upload, const device_t* device);
+
 
 //! \return The name of the given shader stage as expected by glslangValidator
 //!		or an empty string if stage is not a single stage bit.
@@ -537,10 +689,14 @@ void complete_descriptor_set_writes(VkWriteDescriptorSet* writes, uint32_t write
 	\param bindings Specifications of the bindings. You may want to use
 		complete_descriptor_set_layout_bindings() to populate this array.
 	\param binding_count The number of array entries in bindings.
+	\param binding_flags NULL or one entry per binding with flags such as
+		VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT. If any binding uses
+		VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT, the layout and pool are
+		created accordingly.
 	\param descriptor_set_count The number of descriptor sets with identical
 		layout which should be created.
 	\return 0 upon success.*/
-int create_descriptor_sets(descriptor_sets_t* descriptor_sets, const device_t* device, VkDescriptorSetLayoutBinding* bindings, uint32_t binding_count, uint32_t descriptor_set_count);
+int create_descriptor_sets(descriptor_sets_t* descriptor_sets, const device_t* device, VkDescriptorSetLayoutBinding* bindings, uint32_t binding_count, const VkDescriptorBindingFlags* binding_flags, uint32_t descriptor_set_count);
 
 
 void free_descriptor_sets(descriptor_sets_t* descriptor_sets, const device_t* device);
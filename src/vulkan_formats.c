@@ -2,7 +2,7 @@
 
 
 format_description_t get_format_description(VkFormat format) {
-	format_description_t desc = { .packed_bits = 0 };
+	format_description_t desc = { .packed_bits = 0, .block_extent = { 1, 1, 1 } };
 	switch (format) {
 		case VK_FORMAT_R4G4_UNORM_PACK8:
 			desc.cls = FORMAT_CLASS_8_BIT;
@@ -699,281 +699,337 @@ format_description_t get_format_description(VkFormat format) {
 			desc.cls = FORMAT_CLASS_BC1_RGB;
 			desc.block_size = 8;
 			desc.texels_per_block = 16;
+			desc.block_extent = (VkExtent3D) { 4, 4, 1 };
 			break;
 		case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
 			desc.cls = FORMAT_CLASS_BC1_RGB;
 			desc.block_size = 8;
 			desc.texels_per_block = 16;
+			desc.block_extent = (VkExtent3D) { 4, 4, 1 };
 			break;
 		case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
 			desc.cls = FORMAT_CLASS_BC1_RGBA;
 			desc.block_size = 8;
 			desc.texels_per_block = 16;
+			desc.block_extent = (VkExtent3D) { 4, 4, 1 };
 			break;
 		case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
 			desc.cls = FORMAT_CLASS_BC1_RGBA;
 			desc.block_size = 8;
 			desc.texels_per_block = 16;
+			desc.block_extent = (VkExtent3D) { 4, 4, 1 };
 			break;
 		case VK_FORMAT_BC2_UNORM_BLOCK:
 			desc.cls = FORMAT_CLASS_BC2;
 			desc.block_size = 16;
 			desc.texels_per_block = 16;
+			desc.block_extent = (VkExtent3D) { 4, 4, 1 };
 			break;
 		case VK_FORMAT_BC2_SRGB_BLOCK:
 			desc.cls = FORMAT_CLASS_BC2;
 			desc.block_size = 16;
 			desc.texels_per_block = 16;
+			desc.block_extent = (VkExtent3D) { 4, 4, 1 };
 			break;
 		case VK_FORMAT_BC3_UNORM_BLOCK:
 			desc.cls = FORMAT_CLASS_BC3;
 			desc.block_size = 16;
 			desc.texels_per_block = 16;
+			desc.block_extent = (VkExtent3D) { 4, 4, 1 };
 			break;
 		case VK_FORMAT_BC3_SRGB_BLOCK:
 			desc.cls = FORMAT_CLASS_BC3;
 			desc.block_size = 16;
 			desc.texels_per_block = 16;
+			desc.block_extent = (VkExtent3D) { 4, 4, 1 };
 			break;
 		case VK_FORMAT_BC4_UNORM_BLOCK:
 			desc.cls = FORMAT_CLASS_BC4;
 			desc.block_size = 8;
 			desc.texels_per_block = 16;
+			desc.block_extent = (VkExtent3D) { 4, 4, 1 };
 			break;
 		case VK_FORMAT_BC4_SNORM_BLOCK:
 			desc.cls = FORMAT_CLASS_BC4;
 			desc.block_size = 8;
 			desc.texels_per_block = 16;
+			desc.block_extent = (VkExtent3D) { 4, 4, 1 };
 			break;
 		case VK_FORMAT_BC5_UNORM_BLOCK:
 			desc.cls = FORMAT_CLASS_BC5;
 			desc.block_size = 16;
 			desc.texels_per_block = 16;
+			desc.block_extent = (VkExtent3D) { 4, 4, 1 };
 			break;
 		case VK_FORMAT_BC5_SNORM_BLOCK:
 			desc.cls = FORMAT_CLASS_BC5;
 			desc.block_size = 16;
 			desc.texels_per_block = 16;
+			desc.block_extent = (VkExtent3D) { 4, 4, 1 };
 			break;
 		case VK_FORMAT_BC6H_UFLOAT_BLOCK:
 			desc.cls = FORMAT_CLASS_BC6H;
 			desc.block_size = 16;
 			desc.texels_per_block = 16;
+			desc.block_extent = (VkExtent3D) { 4, 4, 1 };
 			break;
 		case VK_FORMAT_BC6H_SFLOAT_BLOCK:
 			desc.cls = FORMAT_CLASS_BC6H;
 			desc.block_size = 16;
 			desc.texels_per_block = 16;
+			desc.block_extent = (VkExtent3D) { 4, 4, 1 };
 			break;
 		case VK_FORMAT_BC7_UNORM_BLOCK:
 			desc.cls = FORMAT_CLASS_BC7;
 			desc.block_size = 16;
 			desc.texels_per_block = 16;
+			desc.block_extent = (VkExtent3D) { 4, 4, 1 };
 			break;
 		case VK_FORMAT_BC7_SRGB_BLOCK:
 			desc.cls = FORMAT_CLASS_BC7;
 			desc.block_size = 16;
 			desc.texels_per_block = 16;
+			desc.block_extent = (VkExtent3D) { 4, 4, 1 };
 			break;
 		case VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK:
 			desc.cls = FORMAT_CLASS_ETC2_RGB;
 			desc.block_size = 8;
 			desc.texels_per_block = 16;
+			desc.block_extent = (VkExtent3D) { 4, 4, 1 };
 			break;
 		case VK_FORMAT_ETC2_R8G8B8_SRGB_BLOCK:
 			desc.cls = FORMAT_CLASS_ETC2_RGB;
 			desc.block_size = 8;
 			desc.texels_per_block = 16;
+			desc.block_extent = (VkExtent3D) { 4, 4, 1 };
 			break;
 		case VK_FORMAT_ETC2_R8G8B8A1_UNORM_BLOCK:
 			desc.cls = FORMAT_CLASS_ETC2_RGBA;
 			desc.block_size = 8;
 			desc.texels_per_block = 16;
+			desc.block_extent = (VkExtent3D) { 4, 4, 1 };
 			break;
 		case VK_FORMAT_ETC2_R8G8B8A1_SRGB_BLOCK:
 			desc.cls = FORMAT_CLASS_ETC2_RGBA;
 			desc.block_size = 8;
 			desc.texels_per_block = 16;
+			desc.block_extent = (VkExtent3D) { 4, 4, 1 };
 			break;
 		case VK_FORMAT_ETC2_R8G8B8A8_UNORM_BLOCK:
 			desc.cls = FORMAT_CLASS_ETC2_EAC_RGBA;
 			desc.block_size = 16;
 			desc.texels_per_block = 16;
+			desc.block_extent = (VkExtent3D) { 4, 4, 1 };
 			break;
 		case VK_FORMAT_ETC2_R8G8B8A8_SRGB_BLOCK:
 			desc.cls = FORMAT_CLASS_ETC2_EAC_RGBA;
 			desc.block_size = 16;
 			desc.texels_per_block = 16;
+			desc.block_extent = (VkExtent3D) { 4, 4, 1 };
 			break;
 		case VK_FORMAT_EAC_R11_UNORM_BLOCK:
 			desc.cls = FORMAT_CLASS_EAC_R;
 			desc.block_size = 8;
 			desc.texels_per_block = 16;
+			desc.block_extent = (VkExtent3D) { 4, 4, 1 };
 			break;
 		case VK_FORMAT_EAC_R11_SNORM_BLOCK:
 			desc.cls = FORMAT_CLASS_EAC_R;
 			desc.block_size = 8;
 			desc.texels_per_block = 16;
+			desc.block_extent = (VkExtent3D) { 4, 4, 1 };
 			break;
 		case VK_FORMAT_EAC_R11G11_UNORM_BLOCK:
 			desc.cls = FORMAT_CLASS_EAC_RG;
 			desc.block_size = 16;
 			desc.texels_per_block = 16;
+			desc.block_extent = (VkExtent3D) { 4, 4, 1 };
 			break;
 		case VK_FORMAT_EAC_R11G11_SNORM_BLOCK:
 			desc.cls = FORMAT_CLASS_EAC_RG;
 			desc.block_size = 16;
 			desc.texels_per_block = 16;
+			desc.block_extent = (VkExtent3D) { 4, 4, 1 };
 			break;
 		case VK_FORMAT_ASTC_4x4_UNORM_BLOCK:
 			desc.cls = FORMAT_CLASS_ASTC_4X4;
 			desc.block_size = 16;
 			desc.texels_per_block = 16;
+			desc.block_extent = (VkExtent3D) { 4, 4, 1 };
 			break;
 		case VK_FORMAT_ASTC_4x4_SRGB_BLOCK:
 			desc.cls = FORMAT_CLASS_ASTC_4X4;
 			desc.block_size = 16;
 			desc.texels_per_block = 16;
+			desc.block_extent = (VkExtent3D) { 4, 4, 1 };
 			break;
 		case VK_FORMAT_ASTC_5x4_UNORM_BLOCK:
 			desc.cls = FORMAT_CLASS_ASTC_5X4;
 			desc.block_size = 16;
 			desc.texels_per_block = 20;
+			desc.block_extent = (VkExtent3D) { 5, 4, 1 };
 			break;
 		case VK_FORMAT_ASTC_5x4_SRGB_BLOCK:
 			desc.cls = FORMAT_CLASS_ASTC_5X4;
 			desc.block_size = 16;
 			desc.texels_per_block = 20;
+			desc.block_extent = (VkExtent3D) { 5, 4, 1 };
 			break;
 		case VK_FORMAT_ASTC_5x5_UNORM_BLOCK:
 			desc.cls = FORMAT_CLASS_ASTC_5X5;
 			desc.block_size = 16;
 			desc.texels_per_block = 25;
+			desc.block_extent = (VkExtent3D) { 5, 5, 1 };
 			break;
 		case VK_FORMAT_ASTC_5x5_SRGB_BLOCK:
 			desc.cls = FORMAT_CLASS_ASTC_5X5;
 			desc.block_size = 16;
 			desc.texels_per_block = 25;
+			desc.block_extent = (VkExtent3D) { 5, 5, 1 };
 			break;
 		case VK_FORMAT_ASTC_6x5_UNORM_BLOCK:
 			desc.cls = FORMAT_CLASS_ASTC_6X5;
 			desc.block_size = 16;
 			desc.texels_per_block = 30;
+			desc.block_extent = (VkExtent3D) { 6, 5, 1 };
 			break;
 		case VK_FORMAT_ASTC_6x5_SRGB_BLOCK:
 			desc.cls = FORMAT_CLASS_ASTC_6X5;
 			desc.block_size = 16;
 			desc.texels_per_block = 30;
+			desc.block_extent = (VkExtent3D) { 6, 5, 1 };
 			break;
 		case VK_FORMAT_ASTC_6x6_UNORM_BLOCK:
 			desc.cls = FORMAT_CLASS_ASTC_6X6;
 			desc.block_size = 16;
 			desc.texels_per_block = 36;
+			desc.block_extent = (VkExtent3D) { 6, 6, 1 };
 			break;
 		case VK_FORMAT_ASTC_6x6_SRGB_BLOCK:
 			desc.cls = FORMAT_CLASS_ASTC_6X6;
 			desc.block_size = 16;
 			desc.texels_per_block = 36;
+			desc.block_extent = (VkExtent3D) { 6, 6, 1 };
 			break;
 		case VK_FORMAT_ASTC_8x5_UNORM_BLOCK:
 			desc.cls = FORMAT_CLASS_ASTC_8X5;
 			desc.block_size = 16;
 			desc.texels_per_block = 40;
+			desc.block_extent = (VkExtent3D) { 8, 5, 1 };
 			break;
 		case VK_FORMAT_ASTC_8x5_SRGB_BLOCK:
 			desc.cls = FORMAT_CLASS_ASTC_8X5;
 			desc.block_size = 16;
 			desc.texels_per_block = 40;
+			desc.block_extent = (VkExtent3D) { 8, 5, 1 };
 			break;
 		case VK_FORMAT_ASTC_8x6_UNORM_BLOCK:
 			desc.cls = FORMAT_CLASS_ASTC_8X6;
 			desc.block_size = 16;
 			desc.texels_per_block = 48;
+			desc.block_extent = (VkExtent3D) { 8, 6, 1 };
 			break;
 		case VK_FORMAT_ASTC_8x6_SRGB_BLOCK:
 			desc.cls = FORMAT_CLASS_ASTC_8X6;
 			desc.block_size = 16;
 			desc.texels_per_block = 48;
+			desc.block_extent = (VkExtent3D) { 8, 6, 1 };
 			break;
 		case VK_FORMAT_ASTC_8x8_UNORM_BLOCK:
 			desc.cls = FORMAT_CLASS_ASTC_8X8;
 			desc.block_size = 16;
 			desc.texels_per_block = 64;
+			desc.block_extent = (VkExtent3D) { 8, 8, 1 };
 			break;
 		case VK_FORMAT_ASTC_8x8_SRGB_BLOCK:
 			desc.cls = FORMAT_CLASS_ASTC_8X8;
 			desc.block_size = 16;
 			desc.texels_per_block = 64;
+			desc.block_extent = (VkExtent3D) { 8, 8, 1 };
 			break;
 		case VK_FORMAT_ASTC_10x5_UNORM_BLOCK:
 			desc.cls = FORMAT_CLASS_ASTC_10X5;
 			desc.block_size = 16;
 			desc.texels_per_block = 50;
+			desc.block_extent = (VkExtent3D) { 10, 5, 1 };
 			break;
 		case VK_FORMAT_ASTC_10x5_SRGB_BLOCK:
 			desc.cls = FORMAT_CLASS_ASTC_10X5;
 			desc.block_size = 16;
 			desc.texels_per_block = 50;
+			desc.block_extent = (VkExtent3D) { 10, 5, 1 };
 			break;
 		case VK_FORMAT_ASTC_10x6_UNORM_BLOCK:
 			desc.cls = FORMAT_CLASS_ASTC_10X6;
 			desc.block_size = 16;
 			desc.texels_per_block = 60;
+			desc.block_extent = (VkExtent3D) { 10, 6, 1 };
 			break;
 		case VK_FORMAT_ASTC_10x6_SRGB_BLOCK:
 			desc.cls = FORMAT_CLASS_ASTC_10X6;
 			desc.block_size = 16;
 			desc.texels_per_block = 60;
+			desc.block_extent = (VkExtent3D) { 10, 6, 1 };
 			break;
 		case VK_FORMAT_ASTC_10x8_UNORM_BLOCK:
 			desc.cls = FORMAT_CLASS_ASTC_10X8;
 			desc.block_size = 16;
 			desc.texels_per_block = 80;
+			desc.block_extent = (VkExtent3D) { 10, 8, 1 };
 			break;
 		case VK_FORMAT_ASTC_10x8_SRGB_BLOCK:
 			desc.cls = FORMAT_CLASS_ASTC_10X8;
 			desc.block_size = 16;
 			desc.texels_per_block = 80;
+			desc.block_extent = (VkExtent3D) { 10, 8, 1 };
 			break;
 		case VK_FORMAT_ASTC_10x10_UNORM_BLOCK:
 			desc.cls = FORMAT_CLASS_ASTC_10X10;
 			desc.block_size = 16;
 			desc.texels_per_block = 100;
+			desc.block_extent = (VkExtent3D) { 10, 10, 1 };
 			break;
 		case VK_FORMAT_ASTC_10x10_SRGB_BLOCK:
 			desc.cls = FORMAT_CLASS_ASTC_10X10;
 			desc.block_size = 16;
 			desc.texels_per_block = 100;
+			desc.block_extent = (VkExtent3D) { 10, 10, 1 };
 			break;
 		case VK_FORMAT_ASTC_12x10_UNORM_BLOCK:
 			desc.cls = FORMAT_CLASS_ASTC_12X10;
 			desc.block_size = 16;
 			desc.texels_per_block = 120;
+			desc.block_extent = (VkExtent3D) { 12, 10, 1 };
 			break;
 		case VK_FORMAT_ASTC_12x10_SRGB_BLOCK:
 			desc.cls = FORMAT_CLASS_ASTC_12X10;
 			desc.block_size = 16;
 			desc.texels_per_block = 120;
+			desc.block_extent = (VkExtent3D) { 12, 10, 1 };
 			break;
 		case VK_FORMAT_ASTC_12x12_UNORM_BLOCK:
 			desc.cls = FORMAT_CLASS_ASTC_12X12;
 			desc.block_size = 16;
 			desc.texels_per_block = 144;
+			desc.block_extent = (VkExtent3D) { 12, 12, 1 };
 			break;
 		case VK_FORMAT_ASTC_12x12_SRGB_BLOCK:
 			desc.cls = FORMAT_CLASS_ASTC_12X12;
 			desc.block_size = 16;
 			desc.texels_per_block = 144;
+			desc.block_extent = (VkExtent3D) { 12, 12, 1 };
 			break;
 		case VK_FORMAT_G8B8G8R8_422_UNORM:
 			desc.cls = FORMAT_CLASS_32_BIT_G8B8G8R8;
 			desc.block_size = 4;
 			desc.texels_per_block = 1;
+			desc.block_extent = (VkExtent3D) { 2, 1, 1 };
 			break;
 		case VK_FORMAT_B8G8R8G8_422_UNORM:
 			desc.cls = FORMAT_CLASS_32_BIT_B8G8R8G8;
 			desc.block_size = 4;
 			desc.texels_per_block = 1;
+			desc.block_extent = (VkExtent3D) { 2, 1, 1 };
 			break;
 		case VK_FORMAT_G8_B8_R8_3PLANE_420_UNORM:
 			desc.cls = FORMAT_CLASS_8_BIT_3_PLANE_420;
@@ -1022,12 +1078,14 @@ format_description_t get_format_description(VkFormat format) {
 			desc.cls = FORMAT_CLASS_64_BIT_G10B10G10R10;
 			desc.block_size = 8;
 			desc.texels_per_block = 1;
+			desc.block_extent = (VkExtent3D) { 2, 1, 1 };
 			desc.packed_bits = 16;
 			break;
 		case VK_FORMAT_B10X6G10X6R10X6G10X6_422_UNORM_4PACK16:
 			desc.cls = FORMAT_CLASS_64_BIT_B10G10R10G10;
 			desc.block_size = 8;
 			desc.texels_per_block = 1;
+			desc.block_extent = (VkExtent3D) { 2, 1, 1 };
 			desc.packed_bits = 16;
 			break;
 		case VK_FORMAT_G10X6_B10X6_R10X6_3PLANE_420_UNORM_3PACK16:
@@ -1082,12 +1140,14 @@ format_description_t get_format_description(VkFormat format) {
 			desc.cls = FORMAT_CLASS_64_BIT_G12B12G12R12;
 			desc.block_size = 8;
 			desc.texels_per_block = 1;
+			desc.block_extent = (VkExtent3D) { 2, 1, 1 };
 			desc.packed_bits = 16;
 			break;
 		case VK_FORMAT_B12X4G12X4R12X4G12X4_422_UNORM_4PACK16:
 			desc.cls = FORMAT_CLASS_64_BIT_B12G12R12G12;
 			desc.block_size = 8;
 			desc.texels_per_block = 1;
+			desc.block_extent = (VkExtent3D) { 2, 1, 1 };
 			desc.packed_bits = 16;
 			break;
 		case VK_FORMAT_G12X4_B12X4_R12X4_3PLANE_420_UNORM_3PACK16:
@@ -1124,11 +1184,13 @@ format_description_t get_format_description(VkFormat format) {
 			desc.cls = FORMAT_CLASS_64_BIT_G16B16G16R16;
 			desc.block_size = 8;
 			desc.texels_per_block = 1;
+			desc.block_extent = (VkExtent3D) { 2, 1, 1 };
 			break;
 		case VK_FORMAT_B16G16R16G16_422_UNORM:
 			desc.cls = FORMAT_CLASS_64_BIT_B16G16R16G16;
 			desc.block_size = 8;
 			desc.texels_per_block = 1;
+			desc.block_extent = (VkExtent3D) { 2, 1, 1 };
 			break;
 		case VK_FORMAT_G16_B16_R16_3PLANE_420_UNORM:
 			desc.cls = FORMAT_CLASS_16_BIT_3_PLANE_420;
@@ -1159,111 +1221,133 @@ format_description_t get_format_description(VkFormat format) {
 			desc.cls = FORMAT_CLASS_PVRTC1_2BPP;
 			desc.block_size = 8;
 			desc.texels_per_block = 1;
+			desc.block_extent = (VkExtent3D) { 8, 4, 1 };
 			break;
 		case VK_FORMAT_PVRTC1_4BPP_UNORM_BLOCK_IMG:
 			desc.cls = FORMAT_CLASS_PVRTC1_4BPP;
 			desc.block_size = 8;
 			desc.texels_per_block = 1;
+			desc.block_extent = (VkExtent3D) { 4, 4, 1 };
 			break;
 		case VK_FORMAT_PVRTC2_2BPP_UNORM_BLOCK_IMG:
 			desc.cls = FORMAT_CLASS_PVRTC2_2BPP;
 			desc.block_size = 8;
 			desc.texels_per_block = 1;
+			desc.block_extent = (VkExtent3D) { 8, 4, 1 };
 			break;
 		case VK_FORMAT_PVRTC2_4BPP_UNORM_BLOCK_IMG:
 			desc.cls = FORMAT_CLASS_PVRTC2_4BPP;
 			desc.block_size = 8;
 			desc.texels_per_block = 1;
+			desc.block_extent = (VkExtent3D) { 4, 4, 1 };
 			break;
 		case VK_FORMAT_PVRTC1_2BPP_SRGB_BLOCK_IMG:
 			desc.cls = FORMAT_CLASS_PVRTC1_2BPP;
 			desc.block_size = 8;
 			desc.texels_per_block = 1;
+			desc.block_extent = (VkExtent3D) { 8, 4, 1 };
 			break;
 		case VK_FORMAT_PVRTC1_4BPP_SRGB_BLOCK_IMG:
 			desc.cls = FORMAT_CLASS_PVRTC1_4BPP;
 			desc.block_size = 8;
 			desc.texels_per_block = 1;
+			desc.block_extent = (VkExtent3D) { 4, 4, 1 };
 			break;
 		case VK_FORMAT_PVRTC2_2BPP_SRGB_BLOCK_IMG:
 			desc.cls = FORMAT_CLASS_PVRTC2_2BPP;
 			desc.block_size = 8;
 			desc.texels_per_block = 1;
+			desc.block_extent = (VkExtent3D) { 8, 4, 1 };
 			break;
 		case VK_FORMAT_PVRTC2_4BPP_SRGB_BLOCK_IMG:
 			desc.cls = FORMAT_CLASS_PVRTC2_4BPP;
 			desc.block_size = 8;
 			desc.texels_per_block = 1;
+			desc.block_extent = (VkExtent3D) { 4, 4, 1 };
 			break;
 		case VK_FORMAT_ASTC_4x4_SFLOAT_BLOCK:
 			desc.cls = FORMAT_CLASS_ASTC_4X4;
 			desc.block_size = 16;
 			desc.texels_per_block = 16;
+			desc.block_extent = (VkExtent3D) { 4, 4, 1 };
 			break;
 		case VK_FORMAT_ASTC_5x4_SFLOAT_BLOCK:
 			desc.cls = FORMAT_CLASS_ASTC_5X4;
 			desc.block_size = 16;
 			desc.texels_per_block = 20;
+			desc.block_extent = (VkExtent3D) { 5, 4, 1 };
 			break;
 		case VK_FORMAT_ASTC_5x5_SFLOAT_BLOCK:
 			desc.cls = FORMAT_CLASS_ASTC_5X5;
 			desc.block_size = 16;
 			desc.texels_per_block = 25;
+			desc.block_extent = (VkExtent3D) { 5, 5, 1 };
 			break;
 		case VK_FORMAT_ASTC_6x5_SFLOAT_BLOCK:
 			desc.cls = FORMAT_CLASS_ASTC_6X5;
 			desc.block_size = 16;
 			desc.texels_per_block = 30;
+			desc.block_extent = (VkExtent3D) { 6, 5, 1 };
 			break;
 		case VK_FORMAT_ASTC_6x6_SFLOAT_BLOCK:
 			desc.cls = FORMAT_CLASS_ASTC_6X6;
 			desc.block_size = 16;
 			desc.texels_per_block = 36;
+			desc.block_extent = (VkExtent3D) { 6, 6, 1 };
 			break;
 		case VK_FORMAT_ASTC_8x5_SFLOAT_BLOCK:
 			desc.cls = FORMAT_CLASS_ASTC_8X5;
 			desc.block_size = 16;
 			desc.texels_per_block = 40;
+			desc.block_extent = (VkExtent3D) { 8, 5, 1 };
 			break;
 		case VK_FORMAT_ASTC_8x6_SFLOAT_BLOCK:
 			desc.cls = FORMAT_CLASS_ASTC_8X6;
 			desc.block_size = 16;
 			desc.texels_per_block = 48;
+			desc.block_extent = (VkExtent3D) { 8, 6, 1 };
 			break;
 		case VK_FORMAT_ASTC_8x8_SFLOAT_BLOCK:
 			desc.cls = FORMAT_CLASS_ASTC_8X8;
 			desc.block_size = 16;
 			desc.texels_per_block = 64;
+			desc.block_extent = (VkExtent3D) { 8, 8, 1 };
 			break;
 		case VK_FORMAT_ASTC_10x5_SFLOAT_BLOCK:
 			desc.cls = FORMAT_CLASS_ASTC_10X5;
 			desc.block_size = 16;
 			desc.texels_per_block = 50;
+			desc.block_extent = (VkExtent3D) { 10, 5, 1 };
 			break;
 		case VK_FORMAT_ASTC_10x6_SFLOAT_BLOCK:
 			desc.cls = FORMAT_CLASS_ASTC_10X6;
 			desc.block_size = 16;
 			desc.texels_per_block = 60;
+			desc.block_extent = (VkExtent3D) { 10, 6, 1 };
 			break;
 		case VK_FORMAT_ASTC_10x8_SFLOAT_BLOCK:
 			desc.cls = FORMAT_CLASS_ASTC_10X8;
 			desc.block_size = 16;
 			desc.texels_per_block = 80;
+			desc.block_extent = (VkExtent3D) { 10, 8, 1 };
 			break;
 		case VK_FORMAT_ASTC_10x10_SFLOAT_BLOCK:
 			desc.cls = FORMAT_CLASS_ASTC_10X10;
 			desc.block_size = 16;
 			desc.texels_per_block = 100;
+			desc.block_extent = (VkExtent3D) { 10, 10, 1 };
 			break;
 		case VK_FORMAT_ASTC_12x10_SFLOAT_BLOCK:
 			desc.cls = FORMAT_CLASS_ASTC_12X10;
 			desc.block_size = 16;
 			desc.texels_per_block = 120;
+			desc.block_extent = (VkExtent3D) { 12, 10, 1 };
 			break;
 		case VK_FORMAT_ASTC_12x12_SFLOAT_BLOCK:
 			desc.cls = FORMAT_CLASS_ASTC_12X12;
 			desc.block_size = 16;
 			desc.texels_per_block = 144;
+			desc.block_extent = (VkExtent3D) { 12, 12, 1 };
 			break;
 		case VK_FORMAT_G8_B8R8_2PLANE_444_UNORM:
 			desc.cls = FORMAT_CLASS_8_BIT_2_PLANE_444;
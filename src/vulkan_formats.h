@@ -103,6 +103,8 @@ typedef struct {
 	VkDeviceSize block_size;
 	//! The number of texels per texel block
 	uint32_t texels_per_block;
+	//! The extent of a texel block in texels, e.g. 4x4x1 for BC formats
+	VkExtent3D block_extent;
 	//! For packed formats such as VK_FORMAT_R5G6B5_UNORM_PACK16, this is the
 	//! number of bits into which a color is being packed. 0 otherwise.
 	uint32_t packed_bits;
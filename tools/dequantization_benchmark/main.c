@@ -0,0 +1,87 @@
+#include "mesh_quantization.h"
+#include "threading.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+
+//! The benchmark uses as many vertices as a scene with 10M triangles and
+//! three vertices per triangle (*.vks version 1)
+#define BENCHMARK_VERTEX_COUNT (3 * 10000000)
+
+
+//! Each measurement is repeated this often and the fastest run counts
+#define BENCHMARK_REPETITION_COUNT 5
+
+
+//! \return A monotonic time in seconds
+double get_time() {
+#ifdef _WIN32
+	LARGE_INTEGER counter, frequency;
+	QueryPerformanceCounter(&counter);
+	QueryPerformanceFrequency(&frequency);
+	return (double) counter.QuadPart / (double) frequency.QuadPart;
+#else
+	struct timespec time;
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return (double) time.tv_sec + 1.0e-9 * (double) time.tv_nsec;
+#endif
+}
+
+
+int main(int argc, char** argv) {
+	uint64_t vertex_count = BENCHMARK_VERTEX_COUNT;
+	if (argc >= 2)
+		sscanf(argv[1], "%llu", (unsigned long long*) &vertex_count);
+	// Generate synthetic quantized positions with all 21 bits in use
+	uint32_t* quantized_positions = malloc(2 * vertex_count * sizeof(uint32_t));
+	uint32_t state = 0x12345678;
+	for (uint64_t i = 0; i != 2 * vertex_count; ++i) {
+		state ^= state << 13;
+		state ^= state >> 17;
+		state ^= state << 5;
+		quantized_positions[i] = state & 0x7fffffff;
+	}
+	const float factor[3] = { 1.0f / 2097152.0f, 2.0f / 2097152.0f, 0.5f / 2097152.0f };
+	const float summand[3] = { -0.5f, 3.0f, 7.25f };
+	float* reference = malloc(3 * vertex_count * sizeof(float));
+	float* positions = malloc(3 * vertex_count * sizeof(float));
+	dequantize_positions(reference, quantized_positions, vertex_count, factor, summand, dequantization_kernel_scalar, 1);
+	printf("Dequantizing %llu vertices. The renderer uses the %s kernel on all %u logical processors.\n", (unsigned long long) vertex_count, get_dequantization_kernel_name(get_best_dequantization_kernel()), get_hardware_thread_count());
+	// Benchmark all supported kernels with one thread and all threads
+	int result = 0;
+	for (uint32_t i = 0; i != dequantization_kernel_count; ++i) {
+		dequantization_kernel_t kernel = (dequantization_kernel_t) i;
+		if (!is_dequantization_kernel_supported(kernel)) {
+			printf("%-8s not supported by this build or CPU\n", get_dequantization_kernel_name(kernel));
+			continue;
+		}
+		uint32_t thread_counts[2] = { 1, get_hardware_thread_count() };
+		for (uint32_t j = 0; j != ((thread_counts[1] > 1) ? 2 : 1); ++j) {
+			uint32_t thread_count = thread_counts[j];
+			double best_time = 1.0e30;
+			for (uint32_t k = 0; k != BENCHMARK_REPETITION_COUNT; ++k) {
+				memset(positions, 0, 3 * vertex_count * sizeof(float));
+				double begin = get_time();
+				dequantize_positions(positions, quantized_positions, vertex_count, factor, summand, kernel, thread_count);
+				double time = get_time() - begin;
+				best_time = (time < best_time) ? time : best_time;
+			}
+			bool match = (memcmp(positions, reference, 3 * vertex_count * sizeof(float)) == 0);
+			printf("%-8s %3u thread(s): %8.2f ms, %8.1f M vertices/s%s\n", get_dequantization_kernel_name(kernel), thread_count, best_time * 1.0e3, (double) vertex_count / best_time * 1.0e-6, match ? "" : " (MISMATCH)");
+			if (!match)
+				result = 1;
+		}
+	}
+	free(quantized_positions);
+	free(reference);
+	free(positions);
+	return result;
+}
@@ -19,6 +19,7 @@ import numpy as np
 import bpy
 from os import path
 import re
+import zlib
 
 
 def encode_normal_32_bit(normal):
@@ -431,11 +432,65 @@ class Scene:
         return merged_mesh
 
 
-def export_scene(blender_scene, scene_file_path, selection_only, add_triangulate_modifier, split_angle, sort_triangles):
+def compress_sections(section_list, max_chunk_size=1 << 20):
+    """
+    Splits each of the given bytes objects into chunks of at most
+    max_chunk_size bytes and compresses each chunk with zlib. Chunks never
+    span multiple sections, so that the renderer can decompress each mesh
+    buffer separately.
+    :return: The chunk table (the chunk count followed by pairs of uncompressed
+        and compressed offsets for each chunk and for the end) and the
+        concatenated compressed chunks as bytes objects.
+    """
+    offset_list = [(0, 0)]
+    chunk_list = list()
+    for section in section_list:
+        for begin in range(0, len(section), max_chunk_size):
+            chunk = section[begin:begin + max_chunk_size]
+            chunk_list.append(zlib.compress(chunk, 9))
+            offset_list.append((offset_list[-1][0] + len(chunk), offset_list[-1][1] + len(chunk_list[-1])))
+    chunk_table = pack("Q", len(chunk_list)) + b"".join(pack("QQ", *offsets) for offsets in offset_list)
+    return chunk_table, b"".join(chunk_list)
+
+
+def deduplicate_vertices(positions, normal_and_uv):
+    """
+    Merges triangle corners that agree in all of their packed vertex data.
+    :param positions: An array of shape (corner_count, 2) with packed
+        positions.
+    :param normal_and_uv: An array of shape (corner_count, 4) with packed
+        normals and texture coordinates.
+    :return: A tuple (positions, normal_and_uv, indices). The first two are
+        like the inputs but only for unique vertices, which are ordered by
+        their first occurrence. indices has shape (corner_count,) and provides
+        the index of the unique vertex for each corner.
+    """
+    corner_data = np.zeros((positions.shape[0], 4), dtype=np.uint32)
+    corner_data[:, 0:2] = positions
+    corner_data[:, 2] = normal_and_uv[:, 0] | (np.asarray(normal_and_uv[:, 1], dtype=np.uint32) << 16)
+    corner_data[:, 3] = normal_and_uv[:, 2] | (np.asarray(normal_and_uv[:, 3], dtype=np.uint32) << 16)
+    _, first_corners, corner_to_unique = np.unique(corner_data, axis=0, return_index=True, return_inverse=True)
+    # np.unique() sorts lexicographically but we want to preserve the
+    # order of the (sorted) triangles for the sake of memory coherence
+    order = np.argsort(first_corners)
+    unique_to_vertex = np.zeros(order.size, dtype=np.uint32)
+    unique_to_vertex[order] = np.arange(order.size, dtype=np.uint32)
+    vertex_corners = first_corners[order]
+    indices = unique_to_vertex[corner_to_unique.reshape(-1)]
+    return positions[vertex_corners], normal_and_uv[vertex_corners], indices
+
+
+def export_scene(blender_scene, scene_file_path, selection_only, add_triangulate_modifier, split_angle, sort_triangles,
+                 indexed=True, compress=False):
     """
     Exports the given bpy.types.scene to the *.vks file at the given path. Some
-    parameters forward to Scene.__init__().
+    parameters forward to Scene.__init__(). If indexed is True, version 2 of
+    the file format with a deduplicated vertex pool and an index buffer is
+    written. Otherwise, version 1 with three vertices per triangle is written.
+    If compress is True, version 3 is written, which is version 2 with the mesh
+    data split into zlib-compressed chunks (compress implies indexed).
     """
+    indexed = indexed or compress
     print()
     print("-###- Beginning Vulkan renderer export to %s. -###-" % scene_file_path)
     if path.splitext(scene_file_path)[1] == ".blend":
@@ -467,12 +522,6 @@ def export_scene(blender_scene, scene_file_path, selection_only, add_triangulate
             mesh.primitive_vertex_indices[j::3] = mesh.primitive_vertex_indices[j::3][triangle_permutation]
             mesh.primitive_vertex_uv[j::3] = mesh.primitive_vertex_uv[j::3][triangle_permutation]
         mesh.primitive_material_index = mesh.primitive_material_index[triangle_permutation]
-    # Open the output file
-    file = open(scene_file_path, "wb")
-    # Write file format marker and version
-    file.write(pack("II", 0x00abcabc, 1))
-    # Write the number of materials, primitives and vertices
-    file.write(pack("QQ", len(used_material_list), triangle_count))
     # Quantize vertex positions to 21 bits per coordinate
     box_min = mesh.vertex_position.min(axis=0)[np.newaxis, :]
     box_max = mesh.vertex_position.max(axis=0)[np.newaxis, :]
@@ -480,21 +529,7 @@ def export_scene(blender_scene, scene_file_path, selection_only, add_triangulate
     quantization_offset = -box_min * quantization_factor
     quantized_positions = np.asarray(mesh.vertex_position * quantization_factor + quantization_offset, dtype=np.uint32)
     quantized_positions = np.minimum(2**21 - 1, quantized_positions)
-    # Write the constants needed for dequantization
-    dequantization_factor = 1.0 / quantization_factor
-    dequantization_summand = box_min + 0.5 * dequantization_factor
-    file.write(pack("fff", *dequantization_factor.flat))
-    file.write(pack("fff", *dequantization_summand.flat))
-    # Make a few changes to material names to support ORCA assets
-    used_material_list = [re.sub(r"\.[0-9][0-9][0-9]$", "", name) for name in used_material_list]
-    used_material_list = [name.replace(".DoubleSided", "") for name in used_material_list]
-    # Write the material names as null-terminated strings, preceded by their
-    # lengths
-    for material_name in used_material_list:
-        file.write(pack("Q", len(material_name.encode("utf-8"))))
-        file.write(material_name.encode("utf-8"))
-        file.write(pack("b", 0))
-    # Write the vertex positions
+    # Pack vertex positions into 64 bits for each triangle corner
     indices = mesh.primitive_vertex_indices
     packed_positions = np.zeros((mesh.get_vertex_count(), 2), dtype=np.uint32)
     packed_positions[:, 0] = quantized_positions[:, 0]
@@ -504,7 +539,6 @@ def export_scene(blender_scene, scene_file_path, selection_only, add_triangulate
     triangle_list_positions = np.zeros((triangle_count * 3, 2), dtype=np.uint32)
     triangle_list_positions[:, 0] = packed_positions[:, 0][indices]
     triangle_list_positions[:, 1] = packed_positions[:, 1][indices]
-    file.write(pack("I" * triangle_list_positions.size, *triangle_list_positions.flat))
     # Pack texture coordinate pairs into 32 bit. We allow a texture to
     # repeat up to eight times within one triangle.
     triangle_vertex_uv = mesh.primitive_vertex_uv.reshape((indices.size // 3, 3, 2))
@@ -522,13 +556,57 @@ def export_scene(blender_scene, scene_file_path, selection_only, add_triangulate
     packed_normal_0, packed_normal_1 = encode_normal_32_bit(mesh.vertex_normal)
     normal_and_uv[:, 0] = packed_normal_0[indices]
     normal_and_uv[:, 1] = packed_normal_1[indices]
-    # Write normal vectors and texture coordinates
-    file.write(pack("H" * normal_and_uv.size, *normal_and_uv.flat))
-    # Write the material index for each primitive
-    file.write(pack("B" * triangle_count, *mesh.primitive_material_index))
+    # Merge identical triangle corners into a single vertex
+    if indexed:
+        triangle_list_positions, normal_and_uv, vertex_indices = \
+            deduplicate_vertices(triangle_list_positions, normal_and_uv)
+    vertex_count = triangle_list_positions.shape[0]
+    # Open the output file
+    file = open(scene_file_path, "wb")
+    # Write file format marker and version
+    file.write(pack("II", 0x00abcabc, 3 if compress else (2 if indexed else 1)))
+    # Write the number of materials, primitives and vertices
+    file.write(pack("QQ", len(used_material_list), triangle_count))
+    if indexed:
+        file.write(pack("Q", vertex_count))
+    # Write the constants needed for dequantization
+    dequantization_factor = 1.0 / quantization_factor
+    dequantization_summand = box_min + 0.5 * dequantization_factor
+    file.write(pack("fff", *dequantization_factor.flat))
+    file.write(pack("fff", *dequantization_summand.flat))
+    # Make a few changes to material names to support ORCA assets
+    used_material_list = [re.sub(r"\.[0-9][0-9][0-9]$", "", name) for name in used_material_list]
+    used_material_list = [name.replace(".DoubleSided", "") for name in used_material_list]
+    # Write the material names as null-terminated strings, preceded by their
+    # lengths
+    for material_name in used_material_list:
+        file.write(pack("Q", len(material_name.encode("utf-8"))))
+        file.write(material_name.encode("utf-8"))
+        file.write(pack("b", 0))
+    # Pack the vertex positions, normal vectors and texture coordinates, the
+    # material index for each primitive and three vertex indices per triangle
+    section_list = [
+        pack("I" * triangle_list_positions.size, *triangle_list_positions.flat),
+        pack("H" * normal_and_uv.size, *normal_and_uv.flat),
+        pack("B" * triangle_count, *mesh.primitive_material_index),
+    ]
+    if indexed:
+        section_list.append(pack("I" * vertex_indices.size, *vertex_indices.flat))
+    # Write them as they are or compressed
+    if compress:
+        chunk_table, compressed_data = compress_sections(section_list)
+        file.write(chunk_table)
+        file.write(compressed_data)
+        print("Compressed %d bytes of mesh data to %d bytes."
+              % (sum(len(section) for section in section_list), len(compressed_data)))
+    else:
+        for section in section_list:
+            file.write(section)
     # Write an end of file marker
     file.write(pack("I", 0x00e0fe0f))
     file.close()
+    if indexed:
+        print("Merged %d triangle corners into %d unique vertices." % (3 * triangle_count, vertex_count))
     print("Wrote %d materials and %d primitives." % (len(used_material_list), triangle_count))
     print("-###- Export completed. -###-")
     print()
@@ -538,7 +616,7 @@ def export_scene(blender_scene, scene_file_path, selection_only, add_triangulate
 bl_info = {
     "name": "Vulkan renderer scene exporter (*.vks)",
     "author": "Christoph Peters",
-    "version": (1, 0, 0),
+    "version": (1, 2, 0),
     "blender": (2, 82, 0),
     "location": "file > Export",
     "description": "This addon exports scenes from Blender to the Vulkan renderer.",
@@ -561,7 +639,7 @@ class VulkanExportOperator(bpy.types.Operator):
         export_path = bpy.path.abspath(self.filepath)
         export_scene(context.scene, export_path, self.selection_only, self.add_triangulate_modifier,
                      self.edge_split_angle if self.add_edge_split_modifier else None,
-                     self.sort_triangles)
+                     self.sort_triangles, self.indexed, self.compress)
         return {"FINISHED"}
 
     # Settings of this operator
@@ -589,6 +667,15 @@ class VulkanExportOperator(bpy.types.Operator):
                                            description="Sort triangles of the mesh by the Morton code of their "
                                                        + "centroid. This may improve memory coherence in rendering",
                                            default=True)
+    indexed: bpy.props.BoolProperty(name="Indexed vertices",
+                                    description="Merge identical vertices and write an index buffer (file format "
+                                                + "version 2). This roughly halves file size and memory for geometry",
+                                    default=True)
+    compress: bpy.props.BoolProperty(name="Compress",
+                                     description="Compress mesh data with zlib in independent chunks (file format "
+                                                 + "version 3, implies indexed vertices). The renderer decompresses "
+                                                 + "these chunks in parallel",
+                                     default=False)
     # Controls file extension filters in the dialog
     filter_glob: bpy.props.StringProperty(default="*.vks", options={'HIDDEN'})
     # Some more meta-data
@@ -17,9 +17,8 @@
 import numpy as np
 import os
 import imageio
-from subprocess import Popen
+import subprocess
 import re
-from time import sleep
 
 
 def linear_to_srgb(linear):
@@ -99,52 +98,37 @@ def convert_materials(destination_directory, source_directory, skip_existing=Tru
         does not exist.
     :param source_directory: The directory that is searched for textures. Only
         file names ending with _BaseColor, _Normal or _Specular are considered.
-    :param skip_existing: Pass True to skip files that would require the output
-        file to be overwritten. Otherwise, output files are overwritten without
-        prompt.
+    :param skip_existing: Pass True to skip textures whose output file is up to
+        date (i.e. newer than the input or produced from an input with the same
+        hash). Otherwise, all output files are overwritten without prompt.
     :param texture_conversion_path: Path to a binary of the program in the
         texture_conversion folder.
     """
     if not os.path.exists(destination_directory):
         os.makedirs(destination_directory)
-    # Lists (terminated, source_file, args, process). First source_file and
-    # args are set, once work starts process is set, once it is finished,
-    # terminated is set to True
-    tasks = list()
-    for file in os.listdir(source_directory):
+    # Write a manifest listing all textures. texture_conversion converts them
+    # concurrently in a single process and skips those that are up to date.
+    manifest_lines = list()
+    for file in sorted(os.listdir(source_directory)):
         match = re.search(r"(_BaseColor\.)|(_Normal\.)|(_Specular\.)", file)
         if match is not None and os.path.splitext(file)[1] != ".vkt":
             source_file = os.path.join(source_directory, file)
             is_srgb = match.group(1) is not None
             is_normal_map = match.group(2) is not None
             destination_file = os.path.join(destination_directory, os.path.splitext(file)[0] + ".vkt")
-            if not skip_existing or not os.path.exists(destination_file):
-                if is_srgb:
-                    format = 132
-                elif is_normal_map:
-                    format = 141
-                else:
-                    format = 131
-                args = [texture_conversion_path, str(format), source_file, destination_file]
-                tasks.append([False, source_file, args, None])
-    # Launch all processes without launching too many at once to avoid running
-    # out of memory
-    cpu_count = os.cpu_count()
-    print("Using %d threads to convert materials." % cpu_count)
-    if cpu_count is None:
-        cpu_count = 32
-    launched_count = terminated_count = 0
-    while terminated_count < len(tasks):
-        for task in tasks:
-            terminated, source_file, args, process = task
-            if not terminated and process is not None and (return_code := process.poll()) is not None:
-                task[0] = True
-                terminated_count += 1
-                if return_code == 0:
-                    print("Finished %s" % source_file)
-                else:
-                    print("Failed for %s with return code %d." % (source_file, return_code))
-            if process is None and launched_count - terminated_count < cpu_count:
-                task[3] = Popen(args)
-                launched_count += 1
-        sleep(0.1)
+            if is_srgb:
+                format = 132
+            elif is_normal_map:
+                format = 141
+            else:
+                format = 131
+            manifest_lines.append("%d\t%s\t%s\n" % (format, source_file, destination_file))
+    manifest_path = os.path.join(destination_directory, "texture_conversion_manifest.txt")
+    with open(manifest_path, "w") as manifest:
+        manifest.writelines(manifest_lines)
+    args = [texture_conversion_path, "-manifest", manifest_path]
+    if not skip_existing:
+        args.append("-force")
+    return_code = subprocess.run(args).returncode
+    if return_code != 0:
+        print("Conversion of some materials failed with return code %d." % return_code)
@@ -0,0 +1,534 @@
+//  Copyright (C) 2021, Christoph Peters, Karlsruhe Institute of Technology
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#include "bc6h.h"
+#include "float_to_half.h"
+#include <math.h>
+#include <string.h>
+
+
+//! Fields in the header of a BC6H block. W and X are the two endpoints of the
+//! first region, Y and Z those of the second region. D is the partition.
+enum { RW, GW, BW, RX, GX, BX, RY, GY, BY, RZ, GZ, BZ, D };
+
+
+/*! A range of bits of a header field, which is stored contiguously in a
+	block. It corresponds to field[msb:lsb] in the notation of the Direct3D
+	specification, i.e. bit lsb is stored first. If msb < lsb, the bits are
+	stored in reverse order.*/
+typedef struct {
+	uint8_t field, msb, lsb;
+} bc6h_segment_t;
+
+
+//! Describes one of the 14 modes of BC6H
+typedef struct {
+	//! The value of the mode bits and their count (2 or 5)
+	uint8_t mode_value, mode_bit_count;
+	//! The number of regions (1 or 2)
+	uint8_t region_count;
+	//! 1 if endpoints other than W are stored as deltas to W
+	uint8_t transformed;
+	//! The precision of endpoints in bits
+	uint8_t endpoint_bits;
+	//! The number of bits for endpoints other than W for each channel
+	uint8_t delta_bits[3];
+	//! The layout of header fields in the block
+	uint8_t segment_count;
+	const bc6h_segment_t* segments;
+} bc6h_mode_t;
+
+
+// Header layouts of all modes following the mode bits
+static const bc6h_segment_t g_mode_1_layout[] = { {GY,4,4},{BY,4,4},{BZ,4,4},{RW,9,0},{GW,9,0},{BW,9,0},{RX,4,0},{GZ,4,4},{GY,3,0},{GX,4,0},{BZ,0,0},{GZ,3,0},{BX,4,0},{BZ,1,1},{BY,3,0},{RY,4,0},{BZ,2,2},{RZ,4,0},{BZ,3,3},{D,4,0} };
+static const bc6h_segment_t g_mode_2_layout[] = { {GY,5,5},{GZ,4,4},{GZ,5,5},{RW,6,0},{BZ,0,0},{BZ,1,1},{BY,4,4},{GW,6,0},{BY,5,5},{BZ,2,2},{GY,4,4},{BW,6,0},{BZ,3,3},{BZ,5,5},{BZ,4,4},{RX,5,0},{GY,3,0},{GX,5,0},{GZ,3,0},{BX,5,0},{BY,3,0},{RY,5,0},{RZ,5,0},{D,4,0} };
+static const bc6h_segment_t g_mode_3_layout[] = { {RW,9,0},{GW,9,0},{BW,9,0},{RX,4,0},{RW,10,10},{GY,3,0},{GX,3,0},{GW,10,10},{BZ,0,0},{GZ,3,0},{BX,3,0},{BW,10,10},{BZ,1,1},{BY,3,0},{RY,4,0},{BZ,2,2},{RZ,4,0},{BZ,3,3},{D,4,0} };
+static const bc6h_segment_t g_mode_4_layout[] = { {RW,9,0},{GW,9,0},{BW,9,0},{RX,3,0},{RW,10,10},{GZ,4,4},{GY,3,0},{GX,4,0},{GW,10,10},{GZ,3,0},{BX,3,0},{BW,10,10},{BZ,1,1},{BY,3,0},{RY,3,0},{BZ,0,0},{BZ,2,2},{RZ,3,0},{GY,4,4},{BZ,3,3},{D,4,0} };
+static const bc6h_segment_t g_mode_5_layout[] = { {RW,9,0},{GW,9,0},{BW,9,0},{RX,3,0},{RW,10,10},{BY,4,4},{GY,3,0},{GX,3,0},{GW,10,10},{BZ,0,0},{GZ,3,0},{BX,4,0},{BW,10,10},{BY,3,0},{RY,3,0},{BZ,1,1},{BZ,2,2},{RZ,3,0},{BZ,4,4},{BZ,3,3},{D,4,0} };
+static const bc6h_segment_t g_mode_6_layout[] = { {RW,8,0},{BY,4,4},{GW,8,0},{GY,4,4},{BW,8,0},{BZ,4,4},{RX,4,0},{GZ,4,4},{GY,3,0},{GX,4,0},{BZ,0,0},{GZ,3,0},{BX,4,0},{BZ,1,1},{BY,3,0},{RY,4,0},{BZ,2,2},{RZ,4,0},{BZ,3,3},{D,4,0} };
+static const bc6h_segment_t g_mode_7_layout[] = { {RW,7,0},{GZ,4,4},{BY,4,4},{GW,7,0},{BZ,2,2},{GY,4,4},{BW,7,0},{BZ,3,3},{BZ,4,4},{RX,5,0},{GY,3,0},{GX,4,0},{BZ,0,0},{GZ,3,0},{BX,4,0},{BZ,1,1},{BY,3,0},{RY,5,0},{RZ,5,0},{D,4,0} };
+static const bc6h_segment_t g_mode_8_layout[] = { {RW,7,0},{BZ,0,0},{BY,4,4},{GW,7,0},{GY,5,5},{GY,4,4},{BW,7,0},{GZ,5,5},{BZ,4,4},{RX,4,0},{GZ,4,4},{GY,3,0},{GX,5,0},{GZ,3,0},{BX,4,0},{BZ,1,1},{BY,3,0},{RY,4,0},{BZ,2,2},{RZ,4,0},{BZ,3,3},{D,4,0} };
+static const bc6h_segment_t g_mode_9_layout[] = { {RW,7,0},{BZ,1,1},{BY,4,4},{GW,7,0},{BY,5,5},{GY,4,4},{BW,7,0},{BZ,5,5},{BZ,4,4},{RX,4,0},{GZ,4,4},{GY,3,0},{GX,4,0},{BZ,0,0},{GZ,3,0},{BX,5,0},{BY,3,0},{RY,4,0},{BZ,2,2},{RZ,4,0},{BZ,3,3},{D,4,0} };
+static const bc6h_segment_t g_mode_10_layout[] = { {RW,5,0},{GZ,4,4},{BZ,0,0},{BZ,1,1},{BY,4,4},{GW,5,0},{GY,5,5},{BY,5,5},{BZ,2,2},{GY,4,4},{BW,5,0},{GZ,5,5},{BZ,3,3},{BZ,5,5},{BZ,4,4},{RX,5,0},{GY,3,0},{GX,5,0},{GZ,3,0},{BX,5,0},{BY,3,0},{RY,5,0},{RZ,5,0},{D,4,0} };
+static const bc6h_segment_t g_mode_11_layout[] = { {RW,9,0},{GW,9,0},{BW,9,0},{RX,9,0},{GX,9,0},{BX,9,0} };
+static const bc6h_segment_t g_mode_12_layout[] = { {RW,9,0},{GW,9,0},{BW,9,0},{RX,8,0},{RW,10,10},{GX,8,0},{GW,10,10},{BX,8,0},{BW,10,10} };
+static const bc6h_segment_t g_mode_13_layout[] = { {RW,9,0},{GW,9,0},{BW,9,0},{RX,7,0},{RW,10,11},{GX,7,0},{GW,10,11},{BX,7,0},{BW,10,11} };
+static const bc6h_segment_t g_mode_14_layout[] = { {RW,9,0},{GW,9,0},{BW,9,0},{RX,3,0},{RW,10,15},{GX,3,0},{GW,10,15},{BX,3,0},{BW,10,15} };
+
+
+#define BC6H_LAYOUT(layout) sizeof(layout) / sizeof(layout[0]), layout
+
+
+//! All modes in the order of the Direct3D specification (modes 1 to 14)
+static const bc6h_mode_t g_modes[14] = {
+	{ 0x00, 2, 2, 1, 10, { 5, 5, 5 }, BC6H_LAYOUT(g_mode_1_layout) },
+	{ 0x01, 2, 2, 1, 7, { 6, 6, 6 }, BC6H_LAYOUT(g_mode_2_layout) },
+	{ 0x02, 5, 2, 1, 11, { 5, 4, 4 }, BC6H_LAYOUT(g_mode_3_layout) },
+	{ 0x06, 5, 2, 1, 11, { 4, 5, 4 }, BC6H_LAYOUT(g_mode_4_layout) },
+	{ 0x0a, 5, 2, 1, 11, { 4, 4, 5 }, BC6H_LAYOUT(g_mode_5_layout) },
+	{ 0x0e, 5, 2, 1, 9, { 5, 5, 5 }, BC6H_LAYOUT(g_mode_6_layout) },
+	{ 0x12, 5, 2, 1, 8, { 6, 5, 5 }, BC6H_LAYOUT(g_mode_7_layout) },
+	{ 0x16, 5, 2, 1, 8, { 5, 6, 5 }, BC6H_LAYOUT(g_mode_8_layout) },
+	{ 0x1a, 5, 2, 1, 8, { 5, 5, 6 }, BC6H_LAYOUT(g_mode_9_layout) },
+	{ 0x1e, 5, 2, 0, 6, { 6, 6, 6 }, BC6H_LAYOUT(g_mode_10_layout) },
+	{ 0x03, 5, 1, 0, 10, { 10, 10, 10 }, BC6H_LAYOUT(g_mode_11_layout) },
+	{ 0x07, 5, 1, 1, 11, { 9, 9, 9 }, BC6H_LAYOUT(g_mode_12_layout) },
+	{ 0x0b, 5, 1, 1, 12, { 8, 8, 8 }, BC6H_LAYOUT(g_mode_13_layout) },
+	{ 0x0f, 5, 1, 1, 16, { 4, 4, 4 }, BC6H_LAYOUT(g_mode_14_layout) },
+};
+
+
+//! For each of the 32 partitions of two-region modes, a mask with bit i set
+//! iff texel i belongs to the second region
+static const uint16_t g_partitions[32] = {
+	0xcccc, 0x8888, 0xeeee, 0xecc8, 0xc880, 0xfeec, 0xfec8, 0xec80, 0xc800, 0xffec, 0xfe80, 0xe800, 0xffe8, 0xff00, 0xfff0, 0xf000,
+	0xf710, 0x008e, 0x7100, 0x08ce, 0x008c, 0x7310, 0x3100, 0x8cce, 0x088c, 0x3110, 0x6666, 0x366c, 0x17e8, 0x0ff0, 0x718e, 0x399c,
+};
+
+
+//! For each partition, the index of the anchor texel of the second region.
+//! The anchor texel of the first region is always texel 0.
+static const uint8_t g_anchors[32] = {
+	15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+	15, 2, 8, 2, 2, 8, 8, 15, 2, 8, 2, 2, 8, 8, 2, 2,
+};
+
+
+//! Interpolation weights (out of 64) for 3-bit and 4-bit indices
+static const uint8_t g_weights_3[8] = { 0, 9, 18, 27, 37, 46, 55, 64 };
+static const uint8_t g_weights_4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+
+//! The texels of a block that is being compressed
+typedef struct {
+	//! Targets in the domain in which the decoder interpolates. The decoder
+	//! multiplies interpolated values by 31 / 64 to get half floats.
+	float values[16][3];
+	//! The bits of the half floats that the decoder should output
+	int32_t halfs[16][3];
+} bc6h_block_t;
+
+
+//! A way to encode a block in a particular mode and partition
+typedef struct {
+	//! Quantized endpoints (not deltas) indexed by region, endpoint and
+	//! channel
+	int32_t endpoints[2][2][3];
+	//! The index of each texel. Anchor texels use the lower half of the range.
+	uint8_t indices[16];
+	//! The squared error of decoded half floats (as integers)
+	int64_t error;
+} bc6h_candidate_t;
+
+
+//! Applies the unquantization of the decoder (for unsigned formats) to an
+//! endpoint with the given number of bits
+static inline int32_t unquantize_endpoint(int32_t endpoint, int32_t bit_count) {
+	if (bit_count >= 15)
+		return endpoint;
+	else if (endpoint == 0)
+		return 0;
+	else if (endpoint == (1 << bit_count) - 1)
+		return 0xffff;
+	else
+		return ((endpoint << 16) + 0x8000) >> bit_count;
+}
+
+
+//! Finds the endpoint with the given number of bits, which unquantizes to the
+//! value closest to the given value
+static inline int32_t quantize_endpoint(float value, int32_t bit_count) {
+	int32_t max_endpoint = (1 << bit_count) - 1;
+	int32_t endpoint = (int32_t) (value * (float) (1 << bit_count) * (1.0f / 65536.0f));
+	endpoint = (endpoint < 0) ? 0 : ((endpoint > max_endpoint) ? max_endpoint : endpoint);
+	int32_t best = endpoint;
+	float best_error = fabsf((float) unquantize_endpoint(endpoint, bit_count) - value);
+	for (int32_t candidate = endpoint - 1; candidate <= endpoint + 1; candidate += 2) {
+		if (candidate < 0 || candidate > max_endpoint)
+			continue;
+		float error = fabsf((float) unquantize_endpoint(candidate, bit_count) - value);
+		if (error < best_error) {
+			best = candidate;
+			best_error = error;
+		}
+	}
+	return best;
+}
+
+
+/*! Determines the best index for each texel in a region, given unquantized
+	endpoints.
+	\param indices Receives indices for texels in the region.
+	\param block The texels.
+	\param region_mask Bit i is set iff texel i is in the region.
+	\param anchor The index of the anchor texel, which only gets indices from
+		the lower half of the range.
+	\param endpoints The two unquantized endpoints.
+	\param index_bits 3 or 4.
+	\return The squared error of all texels in the region.*/
+static int64_t find_indices(uint8_t indices[16], const bc6h_block_t* block, uint32_t region_mask, uint32_t anchor, const int32_t endpoints[2][3], int32_t index_bits) {
+	const uint8_t* weights = (index_bits == 3) ? g_weights_3 : g_weights_4;
+	int32_t palette_size = 1 << index_bits;
+	// Decode the palette exactly as the decoder does
+	int32_t palette[16][3];
+	for (int32_t i = 0; i != palette_size; ++i)
+		for (int32_t j = 0; j != 3; ++j)
+			palette[i][j] = (((endpoints[0][j] * (64 - weights[i]) + endpoints[1][j] * weights[i] + 32) >> 6) * 31) >> 6;
+	int64_t error = 0;
+	for (uint32_t i = 0; i != 16; ++i) {
+		if (!(region_mask & (1 << i)))
+			continue;
+		int32_t entry_count = (i == anchor) ? (palette_size / 2) : palette_size;
+		int64_t best_error = INT64_MAX;
+		for (int32_t k = 0; k != entry_count; ++k) {
+			int64_t texel_error = 0;
+			for (int32_t j = 0; j != 3; ++j) {
+				int64_t difference = palette[k][j] - block->halfs[i][j];
+				texel_error += difference * difference;
+			}
+			if (texel_error < best_error) {
+				best_error = texel_error;
+				indices[i] = (uint8_t) k;
+			}
+		}
+		error += best_error;
+	}
+	return error;
+}
+
+
+//! Fits endpoints to the texels of a region by projecting onto the principal
+//! axis of their distribution
+static void fit_endpoints(float endpoints[2][3], const bc6h_block_t* block, uint32_t region_mask) {
+	float mean[3] = { 0.0f, 0.0f, 0.0f };
+	float count = 0.0f;
+	for (uint32_t i = 0; i != 16; ++i) {
+		if (region_mask & (1 << i)) {
+			for (int32_t j = 0; j != 3; ++j)
+				mean[j] += block->values[i][j];
+			count += 1.0f;
+		}
+	}
+	for (int32_t j = 0; j != 3; ++j)
+		mean[j] /= count;
+	// Compute the covariance matrix
+	float covariance[3][3] = { { 0.0f } };
+	for (uint32_t i = 0; i != 16; ++i) {
+		if (region_mask & (1 << i)) {
+			float offset[3] = { block->values[i][0] - mean[0], block->values[i][1] - mean[1], block->values[i][2] - mean[2] };
+			for (int32_t j = 0; j != 3; ++j)
+				for (int32_t k = 0; k != 3; ++k)
+					covariance[j][k] += offset[j] * offset[k];
+		}
+	}
+	// Find the principal axis using power iteration, starting with the
+	// channel of greatest variance
+	int32_t max_channel = 0;
+	for (int32_t j = 1; j != 3; ++j)
+		if (covariance[j][j] > covariance[max_channel][max_channel])
+			max_channel = j;
+	float axis[3] = { covariance[max_channel][0], covariance[max_channel][1], covariance[max_channel][2] };
+	for (int32_t iteration = 0; iteration != 8; ++iteration) {
+		float next[3];
+		for (int32_t j = 0; j != 3; ++j)
+			next[j] = covariance[j][0] * axis[0] + covariance[j][1] * axis[1] + covariance[j][2] * axis[2];
+		float length = sqrtf(next[0] * next[0] + next[1] * next[1] + next[2] * next[2]);
+		if (!(length > 1.0e-20f)) {
+			axis[0] = axis[1] = axis[2] = 0.0f;
+			break;
+		}
+		for (int32_t j = 0; j != 3; ++j)
+			axis[j] = next[j] / length;
+	}
+	// Project all texels onto the axis
+	float min_projection = 0.0f, max_projection = 0.0f;
+	for (uint32_t i = 0; i != 16; ++i) {
+		if (region_mask & (1 << i)) {
+			float projection = 0.0f;
+			for (int32_t j = 0; j != 3; ++j)
+				projection += (block->values[i][j] - mean[j]) * axis[j];
+			min_projection = (projection < min_projection) ? projection : min_projection;
+			max_projection = (projection > max_projection) ? projection : max_projection;
+		}
+	}
+	for (int32_t j = 0; j != 3; ++j) {
+		endpoints[0][j] = mean[j] + axis[j] * min_projection;
+		endpoints[1][j] = mean[j] + axis[j] * max_projection;
+	}
+}
+
+
+//! Solves for endpoints that minimize the squared error in a region for the
+//! given indices (least squares). Endpoints remain untouched if the system is
+//! singular.
+static void refine_endpoints(float endpoints[2][3], const bc6h_block_t* block, uint32_t region_mask, const uint8_t indices[16], int32_t index_bits) {
+	const uint8_t* weights = (index_bits == 3) ? g_weights_3 : g_weights_4;
+	float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+	float ax[3] = { 0.0f, 0.0f, 0.0f }, bx[3] = { 0.0f, 0.0f, 0.0f };
+	for (uint32_t i = 0; i != 16; ++i) {
+		if (region_mask & (1 << i)) {
+			float b = weights[indices[i]] * (1.0f / 64.0f);
+			float a = 1.0f - b;
+			aa += a * a;
+			ab += a * b;
+			bb += b * b;
+			for (int32_t j = 0; j != 3; ++j) {
+				ax[j] += a * block->values[i][j];
+				bx[j] += b * block->values[i][j];
+			}
+		}
+	}
+	float determinant = aa * bb - ab * ab;
+	if (fabsf(determinant) < 1.0e-6f)
+		return;
+	float inverse_determinant = 1.0f / determinant;
+	for (int32_t j = 0; j != 3; ++j) {
+		endpoints[0][j] = (bb * ax[j] - ab * bx[j]) * inverse_determinant;
+		endpoints[1][j] = (aa * bx[j] - ab * ax[j]) * inverse_determinant;
+	}
+}
+
+
+//! \return The mask of texels in the given region of the given partition
+static inline uint32_t get_region_mask(const bc6h_mode_t* mode, uint32_t partition, uint32_t region) {
+	if (mode->region_count == 1)
+		return 0xffff;
+	return region ? g_partitions[partition] : (~g_partitions[partition] & 0xffff);
+}
+
+
+/*! Quantizes endpoints for the given mode (respecting its delta ranges) and
+	finds the best indices for them.
+	\param candidate The output.
+	\param block The texels.
+	\param mode The mode to use.
+	\param partition The partition to use (ignored for single-region modes).
+	\param endpoints Unquantized endpoints for each region. The endpoints of a
+		region get swapped, if that is needed to give the anchor texel an index
+		in the lower half of the range.*/
+static void quantize_candidate(bc6h_candidate_t* candidate, const bc6h_block_t* block, const bc6h_mode_t* mode, uint32_t partition, float endpoints[2][2][3]) {
+	int32_t bit_count = mode->endpoint_bits;
+	int32_t index_bits = (mode->region_count == 1) ? 4 : 3;
+	for (uint32_t i = 0; i != mode->region_count; ++i) {
+		// Make sure that the anchor texel is closer to the first endpoint
+		uint32_t anchor = i ? g_anchors[partition] : 0;
+		float dot = 0.0f, length_squared = 0.0f;
+		for (int32_t j = 0; j != 3; ++j) {
+			float direction = endpoints[i][1][j] - endpoints[i][0][j];
+			dot += (block->values[anchor][j] - endpoints[i][0][j]) * direction;
+			length_squared += direction * direction;
+		}
+		if (dot > 0.5f * length_squared) {
+			for (int32_t j = 0; j != 3; ++j) {
+				float swap = endpoints[i][0][j];
+				endpoints[i][0][j] = endpoints[i][1][j];
+				endpoints[i][1][j] = swap;
+			}
+		}
+		for (int32_t k = 0; k != 2; ++k)
+			for (int32_t j = 0; j != 3; ++j)
+				candidate->endpoints[i][k][j] = quantize_endpoint(endpoints[i][k][j], bit_count);
+	}
+	// Clamp deltas to the representable range. The decoder wraps around, so
+	// deltas are computed modulo the endpoint range.
+	if (mode->transformed) {
+		int32_t mask = (1 << bit_count) - 1;
+		for (uint32_t i = 0; i != mode->region_count; ++i) {
+			for (int32_t k = 0; k != 2; ++k) {
+				if (i == 0 && k == 0)
+					continue;
+				for (int32_t j = 0; j != 3; ++j) {
+					int32_t base = candidate->endpoints[0][0][j];
+					int32_t delta = (candidate->endpoints[i][k][j] - base) & mask;
+					if (delta >= (1 << (bit_count - 1)))
+						delta -= 1 << bit_count;
+					int32_t max_delta = (1 << (mode->delta_bits[j] - 1)) - 1;
+					delta = (delta < -max_delta - 1) ? (-max_delta - 1) : ((delta > max_delta) ? max_delta : delta);
+					candidate->endpoints[i][k][j] = (base + delta) & mask;
+				}
+			}
+		}
+	}
+	// Find indices
+	candidate->error = 0;
+	for (uint32_t i = 0; i != mode->region_count; ++i) {
+		int32_t unquantized[2][3];
+		for (int32_t k = 0; k != 2; ++k)
+			for (int32_t j = 0; j != 3; ++j)
+				unquantized[k][j] = unquantize_endpoint(candidate->endpoints[i][k][j], bit_count);
+		candidate->error += find_indices(candidate->indices, block, get_region_mask(mode, partition, i), i ? g_anchors[partition] : 0, unquantized, index_bits);
+	}
+}
+
+
+/*! Encodes a block in the given mode and partition, refines endpoints and
+	outputs the result if it is better than the best candidate so far.
+	\param best The best candidate so far.
+	\param best_mode, best_partition The mode and partition of best.
+	\param block The texels.
+	\param mode_index The index of the mode in g_modes.
+	\param partition The partition to use.
+	\param initial_endpoints Unquantized endpoints for each region.
+	\param refinement_count The maximal number of iterations for endpoint
+		refinement.*/
+static void try_mode(bc6h_candidate_t* best, uint32_t* best_mode, uint32_t* best_partition, const bc6h_block_t* block, uint32_t mode_index, uint32_t partition, const float initial_endpoints[2][2][3], uint32_t refinement_count) {
+	const bc6h_mode_t* mode = &g_modes[mode_index];
+	int32_t index_bits = (mode->region_count == 1) ? 4 : 3;
+	float endpoints[2][2][3];
+	memcpy(endpoints, initial_endpoints, sizeof(endpoints));
+	bc6h_candidate_t candidate;
+	quantize_candidate(&candidate, block, mode, partition, endpoints);
+	for (uint32_t i = 0; i != refinement_count; ++i) {
+		float refined_endpoints[2][2][3];
+		memcpy(refined_endpoints, endpoints, sizeof(endpoints));
+		for (uint32_t j = 0; j != mode->region_count; ++j)
+			refine_endpoints(refined_endpoints[j], block, get_region_mask(mode, partition, j), candidate.indices, index_bits);
+		bc6h_candidate_t refined;
+		quantize_candidate(&refined, block, mode, partition, refined_endpoints);
+		if (refined.error >= candidate.error)
+			break;
+		candidate = refined;
+		memcpy(endpoints, refined_endpoints, sizeof(endpoints));
+	}
+	if (candidate.error < best->error) {
+		(*best) = candidate;
+		(*best_mode) = mode_index;
+		(*best_partition) = partition;
+	}
+}
+
+
+//! Estimates the error of a region with unquantized endpoints and 3-bit
+//! indices
+static float estimate_region_error(const bc6h_block_t* block, uint32_t region_mask, const float endpoints[2][3]) {
+	float direction[3], length_squared = 0.0f;
+	for (int32_t j = 0; j != 3; ++j) {
+		direction[j] = endpoints[1][j] - endpoints[0][j];
+		length_squared += direction[j] * direction[j];
+	}
+	float inverse_length_squared = (length_squared > 0.0f) ? (1.0f / length_squared) : 0.0f;
+	float error = 0.0f;
+	for (uint32_t i = 0; i != 16; ++i) {
+		if (region_mask & (1 << i)) {
+			float offset[3], t = 0.0f;
+			for (int32_t j = 0; j != 3; ++j) {
+				offset[j] = block->values[i][j] - endpoints[0][j];
+				t += offset[j] * direction[j];
+			}
+			t = floorf(t * inverse_length_squared * 7.0f + 0.5f) * (1.0f / 7.0f);
+			t = (t < 0.0f) ? 0.0f : ((t > 1.0f) ? 1.0f : t);
+			for (int32_t j = 0; j != 3; ++j) {
+				float difference = offset[j] - t * direction[j];
+				error += difference * difference;
+			}
+		}
+	}
+	return error;
+}
+
+
+//! Appends the given number of low bits of value to a block
+static inline void write_bits(uint8_t block[16], uint32_t* position, uint32_t value, uint32_t bit_count) {
+	for (uint32_t i = 0; i != bit_count; ++i, ++(*position))
+		block[(*position) / 8] |= (uint8_t) (((value >> i) & 1) << ((*position) % 8));
+}
+
+
+//! Writes the bits of a block for the given candidate
+static void pack_block(uint8_t destination[16], const bc6h_candidate_t* candidate, uint32_t mode_index, uint32_t partition) {
+	const bc6h_mode_t* mode = &g_modes[mode_index];
+	// Gather the values of all fields
+	uint32_t fields[13] = { 0 };
+	for (uint32_t i = 0; i != mode->region_count; ++i) {
+		for (uint32_t k = 0; k != 2; ++k) {
+			for (uint32_t j = 0; j != 3; ++j) {
+				int32_t value = candidate->endpoints[i][k][j];
+				if (mode->transformed && (i != 0 || k != 0))
+					value = (value - candidate->endpoints[0][0][j]) & ((1 << mode->delta_bits[j]) - 1);
+				fields[(2 * i + k) * 3 + j] = (uint32_t) value;
+			}
+		}
+	}
+	fields[D] = partition;
+	// Write the header
+	memset(destination, 0, 16);
+	uint32_t position = 0;
+	write_bits(destination, &position, mode->mode_value, mode->mode_bit_count);
+	for (uint32_t i = 0; i != mode->segment_count; ++i) {
+		const bc6h_segment_t* segment = &mode->segments[i];
+		int32_t step = (segment->msb >= segment->lsb) ? 1 : -1;
+		for (int32_t bit = segment->lsb; ; bit += step) {
+			write_bits(destination, &position, fields[segment->field] >> bit, 1);
+			if (bit == segment->msb)
+				break;
+		}
+	}
+	// Write the indices, where anchor texels lack the most significant bit
+	uint32_t index_bits = (mode->region_count == 1) ? 4 : 3;
+	for (uint32_t i = 0; i != 16; ++i) {
+		int32_t is_anchor = (i == 0) || (mode->region_count == 2 && i == g_anchors[partition]);
+		write_bits(destination, &position, candidate->indices[i], index_bits - is_anchor);
+	}
+}
+
+
+void compress_bc6h_block(uint8_t destination[16], const float texels[16][3], bc6h_quality_t quality) {
+	// Convert to half floats and map them to the domain of interpolation
+	bc6h_block_t block;
+	for (uint32_t i = 0; i != 16; ++i) {
+		for (uint32_t j = 0; j != 3; ++j) {
+			// This comparison also maps NaN to zero
+			float value = (texels[i][j] > 0.0f) ? texels[i][j] : 0.0f;
+			int32_t half = float_to_half(value);
+			half = (half > 0x7bff) ? 0x7bff : half;
+			block.halfs[i][j] = half;
+			block.values[i][j] = ((float) half + 0.5f) * (64.0f / 31.0f);
+		}
+	}
+	uint32_t refinement_count = (quality == bc6h_quality_high) ? 4 : ((quality == bc6h_quality_normal) ? 2 : 1);
+	bc6h_candidate_t best = { .error = INT64_MAX };
+	uint32_t best_mode = 0, best_partition = 0;
+	// Try modes with a single region
+	float endpoints[2][2][3];
+	fit_endpoints(endpoints[0], &block, 0xffff);
+	for (uint32_t i = 10; i != 14; ++i)
+		try_mode(&best, &best_mode, &best_partition, &block, i, 0, (const float (*)[2][3]) endpoints, refinement_count);
+	// Rank partitions by their estimated error and try two-region modes for
+	// the most promising ones
+	uint32_t partition_count = (quality == bc6h_quality_high) ? 8 : ((quality == bc6h_quality_normal) ? 1 : 0);
+	if (partition_count > 0 && best.error > 0) {
+		float partition_endpoints[32][2][2][3];
+		float partition_errors[32];
+		for (uint32_t i = 0; i != 32; ++i) {
+			partition_errors[i] = 0.0f;
+			for (uint32_t j = 0; j != 2; ++j) {
+				uint32_t region_mask = j ? g_partitions[i] : (~g_partitions[i] & 0xffff);
+				fit_endpoints(partition_endpoints[i][j], &block, region_mask);
+				partition_errors[i] += estimate_region_error(&block, region_mask, (const float (*)[3]) partition_endpoints[i][j]);
+			}
+		}
+		for (uint32_t i = 0; i != partition_count; ++i) {
+			uint32_t partition = 0;
+			for (uint32_t j = 1; j != 32; ++j)
+				if (partition_errors[j] < partition_errors[partition])
+					partition = j;
+			partition_errors[partition] = INFINITY;
+			for (uint32_t j = 0; j != 10; ++j)
+				try_mode(&best, &best_mode, &best_partition, &block, j, partition, (const float (*)[2][3]) partition_endpoints[partition], refinement_count);
+		}
+	}
+	pack_block(destination, &best, best_mode, best_partition);
+}
@@ -0,0 +1,41 @@
+//  Copyright (C) 2021, Christoph Peters, Karlsruhe Institute of Technology
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+#pragma once
+#include <stdint.h>
+
+
+//! Quality levels for compress_bc6h_block(). Higher levels try more modes and
+//! partitions and refine endpoints more often.
+typedef enum {
+	//! Only modes with a single region and a single endpoint refinement
+	bc6h_quality_fast = 0,
+	//! Additionally two-region modes for the most promising partition
+	bc6h_quality_normal = 1,
+	//! Two-region modes for the eight most promising partitions and more
+	//! refinement iterations
+	bc6h_quality_high = 2,
+} bc6h_quality_t;
+
+
+/*! Compresses a 4x4 block of HDR texels to a block of
+	VK_FORMAT_BC6H_UFLOAT_BLOCK (unsigned half floats). Negative values are
+	clamped to zero, large values to the largest half float. This function is
+	thread safe.
+	\param destination Receives the 16 bytes of the compressed block.
+	\param texels Linear RGB values of the texels in row-major order.
+	\param quality Trades compression speed for quality.*/
+void compress_bc6h_block(uint8_t destination[16], const float texels[16][3], bc6h_quality_t quality);
@@ -18,11 +18,35 @@
 #include "stb_dxt.h"
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "stb_image_write.h"
 #include "float_to_half.h"
+#include "bc6h.h"
+#include "threading.h"
+#include "hashing.h"
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdint.h>
+#include <string.h>
 #include <math.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <direct.h>
+#else
+#include <time.h>
+#include <dirent.h>
+#endif
+// The separable filter uses SSE on x86 with GCC, Clang and MSVC. It performs
+// the same float operations in the same order as the scalar fallback, so the
+// output does not depend on it.
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FILTER_SSE 1
+#include <immintrin.h>
+#else
+#define FILTER_SSE 0
+#endif
 
 
 /*! A subset of the VkFormat enumeration in Vulkan holding formats that can be
@@ -51,6 +75,7 @@ typedef enum vk_format_e {
 	VK_FORMAT_BC1_RGB_UNORM_BLOCK = 131,
 	VK_FORMAT_BC1_RGB_SRGB_BLOCK = 132,
 	VK_FORMAT_BC5_UNORM_BLOCK = 141,
+	VK_FORMAT_BC6H_UFLOAT_BLOCK = 143,
 } vk_format_t;
 
 
@@ -80,6 +105,241 @@ typedef struct mipmap_header_s {
 } mipmap_header_t;
 
 
+/*! The maximal size in bytes of a chunk of uncompressed data in a compressed
+	texture file. Chunks never cross mipmap boundaries.*/
+#define COMPRESSION_CHUNK_SIZE (1 << 20)
+
+
+/*! In version 3 of the file format, the payload and each mipmap begin at a
+	multiple of this many bytes from the beginning of the file and the
+	payload is padded with zeros to a multiple of it. Thus, renderers can read
+	mipmaps with O_DIRECT.*/
+#define ALIGNED_PAYLOAD_ALIGNMENT 4096
+
+
+//! Rounds the given size up to a multiple of ALIGNED_PAYLOAD_ALIGNMENT
+static inline size_t align_payload_size(size_t size) {
+	return (size + ALIGNED_PAYLOAD_ALIGNMENT - 1) & ~((size_t) ALIGNED_PAYLOAD_ALIGNMENT - 1);
+}
+
+
+/*! Returns the file format version that convert_texture() writes: 1 for
+	plain files, 2 for compressed payloads (see write_compressed_payload()) and
+	3 for aligned payloads (see ALIGNED_PAYLOAD_ALIGNMENT). Compression takes
+	precedence over alignment.*/
+static inline int32_t get_file_version(int32_t compress, int32_t align) {
+	return compress ? 2 : (align ? 3 : 1);
+}
+
+
+//! Writes the given number of zero bytes to the given file. Returns 0 upon
+//! success.
+int write_zeros(FILE* file, size_t size) {
+	uint8_t zeros[ALIGNED_PAYLOAD_ALIGNMENT] = { 0 };
+	while (size > 0) {
+		size_t chunk_size = (size < sizeof(zeros)) ? size : sizeof(zeros);
+		if (fwrite(zeros, 1, chunk_size, file) != chunk_size)
+			return 1;
+		size -= chunk_size;
+	}
+	return 0;
+}
+
+
+//! A chunk of the payload that is compressed by compress_chunk_task()
+typedef struct {
+	//! The uncompressed data of the chunk
+	const unsigned char* uncompressed;
+	//! The size of the uncompressed data in bytes
+	int uncompressed_size;
+	//! The zlib stream of the chunk (allocated by stb_image_write) or NULL
+	unsigned char* compressed;
+	//! The size of the zlib stream in bytes
+	int compressed_size;
+} payload_chunk_t;
+
+
+//! A task for run_parallel() that compresses the chunk with the given index
+//! in an array of payload_chunk_t
+int compress_chunk_task(void* raw_chunks, uint32_t chunk_index) {
+	payload_chunk_t* chunk = &((payload_chunk_t*) raw_chunks)[chunk_index];
+	chunk->compressed = stbi_zlib_compress((unsigned char*) chunk->uncompressed, chunk->uncompressed_size, &chunk->compressed_size, 8);
+	if (!chunk->compressed) {
+		printf("Failed to compress chunk %u of the texture.\n", chunk_index);
+		return 1;
+	}
+	return 0;
+}
+
+
+/*! Splits each mipmap of the given uncompressed payload into chunks of at
+	most COMPRESSION_CHUNK_SIZE bytes and compresses each chunk independently
+	using zlib. Chunks are compressed concurrently but the output does not
+	depend on the thread count. Then it writes the chunk table and the
+	compressed chunks to the output file. Returns 0 upon success.*/
+int write_compressed_payload(FILE* output, const uint8_t* payload, const mipmap_header_t* mipmap_headers, int32_t mipmap_count, uint32_t thread_count) {
+	// Gather chunks
+	uint64_t chunk_count = 0;
+	for (int32_t i = 0; i != mipmap_count; ++i)
+		chunk_count += (mipmap_headers[i].size + COMPRESSION_CHUNK_SIZE - 1) / COMPRESSION_CHUNK_SIZE;
+	payload_chunk_t* chunks = calloc(chunk_count + 1, sizeof(payload_chunk_t));
+	uint64_t chunk_index = 0;
+	for (int32_t i = 0; i != mipmap_count; ++i) {
+		for (size_t begin = 0; begin < mipmap_headers[i].size; begin += COMPRESSION_CHUNK_SIZE) {
+			size_t remaining_size = mipmap_headers[i].size - begin;
+			chunks[chunk_index].uncompressed = payload + mipmap_headers[i].offset + begin;
+			chunks[chunk_index].uncompressed_size = (int) ((remaining_size < COMPRESSION_CHUNK_SIZE) ? remaining_size : COMPRESSION_CHUNK_SIZE);
+			++chunk_index;
+		}
+	}
+	// Compress all chunks
+	int32_t result = run_parallel(&compress_chunk_task, chunks, (uint32_t) chunk_count, thread_count);
+	// Write the chunk table and the compressed chunks
+	if (!result) {
+		uint64_t* offsets = calloc(2 * (chunk_count + 1), sizeof(uint64_t));
+		for (uint64_t i = 0; i != chunk_count; ++i) {
+			offsets[2 * i + 2] = offsets[2 * i + 0] + chunks[i].uncompressed_size;
+			offsets[2 * i + 3] = offsets[2 * i + 1] + chunks[i].compressed_size;
+		}
+		fwrite(&chunk_count, sizeof(chunk_count), 1, output);
+		fwrite(offsets, sizeof(uint64_t), 2 * (chunk_count + 1), output);
+		for (uint64_t i = 0; i != chunk_count; ++i)
+			fwrite(chunks[i].compressed, 1, chunks[i].compressed_size, output);
+		printf("Compressed %llu bytes of mipmaps to %llu bytes in %llu chunks.\n", (unsigned long long) offsets[2 * chunk_count], (unsigned long long) offsets[2 * chunk_count + 1], (unsigned long long) chunk_count);
+		free(offsets);
+	}
+	for (uint64_t i = 0; i != chunk_count; ++i)
+		free(chunks[i].compressed);
+	free(chunks);
+	return result;
+}
+
+
+/*! Writes the payload of a texture file incrementally, in pieces that arrive
+	in the order in which they appear in the payload. The output is identical
+	to that of write_compressed_payload() or a single fwrite().*/
+typedef struct {
+	//! The output file
+	FILE* file;
+	//! 1 to compress the payload using zlib
+	int32_t compress;
+	//! The maximal number of threads for compression
+	uint32_t thread_count;
+	//! Where the chunk table goes in the output file
+	fpos_t chunk_table_position;
+	//! The number of chunks in the whole payload and how many are written
+	uint64_t chunk_count, written_chunk_count;
+	//! 2 * (chunk_count + 1) offsets as in write_compressed_payload()
+	uint64_t* offsets;
+	//! Data of the current mipmap that does not fill a whole chunk yet. Its
+	//! capacity is COMPRESSION_CHUNK_SIZE bytes.
+	uint8_t* pending;
+	size_t pending_size;
+} payload_stream_t;
+
+
+/*! Prepares writing a payload incrementally to the current position of the
+	given file. With compression, it reserves space for the chunk table,
+	which end_payload_stream() fills in.
+	\return 0 upon success.*/
+int begin_payload_stream(payload_stream_t* stream, FILE* file, const mipmap_header_t* mipmap_headers, int32_t mipmap_count, int32_t compress, uint32_t thread_count) {
+	memset(stream, 0, sizeof(*stream));
+	stream->file = file;
+	stream->compress = compress;
+	stream->thread_count = thread_count;
+	if (!compress)
+		return 0;
+	for (int32_t i = 0; i != mipmap_count; ++i)
+		stream->chunk_count += (mipmap_headers[i].size + COMPRESSION_CHUNK_SIZE - 1) / COMPRESSION_CHUNK_SIZE;
+	stream->offsets = calloc(2 * (stream->chunk_count + 1), sizeof(uint64_t));
+	stream->pending = malloc(COMPRESSION_CHUNK_SIZE);
+	if (fgetpos(file, &stream->chunk_table_position))
+		return 1;
+	fwrite(&stream->chunk_count, sizeof(stream->chunk_count), 1, file);
+	return fwrite(stream->offsets, sizeof(uint64_t), 2 * (stream->chunk_count + 1), file) != 2 * (stream->chunk_count + 1);
+}
+
+
+/*! Appends data to a payload stream. With compression, all complete chunks
+	are compressed concurrently and written right away.
+	\param data The next bytes of the payload.
+	\param size The size of data in bytes.
+	\param mipmap_end 1 iff data ends the current mipmap. Chunks never cross
+		mipmap boundaries, so this flushes the last chunk of the mipmap.
+	\return 0 upon success.*/
+int stream_payload(payload_stream_t* stream, const uint8_t* data, size_t size, int32_t mipmap_end) {
+	if (!stream->compress)
+		return fwrite(data, 1, size, stream->file) != size;
+	// Fill up the pending chunk
+	size_t pending_fill = COMPRESSION_CHUNK_SIZE - stream->pending_size;
+	pending_fill = (pending_fill < size) ? pending_fill : size;
+	memcpy(stream->pending + stream->pending_size, data, pending_fill);
+	stream->pending_size += pending_fill;
+	data += pending_fill;
+	size -= pending_fill;
+	// Gather complete chunks, referencing data directly where possible
+	payload_chunk_t* chunks = calloc(size / COMPRESSION_CHUNK_SIZE + 2, sizeof(payload_chunk_t));
+	uint32_t chunk_count = 0;
+	int32_t pending_complete = (stream->pending_size == COMPRESSION_CHUNK_SIZE || (mipmap_end && size == 0 && stream->pending_size > 0));
+	if (pending_complete) {
+		chunks[chunk_count].uncompressed = stream->pending;
+		chunks[chunk_count].uncompressed_size = (int) stream->pending_size;
+		++chunk_count;
+	}
+	while (size >= COMPRESSION_CHUNK_SIZE || (mipmap_end && size > 0)) {
+		size_t chunk_size = (size < COMPRESSION_CHUNK_SIZE) ? size : COMPRESSION_CHUNK_SIZE;
+		chunks[chunk_count].uncompressed = data;
+		chunks[chunk_count].uncompressed_size = (int) chunk_size;
+		++chunk_count;
+		data += chunk_size;
+		size -= chunk_size;
+	}
+	int result = (stream->written_chunk_count + chunk_count > stream->chunk_count);
+	if (!result)
+		result = run_parallel(&compress_chunk_task, chunks, chunk_count, stream->thread_count);
+	// Write them and record their offsets
+	for (uint32_t i = 0; i != chunk_count && !result; ++i) {
+		uint64_t* offsets = stream->offsets + 2 * stream->written_chunk_count;
+		offsets[2] = offsets[0] + chunks[i].uncompressed_size;
+		offsets[3] = offsets[1] + chunks[i].compressed_size;
+		++stream->written_chunk_count;
+		result = fwrite(chunks[i].compressed, 1, chunks[i].compressed_size, stream->file) != (size_t) chunks[i].compressed_size;
+	}
+	for (uint32_t i = 0; i != chunk_count; ++i)
+		free(chunks[i].compressed);
+	free(chunks);
+	// Keep the remainder for the next call
+	if (pending_complete)
+		stream->pending_size = 0;
+	memcpy(stream->pending + stream->pending_size, data, size);
+	stream->pending_size += size;
+	return result;
+}
+
+
+/*! Completes a payload stream by writing the chunk table (if any), leaves the
+	file position at the end of the payload and frees the stream.
+	\return 0 upon success.*/
+int end_payload_stream(payload_stream_t* stream) {
+	int result = 0;
+	if (stream->compress) {
+		fpos_t end_position;
+		result = (stream->written_chunk_count != stream->chunk_count || stream->pending_size > 0);
+		result = result || fgetpos(stream->file, &end_position) || fsetpos(stream->file, &stream->chunk_table_position);
+		if (!result) {
+			fwrite(&stream->chunk_count, sizeof(stream->chunk_count), 1, stream->file);
+			fwrite(stream->offsets, sizeof(uint64_t), 2 * (stream->chunk_count + 1), stream->file);
+			result = fsetpos(stream->file, &end_position);
+			printf("Compressed %llu bytes of mipmaps to %llu bytes in %llu chunks.\n", (unsigned long long) stream->offsets[2 * stream->chunk_count], (unsigned long long) stream->offsets[2 * stream->chunk_count + 1], (unsigned long long) stream->chunk_count);
+		}
+	}
+	free(stream->offsets);
+	free(stream->pending);
+	memset(stream, 0, sizeof(*stream));
+	return result;
+}
+
+
 /*! Converts the given scalars (which should be normalized to the range from
 	zero to one) from a linear scale to the sRGB scale (from 0 to 255).*/
 static inline uint8_t linear_to_srgb(float linear) {
@@ -103,6 +363,58 @@ static inline float srgb_to_linear(uint8_t srgb) {
 }
 
 
+/*! An image as loaded by stb_image, before it is converted to linear space.
+	Exactly one of hdr_pixels and ldr_pixels is not NULL.*/
+typedef struct {
+	//! HDR images are loaded as floats with shared_channel_count channels
+	float* hdr_pixels;
+	//! LDR images are loaded as 8-bit values with channel_count channels
+	uint8_t* ldr_pixels;
+	//! The extent of the image in pixels
+	int32_t width, height;
+	//! The number of channels in the loaded image
+	int32_t channel_count;
+	//! The number of channels that are converted to linear space
+	int32_t shared_channel_count;
+	//! Maps each 8-bit value to linear space (using the sRGB transfer function
+	//! or a linear scale)
+	float ldr_to_linear[256];
+} source_image_t;
+
+
+//! Shared state for convert_row_task()
+typedef struct {
+	//! The image to convert
+	const source_image_t* source;
+	//! The row of the source image that corresponds to the first output row.
+	//! It may be negative or exceed the height, since row indices wrap around.
+	int32_t first_row;
+	//! The output with shared_channel_count floats per pixel
+	float* linear_rows;
+} row_conversion_t;
+
+
+//! A task for run_parallel() that converts one row of the source image in a
+//! row_conversion_t to linear space
+int convert_row_task(void* raw_conversion, uint32_t row_index) {
+	const row_conversion_t* conversion = (const row_conversion_t*) raw_conversion;
+	const source_image_t* source = conversion->source;
+	int32_t channel_count = source->shared_channel_count;
+	int32_t source_row = (conversion->first_row + (int32_t) row_index) & (source->height - 1);
+	size_t pixel_begin = (size_t) source_row * source->width;
+	float* destination = conversion->linear_rows + (size_t) row_index * source->width * channel_count;
+	if (source->hdr_pixels)
+		memcpy(destination, source->hdr_pixels + pixel_begin * channel_count, sizeof(float) * source->width * channel_count);
+	else {
+		const uint8_t* ldr_row = source->ldr_pixels + pixel_begin * source->channel_count;
+		for (int32_t i = 0; i != source->width; ++i)
+			for (int32_t j = 0; j != channel_count; ++j)
+				destination[i * channel_count + j] = source->ldr_to_linear[ldr_row[i * source->channel_count + j]];
+	}
+	return 0;
+}
+
+
 /*! Returns the required mipmap count for a square image with the given edge
 	length in pixels when producing a complete hierarchy.*/
 static inline int32_t get_mipmap_count(int32_t extent) {
@@ -117,163 +429,677 @@ static inline int32_t get_mipmap_count(int32_t extent) {
 }
 
 
-int main(int argc, char** argv) {
-	// Grab and validate input arguments
-	int32_t format_int = 0;
-	if (argc >= 4)
-		sscanf(argv[1], "%d", &format_int);
-	vk_format_t format = (vk_format_t) format_int;
+//! \return A monotonic time in seconds
+double get_time() {
+#ifdef _WIN32
+	LARGE_INTEGER counter, frequency;
+	QueryPerformanceCounter(&counter);
+	QueryPerformanceFrequency(&frequency);
+	return (double) counter.QuadPart / (double) frequency.QuadPart;
+#else
+	struct timespec time;
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return (double) time.tv_sec + 1.0e-9 * (double) time.tv_nsec;
+#endif
+}
+
+
+//! Shared state for the filter and encoding tasks, which process one mipmap
+typedef struct {
+	//! The full-resolution image with shared_channel_count channels in linear
+	//! space and its extent
+	const float* linear_image;
+	int32_t width, height;
+	//! The number of channels stored in linear_image and mipmap
+	int32_t shared_channel_count;
+	//! 2 * filter_extent weights of the separable Gaussian filter
+	const double* filter_weights;
+	//! filter_weights converted to float
+	const float* float_weights;
+	int32_t filter_extent;
+	//! The distance between output pixels in input pixels
+	int32_t stride;
+	//! Offset from stride times the output pixel to the first input pixel
+	int32_t offset;
+	//! The mipmap in linear space and its extent
+	float* mipmap;
+	int32_t mipmap_width, mipmap_height;
+	//! The output format and properties derived from it in main()
+	vk_format_t format;
+	int32_t is_srgb, is_bc1, is_half, is_hdr, is_8_bit;
+	int32_t channel_count;
+	size_t bits_per_pixel;
+	//! Where the encoded mipmap goes in the payload
+	uint8_t* destination;
+	//! The number of bytes per encoded row (of pixels or blocks)
+	size_t row_size;
+	//! The quality setting for BC6H compression
+	bc6h_quality_t bc6h_quality;
+} mipmap_job_t;
+
+
+//! A task for run_parallel() that applies the Gaussian filter for one row of
+//! the mipmap described by a mipmap_job_t. It evaluates the full 2D filter
+//! per pixel in double precision and serves as reference for benchmarks.
+int reference_filter_row_task(void* raw_job, uint32_t row_index) {
+	const mipmap_job_t* job = (const mipmap_job_t*) raw_job;
+	int32_t y = (int32_t) row_index;
+	int32_t mask_x = job->width - 1;
+	int32_t mask_y = job->height - 1;
+	int32_t channel_count = job->shared_channel_count;
+	for (int32_t x = 0; x != job->mipmap_width; ++x) {
+		double pixel[4] = { 0.0, 0.0, 0.0, 0.0 };
+		// Iterate over the filter footprint
+		for (int32_t k = 0; k != 2 * job->filter_extent; ++k) {
+			for (int32_t j = 0; j != 2 * job->filter_extent; ++j) {
+				int32_t source_x = x * job->stride + job->offset + j;
+				source_x &= mask_x;
+				int32_t source_y = y * job->stride + job->offset + k;
+				source_y &= mask_y;
+				int32_t pixel_start = channel_count * (source_y * job->width + source_x);
+				double weight = job->filter_weights[j] * job->filter_weights[k];
+				for (int32_t l = 0; l != channel_count; ++l)
+					pixel[l] += weight * job->linear_image[pixel_start + l];
+			}
+		}
+		// Cast the pixel to float
+		float* mipmap_pixel = job->mipmap + channel_count * (y * job->mipmap_width + x);
+		for (int32_t l = 0; l != channel_count; ++l)
+			mipmap_pixel[l] = (float) pixel[l];
+	}
+	return 0;
+}
+
+
+//! Adds weight times source to destination for count floats
+static inline void add_weighted_row(float* destination, const float* source, float weight, size_t count) {
+	size_t i = 0;
+#if FILTER_SSE
+	__m128 weights = _mm_set1_ps(weight);
+	for (; i + 4 <= count; i += 4)
+		_mm_storeu_ps(destination + i, _mm_add_ps(_mm_loadu_ps(destination + i), _mm_mul_ps(weights, _mm_loadu_ps(source + i))));
+#endif
+	for (; i != count; ++i)
+		destination[i] += weight * source[i];
+}
+
+
+//! Applies the horizontal pass of the separable Gaussian filter of the given
+//! job to a vertically filtered row at full width
+static void filter_row_horizontally(float* mipmap_row, const float* column_sums, const mipmap_job_t* job) {
+	int32_t channel_count = job->shared_channel_count;
+	int32_t tap_count = 2 * job->filter_extent;
+	for (int32_t x = 0; x != job->mipmap_width; ++x) {
+		float pixel[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+		int32_t first_x = x * job->stride + job->offset;
+		if (first_x >= 0 && first_x + tap_count <= job->width) {
+			const float* source = column_sums + first_x * channel_count;
+			for (int32_t j = 0; j != tap_count; ++j)
+				for (int32_t l = 0; l != channel_count; ++l)
+					pixel[l] += job->float_weights[j] * source[j * channel_count + l];
+		}
+		else {
+			// Wrap around at the border
+			for (int32_t j = 0; j != tap_count; ++j) {
+				const float* source = column_sums + ((first_x + j) & (job->width - 1)) * channel_count;
+				for (int32_t l = 0; l != channel_count; ++l)
+					pixel[l] += job->float_weights[j] * source[l];
+			}
+		}
+		float* mipmap_pixel = mipmap_row + channel_count * x;
+		for (int32_t l = 0; l != channel_count; ++l)
+			mipmap_pixel[l] = pixel[l];
+	}
+}
+
+
+/*! A task for run_parallel() that applies the Gaussian filter for one row of
+	the mipmap described by a mipmap_job_t. The filter is separable, so it
+	first filters vertically along full-resolution columns and then
+	horizontally. The vertical pass dominates the cost, since it runs at full
+	horizontal resolution. It works on contiguous rows with SIMD and only
+	wraps row indices around, not individual taps.*/
+int filter_row_task(void* raw_job, uint32_t row_index) {
+	const mipmap_job_t* job = (const mipmap_job_t*) raw_job;
+	int32_t y = (int32_t) row_index;
+	int32_t tap_count = 2 * job->filter_extent;
+	size_t row_float_count = (size_t) job->width * job->shared_channel_count;
+	// Filter vertically
+	float* column_sums = calloc(row_float_count, sizeof(float));
+	for (int32_t k = 0; k != tap_count; ++k) {
+		int32_t source_y = (y * job->stride + job->offset + k) & (job->height - 1);
+		add_weighted_row(column_sums, job->linear_image + source_y * row_float_count, job->float_weights[k], row_float_count);
+	}
+	// Filter horizontally
+	filter_row_horizontally(job->mipmap + (size_t) y * job->mipmap_width * job->shared_channel_count, column_sums, job);
+	free(column_sums);
+	return 0;
+}
+
+
+/*! Shared state for the filter tasks of the tiled pipeline, which filters a
+	band of consecutive mipmap rows using chunks of consecutive source rows.*/
+typedef struct {
+	//! The mipmap job. Its linear_image is not used and its mipmap holds the
+	//! rows of the band.
+	const mipmap_job_t* job;
+	//! The index of the first mipmap row in the band
+	int32_t band_begin;
+	//! Source rows in linear space from chunk_begin to chunk_end (exclusive).
+	//! These indices are not wrapped around.
+	const float* chunk;
+	int32_t chunk_begin, chunk_end;
+	//! One vertically filtered row at full width per row of the band
+	float* column_sums;
+} band_filter_t;
+
+
+//! A task for run_parallel() that adds the contributions of the current chunk
+//! of a band_filter_t to the vertical filter of one row of the band. Taps are
+//! added in the same order as in filter_row_task().
+int accumulate_band_row_task(void* raw_band, uint32_t row_index) {
+	const band_filter_t* band = (const band_filter_t*) raw_band;
+	const mipmap_job_t* job = band->job;
+	int32_t y = band->band_begin + (int32_t) row_index;
+	size_t row_float_count = (size_t) job->width * job->shared_channel_count;
+	float* column_sums = band->column_sums + row_index * row_float_count;
+	for (int32_t k = 0; k != 2 * job->filter_extent; ++k) {
+		int32_t source_y = y * job->stride + job->offset + k;
+		if (source_y >= band->chunk_begin && source_y < band->chunk_end)
+			add_weighted_row(column_sums, band->chunk + (source_y - band->chunk_begin) * row_float_count, job->float_weights[k], row_float_count);
+	}
+	return 0;
+}
+
+
+//! A task for run_parallel() that applies the horizontal filter to one row of
+//! the band of a band_filter_t, once all chunks have been accumulated
+int filter_band_row_task(void* raw_band, uint32_t row_index) {
+	const band_filter_t* band = (const band_filter_t*) raw_band;
+	const mipmap_job_t* job = band->job;
+	filter_row_horizontally(job->mipmap + (size_t) row_index * job->mipmap_width * job->shared_channel_count,
+		band->column_sums + (size_t) row_index * job->width * job->shared_channel_count, job);
+	return 0;
+}
+
 
-	// Prepare some information about the output format
-	int32_t is_hdr = 0, is_half = 0, is_srgb = 0, is_bc1 = 0, is_8_bit = 0, format_known = 1;
-	size_t block_size = 0;
+//! A task for run_parallel() that quantizes, block compresses and stores one
+//! row of the mipmap described by a mipmap_job_t. For block-compressed
+//! formats, a row consists of blocks, otherwise of pixels.
+int encode_row_task(void* raw_job, uint32_t row_index) {
+	const mipmap_job_t* job = (const mipmap_job_t*) raw_job;
+	const float* mipmap = job->mipmap;
+	int32_t mipmap_width = job->mipmap_width;
+	int32_t shared_channel_count = job->shared_channel_count;
+	uint8_t* destination = job->destination + row_index * job->row_size;
+	if (job->is_bc1) {
+		uint8_t block[4 * 4 * 4] = {0};
+		int32_t y = 4 * (int32_t) row_index;
+		for (int32_t x = 0; x != mipmap_width; x += 4) {
+			// Quantize the block
+			for (int32_t k = 0; k != 4; ++k)
+				for (int32_t j = 0; j != 4; ++j)
+					for (int32_t l = 0; l != 3; ++l)
+						block[(k * 4 + j) * 4 + l] = job->is_srgb ? linear_to_srgb(mipmap[3 * ((y + k) * mipmap_width + x + j) + l])
+															 : quantize_linear(mipmap[3 * ((y + k) * mipmap_width + x + j) + l]);
+			// Apply block compression
+			stb_compress_dxt_block(destination, block, 0, STB_DXT_HIGHQUAL);
+			destination += 8;
+		}
+	}
+	else if (job->format == VK_FORMAT_BC5_UNORM_BLOCK) {
+		uint8_t block[4 * 4 * 2];
+		int32_t y = 4 * (int32_t) row_index;
+		for (int32_t x = 0; x != mipmap_width; x += 4) {
+			// Quantize the block
+			for (int32_t k = 0; k != 4; ++k)
+				for (int32_t j = 0; j != 4; ++j)
+					for (int32_t l = 0; l != 2; ++l)
+						block[(k * 4 + j) * 2 + l] = quantize_linear(mipmap[2 * ((y + k) * mipmap_width + x + j) + l]);
+			// Apply block compression
+			stb_compress_bc5_block(destination, block);
+			destination += 16;
+		}
+	}
+	else if (job->format == VK_FORMAT_BC6H_UFLOAT_BLOCK) {
+		float block[4 * 4][3];
+		int32_t y = 4 * (int32_t) row_index;
+		for (int32_t x = 0; x != mipmap_width; x += 4) {
+			// Gather the block
+			for (int32_t k = 0; k != 4; ++k)
+				for (int32_t j = 0; j != 4; ++j)
+					for (int32_t l = 0; l != 3; ++l)
+						block[k * 4 + j][l] = mipmap[3 * ((y + k) * mipmap_width + x + j) + l];
+			// Apply block compression
+			compress_bc6h_block(destination, (const float (*)[3]) block, job->bc6h_quality);
+			destination += 16;
+		}
+	}
+	else if (job->is_half) {
+		int32_t y = (int32_t) row_index;
+		for (int32_t x = 0; x != mipmap_width; ++x) {
+			uint16_t pixel[4] = {0};
+			for (int32_t l = 0; l != shared_channel_count; ++l)
+				pixel[l] = float_to_half(mipmap[(y * mipmap_width + x) * shared_channel_count + l]);
+			memcpy(destination, pixel, sizeof(uint16_t) * job->channel_count);
+			destination += sizeof(uint16_t) * job->channel_count;
+		}
+	}
+	else if (job->is_hdr)
+		memcpy(destination, mipmap + row_index * mipmap_width * job->channel_count, job->row_size);
+	// Write low-dynamic range formats with 8 bits per pixel
+	else if (job->is_8_bit) {
+		int32_t y = (int32_t) row_index;
+		for (int32_t x = 0; x != mipmap_width; ++x) {
+			uint8_t pixel[4] = { 0, 0, 0, 255 };
+			for (int32_t l = 0; l != shared_channel_count; ++l)
+				pixel[l] = job->is_srgb ? linear_to_srgb(mipmap[shared_channel_count * (y * mipmap_width + x) + l])
+									   : quantize_linear(mipmap[shared_channel_count * (y * mipmap_width + x) + l]);
+			memcpy(destination, pixel, job->bits_per_pixel / 8);
+			destination += job->bits_per_pixel / 8;
+		}
+	}
+	return 0;
+}
+
+
+/*! Properties of an output format that are relevant to the conversion.*/
+typedef struct {
+	//! Boolean flags describing the format
+	int32_t is_hdr, is_half, is_srgb, is_bc1, is_8_bit;
+	//! The size of a 4x4 block in bytes for block-compressed formats, zero
+	//! otherwise
+	size_t block_size;
+	//! The number of bits per pixel
 	size_t bits_per_pixel;
-	int32_t channel_count = 3;
+	//! The number of channels stored in the output
+	int32_t channel_count;
+} format_description_t;
+
+
+/*! Describes the given output format.
+	\param description The output.
+	\param format The format to describe.
+	\return 0 if the format is supported, 1 otherwise.*/
+int describe_format(format_description_t* description, vk_format_t format) {
+	format_description_t default_description = { .channel_count = 3 };
+	(*description) = default_description;
 	switch (format) {
 	case VK_FORMAT_R8_SRGB:
-		is_srgb = 1;
+		description->is_srgb = 1;
 	case VK_FORMAT_R8_UNORM:
 	case VK_FORMAT_R8_SNORM:
 	case VK_FORMAT_R8_UINT:
 	case VK_FORMAT_R8_SINT:
-		channel_count = 1;
-		bits_per_pixel = 8;
-		is_8_bit = 1;
+		description->channel_count = 1;
+		description->bits_per_pixel = 8;
+		description->is_8_bit = 1;
 		break;
 	case VK_FORMAT_R8G8_SRGB:
-		is_srgb = 1;
+		description->is_srgb = 1;
 	case VK_FORMAT_R8G8_UNORM:
 	case VK_FORMAT_R8G8_SNORM:
 	case VK_FORMAT_R8G8_UINT:
 	case VK_FORMAT_R8G8_SINT:
-		channel_count = 2;
-		bits_per_pixel = 16;
-		is_8_bit = 1;
+		description->channel_count = 2;
+		description->bits_per_pixel = 16;
+		description->is_8_bit = 1;
 		break;
 	case VK_FORMAT_R8G8B8A8_SRGB:
-		is_srgb = 1;
+		description->is_srgb = 1;
 	case VK_FORMAT_R8G8B8A8_UNORM:
 	case VK_FORMAT_R8G8B8A8_SNORM:
 	case VK_FORMAT_R8G8B8A8_UINT:
 	case VK_FORMAT_R8G8B8A8_SINT:
-		channel_count = 4;
-		bits_per_pixel = 32;
-		is_8_bit = 1;
+		description->channel_count = 4;
+		description->bits_per_pixel = 32;
+		description->is_8_bit = 1;
 		break;
 	case VK_FORMAT_R16G16B16A16_SFLOAT:
-		channel_count = 4;
-		bits_per_pixel = 64;
-		is_hdr = 1;
-		is_half = 1;
+		description->channel_count = 4;
+		description->bits_per_pixel = 64;
+		description->is_hdr = 1;
+		description->is_half = 1;
 		break;
 	case VK_FORMAT_R16G16B16_SFLOAT:
-		channel_count = 3;
-		bits_per_pixel = 48;
-		is_hdr = 1;
-		is_half = 1;
+		description->channel_count = 3;
+		description->bits_per_pixel = 48;
+		description->is_hdr = 1;
+		description->is_half = 1;
 		break;
 	case VK_FORMAT_R32G32B32A32_SFLOAT:
-		channel_count = 4;
-		bits_per_pixel = 128;
-		is_hdr = 1;
+		description->channel_count = 4;
+		description->bits_per_pixel = 128;
+		description->is_hdr = 1;
 		break;
 	case VK_FORMAT_R32G32B32_SFLOAT:
-		channel_count = 3;
-		bits_per_pixel = 96;
-		is_hdr = 1;
+		description->channel_count = 3;
+		description->bits_per_pixel = 96;
+		description->is_hdr = 1;
 		break;
 	case VK_FORMAT_BC5_UNORM_BLOCK:
-		block_size = 16;
-		bits_per_pixel = 8;
-		channel_count = 2;
+		description->block_size = 16;
+		description->bits_per_pixel = 8;
+		description->channel_count = 2;
+		break;
+	case VK_FORMAT_BC6H_UFLOAT_BLOCK:
+		description->block_size = 16;
+		description->bits_per_pixel = 8;
+		description->is_hdr = 1;
 		break;
 	case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
-		is_srgb = 1;
+		description->is_srgb = 1;
 	case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
-		bits_per_pixel = 4;
-		block_size = 8;
-		is_bc1 = 1;
+		description->bits_per_pixel = 4;
+		description->block_size = 8;
+		description->is_bc1 = 1;
 		break;
 	default:
-		format_known = 0;
-		break;
+		return 1;
 	}
-	if (argc < 4 || !format_known) {
-		printf("Usage: texture_compression <vk_format> <input_file_path> <output_file_path>\n");
-		printf("vk_format can be one of the following integer values from the VkFormat enumeration in Vulkan:\n\
-VK_FORMAT_R8_UNORM = 9\n\
-VK_FORMAT_R8_SNORM = 10\n\
-VK_FORMAT_R8_UINT = 13\n\
-VK_FORMAT_R8_SINT = 14\n\
-VK_FORMAT_R8_SRGB = 15\n\
-VK_FORMAT_R8G8_UNORM = 16\n\
-VK_FORMAT_R8G8_SNORM = 17\n\
-VK_FORMAT_R8G8_UINT = 20\n\
-VK_FORMAT_R8G8_SINT = 21\n\
-VK_FORMAT_R8G8_SRGB = 22\n\
-VK_FORMAT_R8G8B8A8_UNORM = 37\n\
-VK_FORMAT_R8G8B8A8_SNORM = 38\n\
-VK_FORMAT_R8G8B8A8_UINT = 41\n\
-VK_FORMAT_R8G8B8A8_SINT = 42\n\
-VK_FORMAT_R8G8B8A8_SRGB = 43\n\
-VK_FORMAT_R16G16B16_SFLOAT = 90\n\
-VK_FORMAT_R16G16B16A16_SFLOAT = 97\n\
-VK_FORMAT_R32G32B32_SFLOAT = 106\n\
-VK_FORMAT_R32G32B32A32_SFLOAT = 109\n\
-VK_FORMAT_BC1_RGB_UNORM_BLOCK = 131\n\
-VK_FORMAT_BC1_RGB_SRGB_BLOCK = 132\n\
-VK_FORMAT_BC5_UNORM_BLOCK = 141\n");
-		printf("For a list of supported input file formats, see:\n");
-		printf("https://github.com/nothings/stb/blob/master/stb_image.h\n");
-		printf("The output format is *.vkt, which is a renderer specific format with mipmaps (similar to *.dds).\n");
+	return 0;
+}
+
+
+/*! Source images whose copy in linear space would take more bytes than this
+	are processed by the tiled pipeline, even without -tiled.*/
+#define TILED_PIPELINE_THRESHOLD ((size_t) 1 << 30)
+
+
+/*! The size in bytes of the buffers for source rows in linear space and for
+	vertically filtered rows in the tiled pipeline. Peak memory use of the
+	tiled pipeline is dominated by the loaded source image and a few of these
+	buffers.*/
+#define TILED_BAND_SIZE ((size_t) 32 << 20)
+
+
+//! Frees the pixels of the given source image and sets them to NULL
+void free_source_image(source_image_t* source) {
+	stbi_image_free(source->hdr_pixels);
+	stbi_image_free(source->ldr_pixels);
+	source->hdr_pixels = NULL;
+	source->ldr_pixels = NULL;
+}
+
+
+/*! Prepares the normalized Gaussian filter for the mipmap with the given
+	index and stores it in the given job.
+	\param job The job for the mipmap. The extent of the source image must be
+		set already.
+	\param mipmap_index The index of the mipmap, at least one.
+	\param filter_weights, float_weights Receive arrays that the job
+		references. Free them once the job is done.*/
+void prepare_filter(mipmap_job_t* job, int32_t mipmap_index, double** filter_weights, float** float_weights) {
+	int32_t filter_scale = (1 << mipmap_index);
+	job->stride = filter_scale;
+	double standard_deviation = 0.4 * filter_scale;
+	double gaussian_factor = -0.5 / (standard_deviation * standard_deviation);
+	int32_t filter_extent = job->filter_extent = (int32_t) ceil(3.0 * standard_deviation);
+	double filter_center = filter_extent - 0.5;
+	(*filter_weights) = malloc(2 * filter_extent * sizeof(double));
+	for (int32_t j = 0; j != 2 * filter_extent; ++j)
+		(*filter_weights)[j] = exp(gaussian_factor * (j - filter_center) * (j - filter_center));
+	double total_weight = 0.0;
+	for (int32_t j = 0; j != 2 * filter_extent; ++j)
+		for (int32_t k = 0; k != 2 * filter_extent; ++k)
+			total_weight += (*filter_weights)[j] * (*filter_weights)[k];
+	double normalization = 1.0 / sqrt(total_weight);
+	(*float_weights) = malloc(2 * filter_extent * sizeof(float));
+	for (int32_t j = 0; j != 2 * filter_extent; ++j) {
+		(*filter_weights)[j] *= normalization;
+		(*float_weights)[j] = (float) (*filter_weights)[j];
+	}
+	job->filter_weights = *filter_weights;
+	job->float_weights = *float_weights;
+	job->offset = job->stride / 2 - filter_extent;
+}
+
+
+/*! Generates all mipmaps from the complete source image in linear space,
+	encodes them into a payload in memory and writes it.
+	\param file The output file, positioned where the payload begins.
+	\param shared_job Settings shared by all mipmaps, including linear_image.
+		Settings that are specific to a mipmap are ignored.
+	\param mipmap_headers, mipmap_count The mipmaps to write.
+	\param payload_size The size of the payload in bytes, including padding.
+	\param block_size See format_description_t.
+	\param compress 1 to compress the payload using zlib. The payload must not
+		be aligned.
+	\param benchmark 1 to compare the filter to the reference filter and print
+		timings.
+	\param thread_count The maximal number of threads to use or 0 to use all
+		logical processors.
+	\return 0 upon success.*/
+int write_mipmaps(FILE* file, const mipmap_job_t* shared_job, const mipmap_header_t* mipmap_headers, int32_t mipmap_count, size_t payload_size, size_t block_size, int32_t compress, int32_t benchmark, uint32_t thread_count) {
+	int32_t width = shared_job->width, height = shared_job->height;
+	int32_t shared_channel_count = shared_job->shared_channel_count;
+	// All mipmaps are encoded into this payload in memory and then written at
+	// once. Padding between mipmaps stays zero.
+	uint8_t* payload = calloc(payload_size ? payload_size : 1, 1);
+	// Allocate scratch memory for the largest mipmap (it will be used for all
+	// of them). Mipmaps are not derived from the previous level, because
+	// each level applies a Gaussian to the full-resolution image and
+	// filtering an already decimated level would not be equivalent.
+	size_t linear_mipmap_size = ((sizeof(float) * width * height) / 4) * shared_channel_count;
+	float* linear_mipmap = malloc(linear_mipmap_size);
+	float* reference_mipmap = benchmark ? malloc(linear_mipmap_size) : NULL;
+	// Generate mipmaps
+	int32_t result = 0;
+	for (int32_t i = 0; i != mipmap_count && !result; ++i) {
+		mipmap_job_t job = (*shared_job);
+		job.mipmap_width = width >> i;
+		job.mipmap_height = height >> i;
+		job.destination = payload + mipmap_headers[i].offset;
+		// For the highest resolution mipmap, we skip filtering
+		double* filter_weights = NULL;
+		float* float_weights = NULL;
+		if (job.mipmap_width == width)
+			job.mipmap = (float*) job.linear_image;
+		else {
+			job.mipmap = linear_mipmap;
+			prepare_filter(&job, i, &filter_weights, &float_weights);
+			// Each row of output pixels is computed independently
+			double filter_begin = get_time();
+			result = run_parallel(&filter_row_task, &job, (uint32_t) job.mipmap_height, thread_count);
+			double filter_time = get_time() - filter_begin;
+			if (benchmark && !result) {
+				mipmap_job_t reference_job = job;
+				reference_job.mipmap = reference_mipmap;
+				double reference_begin = get_time();
+				result = run_parallel(&reference_filter_row_task, &reference_job, (uint32_t) job.mipmap_height, thread_count);
+				double reference_time = get_time() - reference_begin;
+				float max_error = 0.0f;
+				size_t float_count = (size_t) job.mipmap_width * job.mipmap_height * shared_channel_count;
+				for (size_t j = 0; j != float_count; ++j) {
+					float error = fabsf(job.mipmap[j] - reference_mipmap[j]);
+					max_error = (error > max_error) ? error : max_error;
+				}
+				printf("Mipmap %2d (%5dx%5d, %3d taps): separable %9.3f ms, reference %9.3f ms, max. error %.3e\n",
+					i, job.mipmap_width, job.mipmap_height, 2 * job.filter_extent, filter_time * 1.0e3, reference_time * 1.0e3, max_error);
+			}
+		}
+		// Quantize, apply block compression and store. Block-compressed
+		// formats are handled one row of blocks at a time.
+		uint32_t row_count = (uint32_t) (block_size ? (job.mipmap_height / 4) : job.mipmap_height);
+		job.row_size = mipmap_headers[i].size / row_count;
+		if (!result)
+			result = run_parallel(&encode_row_task, &job, row_count, thread_count);
+		free(filter_weights);
+		free(float_weights);
+	}
+	free(linear_mipmap);
+	free(reference_mipmap);
+	if (result) {
+		printf("Failed to generate and encode mipmaps.\n");
+		free(payload);
+		return 1;
+	}
+	// Write the payload, possibly compressed
+	if (compress)
+		result = write_compressed_payload(file, payload, mipmap_headers, mipmap_count, thread_count);
+	else if (fwrite(payload, 1, payload_size, file) != payload_size) {
+		printf("Failed to write the payload.\n");
+		result = 1;
+	}
+	free(payload);
+	return result;
+}
+
+
+/*! Like write_mipmaps() but the source image is never converted to linear
+	space as a whole. Instead, each mipmap is produced in bands of rows. The
+	vertical filter for a band accumulates chunks of source rows, which are
+	converted on the fly, including the margins needed by the filter. Encoded
+	bands are written right away. Thus, memory use is bounded by
+	TILED_BAND_SIZE rather than the image size (besides the loaded source
+	image). Filter taps are applied in the same order as in write_mipmaps(),
+	so the output is identical.
+	\param source The loaded source image.
+	\param shared_job As for write_mipmaps() but linear_image is ignored.
+	\see write_mipmaps() for other parameters */
+int write_mipmaps_tiled(FILE* file, const source_image_t* source, const mipmap_job_t* shared_job, const mipmap_header_t* mipmap_headers, int32_t mipmap_count, size_t payload_size, size_t block_size, int32_t compress, uint32_t thread_count) {
+	int32_t width = shared_job->width, height = shared_job->height;
+	size_t row_float_count = (size_t) width * shared_job->shared_channel_count;
+	// Bands have the same number of rows as chunks. It is a multiple of four,
+	// such that bands consist of whole rows of blocks.
+	int32_t band_capacity = (int32_t) (TILED_BAND_SIZE / (row_float_count * sizeof(float)));
+	band_capacity = (band_capacity < 4) ? 4 : (band_capacity & ~3);
+	if (band_capacity > height)
+		band_capacity = (height < 4) ? height : (height & ~3);
+	float* chunk = malloc(band_capacity * row_float_count * sizeof(float));
+	float* column_sums = malloc(band_capacity * row_float_count * sizeof(float));
+	float* band_mipmap = malloc(band_capacity * (row_float_count / 2 + 1) * sizeof(float));
+	uint8_t* band_payload = malloc(band_capacity * ((width * shared_job->bits_per_pixel + 7) / 8));
+	payload_stream_t stream;
+	int32_t result = begin_payload_stream(&stream, file, mipmap_headers, mipmap_count, compress, thread_count);
+	for (int32_t i = 0; i != mipmap_count && !result; ++i) {
+		mipmap_job_t job = (*shared_job);
+		job.linear_image = NULL;
+		job.mipmap_width = width >> i;
+		job.mipmap_height = height >> i;
+		job.destination = band_payload;
+		double* filter_weights = NULL;
+		float* float_weights = NULL;
+		if (i > 0)
+			prepare_filter(&job, i, &filter_weights, &float_weights);
+		int32_t block_height = block_size ? 4 : 1;
+		job.row_size = mipmap_headers[i].size / (uint32_t) (job.mipmap_height / block_height);
+		for (int32_t band_begin = 0; band_begin < job.mipmap_height && !result; band_begin += band_capacity) {
+			int32_t band_row_count = job.mipmap_height - band_begin;
+			band_row_count = (band_row_count < band_capacity) ? band_row_count : band_capacity;
+			row_conversion_t conversion = { .source = source, .linear_rows = chunk };
+			if (i == 0) {
+				// The highest resolution mipmap is just the converted source
+				conversion.first_row = band_begin;
+				result = run_parallel(&convert_row_task, &conversion, (uint32_t) band_row_count, thread_count);
+				job.mipmap = chunk;
+			}
+			else {
+				// Iterate over chunks of source rows in the footprint of the
+				// filter for this band
+				band_filter_t band = { .job = &job, .band_begin = band_begin, .chunk = chunk, .column_sums = column_sums };
+				memset(column_sums, 0, band_row_count * row_float_count * sizeof(float));
+				int32_t footprint_begin = band_begin * job.stride + job.offset;
+				int32_t footprint_end = (band_begin + band_row_count - 1) * job.stride + job.offset + 2 * job.filter_extent;
+				for (int32_t chunk_begin = footprint_begin; chunk_begin < footprint_end && !result; chunk_begin += band_capacity) {
+					band.chunk_begin = conversion.first_row = chunk_begin;
+					band.chunk_end = chunk_begin + band_capacity;
+					band.chunk_end = (band.chunk_end < footprint_end) ? band.chunk_end : footprint_end;
+					result = run_parallel(&convert_row_task, &conversion, (uint32_t) (band.chunk_end - chunk_begin), thread_count);
+					if (!result)
+						result = run_parallel(&accumulate_band_row_task, &band, (uint32_t) band_row_count, thread_count);
+				}
+				job.mipmap = band_mipmap;
+				if (!result)
+					result = run_parallel(&filter_band_row_task, &band, (uint32_t) band_row_count, thread_count);
+			}
+			// Encode the band and write it
+			uint32_t row_count = (uint32_t) (band_row_count / block_height);
+			if (!result)
+				result = run_parallel(&encode_row_task, &job, row_count, thread_count);
+			if (!result)
+				result = stream_payload(&stream, band_payload, row_count * job.row_size, band_begin + band_row_count == job.mipmap_height);
+		}
+		// Pad the mipmap (only in aligned files, which are never compressed)
+		size_t padded_end = (i + 1 < mipmap_count) ? mipmap_headers[i + 1].offset : payload_size;
+		if (!result && !compress)
+			result = write_zeros(file, padded_end - mipmap_headers[i].offset - mipmap_headers[i].size);
+		free(filter_weights);
+		free(float_weights);
+	}
+	result |= end_payload_stream(&stream);
+	if (result)
+		printf("Failed to generate, encode and write mipmaps in bands.\n");
+	free(chunk);
+	free(column_sums);
+	free(band_mipmap);
+	free(band_payload);
+	return result;
+}
+
+
+/*! Converts a single texture to a *.vkt file with mipmaps.
+	\param output_file_path The path of the *.vkt file to write.
+	\param input_file_path The path of an image file that stb_image can load.
+	\param format The output format.
+	\param compress 1 to compress the payload using zlib.
+	\param align 1 to align the payload and mipmaps as described for
+		ALIGNED_PAYLOAD_ALIGNMENT (ignored if compress is 1).
+	\param bc6h_quality The quality setting for BC6H compression (ignored for
+		other formats).
+	\param tiled 1 to use write_mipmaps_tiled(). It is also used if the image
+		in linear space would exceed TILED_PIPELINE_THRESHOLD.
+	\param benchmark 1 to compare the filter to the reference filter and print
+		timings. It needs the whole image in linear space, so it overrides
+		tiled.
+	\param thread_count The maximal number of threads to use or 0 to use all
+		logical processors.
+	\return 0 upon success.*/
+int convert_texture(const char* output_file_path, const char* input_file_path, vk_format_t format, int32_t compress, int32_t align, bc6h_quality_t bc6h_quality, int32_t tiled, int32_t benchmark, uint32_t thread_count) {
+	format_description_t description;
+	if (describe_format(&description, format)) {
+		printf("The format %d is not supported.\n", (int) format);
 		return 1;
 	}
-	const char* input_file_path = argv[argc - 2];
-	const char* output_file_path = argv[argc - 1];
+	int32_t is_hdr = description.is_hdr, is_half = description.is_half, is_srgb = description.is_srgb;
+	int32_t is_bc1 = description.is_bc1, is_8_bit = description.is_8_bit;
+	size_t block_size = description.block_size;
+	size_t bits_per_pixel = description.bits_per_pixel;
+	int32_t channel_count = description.channel_count;
 
-	// Prepare the image
+	// Open the image
 	int32_t width, height, input_channel_count, pixel_count;
 	int32_t shared_channel_count = channel_count;
-	float* linear_image;
+	source_image_t source = { .hdr_pixels = NULL };
 	if (is_hdr) {
-		// Open the image
-		linear_image = stbi_loadf(input_file_path, &width, &height, &input_channel_count, channel_count);
+		source.hdr_pixels = stbi_loadf(input_file_path, &width, &height, &input_channel_count, channel_count);
 		input_channel_count = channel_count;
-		if (!linear_image) {
+		if (!source.hdr_pixels) {
 			printf("Failed to load the HDR image at path %s.\n", input_file_path);
 			return 1;
 		}
-		pixel_count = width * height;
 	}
 	else {
-		// Open the image
-		uint8_t* loaded_image = stbi_load(input_file_path, &width, &height, &input_channel_count, 0);
-		if (!loaded_image) {
+		source.ldr_pixels = stbi_load(input_file_path, &width, &height, &input_channel_count, 0);
+		if (!source.ldr_pixels) {
 			printf("Failed to load the image at path %s.\n", input_file_path);
 			return 1;
 		}
 		if (shared_channel_count > input_channel_count)
 			shared_channel_count = input_channel_count;
-		// Convert to linear RGB and discard superfluous channels
-		pixel_count = width * height;
-		linear_image = malloc(pixel_count * shared_channel_count * sizeof(float));
-		if (is_srgb)
-			for (int32_t i = 0; i != pixel_count; ++i)
-				for (int32_t j = 0; j != shared_channel_count; ++j)
-					linear_image[i * shared_channel_count + j] = srgb_to_linear(loaded_image[i * input_channel_count + j]);
-		else
-			for (int32_t i = 0; i != pixel_count; ++i)
-				for (int32_t j = 0; j != shared_channel_count; ++j)
-					linear_image[i * shared_channel_count + j] = loaded_image[i * input_channel_count + j] * (1.0f / 255.0f);
-		// We no longer need the LDR image
-		stbi_image_free(loaded_image);
-		loaded_image = NULL;
+		for (int32_t i = 0; i != 256; ++i)
+			source.ldr_to_linear[i] = is_srgb ? srgb_to_linear((uint8_t) i) : i * (1.0f / 255.0f);
 	}
+	source.width = width;
+	source.height = height;
+	source.channel_count = input_channel_count;
+	source.shared_channel_count = shared_channel_count;
+	pixel_count = width * height;
 
 	// Check the channel count
 	if (input_channel_count < channel_count && !is_8_bit) {
 		printf("The image at path %s has %d channels but needs to have at least %d.\n", input_file_path, input_channel_count, channel_count);
-		free(linear_image);
+		free_source_image(&source);
 		return 1;
 	}
 	// Determine how many mipmaps we need (we do not go all the way to 1x1 if
@@ -284,10 +1110,30 @@ VK_FORMAT_BC5_UNORM_BLOCK = 141\n");
 	// The image must have power of two size
 	if (width != (1 << (mipmap_count_width - 1)) || height != (1 << (mipmap_count_height - 1))) {
 		printf("The image at path %s has extent %dx%d but it must be a power of two for both dimensions.\n", input_file_path, width, height);
-		free(linear_image);
+		free_source_image(&source);
 		return 1;
 	}
 
+	// Convert the whole image to linear RGB and discard superfluous channels,
+	// unless the tiled pipeline handles it band by band. HDR images are
+	// loaded in linear space already.
+	size_t linear_image_size = sizeof(float) * (size_t) pixel_count * shared_channel_count;
+	tiled = (tiled || linear_image_size > TILED_PIPELINE_THRESHOLD) && !benchmark && pixel_count > 1;
+	float* linear_image = NULL;
+	if (!tiled) {
+		if (is_hdr) {
+			linear_image = source.hdr_pixels;
+			source.hdr_pixels = NULL;
+		}
+		else {
+			linear_image = malloc(linear_image_size);
+			row_conversion_t conversion = { .source = &source, .first_row = 0, .linear_rows = linear_image };
+			run_parallel(&convert_row_task, &conversion, (uint32_t) height, thread_count);
+		}
+		// We no longer need the loaded image
+		free_source_image(&source);
+	}
+
 	if (block_size) {
 		// Block compression only goes down to 4x4 blocks
 		mipmap_count -= 2;
@@ -308,6 +1154,7 @@ VK_FORMAT_BC5_UNORM_BLOCK = 141\n");
 		if (width < 4 || height < 4) {
 			printf("The image at path %s has extent %dx%d but it must be at least 4x4 for block compression to work.\n", input_file_path, width, height);
 			free(linear_image);
+			free_source_image(&source);
 			return 1;
 		}
 	}
@@ -317,158 +1164,811 @@ VK_FORMAT_BC5_UNORM_BLOCK = 141\n");
 	if (!file) {
 		printf("Failed to open the output file: %s\n", output_file_path);
 		free(linear_image);
+		free_source_image(&source);
 		return 1;
 	}
+	// Lay out the mipmaps. In aligned files, they begin at aligned offsets.
+	int32_t aligned = (get_file_version(compress, align) == 3);
+	mipmap_header_t* mipmap_headers = calloc(mipmap_count, sizeof(mipmap_header_t));
+	size_t mipmap_offset = 0;
+	for (int32_t i = 0; i != mipmap_count; ++i) {
+		mipmap_header_t mipmap_header = { .width = width >> i, .height = height >> i };
+		mipmap_header.size = (mipmap_header.width * mipmap_header.height * bits_per_pixel) / 8;
+		mipmap_header.offset = mipmap_offset;
+		mipmap_offset += mipmap_header.size;
+		if (aligned)
+			mipmap_offset = align_payload_size(mipmap_offset);
+		mipmap_headers[i] = mipmap_header;
+	}
 	// Write the header
 	texture_file_header_t header = {
 		.file_marker = 0xbc1bc1,
-		.version = 1,
+		.version = get_file_version(compress, align),
 		.mipmap_count = mipmap_count,
 		.width = width, .height = height,
-		.format = (int32_t) format
+		.format = (int32_t) format,
+		.payload_size = mipmap_offset,
 	};
-	for (int32_t i = 0; i != mipmap_count; ++i) {
-		mipmap_header_t mipmap_header = { .width = width >> i, .height = height >> i };
-		header.payload_size += (mipmap_header.width * mipmap_header.height * bits_per_pixel) / 8;
-	}
 	fwrite((void*) &header, sizeof(int32_t), 8, file);
 	// Write meta data about each mipmap (even though it is redundant)
-	size_t mipmap_offset = 0;
-	for (int32_t i = 0; i != mipmap_count; ++i) {
-		mipmap_header_t mipmap_header = { .width = width >> i, .height = height >> i };
-		mipmap_header.size = (mipmap_header.width * mipmap_header.height * bits_per_pixel) / 8;
-		mipmap_header.offset = mipmap_offset;
-		mipmap_offset += mipmap_header.size;
-		fwrite((void*) &mipmap_header, sizeof(mipmap_header), 1, file);
+	fwrite(mipmap_headers, sizeof(mipmap_header_t), mipmap_count, file);
+	if (aligned)
+		write_zeros(file, align_payload_size(ftell(file)) - ftell(file));
+	// stb_dxt initializes its tables lazily, which is not thread safe
+	if (block_size) {
+		uint8_t dummy_block[4 * 4 * 4] = {0}, dummy_compressed[8];
+		stb_compress_dxt_block(dummy_compressed, dummy_block, 0, STB_DXT_HIGHQUAL);
 	}
 
-	// Allocate scratch memory for the largest mipmap (it will be used for all
-	// of them)
-	float* linear_mipmap = malloc(((sizeof(float) * width * height) / 4) * shared_channel_count);
-	// Generate mipmaps
-	for (int32_t i = 0; i != mipmap_count; ++i) {
-		int32_t mipmap_width = width >> i;
-		int32_t mipmap_height = height >> i;
-		// For the highest resolution mipmap, we skip filtering
-		float* mipmap;
-		if (mipmap_width == width)
-			mipmap = linear_image;
-		else {
-			mipmap = linear_mipmap;
-			// Prepare the normalized Gaussian filter
-			int32_t filter_scale = (1 << i);
-			int32_t stride = filter_scale;
-			double standard_deviation = 0.4 * filter_scale;
-			double gaussian_factor = -0.5 / (standard_deviation * standard_deviation);
-			int32_t filter_extent = (int32_t) ceil(3.0 * standard_deviation);
-			double filter_center = filter_extent - 0.5;
-			double* filter_weights = malloc(2 * filter_extent * sizeof(double));
-			for (int32_t j = 0; j != 2 * filter_extent; ++j)
-				filter_weights[j] = exp(gaussian_factor * (j - filter_center) * (j - filter_center));
-			double total_weight = 0.0;
-			for (int32_t j = 0; j != 2 * filter_extent; ++j)
-				for (int32_t k = 0; k != 2 * filter_extent; ++k)
-					total_weight += filter_weights[j] * filter_weights[k];
-			double normalization = 1.0 / sqrt(total_weight);
-			for (int32_t j = 0; j != 2 * filter_extent; ++j)
-				filter_weights[j] *= normalization;
-			int32_t offset = stride / 2 - filter_extent;
-			// Iterate over output pixels
-			int32_t mask_x = width - 1;
-			int32_t mask_y = height - 1;
-			for (int32_t y = 0; y != mipmap_height; ++y) {
-				for (int32_t x = 0; x != mipmap_width; ++x) {
-					double pixel[4] = { 0.0, 0.0, 0.0, 0.0 };
-					// Iterate over the filter footprint
-					for (int32_t k = 0; k != 2 * filter_extent; ++k) {
-						for (int32_t j = 0; j != 2 * filter_extent; ++j) {
-							int32_t source_x = x * stride + offset + j;
-							source_x &= mask_x;
-							int32_t source_y = y * stride + offset + k;
-							source_y &= mask_y;
-							int32_t pixel_start = shared_channel_count * (source_y * width + source_x);
-							double weight = filter_weights[j] * filter_weights[k];
-							for (int32_t l = 0; l != shared_channel_count; ++l)
-								pixel[l] += weight * linear_image[pixel_start + l];
-						}
-					}
-					// Cast the pixel to float
-					float* mipmap_pixel = mipmap + shared_channel_count * (y * mipmap_width + x);
-					for (int32_t l = 0; l != shared_channel_count; ++l)
-						mipmap_pixel[l] = (float) pixel[l];
-				}
-			}
-			free(filter_weights);
+	// Generate, encode and write mipmaps
+	mipmap_job_t shared_job = {
+		.linear_image = linear_image,
+		.width = width, .height = height,
+		.shared_channel_count = shared_channel_count,
+		.format = format,
+		.is_srgb = is_srgb, .is_bc1 = is_bc1, .is_half = is_half, .is_hdr = is_hdr, .is_8_bit = is_8_bit,
+		.channel_count = channel_count,
+		.bits_per_pixel = bits_per_pixel,
+		.bc6h_quality = bc6h_quality,
+	};
+	int32_t result;
+	if (tiled)
+		result = write_mipmaps_tiled(file, &source, &shared_job, mipmap_headers, mipmap_count, header.payload_size, block_size, compress, thread_count);
+	else
+		result = write_mipmaps(file, &shared_job, mipmap_headers, mipmap_count, header.payload_size, block_size, compress, benchmark, thread_count);
+	// Write an end of file marker
+	int32_t eof = 0xe0fe0f;
+	fwrite((void*) &eof, sizeof(eof), 1, file);
+	// Clean up
+	fclose(file);
+	free(mipmap_headers);
+	free(linear_image);
+	free_source_image(&source);
+	return result;
+}
+
+
+/*! A single texture that is to be converted as part of a batch.*/
+typedef struct {
+	//! The paths of the input image and the output *.vkt file (owned)
+	char* input_file_path;
+	char* output_file_path;
+	//! The output format
+	vk_format_t format;
+	//! The size of the input file in bytes (used for scheduling)
+	uint64_t input_size;
+	//! A hash of the input file or zero if it is unknown
+	uint64_t input_hash;
+	//! 1 if the output is up to date and conversion is skipped
+	int32_t skip;
+	//! The result of checking and converting this texture (0 upon success)
+	int32_t result;
+} conversion_job_t;
+
+
+/*! An entry of the cache file that records for each output file how it has
+	been produced. The cache file holds one line per entry with the hash of
+	the input file in hexadecimal, the format, the file format version, the BC6H
+	quality and the output path.*/
+typedef struct {
+	//! The path of the output file (owned)
+	char* output_file_path;
+	//! Hash of the input file at the time of conversion or zero if unknown
+	uint64_t input_hash;
+	//! The settings used for the conversion
+	int32_t format, version, bc6h_quality;
+} cache_entry_t;
+
+
+//! A batch of conversion jobs along with shared settings
+typedef struct {
+	//! The jobs in this batch
+	conversion_job_t* jobs;
+	uint32_t job_count;
+	//! Cache entries from the previous run, sorted by output path
+	cache_entry_t* cache_entries;
+	uint32_t cache_entry_count;
+	//! 1 to compress all outputs using zlib
+	int32_t compress;
+	//! 1 to align the payloads of all outputs (unless they are compressed)
+	int32_t align;
+	//! The quality setting for all outputs using BC6H
+	bc6h_quality_t bc6h_quality;
+	//! 1 to convert all textures, even if they are up to date
+	int32_t force;
+	//! 1 to use the tiled pipeline for all textures
+	int32_t tiled;
+} batch_t;
+
+
+//! Frees all memory held by the given batch and zeros it
+void free_batch(batch_t* batch) {
+	for (uint32_t i = 0; i != batch->job_count; ++i) {
+		free(batch->jobs[i].input_file_path);
+		free(batch->jobs[i].output_file_path);
+	}
+	free(batch->jobs);
+	for (uint32_t i = 0; i != batch->cache_entry_count; ++i)
+		free(batch->cache_entries[i].output_file_path);
+	free(batch->cache_entries);
+	memset(batch, 0, sizeof(*batch));
+}
+
+
+//! Returns a copy of the given string, which has to be freed
+char* copy_string(const char* string) {
+	size_t size = strlen(string) + 1;
+	char* copy = malloc(size);
+	memcpy(copy, string, size);
+	return copy;
+}
+
+
+//! Returns the concatenation of the given strings, which has to be freed
+char* concatenate_strings(const char* lhs, const char* rhs) {
+	size_t lhs_length = strlen(lhs), rhs_length = strlen(rhs);
+	char* result = malloc(lhs_length + rhs_length + 1);
+	memcpy(result, lhs, lhs_length);
+	memcpy(result + lhs_length, rhs, rhs_length + 1);
+	return result;
+}
+
+
+//! Removes trailing line breaks and other white space from the given string
+void trim_line(char* line) {
+	size_t length = strlen(line);
+	while (length > 0 && (line[length - 1] == '\n' || line[length - 1] == '\r' || line[length - 1] == ' ' || line[length - 1] == '\t'))
+		line[--length] = 0;
+}
+
+
+/*! Appends a conversion job to the given batch.
+	\param batch The batch to modify.
+	\param input_file_path, output_file_path Copied to the job.
+	\param format The output format.*/
+void add_conversion_job(batch_t* batch, const char* input_file_path, const char* output_file_path, vk_format_t format) {
+	batch->jobs = realloc(batch->jobs, (batch->job_count + 1) * sizeof(conversion_job_t));
+	conversion_job_t job = {
+		.input_file_path = copy_string(input_file_path),
+		.output_file_path = copy_string(output_file_path),
+		.format = format,
+	};
+	batch->jobs[batch->job_count++] = job;
+}
+
+
+/*! Reads a manifest file with one line per texture. Each line holds the
+	format, the input path and the output path, separated by tabs. Empty lines
+	and lines starting with # are ignored.
+	\return 0 upon success.*/
+int read_manifest(batch_t* batch, const char* manifest_file_path) {
+	FILE* file = fopen(manifest_file_path, "r");
+	if (!file) {
+		printf("Failed to open the manifest file %s.\n", manifest_file_path);
+		return 1;
+	}
+	char line[4096];
+	uint32_t line_index = 0;
+	while (fgets(line, sizeof(line), file)) {
+		++line_index;
+		trim_line(line);
+		if (line[0] == 0 || line[0] == '#')
+			continue;
+		char* input_file_path = strchr(line, '\t');
+		char* output_file_path = input_file_path ? strchr(input_file_path + 1, '\t') : NULL;
+		int32_t format_int = 0;
+		format_description_t description;
+		if (!output_file_path || sscanf(line, "%d", &format_int) != 1 || describe_format(&description, (vk_format_t) format_int)) {
+			printf("Line %u of the manifest file %s is invalid. Expected <vk_format>\\t<input_file_path>\\t<output_file_path>.\n", line_index, manifest_file_path);
+			fclose(file);
+			return 1;
 		}
+		(*input_file_path++) = 0;
+		(*output_file_path++) = 0;
+		add_conversion_job(batch, input_file_path, output_file_path, (vk_format_t) format_int);
+	}
+	fclose(file);
+	return 0;
+}
 
-		// Quantize, apply block compression and store
-		if (is_bc1) {
-			uint8_t block[4 * 4 * 4] = {0}, compressed[8];
-			// Iterate over blocks
-			for (int32_t y = 0; y != mipmap_height; y += 4) {
-				for (int32_t x = 0; x != mipmap_width; x += 4) {
-					// Quantize the block
-					for (int32_t k = 0; k != 4; ++k)
-						for (int32_t j = 0; j != 4; ++j)
-							for (int32_t l = 0; l != 3; ++l)
-								block[(k * 4 + j) * 4 + l] = is_srgb ? linear_to_srgb(mipmap[3 * ((y + k) * mipmap_width + x + j) + l])
-																	: quantize_linear(mipmap[3 * ((y + k) * mipmap_width + x + j) + l]);
-					// Apply block compression
-					stb_compress_dxt_block(compressed, block, 0, STB_DXT_HIGHQUAL);
-					// Store the block
-					fwrite((void*) compressed, sizeof(uint8_t), sizeof(compressed), file);
-				}
-			}
+
+//! A rule for the directory mode, which assigns a format to all input files
+//! whose name (without extension) ends with the given suffix
+typedef struct {
+	char suffix[256];
+	vk_format_t format;
+} conversion_rule_t;
+
+
+/*! Checks whether a file name matches one of the given rules and if so, adds
+	a conversion job for it to the given batch. Files with extension .vkt are
+	ignored.*/
+void add_directory_file(batch_t* batch, const char* source_directory, const char* destination_directory, const char* file_name, const conversion_rule_t* rules, uint32_t rule_count) {
+	const char* extension = strrchr(file_name, '.');
+	size_t stem_length = extension ? (size_t) (extension - file_name) : strlen(file_name);
+	if (extension && strcmp(extension, ".vkt") == 0)
+		return;
+	for (uint32_t i = 0; i != rule_count; ++i) {
+		size_t suffix_length = strlen(rules[i].suffix);
+		if (suffix_length <= stem_length && memcmp(file_name + stem_length - suffix_length, rules[i].suffix, suffix_length) == 0) {
+			size_t source_length = strlen(source_directory), destination_length = strlen(destination_directory);
+			char* input_file_path = malloc(source_length + strlen(file_name) + 2);
+			sprintf(input_file_path, "%s/%s", source_directory, file_name);
+			char* output_file_path = malloc(destination_length + stem_length + 6);
+			sprintf(output_file_path, "%s/%.*s.vkt", destination_directory, (int) stem_length, file_name);
+			add_conversion_job(batch, input_file_path, output_file_path, rules[i].format);
+			free(input_file_path);
+			free(output_file_path);
+			return;
 		}
-		else if(format == VK_FORMAT_BC5_UNORM_BLOCK) {
-			uint8_t block[4 * 4 * 2], compressed[16];
-			// Iterate over blocks
-			for (int32_t y = 0; y != mipmap_height; y += 4) {
-				for (int32_t x = 0; x != mipmap_width; x += 4) {
-					// Quantize the block
-					for (int32_t k = 0; k != 4; ++k)
-						for (int32_t j = 0; j != 4; ++j)
-							for (int32_t l = 0; l != 2; ++l)
-								block[(k * 4 + j) * 2 + l] = quantize_linear(mipmap[2 * ((y + k) * mipmap_width + x + j) + l]);
-					// Apply block compression
-					stb_compress_bc5_block(compressed, block);
-					// Store the block
-					fwrite((void*) compressed, sizeof(uint8_t), sizeof(compressed), file);
-				}
-			}
+	}
+}
+
+
+//! Compares strings through pointers to them for qsort()
+int compare_strings(const void* raw_lhs, const void* raw_rhs) {
+	return strcmp(*(const char* const*) raw_lhs, *(const char* const*) raw_rhs);
+}
+
+
+//! Frees an array of file names returned by list_directory()
+void free_file_names(char** file_names, uint32_t file_count) {
+	for (uint32_t i = 0; i != file_count; ++i)
+		free(file_names[i]);
+	free(file_names);
+}
+
+
+/*! Lists the names of the files in the given directory (excluding hidden
+	files on Linux and subdirectories on Windows) in lexicographic order.
+	\param directory The path of the directory.
+	\param file_count Receives the number of files.
+	\return An array of file_count names, which has to be freed with
+		free_file_names(), or NULL upon failure.*/
+char** list_directory(const char* directory, uint32_t* file_count) {
+	char** file_names = NULL;
+	(*file_count) = 0;
+#ifdef _WIN32
+	char* pattern = concatenate_strings(directory, "/*");
+	WIN32_FIND_DATAA find_data;
+	HANDLE find = FindFirstFileA(pattern, &find_data);
+	free(pattern);
+	if (find == INVALID_HANDLE_VALUE) {
+		printf("Failed to list the files in the directory %s.\n", directory);
+		return NULL;
+	}
+	do {
+		if (!(find_data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)) {
+			file_names = realloc(file_names, ((*file_count) + 1) * sizeof(char*));
+			file_names[(*file_count)++] = copy_string(find_data.cFileName);
 		}
-		else if (is_half) {
-			uint16_t pixel[4] = {0};
-			for (int32_t y = 0; y != mipmap_height; ++y) {
-				for (int32_t x = 0; x != mipmap_width; ++x) {
-					for (int32_t l = 0; l != shared_channel_count; ++l)
-						pixel[l] = float_to_half(mipmap[(y * mipmap_width + x) * shared_channel_count + l]);
-					fwrite((void*) pixel, sizeof(uint16_t), channel_count, file);
-				}
-			}
+	} while (FindNextFileA(find, &find_data));
+	FindClose(find);
+#else
+	DIR* handle = opendir(directory);
+	if (!handle) {
+		printf("Failed to list the files in the directory %s.\n", directory);
+		return NULL;
+	}
+	struct dirent* entry;
+	while ((entry = readdir(handle))) {
+		if (entry->d_name[0] != '.') {
+			file_names = realloc(file_names, ((*file_count) + 1) * sizeof(char*));
+			file_names[(*file_count)++] = copy_string(entry->d_name);
 		}
-		else if (is_hdr)
-			fwrite(mipmap, sizeof(float), mipmap_width * mipmap_height * channel_count, file);
-		// Write low-dynamic range formats with 8 bits per pixel
-		else if (is_8_bit) {
-			for (int32_t y = 0; y != mipmap_height; ++y) {
-				for (int32_t x = 0; x != mipmap_width; ++x) {
-					uint8_t pixel[4] = { 0, 0, 0, 255 };
-					for (int32_t l = 0; l != shared_channel_count; ++l)
-						pixel[l] = is_srgb ? linear_to_srgb(mipmap[shared_channel_count * (y * mipmap_width + x) + l])
-										  : quantize_linear(mipmap[shared_channel_count * (y * mipmap_width + x) + l]);
-					fwrite(pixel, bits_per_pixel / 8, 1, file);
-				}
-			}
+	}
+	closedir(handle);
+#endif
+	// Make sure that the result is not NULL and does not depend on the order
+	// in which the file system lists files
+	if (!file_names)
+		file_names = malloc(sizeof(char*));
+	qsort(file_names, *file_count, sizeof(char*), &compare_strings);
+	return file_names;
+}
+
+
+/*! Creates conversion jobs for all files in a directory that match one of the
+	rules in the given rules file. Each line of the rules file holds a suffix
+	and a format separated by white space, e.g. "_BaseColor 132". The first
+	matching rule applies. Outputs go to the destination directory, which gets
+	created if it does not exist.
+	\return 0 upon success.*/
+int read_directory(batch_t* batch, const char* source_directory, const char* destination_directory, const char* rules_file_path) {
+	// Read the rules
+	FILE* file = fopen(rules_file_path, "r");
+	if (!file) {
+		printf("Failed to open the rules file %s.\n", rules_file_path);
+		return 1;
+	}
+	conversion_rule_t* rules = NULL;
+	uint32_t rule_count = 0;
+	char line[4096];
+	while (fgets(line, sizeof(line), file)) {
+		trim_line(line);
+		if (line[0] == 0 || line[0] == '#')
+			continue;
+		conversion_rule_t rule;
+		int32_t format_int = 0;
+		format_description_t description;
+		if (sscanf(line, "%255s %d", rule.suffix, &format_int) != 2 || describe_format(&description, (vk_format_t) format_int)) {
+			printf("The line \"%s\" in the rules file %s is invalid. Expected <suffix> <vk_format>.\n", line, rules_file_path);
+			fclose(file);
+			free(rules);
+			return 1;
 		}
+		rule.format = (vk_format_t) format_int;
+		rules = realloc(rules, (rule_count + 1) * sizeof(conversion_rule_t));
+		rules[rule_count++] = rule;
+	}
+	fclose(file);
+	// Go through the files in the source directory
+	uint32_t file_count;
+	char** file_names = list_directory(source_directory, &file_count);
+	if (!file_names) {
+		free(rules);
+		return 1;
 	}
+	for (uint32_t i = 0; i != file_count; ++i)
+		add_directory_file(batch, source_directory, destination_directory, file_names[i], rules, rule_count);
+	free_file_names(file_names, file_count);
+#ifdef _WIN32
+	_mkdir(destination_directory);
+#else
+	mkdir(destination_directory, 0777);
+#endif
+	free(rules);
+	return 0;
+}
 
-	// Write an end of file marker
-	int32_t eof = 0xe0fe0f;
-	fwrite((void*) &eof, sizeof(eof), 1, file);
-	// Clean up
+
+//! Compares cache entries by their output paths for qsort() and bsearch()
+int compare_cache_entries(const void* raw_lhs, const void* raw_rhs) {
+	return strcmp(((const cache_entry_t*) raw_lhs)->output_file_path, ((const cache_entry_t*) raw_rhs)->output_file_path);
+}
+
+
+//! Reads the cache file at the given path into the batch, if it exists. A
+//! missing or malformed cache file just means that nothing is cached.
+void read_cache(batch_t* batch, const char* cache_file_path) {
+	FILE* file = fopen(cache_file_path, "r");
+	if (!file)
+		return;
+	char line[4096];
+	while (fgets(line, sizeof(line), file)) {
+		trim_line(line);
+		cache_entry_t entry;
+		unsigned long long input_hash;
+		int path_offset = 0;
+		if (sscanf(line, "%llx %d %d %d %n", &input_hash, &entry.format, &entry.version, &entry.bc6h_quality, &path_offset) != 4 || path_offset == 0 || line[path_offset] == 0)
+			continue;
+		entry.input_hash = (uint64_t) input_hash;
+		entry.output_file_path = copy_string(line + path_offset);
+		batch->cache_entries = realloc(batch->cache_entries, (batch->cache_entry_count + 1) * sizeof(cache_entry_t));
+		batch->cache_entries[batch->cache_entry_count++] = entry;
+	}
 	fclose(file);
-	free(linear_image);
-	free(linear_mipmap);
+	if (batch->cache_entry_count > 0)
+		qsort(batch->cache_entries, batch->cache_entry_count, sizeof(cache_entry_t), &compare_cache_entries);
+}
+
+
+/*! Writes a cache file with one entry for each job that succeeded.
+	\return 0 upon success.*/
+int write_cache(const batch_t* batch, const char* cache_file_path) {
+	FILE* file = fopen(cache_file_path, "w");
+	if (!file) {
+		printf("Failed to write the cache file %s.\n", cache_file_path);
+		return 1;
+	}
+	for (uint32_t i = 0; i != batch->job_count; ++i) {
+		const conversion_job_t* job = &batch->jobs[i];
+		if (!job->result)
+			fprintf(file, "%016llx %d %d %d %s\n", (unsigned long long) job->input_hash, (int) job->format, (int) get_file_version(batch->compress, batch->align), (int) batch->bc6h_quality, job->output_file_path);
+	}
+	fclose(file);
+	return 0;
+}
+
+
+/*! Computes a hash of the complete contents of the given file.
+	\param hash The output. It is never zero.
+	\param file_path The file to hash.
+	\return 0 upon success.*/
+int hash_file(uint64_t* hash, const char* file_path) {
+	FILE* file = fopen(file_path, "rb");
+	if (!file)
+		return 1;
+	fseek(file, 0, SEEK_END);
+	long size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+	uint8_t* data = malloc(size > 0 ? (size_t) size : 1);
+	int result = (size < 0 || fread(data, 1, (size_t) size, file) != (size_t) size);
+	fclose(file);
+	if (!result) {
+		(*hash) = hash_bytes(data, (size_t) size);
+		(*hash) = (*hash) ? (*hash) : 1;
+	}
+	free(data);
+	return result;
+}
+
+
+/*! A task for run_parallel() that decides whether the job with the given index
+	in a batch_t needs to be converted. Outputs are up to date if they are
+	newer than their inputs or if the hash of the input matches the cache
+	entry. Either way, the format, file format version and BC6H quality (for BC6H
+	outputs) have to match the cache entry (if any).*/
+int check_job_task(void* raw_batch, uint32_t job_index) {
+	const batch_t* batch = (const batch_t*) raw_batch;
+	conversion_job_t* job = &batch->jobs[job_index];
+	struct stat input_stat, output_stat;
+	if (stat(job->input_file_path, &input_stat)) {
+		printf("Failed to access the input file %s.\n", job->input_file_path);
+		job->result = 1;
+		return 0;
+	}
+	job->input_size = (uint64_t) input_stat.st_size;
+	// Look for a cache entry
+	cache_entry_t key = { .output_file_path = job->output_file_path };
+	const cache_entry_t* entry = NULL;
+	if (batch->cache_entry_count > 0)
+		entry = bsearch(&key, batch->cache_entries, batch->cache_entry_count, sizeof(cache_entry_t), &compare_cache_entries);
+	int32_t settings_match = !entry || (entry->format == (int32_t) job->format && entry->version == get_file_version(batch->compress, batch->align)
+		&& (job->format != VK_FORMAT_BC6H_UFLOAT_BLOCK || entry->bc6h_quality == (int32_t) batch->bc6h_quality));
+	if (!batch->force && settings_match && stat(job->output_file_path, &output_stat) == 0) {
+		if (output_stat.st_mtime > input_stat.st_mtime) {
+			job->input_hash = entry ? entry->input_hash : 0;
+			job->skip = 1;
+			return 0;
+		}
+	}
+	else
+		entry = NULL;
+	// The output is outdated or the input has been touched, so a hash is needed
+	if (hash_file(&job->input_hash, job->input_file_path)) {
+		printf("Failed to read the input file %s.\n", job->input_file_path);
+		job->result = 1;
+		return 0;
+	}
+	job->skip = (entry && entry->input_hash == job->input_hash);
+	return 0;
+}
+
+
+//! Shared state for convert_job_task()
+typedef struct {
+	//! The batch being processed
+	batch_t* batch;
+	//! Indices of jobs that need to be converted, largest inputs first
+	const uint32_t* job_indices;
+} batch_conversion_t;
+
+
+//! A task for run_parallel() that converts one texture of a batch using a
+//! batch_conversion_t as context. Failures are recorded in the job.
+int convert_job_task(void* raw_conversion, uint32_t index) {
+	const batch_conversion_t* conversion = (const batch_conversion_t*) raw_conversion;
+	conversion_job_t* job = &conversion->batch->jobs[conversion->job_indices[index]];
+	// Parallelism comes from converting many textures at once
+	job->result = convert_texture(job->output_file_path, job->input_file_path, job->format, conversion->batch->compress, conversion->batch->align, conversion->batch->bc6h_quality, conversion->batch->tiled, 0, 1);
+	if (job->result)
+		printf("Failed to convert %s.\n", job->input_file_path);
+	else
+		printf("Converted %s.\n", job->input_file_path);
 	return 0;
 }
+
+
+//! A job index along with the size of its input for sorting
+typedef struct {
+	uint64_t input_size;
+	uint32_t job_index;
+} job_order_t;
+
+
+//! Orders job_order_t by decreasing input size for qsort()
+int compare_job_sizes(const void* raw_lhs, const void* raw_rhs) {
+	uint64_t lhs = ((const job_order_t*) raw_lhs)->input_size;
+	uint64_t rhs = ((const job_order_t*) raw_rhs)->input_size;
+	return (lhs < rhs) - (lhs > rhs);
+}
+
+
+/*! Converts all textures of a batch that are not up to date. Textures are
+	converted concurrently, one per thread, starting with the largest inputs.
+	Afterwards, the cache file is updated.
+	\param batch A batch with jobs. The results get written to the jobs.
+	\param cache_file_path The path of the cache file.
+	\param thread_count The maximal number of textures to convert at once or
+		0 to use all logical processors.
+	\return 0 if all jobs succeeded.*/
+int convert_batch(batch_t* batch, const char* cache_file_path, uint32_t thread_count) {
+	read_cache(batch, cache_file_path);
+	run_parallel(&check_job_task, batch, batch->job_count, thread_count);
+	// Gather jobs that need to be converted. Starting with large textures
+	// avoids a long tail with a single busy thread.
+	job_order_t* order = malloc((batch->job_count + 1) * sizeof(job_order_t));
+	uint32_t conversion_count = 0, skip_count = 0;
+	for (uint32_t i = 0; i != batch->job_count; ++i) {
+		if (!batch->jobs[i].result && !batch->jobs[i].skip) {
+			job_order_t entry = { .input_size = batch->jobs[i].input_size, .job_index = i };
+			order[conversion_count++] = entry;
+		}
+		skip_count += batch->jobs[i].skip;
+	}
+	qsort(order, conversion_count, sizeof(job_order_t), &compare_job_sizes);
+	uint32_t* job_indices = malloc((conversion_count + 1) * sizeof(uint32_t));
+	for (uint32_t i = 0; i != conversion_count; ++i)
+		job_indices[i] = order[i].job_index;
+	free(order);
+	batch_conversion_t conversion = { .batch = batch, .job_indices = job_indices };
+	run_parallel(&convert_job_task, &conversion, conversion_count, thread_count);
+	free(job_indices);
+	// Report and update the cache
+	uint32_t success_count = 0, failure_count = 0;
+	for (uint32_t i = 0; i != batch->job_count; ++i) {
+		success_count += (!batch->jobs[i].skip && !batch->jobs[i].result);
+		failure_count += (batch->jobs[i].result != 0);
+	}
+	printf("Converted %u textures, skipped %u up-to-date textures, %u failed.\n", success_count, skip_count, failure_count);
+	int result = write_cache(batch, cache_file_path);
+	return (failure_count > 0) || result;
+}
+
+
+/*! The header of a *.vkp texture pack, which concatenates all *.vkt files of
+	a directory. It is followed by slot_count texture_pack_slot_t, the names of
+	all files without terminating nulls and zero padding. Each texture file
+	begins at a multiple of ALIGNED_PAYLOAD_ALIGNMENT bytes, so aligned texture
+	files stay aligned.*/
+typedef struct texture_pack_header_s {
+	//! The value 0xbc1bcf
+	uint32_t file_marker;
+	//! The file format version, currently 1
+	uint32_t version;
+	//! The number of packed texture files
+	uint32_t entry_count;
+	//! The number of slots in the hash table, a power of two greater than
+	//! entry_count
+	uint32_t slot_count;
+	//! The total length of all names in bytes
+	uint64_t names_size;
+} texture_pack_header_t;
+
+
+/*! A slot in the hash table of a texture pack. The key is the file name (i.e.
+	material name and texture type suffix). Collisions are resolved by linear
+	probing from hash_bytes() of the name modulo slot_count. Unused slots are
+	zero.*/
+typedef struct texture_pack_slot_s {
+	//! hash_bytes() of the name
+	uint64_t name_hash;
+	//! The offset in bytes from the beginning of the pack to the texture file
+	//! and its size in bytes
+	uint64_t offset, size;
+	//! The offset of the name within all names and its length in bytes
+	uint32_t name_offset, name_length;
+} texture_pack_slot_t;
+
+
+/*! Copies a file to the current position of another file.
+	\return The number of copied bytes or -1 upon failure.*/
+int64_t append_file(FILE* destination, const char* source_file_path) {
+	FILE* source = fopen(source_file_path, "rb");
+	if (!source)
+		return -1;
+	uint8_t* buffer = malloc(COMPRESSION_CHUNK_SIZE);
+	int64_t total = 0;
+	size_t size;
+	while ((size = fread(buffer, 1, COMPRESSION_CHUNK_SIZE, source)) > 0) {
+		if (fwrite(buffer, 1, size, destination) != size) {
+			total = -1;
+			break;
+		}
+		total += (int64_t) size;
+	}
+	if (ferror(source))
+		total = -1;
+	free(buffer);
+	fclose(source);
+	return total;
+}
+
+
+/*! Concatenates all *.vkt files in the given directory into the texture pack
+	<texture_directory>.vkp (see texture_pack_header_t).
+	\return 0 upon success.*/
+int pack_textures(const char* texture_directory) {
+	uint32_t file_count;
+	char** file_names = list_directory(texture_directory, &file_count);
+	if (!file_names)
+		return 1;
+	// Keep only texture files
+	uint32_t entry_count = 0;
+	for (uint32_t i = 0; i != file_count; ++i) {
+		size_t length = strlen(file_names[i]);
+		if (length > 4 && strcmp(file_names[i] + length - 4, ".vkt") == 0)
+			file_names[entry_count++] = file_names[i];
+		else
+			free(file_names[i]);
+	}
+	// Build the table of contents. Offsets are filled in while copying.
+	texture_pack_header_t header = { .file_marker = 0xbc1bcf, .version = 1, .entry_count = entry_count, .slot_count = 1 };
+	while (header.slot_count < 2 * entry_count + 1)
+		header.slot_count *= 2;
+	texture_pack_slot_t* slots = calloc(header.slot_count, sizeof(texture_pack_slot_t));
+	uint32_t* entry_slots = calloc(entry_count + 1, sizeof(uint32_t));
+	for (uint32_t i = 0; i != entry_count; ++i) {
+		size_t length = strlen(file_names[i]);
+		texture_pack_slot_t slot = {
+			.name_hash = hash_bytes(file_names[i], length),
+			.name_offset = (uint32_t) header.names_size,
+			.name_length = (uint32_t) length,
+		};
+		header.names_size += length;
+		uint32_t index = (uint32_t) (slot.name_hash & (header.slot_count - 1));
+		while (slots[index].name_length != 0)
+			index = (index + 1) & (header.slot_count - 1);
+		slots[index] = slot;
+		entry_slots[i] = index;
+	}
+	// Write the header, the table of contents and the names
+	char* pack_file_path = concatenate_strings(texture_directory, ".vkp");
+	FILE* file = fopen(pack_file_path, "wb");
+	int result = 0;
+	if (!file) {
+		printf("Failed to open the texture pack %s for writing.\n", pack_file_path);
+		result = 1;
+	}
+	size_t toc_size = sizeof(header) + header.slot_count * sizeof(texture_pack_slot_t) + (size_t) header.names_size;
+	if (!result) {
+		result = fwrite(&header, sizeof(header), 1, file) != 1
+			|| fwrite(slots, sizeof(texture_pack_slot_t), header.slot_count, file) != header.slot_count;
+		for (uint32_t i = 0; i != entry_count && !result; ++i)
+			result = fwrite(file_names[i], 1, slots[entry_slots[i]].name_length, file) != slots[entry_slots[i]].name_length;
+		if (!result)
+			result = write_zeros(file, align_payload_size(toc_size) - toc_size);
+	}
+	// Append all texture files
+	uint64_t offset = align_payload_size(toc_size);
+	for (uint32_t i = 0; i != entry_count && !result; ++i) {
+		char* texture_file_path = malloc(strlen(texture_directory) + strlen(file_names[i]) + 2);
+		sprintf(texture_file_path, "%s/%s", texture_directory, file_names[i]);
+		int64_t size = append_file(file, texture_file_path);
+		if (size < 0) {
+			printf("Failed to append the texture file %s to the texture pack.\n", texture_file_path);
+			result = 1;
+		}
+		else {
+			slots[entry_slots[i]].offset = offset;
+			slots[entry_slots[i]].size = (uint64_t) size;
+			offset += align_payload_size((size_t) size);
+			result = write_zeros(file, align_payload_size((size_t) size) - (size_t) size);
+		}
+		free(texture_file_path);
+	}
+	// Now that the offsets are known, write the table of contents again
+	if (!result)
+		result = fseek(file, (long) sizeof(header), SEEK_SET)
+			|| fwrite(slots, sizeof(texture_pack_slot_t), header.slot_count, file) != header.slot_count;
+	if (file)
+		result |= (fclose(file) != 0);
+	if (result) {
+		printf("Failed to write the texture pack %s.\n", pack_file_path);
+		remove(pack_file_path);
+	}
+	else
+		printf("Packed %u texture files with %.1f MiB into %s.\n", entry_count, (double) offset / (1024.0 * 1024.0), pack_file_path);
+	free(pack_file_path);
+	free(entry_slots);
+	free(slots);
+	free_file_names(file_names, entry_count);
+	return result;
+}
+
+
+int main(int argc, char** argv) {
+	// Packing does not take any options
+	if (argc == 3 && strcmp(argv[1], "-pack") == 0)
+		return pack_textures(argv[2]);
+	// Figure out the mode and how many arguments precede the options
+	int32_t manifest_mode = (argc >= 3 && strcmp(argv[1], "-manifest") == 0);
+	int32_t directory_mode = (argc >= 5 && strcmp(argv[1], "-directory") == 0);
+	int32_t batch_mode = manifest_mode || directory_mode;
+	int option_begin = manifest_mode ? 3 : (directory_mode ? 5 : 2);
+	int option_end = batch_mode ? argc : (argc - 2);
+	// Grab and validate input arguments
+	int32_t format_int = 0;
+	if (!batch_mode && argc >= 4)
+		sscanf(argv[1], "%d", &format_int);
+	vk_format_t format = (vk_format_t) format_int;
+	format_description_t description;
+	int32_t format_known = batch_mode || !describe_format(&description, format);
+	// Options go between the format and the file paths or after the batch
+	// arguments
+	int32_t compress = 0, align = 0, tiled = 0, benchmark = 0, force = 0, options_known = 1;
+	uint32_t thread_count = 0, quality = bc6h_quality_normal;
+	for (int i = option_begin; i < option_end; ++i) {
+		if (strcmp(argv[i], "-compress") == 0)
+			compress = 1;
+		else if (strcmp(argv[i], "-align") == 0)
+			align = 1;
+		else if (strcmp(argv[i], "-tiled") == 0)
+			tiled = 1;
+		else if (strcmp(argv[i], "-benchmark") == 0 && !batch_mode)
+			benchmark = 1;
+		else if (strcmp(argv[i], "-force") == 0 && batch_mode)
+			force = 1;
+		else if (strcmp(argv[i], "-threads") == 0 && i + 1 < option_end && sscanf(argv[i + 1], "%u", &thread_count) == 1)
+			++i;
+		else if (strcmp(argv[i], "-quality") == 0 && i + 1 < option_end && sscanf(argv[i + 1], "%u", &quality) == 1 && quality <= bc6h_quality_high)
+			++i;
+		else
+			options_known = 0;
+	}
+	if ((!batch_mode && argc < 4) || !format_known || !options_known) {
+		printf("Usage: texture_conversion <vk_format> [-compress | -align] [-quality <0|1|2>] [-threads <count>] [-tiled] [-benchmark] <input_file_path> <output_file_path>\n");
+		printf("   or: texture_conversion -manifest <manifest_file_path> [-compress | -align] [-quality <0|1|2>] [-threads <count>] [-tiled] [-force]\n");
+		printf("   or: texture_conversion -directory <source_directory> <destination_directory> <rules_file_path> [-compress | -align] [-quality <0|1|2>] [-threads <count>] [-tiled] [-force]\n");
+		printf("   or: texture_conversion -pack <texture_directory>\n");
+		printf("vk_format can be one of the following integer values from the VkFormat enumeration in Vulkan:\n\
+VK_FORMAT_R8_UNORM = 9\n\
+VK_FORMAT_R8_SNORM = 10\n\
+VK_FORMAT_R8_UINT = 13\n\
+VK_FORMAT_R8_SINT = 14\n\
+VK_FORMAT_R8_SRGB = 15\n\
+VK_FORMAT_R8G8_UNORM = 16\n\
+VK_FORMAT_R8G8_SNORM = 17\n\
+VK_FORMAT_R8G8_UINT = 20\n\
+VK_FORMAT_R8G8_SINT = 21\n\
+VK_FORMAT_R8G8_SRGB = 22\n\
+VK_FORMAT_R8G8B8A8_UNORM = 37\n\
+VK_FORMAT_R8G8B8A8_SNORM = 38\n\
+VK_FORMAT_R8G8B8A8_UINT = 41\n\
+VK_FORMAT_R8G8B8A8_SINT = 42\n\
+VK_FORMAT_R8G8B8A8_SRGB = 43\n\
+VK_FORMAT_R16G16B16_SFLOAT = 90\n\
+VK_FORMAT_R16G16B16A16_SFLOAT = 97\n\
+VK_FORMAT_R32G32B32_SFLOAT = 106\n\
+VK_FORMAT_R32G32B32A32_SFLOAT = 109\n\
+VK_FORMAT_BC1_RGB_UNORM_BLOCK = 131\n\
+VK_FORMAT_BC1_RGB_SRGB_BLOCK = 132\n\
+VK_FORMAT_BC5_UNORM_BLOCK = 141\n\
+VK_FORMAT_BC6H_UFLOAT_BLOCK = 143\n");
+		printf("For a list of supported input file formats, see:\n");
+		printf("https://github.com/nothings/stb/blob/master/stb_image.h\n");
+		printf("The output format is *.vkt, which is a renderer specific format with mipmaps (similar to *.dds).\n");
+		printf("With -compress, the mipmaps are split into chunks, which are compressed using zlib (version 2 of the file format).\n");
+		printf("With -align, the payload and each mipmap begin at a multiple of 4096 bytes in the file, such that the renderer can read them with O_DIRECT (version 3 of the file format). It is ignored with -compress.\n");
+		printf("With -quality, BC6H compression is faster (0), balanced (1, the default) or better (2). Other formats ignore it.\n");
+		printf("With -threads, at most the given number of threads is used. By default, all logical processors are used. The output does not depend on it.\n");
+		printf("With -tiled, the image is converted to linear space and filtered in bands of rows, and encoded mipmap rows are written right away. It bounds memory use besides the loaded image and does not change the output. It is used automatically for images that would take more than 1 GiB in linear space.\n");
+		printf("With -benchmark, each mipmap is additionally filtered with the slow reference filter. Timings for both filters and the maximal error are printed.\n");
+		printf("With -manifest, all textures listed in the manifest file get converted. Each line holds <vk_format>, <input_file_path> and <output_file_path> separated by tabs.\n");
+		printf("With -directory, all files in the source directory whose name (without extension) ends with a suffix from the rules file get converted to *.vkt files in the destination directory. Each line of the rules file holds <suffix> <vk_format>, e.g. \"_BaseColor 132\".\n");
+		printf("In both batch modes, textures are converted concurrently (-threads limits how many at once). Outputs that are newer than their inputs or whose input hash matches the cache file (<manifest_file_path>.cache or texture_conversion.cache in the destination directory) are skipped, unless -force is given.\n");
+		printf("With -pack, all *.vkt files in the texture directory get concatenated into <texture_directory>.vkp with a hashed table of contents keyed by file name. The renderer loads textures from this pack when it exists, which takes a single open. Texture files begin at multiples of 4096 bytes in the pack, so aligned files stay aligned.\n");
+		return 1;
+	}
+	if (batch_mode) {
+		// Gather the jobs and convert them
+		batch_t batch = { .compress = compress, .align = align, .bc6h_quality = (bc6h_quality_t) quality, .force = force, .tiled = tiled };
+		char* cache_file_path;
+		int result;
+		if (manifest_mode) {
+			result = read_manifest(&batch, argv[2]);
+			cache_file_path = concatenate_strings(argv[2], ".cache");
+		}
+		else {
+			result = read_directory(&batch, argv[2], argv[3], argv[4]);
+			cache_file_path = concatenate_strings(argv[3], "/texture_conversion.cache");
+		}
+		if (!result)
+			result = convert_batch(&batch, cache_file_path, thread_count);
+		free(cache_file_path);
+		free_batch(&batch);
+		return result;
+	}
+	return convert_texture(argv[argc - 1], argv[argc - 2], format, compress, align, (bc6h_quality_t) quality, tiled, benchmark, thread_count);
+}
@@ -7,10 +7,10 @@ def load_formats(vk_xml_path="vk.xml"):
     Extracts all <format> tags from the Vulkan XML specification.
     :param vk_xml_path: Path to the vk.xml file.
     :return: Tuples of strings (name, cls, block_size, texels_per_block,
-        packed_bits) some of which may be empty.
+        packed_bits, block_extent) some of which may be empty.
     """
     doc = parse(vk_xml_path)
-    attrs = ["name", "class", "blockSize", "texelsPerBlock", "packed"]
+    attrs = ["name", "class", "blockSize", "texelsPerBlock", "packed", "blockExtent"]
     return [[format.getAttribute(attr) for attr in attrs] for format in doc.getElementsByTagName("format")]
 
 
@@ -28,17 +28,19 @@ def generate_vulkan_formats():
 
 
 format_description_t get_format_description(VkFormat format) {
-\tformat_description_t desc = { .packed_bits = 0 };
+\tformat_description_t desc = { .packed_bits = 0, .block_extent = { 1, 1, 1 } };
 \tswitch (format) {
 """
         )
-        for name, cls, block_size, texels_per_block, packed_bits in load_formats():
+        for name, cls, block_size, texels_per_block, packed_bits, block_extent in load_formats():
             if cls not in classes:
                 classes.append(cls)
             file.write("\t\tcase %s:\n" % name)
             file.write("\t\t\tdesc.cls = %s;\n" % format_class(cls))
             file.write("\t\t\tdesc.block_size = %s;\n" % block_size)
             file.write("\t\t\tdesc.texels_per_block = %s;\n" % texels_per_block)
+            if len(block_extent):
+                file.write("\t\t\tdesc.block_extent = (VkExtent3D) { %s };\n" % block_extent.replace(",", ", "))
             if len(packed_bits):
                 file.write("\t\t\tdesc.packed_bits = %s;\n" % packed_bits)
             file.write("\t\t\tbreak;\n")
@@ -78,6 +80,8 @@ typedef struct {
 \tVkDeviceSize block_size;
 \t//! The number of texels per texel block
 \tuint32_t texels_per_block;
+\t//! The extent of a texel block in texels, e.g. 4x4x1 for BC formats
+\tVkExtent3D block_extent;
 \t//! For packed formats such as VK_FORMAT_R5G6B5_UNORM_PACK16, this is the
 \t//! number of bits into which a color is being packed. 0 otherwise.
 \tuint32_t packed_bits;